@@ -6,29 +6,89 @@
 #include <utility>
 #include <future>
 #include <thread>
+#include <ctime>
+#include "util/topology.hpp"
+#include "util/trace.hpp"
+#include "util/log.hpp"
+#include "util/memory.hpp"
+#include "mapimage.hpp"
+#include "path/gpupathbackend.hpp"
 
 extern int GLOBAL_NUM_ENTITIES;
+extern bool GLOBAL_CPU_PATHS;
+extern bool GLOBAL_TRACE;
+extern uint64_t GLOBAL_SEED;
+extern std::string GLOBAL_RECORD_FILE;
+extern std::string GLOBAL_REPLAY_FILE;
+extern std::string GLOBAL_METRICS_NAME;
+
+DetachedTask Application::requestSteps() {
+	pathInFlight = true;
+	if (world.numComputes > 5) {
+		world.setNewGoal();
+	}
+	// the batch is taken from the current positions, updateAstar holds the
+	// entities still until this resumes from poll() and applies its steps
+	PathResult result = co_await pathService->solve(world.makePathBatch());
+	currentSteps = std::move(result.steps);
+	world.setSteps(currentSteps.data());
+	replay.recordSteps(world.getTick(), currentSteps.data(), currentSteps.size());
+	pathInFlight = false;
+}
 
 void Application::updateAstar() {
+	topology::Placement::get().pinCurrentThread(topology::ROLE_SIMULATION);
+	TraceRecorder::get().setThreadName("simulation");
+	// path work on this thread sets its own scope
+	MemoryScope memoryScope(MEM_WORLD);
+	while (!cleaned && replay.playing()) {
+		if (timer.elapsed() >= 0.001) {
+			replayTick();
+			timer.restart();
+		}
+	}
 	while (!cleaned) {
-		if (world.getStepsCount() <= 0 || world.finished || world.getGoalReached()) {
-			if (world.numComputes > 5) {
-				world.setNewGoal();
-			}
-			renderer.mapComputeMemory(world.origMap, world.entities.data(), &world.getMapDims(), &world.goal, world.mapSize, world.entitiesSize);
-			renderer.executeCompute();
-			world.setSteps(renderer.getSteps());
+		if (!pathInFlight && (world.getStepsCount() <= 0 || world.finished || world.getGoalReached())) {
+			requestSteps();
 		}
+		pathService->poll();
 
-		if (timer.elapsed() >= 0.001) {
+		// steps are relative to the positions the batch was taken at, moving on
+		// the old steps meanwhile would put entities off their new paths
+		if (!pathInFlight && timer.elapsed() >= 0.001) {
+			uint64_t lockStart = tsc::now();
 			std::lock_guard<std::mutex> lock(entityMutex);
+			entityLockWait.recordTicks(tsc::now() - lockStart);
 			world.updateEntities();
+			tickCounter.add();
 			timer.restart();
 		}
 	}
 }
 
 
+// recorded goals and steps instead of path queries
+void Application::replayTick() {
+	uint64_t lockStart = tsc::now();
+	std::lock_guard<std::mutex> lock(entityMutex);
+	entityLockWait.recordTicks(tsc::now() - lockStart);
+
+	uint64_t tick = world.getTick();
+	if (replay.finished(tick))
+		return;
+
+	uvec2 goal;
+	while (replay.goalResetAt(tick, goal))
+		world.setGoal(goal);
+	while (ReplayLog::StepsEvent* event = replay.stepsAt(tick))
+		world.setSteps(event->steps.data());
+	world.updateEntities();
+	tickCounter.add();
+
+	if (replay.finished(world.getTick()))
+		replay.verify(world);
+}
+
 void Application::run()
 {
 	init();
@@ -37,6 +97,18 @@ void Application::run()
 		update();
 		glfwPollEvents();
 	}
+	cleaned = true;
+	if (astarComputeThread.joinable())
+		astarComputeThread.join();
+	replay.finish(world);
+	MetricsRegistry::get().stopPublishing();
+
+	LatencyRegistry::get().report(stdout);
+	LatencyRegistry::get().writeReport("latency.txt");
+	memory::report(stdout);
+	if (GLOBAL_TRACE)
+		TraceRecorder::get().write("trace.json");
+	Logger::get().shutdown();
 	// hack
 	exit(0);
 }
@@ -45,15 +117,56 @@ void Application::init()
 {
 	//world.init(100, 100, 10);
 	std::string map = "test3.png";
-	world.init(map, GLOBAL_NUM_ENTITIES);
+
+	topology::ThreadConfig threadConfig;
+	threadConfig.loadFromFile("threads.cfg");
+	topology::Placement::get().configure(threadConfig, GLOBAL_NUM_THREADS - 1);
+	topology::Placement::get().pinCurrentThread(topology::ROLE_MAIN);
+	TraceRecorder::get().setEnabled(GLOBAL_TRACE);
+	TraceRecorder::get().setThreadName("main");
+	if (!GLOBAL_METRICS_NAME.empty())
+		MetricsRegistry::get().startPublishing(GLOBAL_METRICS_NAME, std::chrono::milliseconds(100));
+
+	if (!GLOBAL_REPLAY_FILE.empty())
+		replay.load(GLOBAL_REPLAY_FILE);
+	uint64_t seed = GLOBAL_SEED ? GLOBAL_SEED : static_cast<uint64_t>(time(NULL));
+	world.setSeed(replay.playing() ? replay.seed() : seed);
+	{
+		MemoryScope memoryScope(MEM_WORLD);
+		world.init(map, GLOBAL_NUM_ENTITIES);
+	}
+	MetricsRegistry::get().gauge("entities").set(static_cast<double>(world.entities.size()));
 	//world.printEntities();
 
-	renderer.init(map);
-	renderer.initCompute(world.mapSize, world.entitiesSize);
+	{
+		MemoryScope memoryScope(MEM_RENDERER);
+		renderer.init(map);
+		renderer.initCompute(world.mapSize, world.entitiesSize);
+	}
+	// world and texture have their own copies now
+	MapImageCache::get().clear();
 	
-	renderer.mapComputeMemory(world.origMap, world.entities.data(), &world.getMapDims(), &world.goal, world.mapSize, world.entitiesSize);
-	renderer.executeCompute();
-	world.setSteps(renderer.getSteps());
+	if (GLOBAL_CPU_PATHS)
+		pathService.reset(new PathService(std::unique_ptr<PathBackend>(new CpuPathBackend(renderer.getScheduler()))));
+	else
+		pathService.reset(new PathService(std::unique_ptr<PathBackend>(new GpuPathBackend(renderer))));
+
+	if (replay.playing())
+	{
+		replay.restore(world);
+		world.setReplay(&replay);
+	}
+	else
+	{
+		if (!GLOBAL_RECORD_FILE.empty())
+		{
+			replay.startRecording(GLOBAL_RECORD_FILE, world);
+			world.setReplay(&replay);
+		}
+		currentSteps = pathService->solveNow(world.makePathBatch()).steps;
+		world.setSteps(currentSteps.data());
+		replay.recordSteps(world.getTick(), currentSteps.data(), currentSteps.size());
+	}
 	astarComputeThread = std::thread(&Application::updateAstar, this);
 }
 
@@ -77,7 +190,9 @@ void Application::update()
 
 	std::vector<uvec2> entities;
 	{
+		uint64_t lockStart = tsc::now();
 		std::lock_guard<std::mutex> lock(entityMutex);
+		entityLockWait.recordTicks(tsc::now() - lockStart);
 		entities = world.getEntities();
 	}
 	for (auto e : entities)
@@ -88,6 +203,14 @@ void Application::update()
 
 	renderer.submitEntity(Entity(world.goal.x, world.goal.y, true));
 	renderer.render();
+	memory::frame();
+
+	if (reportTimer.elapsed() >= 5.0)
+	{
+		LatencyRegistry::get().report(stdout);
+		memory::report(stdout);
+		reportTimer.restart();
+	}
 }
 
 void Application::cleanup()
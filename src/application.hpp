@@ -5,7 +5,14 @@
 #include "renderer/renderer.hpp"
 #include "world.h"
 #include "util/timer.hpp"
+#include "util/coroutine.hpp"
+#include "path/pathservice.hpp"
+#include "util/histogram.hpp"
+#include "util/metrics.hpp"
+#include "replay.hpp"
 #include <mutex>
+#include <memory>
+#include <atomic>
 
 
 class Application
@@ -18,13 +25,24 @@ private:
 	void cleanup();
 
 	void updateAstar();
+	void replayTick();
+	DetachedTask requestSteps();
 
 	Renderer renderer;
 	World world;
 	Timer timer;
 
 	std::mutex entityMutex;
+	LatencyHistogram& entityLockWait = LatencyRegistry::get().histogram("entity_lock");
+	MetricCounter& tickCounter = MetricsRegistry::get().counter("ticks");
+	Timer reportTimer;
 	std::thread astarComputeThread;
 
-	bool cleaned = false;
+	std::unique_ptr<PathService> pathService;
+	std::vector<ivec2> currentSteps;
+	bool pathInFlight = false;
+
+	ReplayLog replay;
+
+	std::atomic<bool> cleaned{ false };
 };
\ No newline at end of file
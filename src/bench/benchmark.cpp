@@ -0,0 +1,192 @@
+#include "benchmark.hpp"
+#include "../util/timer.hpp"
+#include "../util/topology.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+namespace bench
+{
+	double tCritical95(size_t df)
+	{
+		static const double table[] = {
+			0.0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+			2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+			2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+		};
+		if (df == 0)
+			return 0.0;
+		if (df <= 30)
+			return table[df];
+		if (df <= 40)
+			return 2.021;
+		if (df <= 60)
+			return 2.000;
+		if (df <= 120)
+			return 1.980;
+		return 1.960;
+	}
+
+	// nearest rank on sorted data
+	static double percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty())
+			return 0.0;
+		size_t idx = static_cast<size_t>(std::ceil(p * sorted.size()));
+		idx = std::min(sorted.size(), std::max<size_t>(idx, 1)) - 1;
+		return sorted[idx];
+	}
+
+	Summary summarize(const std::vector<double>& samples, uint64_t items)
+	{
+		Summary s;
+		s.n = samples.size();
+		if (s.n == 0)
+			return s;
+
+		std::vector<double> sorted = samples;
+		std::sort(sorted.begin(), sorted.end());
+
+		double sum = 0.0;
+		for (double v : samples)
+			sum += v;
+		s.mean = sum / s.n;
+
+		if (s.n > 1)
+		{
+			double sq = 0.0;
+			for (double v : samples)
+				sq += (v - s.mean) * (v - s.mean);
+			s.stddev = std::sqrt(sq / (s.n - 1));
+			s.ci95 = tCritical95(s.n - 1) * s.stddev / std::sqrt(double(s.n));
+		}
+
+		s.min = sorted.front();
+		s.max = sorted.back();
+		s.p50 = percentile(sorted, 0.50);
+		s.p99 = percentile(sorted, 0.99);
+		if (s.mean > 0.0)
+			s.throughput = items / s.mean;
+		return s;
+	}
+
+	double measure(const std::function<void()>& fn)
+	{
+		Timer timer;
+		fn();
+		return timer.elapsed();
+	}
+
+	Result makeResult(const std::string& stage, const Params& params, uint64_t items, std::vector<double> samples)
+	{
+		Result result;
+		result.stage = stage;
+		result.params = params;
+		result.items = items;
+		result.samples = std::move(samples);
+		result.summary = summarize(result.samples, items);
+		return result;
+	}
+
+	Result run(const std::string& stage, const Params& params, const Options& options,
+		uint64_t items, const std::function<double()>& sample)
+	{
+		for (int i = 0; i < options.warmup; i++)
+			sample();
+
+		std::vector<double> samples;
+		samples.reserve(options.reps);
+		for (int i = 0; i < options.reps; i++)
+			samples.push_back(sample());
+		return makeResult(stage, params, items, std::move(samples));
+	}
+
+	void printResult(const Result& r)
+	{
+		const Summary& s = r.summary;
+		printf("%-8s %-12s E%-5d T%-2d %-8s mean %9.4f ms +- %8.4f  p50 %9.4f  p99 %9.4f  %12.0f items/s\n",
+			r.stage.c_str(), r.params.map.c_str(), r.params.entities, r.params.threads,
+			r.params.pinned ? "pinned" : "floating",
+			s.mean * 1000, s.ci95 * 1000, s.p50 * 1000, s.p99 * 1000, s.throughput);
+	}
+
+	void writeCsv(const std::string& filename, const std::vector<Result>& results)
+	{
+		std::ofstream file(filename);
+		if (!file)
+			throw std::runtime_error("failed to open " + filename);
+
+		file << "stage,map,entities,threads,pinned,items,n,mean_ms,stddev_ms,ci95_ms,min_ms,p50_ms,p99_ms,max_ms,throughput\n";
+		for (const Result& r : results)
+		{
+			const Summary& s = r.summary;
+			file << r.stage << ',' << r.params.map << ',' << r.params.entities << ',' << r.params.threads << ','
+				<< (r.params.pinned ? 1 : 0) << ',' << r.items << ',' << s.n << ','
+				<< s.mean * 1000 << ',' << s.stddev * 1000 << ',' << s.ci95 * 1000 << ','
+				<< s.min * 1000 << ',' << s.p50 * 1000 << ',' << s.p99 * 1000 << ',' << s.max * 1000 << ','
+				<< s.throughput << '\n';
+		}
+	}
+
+	static std::string jsonString(const std::string& s)
+	{
+		std::string out = "\"";
+		for (char c : s)
+		{
+			if (c == '"' || c == '\\')
+				out += '\\';
+			out += c;
+		}
+		return out + "\"";
+	}
+
+	void writeJson(const std::string& filename, const std::vector<Result>& results, const Options& options)
+	{
+		std::ofstream file(filename);
+		if (!file)
+			throw std::runtime_error("failed to open " + filename);
+		file.precision(9);
+
+		const topology::Topology& topo = topology::Topology::system();
+		file << "{\n";
+		file << "  \"version\": 1,\n";
+		file << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n";
+		file << "  \"machine\": { \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"cores\": " << topo.coreCount() << ", \"numa_nodes\": " << topo.nodeCount() << " },\n";
+		file << "  \"warmup\": " << options.warmup << ",\n";
+		file << "  \"reps\": " << options.reps << ",\n";
+		file << "  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Result& r = results[i];
+			const Summary& s = r.summary;
+			file << "    {\n";
+			file << "      \"stage\": " << jsonString(r.stage) << ",\n";
+			file << "      \"map\": " << jsonString(r.params.map) << ",\n";
+			file << "      \"entities\": " << r.params.entities << ",\n";
+			file << "      \"threads\": " << r.params.threads << ",\n";
+			file << "      \"pinned\": " << (r.params.pinned ? "true" : "false") << ",\n";
+			file << "      \"items\": " << r.items << ",\n";
+			file << "      \"summary\": { \"n\": " << s.n
+				<< ", \"mean\": " << s.mean << ", \"stddev\": " << s.stddev << ", \"ci95\": " << s.ci95
+				<< ", \"min\": " << s.min << ", \"p50\": " << s.p50 << ", \"p99\": " << s.p99
+				<< ", \"max\": " << s.max << ", \"throughput\": " << s.throughput << " },\n";
+			file << "      \"counters\": {";
+			for (size_t c = 0; c < r.counters.size(); c++)
+				file << (c ? ", " : " ") << jsonString(r.counters[c].first) << ": " << r.counters[c].second;
+			file << (r.counters.empty() ? "},\n" : " },\n");
+			file << "      \"samples\": [";
+			for (size_t k = 0; k < r.samples.size(); k++)
+				file << (k ? ", " : "") << r.samples[k];
+			file << "]\n";
+			file << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		file << "  ]\n";
+		file << "}\n";
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <utility>
+
+// Small measurement harness used by the Benchmark target.
+//
+// A stage is measured by calling a sample function warmup + reps times,
+// the warmup samples are dropped. Each sample returns the seconds one
+// repetition took, so stages that get their time elsewhere (GPU timestamps)
+// can report it directly; measure() wraps plain CPU work.
+namespace bench
+{
+	struct Params
+	{
+		std::string map;
+		int entities = 0;
+		int threads = 1;
+		bool pinned = false;
+	};
+
+	struct Options
+	{
+		int warmup = 5;
+		int reps = 30;
+	};
+
+	struct Summary
+	{
+		size_t n = 0;
+		double mean = 0.0;
+		double stddev = 0.0;    // sample standard deviation
+		double ci95 = 0.0;      // half width of the 95% interval of the mean
+		double min = 0.0;
+		double p50 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+		double throughput = 0.0; // items per second at the mean
+	};
+
+	struct Result
+	{
+		std::string stage;
+		Params params;
+		uint64_t items = 0;           // work items per repetition
+		std::vector<double> samples;  // seconds, in run order
+		Summary summary;
+		std::vector<std::pair<std::string, double>> counters;
+	};
+
+	// two sided 95% critical value of Student's t
+	double tCritical95(size_t degreesOfFreedom);
+	Summary summarize(const std::vector<double>& samples, uint64_t items);
+
+	double measure(const std::function<void()>& fn);
+	Result run(const std::string& stage, const Params& params, const Options& options,
+		uint64_t items, const std::function<double()>& sample);
+	Result makeResult(const std::string& stage, const Params& params, uint64_t items, std::vector<double> samples);
+
+	void printResult(const Result& result);
+	// one row per result, times in milliseconds
+	void writeCsv(const std::string& filename, const std::vector<Result>& results);
+	// results with their raw samples plus a description of the machine
+	void writeJson(const std::string& filename, const std::vector<Result>& results, const Options& options);
+}
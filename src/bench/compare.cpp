@@ -0,0 +1,435 @@
+#include "compare.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace bench
+{
+	// Just enough JSON for the files writeJson produces.
+	struct JsonValue
+	{
+		enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+		Type type = JSON_NULL;
+		bool boolean = false;
+		double number = 0.0;
+		std::string string;
+		std::vector<JsonValue> array;
+		std::vector<std::pair<std::string, JsonValue>> object;
+
+		const JsonValue* find(const std::string& key) const
+		{
+			for (const auto& member : object)
+			{
+				if (member.first == key)
+					return &member.second;
+			}
+			return nullptr;
+		}
+		double numberOr(const std::string& key, double fallback) const
+		{
+			const JsonValue* v = find(key);
+			return v && v->type == JSON_NUMBER ? v->number : fallback;
+		}
+	};
+
+	class JsonParser
+	{
+	public:
+		JsonParser(const std::string& text, const std::string& filename) : mText(text), mFilename(filename) {}
+
+		JsonValue parse()
+		{
+			JsonValue value = parseValue();
+			skipSpace();
+			if (mPos != mText.size())
+				fail("trailing characters");
+			return value;
+		}
+	private:
+		void fail(const char* what)
+		{
+			throw std::runtime_error(mFilename + ": " + what + " at offset " + std::to_string(mPos));
+		}
+		void skipSpace()
+		{
+			while (mPos < mText.size() && (mText[mPos] == ' ' || mText[mPos] == '\n' || mText[mPos] == '\r' || mText[mPos] == '\t'))
+				mPos++;
+		}
+		bool consume(char c)
+		{
+			skipSpace();
+			if (mPos < mText.size() && mText[mPos] == c)
+			{
+				mPos++;
+				return true;
+			}
+			return false;
+		}
+		void expect(char c)
+		{
+			if (!consume(c))
+				fail("unexpected character");
+		}
+		bool literal(const char* word)
+		{
+			size_t len = strlen(word);
+			if (mText.compare(mPos, len, word) != 0)
+				return false;
+			mPos += len;
+			return true;
+		}
+
+		std::string parseString()
+		{
+			expect('"');
+			std::string out;
+			while (mPos < mText.size() && mText[mPos] != '"')
+			{
+				char c = mText[mPos++];
+				if (c == '\\' && mPos < mText.size())
+				{
+					char e = mText[mPos++];
+					switch (e)
+					{
+					case 'n': out += '\n'; break;
+					case 't': out += '\t'; break;
+					case 'r': out += '\r'; break;
+					case 'u': out += '?'; mPos = std::min(mPos + 4, mText.size()); break;
+					default: out += e; break;
+					}
+				}
+				else
+				{
+					out += c;
+				}
+			}
+			expect('"');
+			return out;
+		}
+
+		JsonValue parseValue()
+		{
+			JsonValue value;
+			skipSpace();
+			if (mPos >= mText.size())
+				fail("unexpected end");
+
+			char c = mText[mPos];
+			if (c == '{')
+			{
+				value.type = JsonValue::JSON_OBJECT;
+				mPos++;
+				if (consume('}'))
+					return value;
+				do
+				{
+					skipSpace();
+					std::string key = parseString();
+					expect(':');
+					value.object.emplace_back(std::move(key), parseValue());
+				} while (consume(','));
+				expect('}');
+			}
+			else if (c == '[')
+			{
+				value.type = JsonValue::JSON_ARRAY;
+				mPos++;
+				if (consume(']'))
+					return value;
+				do
+				{
+					value.array.push_back(parseValue());
+				} while (consume(','));
+				expect(']');
+			}
+			else if (c == '"')
+			{
+				value.type = JsonValue::JSON_STRING;
+				value.string = parseString();
+			}
+			else if (literal("true") || literal("false"))
+			{
+				value.type = JsonValue::JSON_BOOL;
+				value.boolean = c == 't';
+			}
+			else if (literal("null"))
+			{
+				value.type = JsonValue::JSON_NULL;
+			}
+			else
+			{
+				const char* start = mText.c_str() + mPos;
+				char* end = nullptr;
+				value.type = JsonValue::JSON_NUMBER;
+				value.number = strtod(start, &end);
+				if (end == start)
+					fail("unexpected character");
+				mPos += end - start;
+			}
+			return value;
+		}
+
+		const std::string& mText;
+		const std::string& mFilename;
+		size_t mPos = 0;
+	};
+
+	static std::string readFile(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("failed to open " + filename);
+		std::stringstream buffer;
+		buffer << file.rdbuf();
+		return buffer.str();
+	}
+
+	static std::vector<Result> readJsonResults(const std::string& filename)
+	{
+		std::string text = readFile(filename);
+		JsonValue root = JsonParser(text, filename).parse();
+		const JsonValue* results = root.find("results");
+		if (!results || results->type != JsonValue::JSON_ARRAY)
+			throw std::runtime_error(filename + ": no results array, not written by Benchmark?");
+
+		std::vector<Result> out;
+		for (const JsonValue& r : results->array)
+		{
+			Result result;
+			const JsonValue* stage = r.find("stage");
+			const JsonValue* map = r.find("map");
+			const JsonValue* pinned = r.find("pinned");
+			const JsonValue* samples = r.find("samples");
+			result.stage = stage ? stage->string : "";
+			result.params.map = map ? map->string : "";
+			result.params.entities = static_cast<int>(r.numberOr("entities", 0));
+			result.params.threads = static_cast<int>(r.numberOr("threads", 1));
+			result.params.pinned = pinned && pinned->boolean;
+			result.items = static_cast<uint64_t>(r.numberOr("items", 0));
+			if (samples)
+			{
+				for (const JsonValue& s : samples->array)
+					result.samples.push_back(s.number);
+			}
+			result.summary = summarize(result.samples, result.items);
+			out.push_back(std::move(result));
+		}
+		return out;
+	}
+
+	// recordtime_E<entities>_T<threads>.txt, written by the renderer before
+	// the Benchmark target existed
+	static std::vector<Result> readRecordTimes(const std::string& filename)
+	{
+		Result result;
+		result.stage = "record";
+		size_t slash = filename.find_last_of("/\\");
+		std::string base = slash == std::string::npos ? filename : filename.substr(slash + 1);
+		int entities = 0, threads = 0;
+		if (sscanf(base.c_str(), "recordtime_E%d_T%d", &entities, &threads) != 2)
+			throw std::runtime_error(filename + ": expected a .json file or recordtime_E<n>_T<n>.txt");
+		result.params.entities = entities;
+		result.params.threads = threads;
+		result.items = static_cast<uint64_t>(entities);
+
+		std::istringstream in(readFile(filename));
+		double ms;
+		while (in >> ms)
+			result.samples.push_back(ms / 1000.0);
+		if (result.samples.empty())
+			throw std::runtime_error(filename + ": no values");
+		result.summary = summarize(result.samples, result.items);
+		return { result };
+	}
+
+	std::vector<Result> readResults(const std::string& filename)
+	{
+		size_t dot = filename.find_last_of('.');
+		if (dot != std::string::npos && filename.substr(dot) == ".json")
+			return readJsonResults(filename);
+		return readRecordTimes(filename);
+	}
+
+	MannWhitney mannWhitneyU(const std::vector<double>& a, const std::vector<double>& b)
+	{
+		MannWhitney result;
+		size_t n1 = a.size(), n2 = b.size();
+		if (n1 == 0 || n2 == 0)
+			return result;
+
+		std::vector<std::pair<double, int>> all;
+		all.reserve(n1 + n2);
+		for (double v : a)
+			all.push_back({ v, 0 });
+		for (double v : b)
+			all.push_back({ v, 1 });
+		std::sort(all.begin(), all.end());
+
+		// average ranks over ties
+		double rankSumA = 0.0;
+		double tieTerm = 0.0;
+		size_t n = all.size();
+		for (size_t i = 0; i < n;)
+		{
+			size_t j = i;
+			while (j < n && all[j].first == all[i].first)
+				j++;
+			double rank = (i + 1 + j) / 2.0;
+			for (size_t k = i; k < j; k++)
+			{
+				if (all[k].second == 0)
+					rankSumA += rank;
+			}
+			double t = double(j - i);
+			tieTerm += t * t * t - t;
+			i = j;
+		}
+
+		result.u = rankSumA - n1 * (n1 + 1) / 2.0;
+		double mean = n1 * n2 / 2.0;
+		double variance = n1 * n2 / 12.0 * ((n + 1) - tieTerm / (double(n) * (n - 1)));
+		if (variance <= 0.0)
+			return result; // every value equal
+
+		// continuity correction towards the mean
+		double diff = std::fabs(result.u - mean) - 0.5;
+		result.z = std::max(0.0, diff) / std::sqrt(variance);
+		if (result.u < mean)
+			result.z = -result.z;
+		result.p = std::erfc(std::fabs(result.z) / std::sqrt(2.0));
+		return result;
+	}
+
+	const char* verdictName(Verdict verdict)
+	{
+		switch (verdict)
+		{
+		case VERDICT_UNCHANGED: return "same";
+		case VERDICT_IMPROVED: return "faster";
+		case VERDICT_REGRESSED: return "REGRESSED";
+		case VERDICT_UNTESTED: return "untested";
+		case VERDICT_UNTESTED_SLOWER: return "slower?";
+		case VERDICT_MISSING: return "missing";
+		case VERDICT_ADDED: return "new";
+		}
+		return "?";
+	}
+
+	static bool sameConfig(const Result& a, const Result& b)
+	{
+		// legacy record times carry no map name
+		bool sameMap = a.params.map == b.params.map || a.params.map.empty() || b.params.map.empty();
+		return a.stage == b.stage && sameMap && a.params.entities == b.params.entities
+			&& a.params.threads == b.params.threads && a.params.pinned == b.params.pinned;
+	}
+
+	static bool wanted(const Result& r, const CompareOptions& options)
+	{
+		return options.stages.empty() || std::find(options.stages.begin(), options.stages.end(), r.stage) != options.stages.end();
+	}
+
+	std::vector<Comparison> compare(const std::vector<Result>& baseline, const std::vector<Result>& candidate,
+		const CompareOptions& options)
+	{
+		std::vector<Comparison> out;
+		std::vector<bool> matched(candidate.size(), false);
+
+		for (const Result& base : baseline)
+		{
+			if (!wanted(base, options))
+				continue;
+
+			Comparison c;
+			c.stage = base.stage;
+			c.params = base.params;
+			c.baseline = &base;
+			c.baselineMedian = base.summary.p50;
+			for (size_t i = 0; i < candidate.size(); i++)
+			{
+				if (!matched[i] && sameConfig(base, candidate[i]))
+				{
+					matched[i] = true;
+					c.candidate = &candidate[i];
+					break;
+				}
+			}
+			if (!c.candidate)
+			{
+				c.verdict = VERDICT_MISSING;
+				out.push_back(c);
+				continue;
+			}
+
+			c.candidateMedian = c.candidate->summary.p50;
+			c.change = c.baselineMedian > 0.0 ? c.candidateMedian / c.baselineMedian - 1.0 : 0.0;
+			c.tested = base.samples.size() >= options.minSamples && c.candidate->samples.size() >= options.minSamples;
+			if (c.tested)
+			{
+				c.test = mannWhitneyU(base.samples, c.candidate->samples);
+				bool significant = c.test.p < options.alpha;
+				if (significant && c.change > options.threshold)
+					c.verdict = VERDICT_REGRESSED;
+				else if (significant && c.change < -options.threshold)
+					c.verdict = VERDICT_IMPROVED;
+				else
+					c.verdict = VERDICT_UNCHANGED;
+			}
+			else
+			{
+				c.verdict = c.change > options.threshold ? VERDICT_UNTESTED_SLOWER : VERDICT_UNTESTED;
+			}
+			out.push_back(c);
+		}
+
+		for (size_t i = 0; i < candidate.size(); i++)
+		{
+			if (matched[i] || !wanted(candidate[i], options))
+				continue;
+			Comparison c;
+			c.stage = candidate[i].stage;
+			c.params = candidate[i].params;
+			c.candidate = &candidate[i];
+			c.candidateMedian = candidate[i].summary.p50;
+			c.verdict = VERDICT_ADDED;
+			out.push_back(c);
+		}
+		return out;
+	}
+
+	bool failed(const Comparison& c, const CompareOptions& options)
+	{
+		if (c.verdict == VERDICT_REGRESSED)
+			return true;
+		return options.strict && (c.verdict == VERDICT_UNTESTED_SLOWER || c.verdict == VERDICT_MISSING);
+	}
+
+	void printComparisons(const std::vector<Comparison>& comparisons, FILE* out)
+	{
+		fprintf(out, "%-12s %-14s %6s %3s %-3s %5s %11s %11s %8s %13s %13s %9s  %s\n",
+			"stage", "map", "E", "T", "pin", "n", "base p50", "new p50", "change",
+			"base items/s", "new items/s", "p", "verdict");
+		for (const Comparison& c : comparisons)
+		{
+			const Result* any = c.baseline ? c.baseline : c.candidate;
+			size_t nBase = c.baseline ? c.baseline->samples.size() : 0;
+			size_t nNew = c.candidate ? c.candidate->samples.size() : 0;
+			double baseRate = c.baseline ? c.baseline->summary.throughput : 0.0;
+			double newRate = c.candidate ? c.candidate->summary.throughput : 0.0;
+			std::string n = std::to_string(nBase) + "/" + std::to_string(nNew);
+			std::string p = c.tested ? std::to_string(c.test.p).substr(0, 8) : "-";
+
+			fprintf(out, "%-12s %-14.14s %6d %3d %-3s %5s %8.4f ms %8.4f ms %+7.1f%% %13.0f %13.0f %9s  %s\n",
+				c.stage.c_str(), any->params.map.c_str(), c.params.entities, c.params.threads,
+				c.params.pinned ? "yes" : "no", n.c_str(), c.baselineMedian * 1000, c.candidateMedian * 1000,
+				c.baseline && c.candidate ? c.change * 100 : 0.0, baseRate, newRate, p.c_str(), verdictName(c.verdict));
+		}
+	}
+}
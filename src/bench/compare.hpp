@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "benchmark.hpp"
+
+// Regression check between two benchmark runs, used by BenchCompare.
+//
+// Results are matched on stage and parameters. Each pair's samples go
+// through a two sided Mann-Whitney U test, which makes no assumption about
+// the shape of the timing distributions. A pair regresses when the test is
+// significant and the median got slower by more than the threshold.
+namespace bench
+{
+	// Reads a file written by writeJson, or a legacy recordtime_E<n>_T<n>.txt
+	// (whitespace separated record times in ms) as "record" results.
+	std::vector<Result> readResults(const std::string& filename);
+
+	struct MannWhitney
+	{
+		double u = 0.0; // U of the first sample
+		double z = 0.0;
+		double p = 1.0; // two sided, normal approximation with tie correction
+	};
+	MannWhitney mannWhitneyU(const std::vector<double>& a, const std::vector<double>& b);
+
+	struct CompareOptions
+	{
+		double threshold = 0.05; // relative change of the median
+		double alpha = 0.01;
+		size_t minSamples = 5;   // fewer on either side: threshold only, no test
+		bool strict = false;     // untested slowdowns and missing results fail too
+		std::vector<std::string> stages; // empty compares every stage
+	};
+
+	enum Verdict
+	{
+		VERDICT_UNCHANGED,
+		VERDICT_IMPROVED,
+		VERDICT_REGRESSED,
+		VERDICT_UNTESTED,        // too few samples, within threshold
+		VERDICT_UNTESTED_SLOWER, // too few samples, slower than threshold
+		VERDICT_MISSING,         // only in the baseline
+		VERDICT_ADDED            // only in the candidate
+	};
+
+	struct Comparison
+	{
+		std::string stage;
+		Params params;
+		const Result* baseline = nullptr;
+		const Result* candidate = nullptr;
+		double baselineMedian = 0.0;  // seconds
+		double candidateMedian = 0.0;
+		double change = 0.0;          // candidate / baseline - 1 of the medians
+		MannWhitney test;
+		bool tested = false;
+		Verdict verdict = VERDICT_UNCHANGED;
+	};
+
+	std::vector<Comparison> compare(const std::vector<Result>& baseline, const std::vector<Result>& candidate,
+		const CompareOptions& options);
+	void printComparisons(const std::vector<Comparison>& comparisons, FILE* out);
+	bool failed(const Comparison& comparison, const CompareOptions& options);
+	const char* verdictName(Verdict verdict);
+}
@@ -0,0 +1,514 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <GLFW/glfw3.h>
+
+#include "benchmark.hpp"
+#include "../world.h"
+#include "../lodepng/lodepng.h"
+#include "../renderer/renderer.hpp"
+#include "../renderer/entityuniforms.hpp"
+#include "../path/pathservice.hpp"
+#include "../path/gpupathbackend.hpp"
+#include "../util/scheduler.hpp"
+#include "../util/topology.hpp"
+#include "../util/trace.hpp"
+#include "../util/log.hpp"
+#include "../mapgen/mapgen.hpp"
+#include "../replay.hpp"
+#include "../mapimage.hpp"
+
+// read by the renderer and the scheduler, set per configuration
+int GLOBAL_NUM_THREADS = 1;
+int GLOBAL_NUM_ENTITIES = 250;
+
+// typical minUniformBufferOffsetAlignment, the real value needs a device
+#define BENCH_UNIFORM_ALIGNMENT 256
+// frames until the renderer reads back a frame's GPU timestamps
+#define BENCH_GPU_READBACK_LAG 2
+
+// a map file, or a generated map plus the PNG written for it
+struct BenchMap
+{
+	std::string file;
+	std::shared_ptr<GeneratedMap> generated;
+};
+
+struct BenchConfig
+{
+	std::vector<int> entities = { 64, 128, 250 };
+	std::vector<int> threads = { 1, 2, 4 };
+	std::vector<std::string> maps = { "test3.png" };
+	std::vector<int> pin = { 0 };
+	std::vector<std::string> stages = { "decode", "mapload", "path", "update", "uniform" };
+	bench::Options options;
+	bool gpu = false;
+	std::string csv = "bench.csv";
+	std::string json = "bench.json";
+	std::string trace;
+	std::string replay;
+};
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+	std::vector<std::string> out;
+	size_t begin = 0;
+	while (begin <= list.size())
+	{
+		size_t end = list.find(',', begin);
+		if (end == std::string::npos)
+			end = list.size();
+		if (end > begin)
+			out.push_back(list.substr(begin, end - begin));
+		begin = end + 1;
+	}
+	return out;
+}
+
+static std::vector<int> splitInts(const std::string& list)
+{
+	std::vector<int> out;
+	for (const std::string& s : splitList(list))
+		out.push_back(std::atoi(s.c_str()));
+	return out;
+}
+
+static void printUsage()
+{
+	printf("usage: Benchmark [options]\n");
+	printf("  --entities 64,128,250   entity counts to sweep\n");
+	printf("  --threads 1,2,4         thread counts to sweep (GLOBAL_NUM_THREADS)\n");
+	printf("  --maps test3.png,...    maps to sweep, files or generator specs like\n");
+	printf("                          gen:maze:4096x4096:seed=1:density=0.1 (maze, rooms, field, spiral)\n");
+	printf("  --pin 0,1               run floating and/or pinned (threads.cfg placement)\n");
+	printf("  --stages decode,mapload,path,update,uniform,record\n");
+	printf("  --gpu                   also run the record stage, opens a window; with the\n");
+	printf("                          path stage this adds path_gpu, the application's default backend\n");
+	printf("  --warmup N --reps N\n");
+	printf("  --csv file --json file\n");
+	printf("  --trace file            write a Chrome trace of the whole run\n");
+	printf("  --log-level warn        debug, info, warn, error or off\n");
+	printf("  --replay file           replay a recorded run on each map and thread count,\n");
+	printf("                          solving its path batches with the CPU backend\n");
+}
+
+static BenchConfig parseArgs(int argc, char* argv[])
+{
+	BenchConfig config;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		auto value = [&]() -> std::string
+		{
+			if (i + 1 >= argc)
+				throw std::runtime_error("missing value for " + arg);
+			return argv[++i];
+		};
+
+		if (arg == "--entities")
+			config.entities = splitInts(value());
+		else if (arg == "--threads")
+			config.threads = splitInts(value());
+		else if (arg == "--maps")
+			config.maps = splitList(value());
+		else if (arg == "--pin")
+			config.pin = splitInts(value());
+		else if (arg == "--stages")
+			config.stages = splitList(value());
+		else if (arg == "--warmup")
+			config.options.warmup = std::atoi(value().c_str());
+		else if (arg == "--reps")
+			config.options.reps = std::atoi(value().c_str());
+		else if (arg == "--csv")
+			config.csv = value();
+		else if (arg == "--json")
+			config.json = value();
+		else if (arg == "--replay")
+			config.replay = value();
+		else if (arg == "--trace")
+			config.trace = value();
+		else if (arg == "--log-level")
+		{
+			LogLevel level;
+			if (!Logger::parseLevel(value(), level))
+				throw std::runtime_error("unknown log level " + std::string(argv[i]));
+			Logger::get().setLevel(level);
+		}
+		else if (arg == "--gpu")
+			config.gpu = true;
+		else if (arg == "--help" || arg == "-h")
+		{
+			printUsage();
+			exit(0);
+		}
+		else
+			throw std::runtime_error("unknown option " + arg);
+	}
+	if (config.gpu && std::find(config.stages.begin(), config.stages.end(), "record") == config.stages.end())
+		config.stages.push_back("record");
+	if (config.options.reps < 2)
+		throw std::runtime_error("--reps must be at least 2");
+	return config;
+}
+
+static bool hasStage(const BenchConfig& config, const char* stage)
+{
+	return std::find(config.stages.begin(), config.stages.end(), stage) != config.stages.end();
+}
+
+static void benchDecode(const bench::Params& params, const bench::Options& options, std::vector<bench::Result>& results)
+{
+	std::vector<unsigned char> image;
+	unsigned width = 0, height = 0;
+	if (lodepng::decode(image, width, height, params.map, LCT_RGBA) != 0)
+		throw std::runtime_error("failed to decode " + params.map);
+
+	results.push_back(bench::run("decode", params, options, uint64_t(width) * height, [&]()
+	{
+		return bench::measure([&]()
+		{
+			image.clear();
+			lodepng::decode(image, width, height, params.map, LCT_RGBA);
+		});
+	}));
+}
+
+// the way the application loads maps: MapImageCache maps the file, decodes
+// its rows to grey (in parallel parts for indexed PNGs) and writes the .raw
+// sidecar. mapload times that first load, mapload_raw the later ones that
+// read the sidecar back
+static void benchMapLoad(const bench::Params& params, const bench::Options& options, std::vector<bench::Result>& results)
+{
+	const std::string sidecar = params.map + ".raw";
+	std::error_code error;
+	std::filesystem::remove(sidecar, error);
+	std::shared_ptr<const MapImage> image = MapImageCache::get().load(params.map);
+	uint64_t pixels = uint64_t(image->width) * image->height;
+	image.reset();
+
+	results.push_back(bench::run("mapload", params, options, pixels, [&]()
+	{
+		MapImageCache::get().clear();
+		std::filesystem::remove(sidecar, error);
+		return bench::measure([&]() { MapImageCache::get().load(params.map); });
+	}));
+	results.push_back(bench::run("mapload_raw", params, options, pixels, [&]()
+	{
+		MapImageCache::get().clear();
+		return bench::measure([&]() { MapImageCache::get().load(params.map); });
+	}));
+	MapImageCache::get().clear();
+}
+
+static BenchMap loadMap(const std::string& map)
+{
+	BenchMap result;
+	if (!isMapSpec(map))
+	{
+		result.file = map;
+		return result;
+	}
+
+	// the decode, mapload and record stages need a file, the world takes the cells directly.
+	// It is only written for this run, the fastest level is good enough
+	MapSpec spec = parseMapSpec(map);
+	result.generated = std::make_shared<GeneratedMap>(generateMap(spec));
+	result.file = mapSpecName(spec) + ".png";
+	writeMapPng(*result.generated, result.file, 1);
+	printf("generated %s\n", result.file.c_str());
+	return result;
+}
+
+static void initWorld(World& world, const BenchMap& map, int entities)
+{
+	if (map.generated)
+		world.init(*map.generated, entities);
+	else
+		world.init(map.file, entities);
+}
+
+static void benchWorld(const BenchConfig& config, const BenchMap& map, const bench::Params& params, std::vector<bench::Result>& results)
+{
+	World world;
+	initWorld(world, map, params.entities);
+
+	const std::vector<uvec2> startEntities = world.entities;
+	const uvec2 startGoal = world.goal;
+
+	// same split as the application: one thread records, the rest are workers
+	Scheduler scheduler(params.threads - 1);
+	scheduler.pinWorkers();
+	PathService service(std::unique_ptr<PathBackend>(new CpuPathBackend(scheduler)));
+
+	std::vector<ivec2> steps = service.solveNow(world.makePathBatch()).steps;
+
+	if (hasStage(config, "path"))
+	{
+		scheduler.resetStats();
+		bench::Result result = bench::run("path", params, config.options, params.entities, [&]()
+		{
+			return bench::measure([&]() { service.solveNow(world.makePathBatch()); });
+		});
+		Scheduler::Stats stats = scheduler.stats();
+		result.counters.push_back({ "background_chunks", double(stats.backgroundChunks) });
+		result.counters.push_back({ "preemptions", double(stats.preemptions) });
+		results.push_back(std::move(result));
+	}
+
+	if (hasStage(config, "update"))
+	{
+		// one full set of steps per repetition, restarting from the same state
+		const int updates = PATH_STEPS;
+		results.push_back(bench::run("update", params, config.options, uint64_t(params.entities) * updates, [&]()
+		{
+			world.entities = startEntities;
+			world.goal = startGoal;
+			world.setSteps(steps.data());
+			return bench::measure([&]()
+			{
+				for (int i = 0; i < updates; i++)
+					world.updateEntities();
+			});
+		}));
+		world.entities = startEntities;
+		world.goal = startGoal;
+	}
+
+	if (hasStage(config, "uniform"))
+	{
+		std::vector<Entity> toDraw;
+		for (const uvec2& e : world.entities)
+			toDraw.push_back(Entity(e.x, e.y));
+		toDraw.push_back(Entity(world.goal.x, world.goal.y, true));
+
+		int stride = BENCH_UNIFORM_ALIGNMENT / sizeof(float);
+		std::vector<float> posBuffer(size_t(stride) * (toDraw.size() + 1));
+		results.push_back(bench::run("uniform", params, config.options, toDraw.size(), [&]()
+		{
+			return bench::measure([&]() { buildEntityUniforms(toDraw, posBuffer.data(), stride); });
+		}));
+	}
+}
+
+// Plays the log on a fresh world. onSteps runs right before each recorded
+// set of steps is applied, with the world in the state it was applied in.
+static bool playReplay(ReplayLog& log, const BenchMap& map, double* simTime,
+	const std::function<void(World&)>& onSteps)
+{
+	World world;
+	world.setSeed(log.seed());
+	initWorld(world, map, static_cast<int>(log.entityCount()));
+	log.restore(world);
+	log.rewind();
+	world.setReplay(&log);
+
+	Timer timer;
+	double outside = 0.0;
+	while (!log.finished(world.getTick()))
+	{
+		uint64_t tick = world.getTick();
+		uvec2 goal;
+		while (log.goalResetAt(tick, goal))
+			world.setGoal(goal);
+		while (ReplayLog::StepsEvent* event = log.stepsAt(tick))
+		{
+			if (onSteps)
+				outside += bench::measure([&]() { onSteps(world); });
+			world.setSteps(event->steps.data());
+		}
+		world.updateEntities();
+	}
+	if (simTime)
+		*simTime = timer.elapsed() - outside;
+	return log.verify(world);
+}
+
+static void benchReplay(const BenchConfig& config, const BenchMap& map, bench::Params params, std::vector<bench::Result>& results)
+{
+	ReplayLog log;
+	log.load(config.replay);
+	params.entities = static_cast<int>(log.entityCount());
+
+	// recorded workload against the CPU backend, batches rebuilt from the
+	// state at the tick their recorded steps were applied
+	Scheduler scheduler(params.threads - 1);
+	scheduler.pinWorkers();
+	PathService service(std::unique_ptr<PathBackend>(new CpuPathBackend(scheduler)));
+	std::vector<double> pathSamples;
+	playReplay(log, map, nullptr, [&](World& world)
+	{
+		pathSamples.push_back(bench::measure([&]() { service.solveNow(world.makePathBatch()); }));
+	});
+	results.push_back(bench::makeResult("replay_path", params, params.entities, std::move(pathSamples)));
+
+	// the simulation alone, with recorded steps
+	bench::Result sim = bench::run("replay_sim", params, config.options, log.endTick() * params.entities, [&]()
+	{
+		double simTime = 0.0;
+		if (!playReplay(log, map, &simTime, nullptr))
+			throw std::runtime_error("replay diverged from the recording");
+		return simTime;
+	});
+	results.push_back(std::move(sim));
+}
+
+static void benchRecord(const BenchConfig& config, const BenchMap& map, const bench::Params& params, std::vector<bench::Result>& results)
+{
+	// the renderer needs a worker to record on and room for the goal
+	if (params.threads < 2 || params.entities > MAX_DRAW_ENTITIES - 2)
+	{
+		printf("record   %-12s E%-5d T%-2d skipped\n", params.map.c_str(), params.entities, params.threads);
+		return;
+	}
+
+	World world;
+	initWorld(world, map, params.entities);
+
+	std::unique_ptr<Renderer> renderer(new Renderer());
+	renderer->init(params.map);
+	bool gpuPaths = hasStage(config, "path");
+	if (gpuPaths)
+		renderer->initCompute(world.mapSize, world.entitiesSize);
+	renderer->getScheduler().resetStats();
+
+	std::vector<double> recordSamples;
+	std::vector<double> gpuSamples;
+	int frames = config.options.warmup + config.options.reps;
+	// the GPU time of a frame is read back BENCH_GPU_READBACK_LAG frames later
+	for (int i = 0; i < frames + BENCH_GPU_READBACK_LAG && !renderer->windowShouldClose(); i++)
+	{
+		for (const uvec2& e : world.entities)
+			renderer->submitEntity(Entity(e.x, e.y));
+		renderer->submitEntity(Entity(world.goal.x, world.goal.y, true));
+		renderer->render();
+		glfwPollEvents();
+
+		if (i >= config.options.warmup && i < frames)
+			recordSamples.push_back(renderer->getLastRecordTime());
+		if (i >= config.options.warmup + BENCH_GPU_READBACK_LAG)
+			gpuSamples.push_back(renderer->getLastGpuFrameTime());
+	}
+
+	Scheduler::Stats stats = renderer->getScheduler().stats();
+	bench::Result record = bench::makeResult("record", params, params.entities + 1, std::move(recordSamples));
+	record.counters.push_back({ "deadline_tasks", double(stats.deadlineTasks) });
+	record.counters.push_back({ "missed_deadlines", double(stats.missedDeadlines) });
+	record.counters.push_back({ "worst_lateness", stats.worstLateness });
+	results.push_back(std::move(record));
+	results.push_back(bench::makeResult("gpuframe", params, params.entities + 1, std::move(gpuSamples)));
+
+	// the path stage above measured the CPU backend, the application defaults to this one
+	if (gpuPaths)
+	{
+		PathService service(std::unique_ptr<PathBackend>(new GpuPathBackend(*renderer)));
+		results.push_back(bench::run("path_gpu", params, config.options, params.entities, [&]()
+		{
+			return bench::measure([&]() { service.solveNow(world.makePathBatch()); });
+		}));
+	}
+
+	renderer->cleanup();
+}
+
+int main(int argc, char* argv[])
+{
+	// world and renderer set-up messages would interleave with the results
+	Logger::get().setLevel(LEVEL_WARN);
+	try
+	{
+		BenchConfig config = parseArgs(argc, argv);
+
+		TraceRecorder::get().setEnabled(!config.trace.empty());
+		TraceRecorder::get().setThreadName("bench");
+
+		topology::ThreadConfig threadConfig;
+		threadConfig.loadFromFile("threads.cfg");
+
+		std::vector<int> allCpus;
+		for (const topology::Cpu& cpu : topology::Topology::system().cpus())
+			allCpus.push_back(cpu.id);
+
+		std::vector<bench::Result> results;
+		for (const std::string& mapName : config.maps)
+		{
+			BenchMap map = loadMap(mapName);
+			for (int pin : config.pin)
+			{
+				for (int threads : config.threads)
+				{
+					GLOBAL_NUM_THREADS = threads;
+					threadConfig.pin = pin != 0;
+					topology::Placement::get().configure(threadConfig, threads - 1);
+					if (threadConfig.pin)
+						topology::Placement::get().pinCurrentThread(topology::ROLE_MAIN);
+					else
+						topology::setCurrentAffinity(allCpus);
+
+					bench::Params params;
+					params.map = map.file;
+					params.threads = threads;
+					params.pinned = threadConfig.pin;
+
+					if (hasStage(config, "decode"))
+					{
+						benchDecode(params, config.options, results);
+						bench::printResult(results.back());
+					}
+
+					if (hasStage(config, "mapload"))
+					{
+						size_t first = results.size();
+						benchMapLoad(params, config.options, results);
+						for (size_t i = first; i < results.size(); i++)
+							bench::printResult(results[i]);
+					}
+
+					if (!config.replay.empty())
+					{
+						size_t first = results.size();
+						benchReplay(config, map, params, results);
+						for (size_t i = first; i < results.size(); i++)
+							bench::printResult(results[i]);
+					}
+
+					for (int entities : config.entities)
+					{
+						GLOBAL_NUM_ENTITIES = entities;
+						params.entities = entities;
+
+						size_t first = results.size();
+						benchWorld(config, map, params, results);
+						if (hasStage(config, "record"))
+							benchRecord(config, map, params, results);
+						for (size_t i = first; i < results.size(); i++)
+							bench::printResult(results[i]);
+					}
+				}
+			}
+		}
+
+		bench::writeCsv(config.csv, results);
+		bench::writeJson(config.json, results, config.options);
+		printf("wrote %s and %s\n", config.csv.c_str(), config.json.c_str());
+		if (!config.trace.empty())
+			TraceRecorder::get().write(config.trace);
+		// whole run, all configurations mixed
+		Logger::get().flush();
+		LatencyRegistry::get().report(stdout);
+	}
+	catch (const std::exception& e)
+	{
+		Logger::get().shutdown();
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
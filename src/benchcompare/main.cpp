@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "../bench/compare.hpp"
+
+// BenchCompare <baseline> <candidate> [--threshold pct] [--alpha a]
+//              [--min-samples n] [--stages a,b] [--strict]
+//
+// Both sides are a Benchmark --json file or recordtime_E<n>_T<n>.txt files,
+// several separated by commas. Exits with 1 when anything regressed, so it
+// can gate a build, and with 2 on bad arguments or unreadable input.
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+	std::vector<std::string> out;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		if (!item.empty())
+			out.push_back(item);
+	}
+	return out;
+}
+
+static std::vector<bench::Result> readAll(const std::string& list)
+{
+	std::vector<bench::Result> out;
+	for (const std::string& file : splitList(list))
+	{
+		std::vector<bench::Result> results = bench::readResults(file);
+		out.insert(out.end(), results.begin(), results.end());
+	}
+	return out;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* usage = "usage: BenchCompare <baseline> <candidate> [--threshold pct] [--alpha a] "
+		"[--min-samples n] [--stages a,b] [--strict]\n";
+
+	bench::CompareOptions options;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--threshold" && i + 1 < argc)
+			options.threshold = atof(argv[++i]) / 100.0;
+		else if (arg == "--alpha" && i + 1 < argc)
+			options.alpha = atof(argv[++i]);
+		else if (arg == "--min-samples" && i + 1 < argc)
+			options.minSamples = static_cast<size_t>(std::max(1, atoi(argv[++i])));
+		else if (arg == "--stages" && i + 1 < argc)
+			options.stages = splitList(argv[++i]);
+		else if (arg == "--strict")
+			options.strict = true;
+		else if (arg[0] != '-')
+			files.push_back(arg);
+		else
+		{
+			printf("%s", usage);
+			return 2;
+		}
+	}
+	if (files.size() != 2)
+	{
+		printf("%s", usage);
+		return 2;
+	}
+
+	std::vector<bench::Result> baseline, candidate;
+	try
+	{
+		baseline = readAll(files[0]);
+		candidate = readAll(files[1]);
+	}
+	catch (const std::exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return 2;
+	}
+
+	std::vector<bench::Comparison> comparisons = bench::compare(baseline, candidate, options);
+	bench::printComparisons(comparisons, stdout);
+
+	int regressions = 0;
+	for (const bench::Comparison& c : comparisons)
+	{
+		if (bench::failed(c, options))
+			regressions++;
+	}
+	printf("\n%zu compared, %d failed (threshold %.1f%%, alpha %g%s)\n", comparisons.size(), regressions,
+		options.threshold * 100, options.alpha, options.strict ? ", strict" : "");
+	return regressions ? 1 : 0;
+}
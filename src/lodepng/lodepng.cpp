@@ -34,6 +34,58 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <stdio.h> /* file handling */
 #include <stdlib.h> /* allocations */
 
+/*
+SIMD unfiltering for 8-bit RGB and RGBA scanlines, SIMD checksums and color conversions. SSE2 is part of
+every x86-64 CPU, so it is chosen at compile time; SSSE3, AVX2 and PCLMULQDQ are only used
+after checking the CPU at runtime. The NEON kernels and the ARMv8 CRC32 instructions are
+opt-in: define LODEPNG_USE_NEON on an ARM target that has them, no shipped configuration
+builds for ARM yet. Define LODEPNG_NO_SIMD to build the plain C version only.
+*/
+#ifndef LODEPNG_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LODEPNG_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define LODEPNG_TARGET_SSSE3
+#define LODEPNG_TARGET_AVX2
+#define LODEPNG_TARGET_PCLMUL
+#else
+#include <cpuid.h>
+#define LODEPNG_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define LODEPNG_TARGET_AVX2 __attribute__((target("avx2")))
+#define LODEPNG_TARGET_PCLMUL __attribute__((target("pclmul")))
+#endif
+#ifdef LODEPNG_COMPILE_DECODER
+#define LODEPNG_UNFILTER_SSE2
+#endif /*LODEPNG_COMPILE_DECODER*/
+#elif defined(LODEPNG_USE_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+#define LODEPNG_SIMD_NEON
+#include <arm_neon.h>
+#ifdef LODEPNG_COMPILE_DECODER
+#define LODEPNG_UNFILTER_NEON
+#endif /*LODEPNG_COMPILE_DECODER*/
+#endif
+#if defined(LODEPNG_USE_NEON) && defined(__ARM_FEATURE_CRC32)
+#define LODEPNG_CRC32_ARM
+#include <arm_acle.h>
+#endif
+#endif /*!LODEPNG_NO_SIMD*/
+
+/*
+The LZ77 matcher of the compression levels compares 8 bytes at once and finds the first
+different one by counting trailing zero bits, which is only the first byte in memory on
+little endian CPUs. Elsewhere it compares byte by byte.
+*/
+#ifdef LODEPNG_COMPILE_ENCODER
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>
+#define LODEPNG_CTZ64
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LODEPNG_CTZ64
+#endif
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -125,6 +177,47 @@ Example: if(!uivector_resizev(&frequencies_ll, 286, 0)) ERROR_BREAK(83);
   return;\
 }
 
+#ifdef LODEPNG_SIMD_X86
+#define LODEPNG_CPU_SSSE3 1u
+#define LODEPNG_CPU_PCLMUL 2u
+#define LODEPNG_CPU_AVX2 4u
+
+static unsigned detectCPU(void) {
+  unsigned features = 0, ecx1, ebx7 = 0, xcr0 = 0;
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] >= 7) {
+    __cpuidex(info, 7, 0);
+    ebx7 = (unsigned)info[1];
+  }
+  __cpuid(info, 1);
+  ecx1 = (unsigned)info[2];
+  if((ecx1 >> 27) & 1) xcr0 = (unsigned)_xgetbv(0);
+#else
+  unsigned eax, ebx, ecx, edx;
+  if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+  ecx1 = ecx;
+  if(__get_cpuid_max(0, 0) >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    ebx7 = ebx;
+  }
+  if((ecx1 >> 27) & 1) __asm__("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+#endif
+  if((ecx1 >> 9) & 1) features |= LODEPNG_CPU_SSSE3;
+  if((ecx1 >> 1) & 1) features |= LODEPNG_CPU_PCLMUL;
+  /*AVX2 also needs the OS to save the YMM registers (OSXSAVE and XCR0)*/
+  if(((ebx7 >> 5) & 1) && (xcr0 & 6) == 6) features |= LODEPNG_CPU_AVX2;
+  return features;
+}
+
+/*the LODEPNG_CPU_ flags of the CPU this runs on*/
+static unsigned cpuFeatures(void) {
+  static const unsigned features = detectCPU();
+  return features;
+}
+#endif /*LODEPNG_SIMD_X86*/
+
 /*
 About uivector, ucvector and string:
 -All of them wrap dynamic arrays or text strings in a similar way.
@@ -254,6 +347,50 @@ static unsigned ucvector_push_back(ucvector* p, unsigned char c) {
 }
 #endif /*defined(LODEPNG_COMPILE_PNG) || defined(LODEPNG_COMPILE_ENCODER)*/
 
+#ifdef LODEPNG_COMPILE_DECODER
+/*a piece of compressed input. The IDAT chunks of a PNG are inflated where they are in
+the file, as a list of segments, instead of being copied together first*/
+typedef struct LodePNGSegment {
+  const unsigned char* data;
+  size_t size;
+} LodePNGSegment;
+
+#ifdef LODEPNG_COMPILE_PNG
+/*dynamic vector of segments*/
+typedef struct segvector {
+  LodePNGSegment* data;
+  size_t size; /*in segments*/
+  size_t allocsize; /*in segments*/
+} segvector;
+
+static void segvector_init(segvector* p) {
+  p->data = NULL;
+  p->size = p->allocsize = 0;
+}
+
+static void segvector_cleanup(segvector* p) {
+  p->size = p->allocsize = 0;
+  lodepng_free(p->data);
+  p->data = NULL;
+}
+
+/*returns 1 if success, 0 if failure ==> nothing done*/
+static unsigned segvector_push_back(segvector* p, const unsigned char* data, size_t size) {
+  if(p->size == p->allocsize) {
+    size_t newsize = p->allocsize ? p->allocsize * 2 : 8;
+    void* buffer = lodepng_realloc(p->data, newsize * sizeof(LodePNGSegment));
+    if(!buffer) return 0;
+    p->data = (LodePNGSegment*)buffer;
+    p->allocsize = newsize;
+  }
+  p->data[p->size].data = data;
+  p->data[p->size].size = size;
+  ++p->size;
+  return 1;
+}
+#endif /*LODEPNG_COMPILE_PNG*/
+#endif /*LODEPNG_COMPILE_DECODER*/
+
 
 /* ////////////////////////////////////////////////////////////////////////// */
 
@@ -398,20 +535,116 @@ static void addBitsToStreamReversed(size_t* bitpointer, ucvector* bitstream, uns
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-#define READBIT(bitpointer, bitstream) ((bitstream[bitpointer >> 3] >> (bitpointer & 0x7)) & (unsigned char)1)
-
-static unsigned char readBitFromStream(size_t* bitpointer, const unsigned char* bitstream) {
-  unsigned char result = (unsigned char)(READBIT(*bitpointer, bitstream));
-  ++(*bitpointer);
-  return result;
+/*
+The inflater reads through a 64-bit buffer instead of bit by bit. ensureBits
+loads at least 56 bits starting at bp, enough for a length code, its extra
+bits, a distance code and its extra bits (15 + 5 + 15 + 13 bits); peekBits
+and advanceBits then only shift the buffer. Bytes past the end read as zero,
+so callers compare bp with bitsize to detect reading past the input.
+
+The input is a list of segments, read in place. bp counts over all of them;
+data is the segment holding the bytes last loaded, so the common case is a
+single bounds check against segend and the slow path only runs for the last
+few bytes of each segment.
+*/
+typedef struct LodePNGBitReader {
+  const LodePNGSegment* segments;
+  size_t numsegments;
+  LodePNGSegment single; /*the segment of contiguous input*/
+  size_t size; /*size of the whole input in bytes*/
+  size_t bitsize; /*size of the whole input in bits*/
+  size_t bp; /*current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
+  unsigned long long buffer; /*the bits from bp on, valid after ensureBits*/
+  size_t segment; /*index of the current segment*/
+  const unsigned char* data; /*data of the current segment*/
+  size_t segstart; /*offset of the current segment in the input*/
+  size_t segend; /*offset of the end of the current segment*/
+} LodePNGBitReader;
+
+static void LodePNGBitReader_initSegments(LodePNGBitReader* reader, const LodePNGSegment* segments,
+                                          size_t numsegments) {
+  size_t i;
+  reader->segments = segments;
+  reader->numsegments = numsegments;
+  reader->size = 0;
+  for(i = 0; i != numsegments; ++i) reader->size += segments[i].size;
+  reader->bitsize = reader->size * 8;
+  reader->bp = 0;
+  reader->buffer = 0;
+  reader->segment = 0;
+  reader->data = numsegments ? segments[0].data : 0;
+  reader->segstart = 0;
+  reader->segend = numsegments ? segments[0].size : 0;
+}
+
+static void LodePNGBitReader_init(LodePNGBitReader* reader, const unsigned char* data, size_t size) {
+  reader->single.data = data;
+  reader->single.size = size;
+  LodePNGBitReader_initSegments(reader, &reader->single, 1);
+}
+
+/*makes the segment holding byte pos current, segments are only ever walked forward*/
+static void seekSegment(LodePNGBitReader* reader, size_t pos) {
+  while(pos >= reader->segend && reader->segment + 1 < reader->numsegments) {
+    ++reader->segment;
+    reader->data = reader->segments[reader->segment].data;
+    reader->segstart = reader->segend;
+    reader->segend += reader->segments[reader->segment].size;
+  }
+}
+
+/*copies size bytes from byte pos on, across segment boundaries. They must be inside the input*/
+static void copyBytes(const LodePNGBitReader* reader, unsigned char* out, size_t pos, size_t size) {
+  size_t segment = reader->segment;
+  size_t segstart = reader->segstart;
+  if(pos < segstart) segment = segstart = 0;
+  while(size) {
+    size_t segsize = reader->segments[segment].size;
+    if(pos >= segstart + segsize) {
+      segstart += segsize;
+      ++segment;
+    } else {
+      size_t amount = LODEPNG_MIN(size, segstart + segsize - pos);
+      memcpy(out, reader->segments[segment].data + (pos - segstart), amount);
+      out += amount;
+      pos += amount;
+      size -= amount;
+    }
+  }
 }
 
-static unsigned readBitsFromStream(size_t* bitpointer, const unsigned char* bitstream, size_t nbits) {
-  unsigned result = 0, i;
-  for(i = 0; i != nbits; ++i) {
-    result += ((unsigned)READBIT(*bitpointer, bitstream)) << i;
-    ++(*bitpointer);
+static void ensureBits(LodePNGBitReader* reader) {
+  size_t start = reader->bp >> 3;
+  unsigned long long result = 0;
+  if(start + 8 > reader->segend) seekSegment(reader, start);
+  if(start + 8 <= reader->segend) {
+    const unsigned char* p = reader->data + (start - reader->segstart);
+    result = (unsigned long long)p[0] | ((unsigned long long)p[1] << 8) | ((unsigned long long)p[2] << 16)
+           | ((unsigned long long)p[3] << 24) | ((unsigned long long)p[4] << 32) | ((unsigned long long)p[5] << 40)
+           | ((unsigned long long)p[6] << 48) | ((unsigned long long)p[7] << 56);
+  } else if(start < reader->size) {
+    /*near the end of a segment or of the input*/
+    unsigned char bytes[8];
+    size_t i, n = LODEPNG_MIN(reader->size - start, (size_t)8);
+    copyBytes(reader, bytes, start, n);
+    for(i = 0; i != n; ++i) result |= (unsigned long long)bytes[i] << (8 * i);
   }
+  reader->buffer = result >> (reader->bp & 7u);
+}
+
+/*nbits must not exceed what the last ensureBits loaded and was not yet advanced over*/
+static unsigned peekBits(const LodePNGBitReader* reader, unsigned nbits) {
+  return (unsigned)(reader->buffer & (((unsigned long long)1 << nbits) - 1u));
+}
+
+static void advanceBits(LodePNGBitReader* reader, unsigned nbits) {
+  reader->buffer >>= nbits;
+  reader->bp += nbits;
+}
+
+static unsigned readBits(LodePNGBitReader* reader, unsigned nbits) {
+  unsigned result = peekBits(reader, nbits);
+  advanceBits(reader, nbits);
   return result;
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
@@ -460,11 +693,14 @@ static const unsigned CLCL_ORDER[NUM_CODE_LENGTH_CODES]
 Huffman tree struct, containing multiple representations of the tree
 */
 typedef struct HuffmanTree {
-  unsigned* tree2d;
   unsigned* tree1d;
   unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
   unsigned maxbitlen; /*maximum number of bits a single code can get*/
   unsigned numcodes; /*number of symbols in the alphabet = number of codes*/
+  /*decoder lookup tables, see HuffmanTree_makeTable*/
+  unsigned short* table_len; /*length of the code, or the longest code of the secondary table*/
+  unsigned short* table_value; /*the symbol, or the start of the secondary table*/
+  unsigned tablebits; /*number of bits looked up in the primary table*/
 } HuffmanTree;
 
 /*function used for debug purposes to draw the tree in ascii art with C++*/
@@ -479,68 +715,124 @@ static void HuffmanTree_draw(HuffmanTree* tree) {
 }*/
 
 static void HuffmanTree_init(HuffmanTree* tree) {
-  tree->tree2d = 0;
   tree->tree1d = 0;
   tree->lengths = 0;
+  tree->table_len = 0;
+  tree->table_value = 0;
+  tree->tablebits = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree) {
-  lodepng_free(tree->tree2d);
   lodepng_free(tree->tree1d);
   lodepng_free(tree->lengths);
+  lodepng_free(tree->table_len);
+  lodepng_free(tree->table_value);
 }
 
-/*the tree representation used by the decoder. return value is error*/
-static unsigned HuffmanTree_make2DTree(HuffmanTree* tree) {
-  unsigned nodefilled = 0; /*up to which node it is filled*/
-  unsigned treepos = 0; /*position in the tree (1 of the numcodes columns)*/
-  unsigned n, i;
-
-  tree->tree2d = (unsigned*)lodepng_malloc(tree->numcodes * 2 * sizeof(unsigned));
-  if(!tree->tree2d) return 83; /*alloc fail*/
+#ifdef LODEPNG_COMPILE_DECODER
+/*bits of the primary decoding table, longer codes continue in a secondary table*/
+#define FIRSTBITS 10u
+/*table_value of entries no code maps to*/
+#define INVALIDSYMBOL 65535u
+
+static unsigned reverseBits(unsigned bits, unsigned num) {
+  unsigned i, result = 0;
+  for(i = 0; i < num; ++i) result |= ((bits >> (num - i - 1u)) & 1u) << i;
+  return result;
+}
 
-  /*
-  convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means
-  uninited, a value >= numcodes is an address to another bit, a value < numcodes
-  is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as
-  many columns as codes - 1.
-  A good huffman tree has N * 2 - 1 nodes, of which N - 1 are internal nodes.
-  Here, the internal nodes are stored (what their 0 and 1 option point to).
-  There is only memory for such good tree currently, if there are more nodes
-  (due to too long length codes), error 55 will happen
-  */
-  for(n = 0; n < tree->numcodes * 2; ++n) {
-    tree->tree2d[n] = 32767; /*32767 here means the tree2d isn't filled there yet*/
-  }
-
-  for(n = 0; n < tree->numcodes; ++n) /*the codes*/ {
-    for(i = 0; i != tree->lengths[n]; ++i) /*the bits for this code*/ {
-      unsigned char bit = (unsigned char)((tree->tree1d[n] >> (tree->lengths[n] - i - 1)) & 1);
-      /*oversubscribed, see comment in lodepng_error_text*/
-      if(treepos > 2147483647 || treepos + 2 > tree->numcodes) return 55;
-      if(tree->tree2d[2 * treepos + bit] == 32767) /*not yet filled in*/ {
-        if(i + 1 == tree->lengths[n]) /*last bit*/ {
-          tree->tree2d[2 * treepos + bit] = n; /*put the current code in it*/
-          treepos = 0;
-        } else {
-          /*put address of the next step in here, first that address has to be found of course
-          (it's just nodefilled + 1)...*/
-          ++nodefilled;
-          /*addresses encoded with numcodes added to it*/
-          tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;
-          treepos = nodefilled;
-        }
+/*
+Builds the decoder tables, return value is error. Deflate sends the most
+significant bit of a code first, so the next input bits index the table with
+the code reversed. A code of length l <= tablebits fills every primary entry
+whose low l bits are that code. Longer codes share the primary entry of their
+first tablebits bits, which points to a secondary table indexed by the
+remaining bits and sized for the longest code with that prefix. Entries that
+no code reaches decode to INVALIDSYMBOL.
+*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree) {
+  unsigned maxlens[1u << FIRSTBITS];
+  unsigned long kraft = 0;
+  unsigned longest = 0, headsize, mask, i, n;
+  size_t size, pointer;
+
+  for(n = 0; n != tree->numcodes; ++n) {
+    unsigned l = tree->lengths[n];
+    if(l > 15) return 55; /*deflate codes are at most 15 bits*/
+    if(l) kraft += 1ul << (15u - l);
+    if(l > longest) longest = l;
+  }
+  /*oversubscribed, see comment in lodepng_error_text*/
+  if(kraft > (1ul << 15)) return 55;
+
+  tree->tablebits = LODEPNG_MIN(longest, FIRSTBITS);
+  headsize = 1u << tree->tablebits;
+  mask = headsize - 1u;
+
+  /*the longest code behind each primary entry decides its secondary table size*/
+  for(i = 0; i != headsize; ++i) maxlens[i] = 0;
+  for(n = 0; n != tree->numcodes; ++n) {
+    unsigned l = tree->lengths[n];
+    if(l <= tree->tablebits) continue;
+    i = reverseBits(tree->tree1d[n] >> (l - tree->tablebits), tree->tablebits);
+    maxlens[i] = LODEPNG_MAX(maxlens[i], l);
+  }
+  size = headsize;
+  for(i = 0; i != headsize; ++i) {
+    if(maxlens[i] > tree->tablebits) size += (size_t)1u << (maxlens[i] - tree->tablebits);
+  }
+
+  tree->table_len = (unsigned short*)lodepng_malloc(size * sizeof(unsigned short));
+  tree->table_value = (unsigned short*)lodepng_malloc(size * sizeof(unsigned short));
+  if(!tree->table_len || !tree->table_value) return 83; /*alloc fail*/
+
+  /*unused entries still consume their bits, so running out of input is noticed*/
+  pointer = headsize;
+  for(i = 0; i != headsize; ++i) {
+    unsigned l = maxlens[i];
+    tree->table_value[i] = INVALIDSYMBOL;
+    if(l <= tree->tablebits) {
+      tree->table_len[i] = (unsigned short)tree->tablebits;
+    } else {
+      size_t j, num = (size_t)1u << (l - tree->tablebits);
+      tree->table_len[i] = (unsigned short)l;
+      tree->table_value[i] = (unsigned short)pointer;
+      for(j = 0; j != num; ++j) {
+        tree->table_len[pointer + j] = (unsigned short)l;
+        tree->table_value[pointer + j] = INVALIDSYMBOL;
       }
-      else treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
+      pointer += num;
     }
   }
 
-  for(n = 0; n < tree->numcodes * 2; ++n) {
-    if(tree->tree2d[n] == 32767) tree->tree2d[n] = 0; /*remove possible remaining 32767's*/
+  for(n = 0; n != tree->numcodes; ++n) {
+    unsigned l = tree->lengths[n], reverse, j, num;
+    if(!l) continue;
+    reverse = reverseBits(tree->tree1d[n], l);
+    if(l <= tree->tablebits) {
+      num = 1u << (tree->tablebits - l);
+      for(j = 0; j != num; ++j) {
+        unsigned index = reverse | (j << l);
+        tree->table_len[index] = (unsigned short)l;
+        tree->table_value[index] = (unsigned short)n;
+      }
+    } else {
+      unsigned primary = reverse & mask;
+      unsigned tablelen = tree->table_len[primary] - tree->tablebits;
+      unsigned start = tree->table_value[primary];
+      unsigned rest = l - tree->tablebits;
+      num = 1u << (tablelen - rest);
+      for(j = 0; j != num; ++j) {
+        unsigned index = start + ((reverse >> tree->tablebits) | (j << rest));
+        tree->table_len[index] = (unsigned short)l;
+        tree->table_value[index] = (unsigned short)n;
+      }
+    }
   }
 
   return 0;
 }
+#endif /*LODEPNG_COMPILE_DECODER*/
 
 /*
 Second step for the ...makeFromLengths and ...makeFromFrequencies functions.
@@ -579,8 +871,10 @@ static unsigned HuffmanTree_makeFromLengths2(HuffmanTree* tree) {
   uivector_cleanup(&blcount);
   uivector_cleanup(&nextcode);
 
-  if(!error) return HuffmanTree_make2DTree(tree);
-  else return error;
+#ifdef LODEPNG_COMPILE_DECODER
+  if(!error) error = HuffmanTree_makeTable(tree);
+#endif /*LODEPNG_COMPILE_DECODER*/
+  return error;
 }
 
 /*
@@ -843,25 +1137,22 @@ static unsigned generateFixedDistanceTree(HuffmanTree* tree) {
 #ifdef LODEPNG_COMPILE_DECODER
 
 /*
-returns the code, or (unsigned)(-1) if error happened
-inbitlength is the length of the complete buffer, in bits (so its byte length times 8)
+Decodes one symbol with at most two table lookups, ensureBits must have been
+called with at least 15 bits left. Returns INVALIDSYMBOL for codes the tree
+does not contain.
 */
-static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
-                                    const HuffmanTree* codetree, size_t inbitlength) {
-  unsigned treepos = 0, ct;
-  for(;;) {
-    if(*bp >= inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
-    /*
-    decode the symbol from the tree. The "readBitFromStream" code is inlined in
-    the expression below because this is the biggest bottleneck while decoding
-    */
-    ct = codetree->tree2d[(treepos << 1) + READBIT(*bp, in)];
-    ++(*bp);
-    if(ct < codetree->numcodes) return ct; /*the symbol is decoded, return it*/
-    else treepos = ct - codetree->numcodes; /*symbol not yet decoded, instead move tree position*/
-
-    if(treepos >= codetree->numcodes) return (unsigned)(-1); /*error: it appeared outside the codetree*/
-  }
+static unsigned huffmanDecodeSymbol(LodePNGBitReader* reader, const HuffmanTree* codetree) {
+  unsigned index = peekBits(reader, codetree->tablebits);
+  unsigned l = codetree->table_len[index];
+  unsigned value = codetree->table_value[index];
+  if(l <= codetree->tablebits) {
+    advanceBits(reader, l);
+    return value;
+  }
+  advanceBits(reader, codetree->tablebits);
+  index = value + peekBits(reader, l - codetree->tablebits);
+  advanceBits(reader, codetree->table_len[index] - codetree->tablebits);
+  return codetree->table_value[index];
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -871,20 +1162,46 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
 /* / Inflator (Decompressor)                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
+/*deflate distances reach at most this far back*/
+#define INFLATE_WINDOW 32768u
+
+/*
+Streaming output for the inflator. Without a sink, everything is inflated into one
+buffer. With a sink, the out buffer is a fixed window: when it fills up, the new bytes
+are handed to consume and only the last INFLATE_WINDOW bytes are kept for back
+references.
+*/
+typedef struct LodePNGInflateSink {
+  /*receives all output bytes in order, data is only valid during the call. A nonzero
+  return value stops inflating and is returned as error*/
+  unsigned (*consume)(void* user, const unsigned char* data, size_t size);
+  void* user;
+  size_t consumed; /*bytes at the start of the window that consume already saw*/
+} LodePNGInflateSink;
+
+static unsigned flushInflateWindow(ucvector* out, size_t* pos, LodePNGInflateSink* sink) {
+  size_t keep = LODEPNG_MIN(*pos, (size_t)INFLATE_WINDOW);
+  unsigned error = sink->consume(sink->user, out->data + sink->consumed, *pos - sink->consumed);
+  if(error) return error;
+  memmove(out->data, out->data + *pos - keep, keep);
+  *pos = keep;
+  sink->consumed = keep;
+  return 0;
+}
+
 /*get the tree of a deflated block with fixed tree, as specified in the deflate specification*/
-static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d) {
-  /*TODO: check for out of memory errors*/
-  generateFixedLitLenTree(tree_ll);
-  generateFixedDistanceTree(tree_d);
+static unsigned getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d) {
+  unsigned error = generateFixedLitLenTree(tree_ll);
+  if(error) return error;
+  return generateFixedDistanceTree(tree_d);
 }
 
 /*get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
 static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
-                                      const unsigned char* in, size_t* bp, size_t inlength) {
+                                      LodePNGBitReader* reader) {
   /*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated*/
   unsigned error = 0;
   unsigned n, HLIT, HDIST, HCLEN, i;
-  size_t inbitlength = inlength * 8;
 
   /*see comments in deflateDynamic for explanation of the context and these variables, it is analogous*/
   unsigned* bitlen_ll = 0; /*lit,len code lengths*/
@@ -893,16 +1210,17 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   unsigned* bitlen_cl = 0;
   HuffmanTree tree_cl; /*the code tree for code length codes (the huffman tree for compressed huffman trees)*/
 
-  if((*bp) + 14 > (inlength << 3)) return 49; /*error: the bit pointer is or will go past the memory*/
+  if(reader->bp + 14 > reader->bitsize) return 49; /*error: the bit pointer is or will go past the memory*/
+  ensureBits(reader);
 
   /*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already*/
-  HLIT =  readBitsFromStream(bp, in, 5) + 257;
+  HLIT =  readBits(reader, 5) + 257;
   /*number of distance codes. Unlike the spec, the value 1 is added to it here already*/
-  HDIST = readBitsFromStream(bp, in, 5) + 1;
+  HDIST = readBits(reader, 5) + 1;
   /*number of code length codes. Unlike the spec, the value 4 is added to it here already*/
-  HCLEN = readBitsFromStream(bp, in, 4) + 4;
+  HCLEN = readBits(reader, 4) + 4;
 
-  if((*bp) + HCLEN * 3 > (inlength << 3)) return 50; /*error: the bit pointer is or will go past the memory*/
+  if(reader->bp + HCLEN * 3 > reader->bitsize) return 50; /*error: the bit pointer is or will go past the memory*/
 
   HuffmanTree_init(&tree_cl);
 
@@ -913,7 +1231,8 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     if(!bitlen_cl) ERROR_BREAK(83 /*alloc fail*/);
 
     for(i = 0; i != NUM_CODE_LENGTH_CODES; ++i) {
-      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = readBitsFromStream(bp, in, 3);
+      if(i % 16 == 0) ensureBits(reader);
+      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = readBits(reader, 3);
       else bitlen_cl[CLCL_ORDER[i]] = 0; /*if not, it must stay 0*/
     }
 
@@ -930,7 +1249,10 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     /*i is the current symbol we're reading in the part that contains the code lengths of lit/len and dist codes*/
     i = 0;
     while(i < HLIT + HDIST) {
-      unsigned code = huffmanDecodeSymbol(in, bp, &tree_cl, inbitlength);
+      unsigned code;
+      ensureBits(reader); /*a code of at most 7 bits and at most 7 extra bits*/
+      code = huffmanDecodeSymbol(reader, &tree_cl);
+      if(reader->bp > reader->bitsize) ERROR_BREAK(10); /*error: end of input memory reached without endcode*/
       if(code <= 15) /*a length code*/ {
         if(i < HLIT) bitlen_ll[i] = code;
         else bitlen_d[i - HLIT] = code;
@@ -941,8 +1263,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
         if(i == 0) ERROR_BREAK(54); /*can't repeat previous if i is 0*/
 
-        if((*bp + 2) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 2);
+        replength += readBits(reader, 2);
 
         if(i < HLIT + 1) value = bitlen_ll[i - 1];
         else value = bitlen_d[i - HLIT - 1];
@@ -955,8 +1276,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
         }
       } else if(code == 17) /*repeat "0" 3-10 times*/ {
         unsigned replength = 3; /*read in the bits that indicate repeat length*/
-        if((*bp + 3) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 3);
+        replength += readBits(reader, 3);
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; ++n) {
@@ -968,8 +1288,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
         }
       } else if(code == 18) /*repeat "0" 11-138 times*/ {
         unsigned replength = 11; /*read in the bits that indicate repeat length*/
-        if((*bp + 7) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 7);
+        replength += readBits(reader, 7);
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; ++n) {
@@ -979,15 +1298,10 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
           else bitlen_d[i - HLIT] = 0;
           ++i;
         }
-      } else /*if(code == (unsigned)(-1))*/ /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/ {
-        if(code == (unsigned)(-1)) {
-          /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
-          (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inbitlength ? 10 : 11;
-        }
-        else error = 16; /*unexisting code, this can never happen*/
-        break;
+      } else /*INVALIDSYMBOL*/ {
+        ERROR_BREAK(11); /*error: a code the tree does not contain*/
       }
+      if(reader->bp > reader->bitsize) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
     }
     if(error) break;
 
@@ -1010,27 +1324,35 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 }
 
 /*inflate a block with dynamic of fixed Huffman tree*/
-static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size_t* bp,
-                                    size_t* pos, size_t inlength, unsigned btype) {
+static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
+                                    size_t* pos, unsigned btype, LodePNGInflateSink* sink) {
   unsigned error = 0;
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
   HuffmanTree tree_d; /*the huffman tree for distance codes*/
-  size_t inbitlength = inlength * 8;
 
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
 
-  if(btype == 1) getTreeInflateFixed(&tree_ll, &tree_d);
-  else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, in, bp, inlength);
+  if(btype == 1) error = getTreeInflateFixed(&tree_ll, &tree_d);
+  else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
 
   while(!error) /*decode all symbols until end reached, breaks at end code*/ {
+    unsigned code_ll;
+    /*out->size runs ahead of pos so there is room for the longest match without a resize per symbol*/
+    if((*pos) + 258 > out->size) {
+      if(sink && (*pos) + 258 > out->allocsize) error = flushInflateWindow(out, pos, sink);
+      else if(!sink && !ucvector_reserve(out, (*pos) + 258)) error = 83; /*alloc fail*/
+      if(error) break;
+      out->size = out->allocsize;
+    }
+
+    /*one load covers a length code, its extra bits, a distance code and its extra bits*/
+    ensureBits(reader);
     /*code_ll is literal, length or end code*/
-    unsigned code_ll = huffmanDecodeSymbol(in, bp, &tree_ll, inbitlength);
+    code_ll = huffmanDecodeSymbol(reader, &tree_ll);
+    if(reader->bp > reader->bitsize) ERROR_BREAK(10); /*error: end of input memory reached without endcode*/
     if(code_ll <= 255) /*literal symbol*/ {
-      /*ucvector_push_back would do the same, but for some reason the two lines below run 10% faster*/
-      if(!ucvector_resize(out, (*pos) + 1)) ERROR_BREAK(83 /*alloc fail*/);
-      out->data[*pos] = (unsigned char)code_ll;
-      ++(*pos);
+      out->data[(*pos)++] = (unsigned char)code_ll;
     } else if(code_ll >= FIRST_LENGTH_CODE_INDEX && code_ll <= LAST_LENGTH_CODE_INDEX) /*length code*/ {
       unsigned code_d, distance;
       unsigned numextrabits_l, numextrabits_d; /*extra bits for length and distance*/
@@ -1041,16 +1363,14 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
 
       /*part 2: get extra bits and add the value of that to length*/
       numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
-      if((*bp + numextrabits_l) > inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      length += readBitsFromStream(bp, in, numextrabits_l);
+      length += readBits(reader, numextrabits_l);
 
       /*part 3: get distance code*/
-      code_d = huffmanDecodeSymbol(in, bp, &tree_d, inbitlength);
+      code_d = huffmanDecodeSymbol(reader, &tree_d);
       if(code_d > 29) {
-        if(code_d == (unsigned)(-1)) /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/ {
-          /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
-          (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inlength * 8 ? 10 : 11;
+        if(code_d == INVALIDSYMBOL) {
+          /*return error code 10 or 11 depending on whether the input ran out (10=no endcode, 11=invalid code)*/
+          error = reader->bp > reader->bitsize ? 10 : 11;
         }
         else error = 18; /*error: invalid distance code (30-31 are never used)*/
         break;
@@ -1059,15 +1379,14 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
 
       /*part 4: get extra bits from distance*/
       numextrabits_d = DISTANCEEXTRA[code_d];
-      if((*bp + numextrabits_d) > inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      distance += readBitsFromStream(bp, in, numextrabits_d);
+      distance += readBits(reader, numextrabits_d);
+      if(reader->bp > reader->bitsize) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
 
       /*part 5: fill in all the out[n] values based on the length and dist*/
       start = (*pos);
       if(distance > start) ERROR_BREAK(52); /*too long backward distance*/
       backward = start - distance;
 
-      if(!ucvector_resize(out, (*pos) + length)) ERROR_BREAK(83 /*alloc fail*/);
       if (distance < length) {
         for(forward = 0; forward < length; ++forward) {
           out->data[(*pos)++] = out->data[backward++];
@@ -1078,13 +1397,11 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
       }
     } else if(code_ll == 256) {
       break; /*end code, break the loop*/
-    } else /*if(code == (unsigned)(-1))*/ /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/ {
-      /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
-      (10=no endcode, 11=wrong jump outside of tree)*/
-      error = ((*bp) > inlength * 8) ? 10 : 11;
-      break;
+    } else /*INVALIDSYMBOL, or the unused codes 286 and 287*/ {
+      ERROR_BREAK(11); /*error: a code the tree does not contain*/
     }
   }
+  if(!sink) out->size = *pos;
 
   HuffmanTree_cleanup(&tree_ll);
   HuffmanTree_cleanup(&tree_d);
@@ -1092,61 +1409,93 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   return error;
 }
 
-static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength) {
+static unsigned inflateNoCompression(ucvector* out, LodePNGBitReader* reader, size_t* pos,
+                                     LodePNGInflateSink* sink) {
   size_t p;
-  unsigned LEN, NLEN, n, error = 0;
+  unsigned LEN, NLEN, error = 0;
+  unsigned char header[4];
 
   /*go to first boundary of byte*/
-  while(((*bp) & 0x7) != 0) ++(*bp);
-  p = (*bp) / 8; /*byte position*/
+  p = (reader->bp + 7u) >> 3; /*byte position*/
 
   /*read LEN (2 bytes) and NLEN (2 bytes)*/
-  if(p + 4 >= inlength) return 52; /*error, bit pointer will jump past memory*/
-  LEN = in[p] + 256u * in[p + 1]; p += 2;
-  NLEN = in[p] + 256u * in[p + 1]; p += 2;
+  if(p + 4 > reader->size) return 52; /*error, bit pointer will jump past memory*/
+  seekSegment(reader, p);
+  copyBytes(reader, header, p, 4);
+  LEN = header[0] + 256u * header[1];
+  NLEN = header[2] + 256u * header[3];
+  p += 4;
 
   /*check if 16-bit NLEN is really the one's complement of LEN*/
   if(LEN + NLEN != 65535) return 21; /*error: NLEN is not one's complement of LEN*/
 
-  if(!ucvector_resize(out, (*pos) + LEN)) return 83; /*alloc fail*/
-
   /*read the literal data: LEN bytes are now stored in the out buffer*/
-  if(p + LEN > inlength) return 23; /*error: reading outside of in buffer*/
-  for(n = 0; n < LEN; ++n) out->data[(*pos)++] = in[p++];
+  if(p + LEN > reader->size) return 23; /*error: reading outside of in buffer*/
+  if(sink) {
+    /*a stored block can be twice the window, copy it in as many pieces as needed*/
+    while(LEN) {
+      size_t amount;
+      if(*pos == out->allocsize) {
+        error = flushInflateWindow(out, pos, sink);
+        if(error) return error;
+      }
+      amount = LODEPNG_MIN((size_t)LEN, out->allocsize - *pos);
+      seekSegment(reader, p);
+      copyBytes(reader, out->data + *pos, p, amount);
+      (*pos) += amount;
+      p += amount;
+      LEN -= (unsigned)amount;
+    }
+  } else {
+    if(!ucvector_resize(out, (*pos) + LEN)) return 83; /*alloc fail*/
+    seekSegment(reader, p);
+    copyBytes(reader, out->data + *pos, p, LEN);
+    (*pos) += LEN;
+    p += LEN;
+  }
 
-  (*bp) = p * 8;
+  reader->bp = p * 8;
 
   return error;
 }
 
-static unsigned lodepng_inflatev(ucvector* out,
-                                 const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings) {
-  /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
-  size_t bp = 0;
+/*inflates the deflate data from reader's bp on up to the final block. With partial, the data may also
+end without a final block where the reader's input ends*/
+static unsigned inflatev(ucvector* out, LodePNGBitReader* reader, LodePNGInflateSink* sink, unsigned partial) {
   unsigned BFINAL = 0;
   size_t pos = 0; /*byte position in the out buffer*/
   unsigned error = 0;
 
-  (void)settings;
+  /*the window plus room for two stored blocks' worth of output between flushes*/
+  if(sink && !ucvector_reserve(out, INFLATE_WINDOW * 3)) return 83; /*alloc fail*/
 
-  while(!BFINAL) {
+  while(!BFINAL && !(partial && reader->bp == reader->bitsize)) {
     unsigned BTYPE;
-    if(bp + 2 >= insize * 8) return 52; /*error, bit pointer will jump past memory*/
-    BFINAL = readBitFromStream(&bp, in);
-    BTYPE = 1u * readBitFromStream(&bp, in);
-    BTYPE += 2u * readBitFromStream(&bp, in);
+    if(reader->bp + 2 >= reader->bitsize) return 52; /*error, bit pointer will jump past memory*/
+    ensureBits(reader);
+    BFINAL = readBits(reader, 1);
+    BTYPE = readBits(reader, 2);
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-    else if(BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize); /*no compression*/
-    else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, reader, &pos, sink); /*no compression*/
+    else error = inflateHuffmanBlock(out, reader, &pos, BTYPE, sink); /*compression, BTYPE 01 or 10*/
 
     if(error) return error;
   }
 
+  if(sink) error = sink->consume(sink->user, out->data + sink->consumed, pos - sink->consumed);
   return error;
 }
 
+static unsigned lodepng_inflatev(ucvector* out,
+                                 const unsigned char* in, size_t insize,
+                                 const LodePNGDecompressSettings* settings) {
+  LodePNGBitReader reader;
+  (void)settings;
+  LodePNGBitReader_init(&reader, in, insize);
+  return inflatev(out, &reader, 0, 0);
+}
+
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGDecompressSettings* settings) {
@@ -1234,10 +1583,28 @@ typedef struct Hash {
   int* headz; /*similar to head, but for chainz*/
   unsigned short* chainz; /*those with same amount of zeros*/
   unsigned short* zeros; /*length of zeros streak, used as a second hash chain*/
+
+  /*only for the compression levels, which use these instead of all the above*/
+  unsigned* head4; /*4 byte hash value to the last position with it + 1, 0 if none*/
+  unsigned* prev4; /*position & 32767 to the previous position + 1 with the same hash value*/
 } Hash;
 
-static unsigned hash_init(Hash* hash, unsigned windowsize) {
+/*bits of the 4 byte hash of the compression levels*/
+#define HASH4_BITS 15u
+
+static unsigned hash_init(Hash* hash, unsigned windowsize, unsigned level) {
   unsigned i;
+  if(level) {
+    hash->head = hash->val = hash->headz = 0;
+    hash->chain = hash->chainz = hash->zeros = 0;
+    hash->head4 = (unsigned*)lodepng_malloc(sizeof(unsigned) << HASH4_BITS);
+    hash->prev4 = (unsigned*)lodepng_malloc(sizeof(unsigned) * 32768);
+    if(!hash->head4 || !hash->prev4) return 83; /*alloc fail*/
+    /*prev4 is only read through head4, at positions that were written*/
+    for(i = 0; i != (1u << HASH4_BITS); ++i) hash->head4[i] = 0;
+    return 0;
+  }
+  hash->head4 = hash->prev4 = 0;
   hash->head = (int*)lodepng_malloc(sizeof(int) * HASH_NUM_VALUES);
   hash->val = (int*)lodepng_malloc(sizeof(int) * windowsize);
   hash->chain = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
@@ -1269,6 +1636,9 @@ static void hash_cleanup(Hash* hash) {
   lodepng_free(hash->zeros);
   lodepng_free(hash->headz);
   lodepng_free(hash->chainz);
+
+  lodepng_free(hash->head4);
+  lodepng_free(hash->prev4);
 }
 
 
@@ -1471,9 +1841,167 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   return error;
 }
 
+/*
+The compression levels use the parameters of zlib's levels with a matcher of their own. Its
+hash is a multiplication of 4 bytes, which spreads the filtered bytes of PNGs well enough that
+the zero runs need no chain of their own, and there is one chain through the whole 32K window,
+walked to a depth that depends on the level. Levels 1 to 3 take the first match they find, 4 to 9
+also try the next position. Positions are kept as 32-bit numbers, so that is the input limit.
+*/
+typedef struct LZ77Level {
+  unsigned short good; /*only walk a quarter of the chain after a match this long*/
+  unsigned short lazy; /*lazy: no search after a match this long, greedy: longer matches are not hashed*/
+  unsigned short nice; /*stop searching at a match this long*/
+  unsigned short chain; /*the most chain positions to try*/
+} LZ77Level;
+
+static const LZ77Level LZ77_LEVELS[10] = {
+  {0, 0, 0, 0}, /*level 0 is encodeLZ77*/
+  {4, 4, 8, 4}, {4, 5, 16, 8}, {4, 6, 32, 32},
+  {4, 4, 16, 16}, {8, 16, 32, 32}, {8, 16, 128, 128},
+  {8, 32, 128, 256}, {32, 128, 258, 1024}, {32, 258, 258, 4096}
+};
+
+static unsigned getHash4(const unsigned char* data) {
+  unsigned value = data[0] | ((unsigned)data[1] << 8u) | ((unsigned)data[2] << 16u) | ((unsigned)data[3] << 24u);
+  return ((value * 2654435761u) & 0xffffffffu) >> (32u - HASH4_BITS);
+}
+
+/*puts the positions from start to end in the chain, as far as they have 4 bytes*/
+static void hash4_insert(Hash* hash, const unsigned char* in, size_t start, size_t end, size_t insize) {
+  size_t pos;
+  if(insize < 4) return;
+  if(end > insize - 3) end = insize - 3;
+  for(pos = start; pos < end; ++pos) {
+    unsigned hashval = getHash4(&in[pos]);
+    hash->prev4[pos & 32767u] = hash->head4[hashval];
+    hash->head4[hashval] = (unsigned)pos + 1u;
+  }
+}
+
+#ifdef LODEPNG_CTZ64
+static unsigned ctz64(unsigned long long value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctzll(value);
+#endif
+}
+#endif /*LODEPNG_CTZ64*/
+
+/*the amount of equal bytes at match and scan, up to end. match comes before scan*/
+static unsigned matchLength(const unsigned char* match, const unsigned char* scan, const unsigned char* end) {
+  const unsigned char* start = scan;
+#ifdef LODEPNG_CTZ64
+  while(end - scan >= 8) {
+    unsigned long long a, b;
+    memcpy(&a, match, 8);
+    memcpy(&b, scan, 8);
+    if(a != b) return (unsigned)(scan - start) + ctz64(a ^ b) / 8u;
+    match += 8;
+    scan += 8;
+  }
+#endif /*LODEPNG_CTZ64*/
+  while(scan != end && *match == *scan) {
+    ++match;
+    ++scan;
+  }
+  return (unsigned)(scan - start);
+}
+
+/*the longest match for pos among at most chain positions before it, 0 if none. pos must
+have 4 bytes and not be in the chain yet*/
+static unsigned longestMatch(const Hash* hash, const unsigned char* in, size_t pos, size_t insize,
+                             unsigned chain, unsigned nice, unsigned* distance) {
+  const unsigned char* scan = &in[pos];
+  const unsigned char* end = &in[LODEPNG_MIN(insize, pos + MAX_SUPPORTED_DEFLATE_LENGTH)];
+  size_t limit = pos > 32768 ? pos - 32768 : 0;
+  unsigned length = 0;
+  unsigned next = hash->head4[getHash4(scan)];
+  if(nice > (unsigned)(end - scan)) nice = (unsigned)(end - scan);
+
+  /*the chain only goes back, and positions older than the window are not followed, so
+  the slots of prev4 that were reused by newer positions are never reached*/
+  while(next != 0 && next - 1u >= limit && chain-- != 0) {
+    size_t candidate = next - 1u;
+    const unsigned char* match = &in[candidate];
+    /*a longer match also has to agree at the byte after the current best*/
+    if(match[length] == scan[length]) {
+      unsigned current = matchLength(match, scan, end);
+      if(current > length) {
+        length = current;
+        *distance = (unsigned)(pos - candidate);
+        if(length >= nice) break;
+      }
+    }
+    next = hash->prev4[candidate & 32767u];
+  }
+  return length;
+}
+
+/*LZ77-encodes like encodeLZ77, with the parameters of a compression level from 1 to 9*/
+static unsigned encodeLZ77Level(uivector* out, Hash* hash, const unsigned char* in, size_t inpos, size_t insize,
+                                unsigned level) {
+  const LZ77Level* params = &LZ77_LEVELS[level];
+  unsigned greedy = level <= 3;
+  size_t pos = inpos;
+  unsigned prevlength = 0, prevdistance = 0, pending = 0;
+
+  while(pos < insize) {
+    unsigned length = 0, distance = 0;
+    if(pos + 4 <= insize) {
+      if(greedy || prevlength < params->lazy) {
+        unsigned chain = params->chain;
+        if(!greedy && prevlength >= params->good) chain >>= 2u;
+        length = longestMatch(hash, in, pos, insize, chain, params->nice, &distance);
+        /*longer distances have more extra bits, 3 literals are cheaper than a far match of 3*/
+        if(length == 3 && distance > 4096) length = 0;
+      }
+      hash4_insert(hash, in, pos, pos + 1, insize);
+    }
+
+    if(greedy) {
+      if(length >= 3) {
+        addLengthDistance(out, length, distance);
+        if(length <= params->lazy) hash4_insert(hash, in, pos + 1, pos + length, insize);
+        pos += length;
+      } else {
+        if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+        ++pos;
+      }
+    } else if(prevlength >= 3 && length <= prevlength) {
+      /*the match of the previous position is at least as good, the positions up to pos are hashed*/
+      addLengthDistance(out, prevlength, prevdistance);
+      hash4_insert(hash, in, pos + 1, pos - 1 + prevlength, insize);
+      pos += prevlength - 1;
+      prevlength = 0;
+      pending = 0;
+    } else {
+      /*the previous position becomes a literal, this one waits for the next*/
+      if(pending && !uivector_push_back(out, in[pos - 1])) return 83; /*alloc fail*/
+      prevlength = length;
+      prevdistance = distance;
+      pending = 1;
+      ++pos;
+    }
+  }
+  /*a match of the last position can't be longer than 1*/
+  if(pending && !uivector_push_back(out, in[pos - 1])) return 83; /*alloc fail*/
+  return 0;
+}
+
+static unsigned encodeLZ77Settings(uivector* out, Hash* hash, const unsigned char* in, size_t inpos, size_t insize,
+                                   const LodePNGCompressSettings* settings) {
+  if(settings->level) return encodeLZ77Level(out, hash, in, inpos, insize, settings->level);
+  return encodeLZ77(out, hash, in, inpos, insize, settings->windowsize,
+                    settings->minmatch, settings->nicematch, settings->lazymatching);
+}
+
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize) {
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize, unsigned final) {
   /*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
   2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
 
@@ -1483,7 +2011,7 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
     unsigned BFINAL, BTYPE, LEN, NLEN;
     unsigned char firstbyte;
 
-    BFINAL = (i == numdeflateblocks - 1);
+    BFINAL = final && (i == numdeflateblocks - 1);
     BTYPE = 0;
 
     firstbyte = (unsigned char)(BFINAL + ((BTYPE & 1) << 1) + ((BTYPE & 2) << 1));
@@ -1596,8 +2124,7 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   allow breaking out of it to the cleanup phase on error conditions.*/
   while(!error) {
     if(settings->use_lz77) {
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      error = encodeLZ77Settings(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(error) break;
     } else {
       if(!uivector_resize(&lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
@@ -1785,8 +2312,7 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   if(settings->use_lz77) /*LZ77 encoded*/ {
     uivector lz77_encoded;
     uivector_init(&lz77_encoded);
-    error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                       settings->minmatch, settings->nicematch, settings->lazymatching);
+    error = encodeLZ77Settings(&lz77_encoded, hash, data, datapos, dataend, settings);
     if(!error) writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
     uivector_cleanup(&lz77_encoded);
   } else /*no LZ77, but still will be Huffman compressed*/ {
@@ -1804,41 +2330,91 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings) {
+/*puts the positions from start to end in the hash chains without encoding them, so that
+the data after end can refer back to them*/
+static void hash_prime(Hash* hash, const unsigned char* in, size_t start, size_t end, size_t insize,
+                       unsigned windowsize, unsigned level) {
+  size_t pos;
+  unsigned numzeros = 0;
+  if(level) {
+    hash4_insert(hash, in, start, end, insize);
+    return;
+  }
+  for(pos = start; pos < end; ++pos) {
+    unsigned hashval = getHash(in, insize, pos);
+    if(hashval == 0) {
+      if(numzeros == 0) numzeros = countZeros(in, insize, pos);
+      else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
+    } else {
+      numzeros = 0;
+    }
+    updateHashChain(hash, pos & (windowsize - 1), hashval, (unsigned short)numzeros);
+  }
+}
+
+/*deflates in[start..insize), in[0..start) is history that matches may refer to. Unless final,
+the output ends with a sync flush, an empty stored block, so that it ends at a byte boundary
+and more deflate data can be appended to it*/
+static unsigned deflatev(ucvector* out, const unsigned char* in, size_t start, size_t insize,
+                         unsigned final, const LodePNGCompressSettings* settings) {
   unsigned error = 0;
   size_t i, blocksize, numdeflateblocks;
+  size_t datasize = insize - start;
   size_t bp = 0; /*the bit pointer*/
+  /*the compression levels always use the whole window*/
+  unsigned windowsize = settings->level ? 32768 : settings->windowsize;
   Hash hash;
 
+  if(start > insize) return 60; /*error: history larger than the input*/
   if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
-  else if(settings->btype == 1) blocksize = insize;
+  if(settings->level > 9) return 105;
+  if(settings->level && insize > 0xffffffffu) return 106;
+  else if(settings->btype == 0) return deflateNoCompression(out, in + start, datasize, final);
+  else if(settings->btype == 1) blocksize = datasize;
   else /*if(settings->btype == 2)*/ {
     /*on PNGs, deflate blocks of 65-262k seem to give most dense encoding*/
-    blocksize = insize / 8 + 8;
+    blocksize = datasize / 8 + 8;
     if(blocksize < 65536) blocksize = 65536;
     if(blocksize > 262144) blocksize = 262144;
   }
 
-  numdeflateblocks = (insize + blocksize - 1) / blocksize;
+  numdeflateblocks = (datasize + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
-  error = hash_init(&hash, settings->windowsize);
-  if(error) return error;
+  error = hash_init(&hash, windowsize, settings->level);
+  if(error) {
+    hash_cleanup(&hash);
+    return error;
+  }
+
+  if(start && settings->use_lz77) {
+    /*the window only reaches back windowsize bytes, older history can't be referred to*/
+    hash_prime(&hash, in, start - LODEPNG_MIN(start, (size_t)windowsize), start, insize,
+               windowsize, settings->level);
+  }
 
   for(i = 0; i != numdeflateblocks && !error; ++i) {
-    unsigned final = (i == numdeflateblocks - 1);
-    size_t start = i * blocksize;
-    size_t end = start + blocksize;
-    if(end > insize) end = insize;
+    unsigned last = (i == numdeflateblocks - 1);
+    size_t blockstart = start + i * blocksize;
+    size_t blockend = blockstart + blocksize;
+    if(blockend > insize) blockend = insize;
 
-    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, blockstart, blockend, settings, final && last);
+    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, blockstart, blockend, settings, final && last);
   }
 
   hash_cleanup(&hash);
 
+  if(!error && !final) {
+    addBitToStream(&bp, out, 0); /*BFINAL*/
+    addBitToStream(&bp, out, 0); /*BTYPE 00, the rest of the byte is padding*/
+    addBitToStream(&bp, out, 0);
+    ucvector_push_back(out, 0); /*LEN 0*/
+    ucvector_push_back(out, 0);
+    ucvector_push_back(out, 255); /*NLEN*/
+    ucvector_push_back(out, 255);
+  }
+
   return error;
 }
 
@@ -1848,7 +2424,7 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
   unsigned error;
   ucvector v;
   ucvector_init_buffer(&v, *out, *outsize);
-  error = lodepng_deflatev(&v, in, insize, settings);
+  error = deflatev(&v, in, 0, insize, 1, settings);
   *out = v.data;
   *outsize = v.size;
   return error;
@@ -1870,7 +2446,7 @@ static unsigned deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                  */
 /* ////////////////////////////////////////////////////////////////////////// */
 
-static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len) {
+static unsigned update_adler32C(unsigned adler, const unsigned char* data, unsigned len) {
   unsigned s1 = adler & 0xffff;
   unsigned s2 = (adler >> 16) & 0xffff;
 
@@ -1890,20 +2466,131 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
   return (s2 << 16) | s1;
 }
 
+#ifdef LODEPNG_SIMD_X86
+/*
+The SIMD versions sum 32 bytes per step: s1 gets the byte sums, s2 the bytes weighted 32
+down to 1, plus 32 times s1 as it was before the step, which is summed in ps and added
+once per 5536 bytes, the most before the sums must be reduced, as in the C version.
+*/
+#define ADLER32_STEPS (5552 / 32)
+
+LODEPNG_TARGET_SSSE3
+static unsigned update_adler32SSSE3(unsigned adler, const unsigned char* data, unsigned len) {
+  unsigned s1 = adler & 0xffff;
+  unsigned s2 = (adler >> 16) & 0xffff;
+  const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+
+  while(len >= 32) {
+    unsigned steps = len / 32 > ADLER32_STEPS ? ADLER32_STEPS : len / 32;
+    __m128i ps = _mm_cvtsi32_si128((int)(s1 * steps));
+    __m128i v1 = zero;
+    __m128i v2 = _mm_cvtsi32_si128((int)s2);
+    len -= steps * 32;
+    while(steps > 0) {
+      __m128i a = _mm_loadu_si128((const __m128i*)data);
+      __m128i b = _mm_loadu_si128((const __m128i*)(data + 16));
+      ps = _mm_add_epi32(ps, v1);
+      v1 = _mm_add_epi32(v1, _mm_sad_epu8(a, zero));
+      v2 = _mm_add_epi32(v2, _mm_madd_epi16(_mm_maddubs_epi16(a, tap1), ones));
+      v1 = _mm_add_epi32(v1, _mm_sad_epu8(b, zero));
+      v2 = _mm_add_epi32(v2, _mm_madd_epi16(_mm_maddubs_epi16(b, tap2), ones));
+      data += 32;
+      --steps;
+    }
+    v2 = _mm_add_epi32(v2, _mm_slli_epi32(ps, 5));
+    v1 = _mm_add_epi32(v1, _mm_shuffle_epi32(v1, _MM_SHUFFLE(2, 3, 0, 1)));
+    v1 = _mm_add_epi32(v1, _mm_shuffle_epi32(v1, _MM_SHUFFLE(1, 0, 3, 2)));
+    v2 = _mm_add_epi32(v2, _mm_shuffle_epi32(v2, _MM_SHUFFLE(2, 3, 0, 1)));
+    v2 = _mm_add_epi32(v2, _mm_shuffle_epi32(v2, _MM_SHUFFLE(1, 0, 3, 2)));
+    s1 = (s1 + (unsigned)_mm_cvtsi128_si32(v1)) % 65521;
+    s2 = (unsigned)_mm_cvtsi128_si32(v2) % 65521;
+  }
+  return update_adler32C((s2 << 16) | s1, data, len);
+}
+
+LODEPNG_TARGET_AVX2
+static unsigned update_adler32AVX2(unsigned adler, const unsigned char* data, unsigned len) {
+  unsigned s1 = adler & 0xffff;
+  unsigned s2 = (adler >> 16) & 0xffff;
+  const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                       16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi16(1);
+
+  while(len >= 32) {
+    unsigned steps = len / 32 > ADLER32_STEPS ? ADLER32_STEPS : len / 32;
+    __m256i ps = _mm256_setr_epi32((int)(s1 * steps), 0, 0, 0, 0, 0, 0, 0);
+    __m256i v1 = zero;
+    __m256i v2 = _mm256_setr_epi32((int)s2, 0, 0, 0, 0, 0, 0, 0);
+    __m128i h1, h2;
+    len -= steps * 32;
+    while(steps > 0) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)data);
+      ps = _mm256_add_epi32(ps, v1);
+      v1 = _mm256_add_epi32(v1, _mm256_sad_epu8(a, zero));
+      v2 = _mm256_add_epi32(v2, _mm256_madd_epi16(_mm256_maddubs_epi16(a, tap), ones));
+      data += 32;
+      --steps;
+    }
+    v2 = _mm256_add_epi32(v2, _mm256_slli_epi32(ps, 5));
+    h1 = _mm_add_epi32(_mm256_castsi256_si128(v1), _mm256_extracti128_si256(v1, 1));
+    h2 = _mm_add_epi32(_mm256_castsi256_si128(v2), _mm256_extracti128_si256(v2, 1));
+    h1 = _mm_add_epi32(h1, _mm_shuffle_epi32(h1, _MM_SHUFFLE(2, 3, 0, 1)));
+    h1 = _mm_add_epi32(h1, _mm_shuffle_epi32(h1, _MM_SHUFFLE(1, 0, 3, 2)));
+    h2 = _mm_add_epi32(h2, _mm_shuffle_epi32(h2, _MM_SHUFFLE(2, 3, 0, 1)));
+    h2 = _mm_add_epi32(h2, _mm_shuffle_epi32(h2, _MM_SHUFFLE(1, 0, 3, 2)));
+    s1 = (s1 + (unsigned)_mm_cvtsi128_si32(h1)) % 65521;
+    s2 = (unsigned)_mm_cvtsi128_si32(h2) % 65521;
+  }
+  return update_adler32C((s2 << 16) | s1, data, len);
+}
+#endif /*LODEPNG_SIMD_X86*/
+
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len) {
+#ifdef LODEPNG_SIMD_X86
+  if(len >= 64) {
+    unsigned features = cpuFeatures();
+    if(features & LODEPNG_CPU_AVX2) return update_adler32AVX2(adler, data, len);
+    if(features & LODEPNG_CPU_SSSE3) return update_adler32SSSE3(adler, data, len);
+  }
+#endif /*LODEPNG_SIMD_X86*/
+  return update_adler32C(adler, data, len);
+}
+
 /*Return the adler32 of the bytes data[0..len-1]*/
 static unsigned adler32(const unsigned char* data, unsigned len) {
   return update_adler32(1L, data, len);
 }
 
+#if defined(LODEPNG_COMPILE_ENCODER) || (defined(LODEPNG_COMPILE_PNG) && defined(LODEPNG_COMPILE_DECODER))
+/*Return the adler32 of two pieces of data one after the other, from the adler32 of each and the
+length of the second*/
+static unsigned adler32_combine(unsigned adler1, unsigned adler2, size_t len2) {
+  /*the bytes of the second piece each add the first piece's s1 to s2 once more*/
+  const unsigned BASE = 65521;
+  unsigned rem = (unsigned)(len2 % BASE);
+  unsigned s1 = adler1 & 0xffff;
+  unsigned s2 = (rem * s1) % BASE;
+  s1 += (adler2 & 0xffff) + BASE - 1;
+  s2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + BASE - rem;
+  if(s1 >= BASE) s1 -= BASE;
+  if(s1 >= BASE) s1 -= BASE;
+  if(s2 >= (BASE << 1)) s2 -= (BASE << 1);
+  if(s2 >= BASE) s2 -= BASE;
+  return (s2 << 16) | s1;
+}
+#endif /*LODEPNG_COMPILE_ENCODER || (LODEPNG_COMPILE_PNG && LODEPNG_COMPILE_DECODER)*/
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                 size_t insize, const LodePNGDecompressSettings* settings) {
-  unsigned error = 0;
+static unsigned zlib_check_header(const unsigned char* in, size_t insize) {
   unsigned CM, CINFO, FDICT;
 
   if(insize < 2) return 53; /*error, size of zlib data too small*/
@@ -1928,6 +2615,13 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
       "The additional flags shall not specify a preset dictionary."*/
     return 26;
   }
+  return 0;
+}
+
+unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                                 size_t insize, const LodePNGDecompressSettings* settings) {
+  unsigned error = zlib_check_header(in, insize);
+  if(error) return error;
 
   error = inflate(out, outsize, in + 2, insize - 2, settings);
   if(error) return error;
@@ -1950,20 +2644,132 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
   }
 }
 
+typedef struct ZlibStream {
+  LodePNGInflateSink* sink;
+  unsigned adler;
+  unsigned check_adler;
+} ZlibStream;
+
+static unsigned zlibStreamConsume(void* user, const unsigned char* data, size_t size) {
+  ZlibStream* stream = (ZlibStream*)user;
+  if(stream->check_adler) stream->adler = update_adler32(stream->adler, data, (unsigned)size);
+  return stream->sink->consume(stream->sink->user, data, size);
+}
+
+/*lodepng_zlib_decompress for a zlib stream split over segments, which are read in place.
+Without a sink the output goes to out, which may already have room reserved. With a sink,
+out is only the window and the output goes to sink piece by piece. The custom_zlib and
+custom_inflate settings take contiguous input and are not used*/
+static unsigned zlib_decompress_segments(ucvector* out, const LodePNGSegment* segments, size_t numsegments,
+                                         const LodePNGDecompressSettings* settings, LodePNGInflateSink* sink) {
+  LodePNGBitReader reader;
+  ZlibStream stream;
+  LodePNGInflateSink wrapper;
+  unsigned char bytes[4];
+  unsigned error;
+
+  LodePNGBitReader_initSegments(&reader, segments, numsegments);
+  if(reader.size < 2) return 53; /*error, size of zlib data too small*/
+  copyBytes(&reader, bytes, 0, 2);
+  error = zlib_check_header(bytes, reader.size);
+  if(error) return error;
+
+  stream.sink = sink;
+  stream.adler = 1;
+  stream.check_adler = !settings->ignore_adler32;
+  wrapper.consume = zlibStreamConsume;
+  wrapper.user = &stream;
+  wrapper.consumed = 0;
+  reader.bp = 16; /*the deflate data follows the 2 byte header*/
+  error = inflatev(out, &reader, sink ? &wrapper : 0, 0);
+  if(error) return error;
+
+  if(stream.check_adler) {
+    if(reader.size < 6) return 53; /*error, size of zlib data too small*/
+    if(!sink) stream.adler = adler32(out->data, (unsigned)out->size);
+    copyBytes(&reader, bytes, reader.size - 4, 4);
+    if(stream.adler != lodepng_read32bitInt(bytes)) return 58; /*error, adler checksum not correct*/
+  }
+  return 0;
+}
+
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
-unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                               size_t insize, const LodePNGCompressSettings* settings) {
-  /*initially, *out must be NULL and outsize 0, if you just give some random *out
-  that's pointing to a non allocated buffer, this'll crash*/
-  ucvector outv;
+/*the input of lodepng_zlib_compress cut into parts that run_parts compresses*/
+typedef struct DeflateParts {
+  const unsigned char* in;
+  size_t insize;
+  size_t partsize;
+  size_t count;
+  unsigned independent; /*whether parts start with an empty window instead of the 32K before them*/
+  const LodePNGCompressSettings* settings;
+  ucvector* outputs;
+  unsigned* adlers;
+  unsigned* errors;
+} DeflateParts;
+
+static void deflatePart(void* task_data, size_t i) {
+  DeflateParts* parts = (DeflateParts*)task_data;
+  size_t start = i * parts->partsize;
+  size_t end = LODEPNG_MIN(parts->insize, start + parts->partsize);
+  /*matches may refer back into the 32K before the part, which the previous part compresses*/
+  size_t history = parts->independent ? 0 : LODEPNG_MIN(start, (size_t)32768);
+  const unsigned char* in = parts->in + start - history;
+  parts->errors[i] = deflatev(&parts->outputs[i], in, history, history + end - start, i + 1 == parts->count,
+                              parts->settings);
+  parts->adlers[i] = adler32(in + history, (unsigned)(end - start));
+}
+
+/*deflates in as parts of partsize bytes, run by settings->run_parts if set, and appends them to out,
+followed by the adler32. If offsets is not null, it receives where in out each part starts*/
+static unsigned zlib_compress_parts(ucvector* out, const unsigned char* in, size_t insize, size_t partsize,
+                                    unsigned independent, size_t* offsets,
+                                    const LodePNGCompressSettings* settings) {
+  DeflateParts parts;
+  unsigned error = 0;
   size_t i;
-  unsigned error;
-  unsigned char* deflatedata = 0;
-  size_t deflatesize = 0;
+  parts.in = in;
+  parts.insize = insize;
+  parts.partsize = partsize;
+  parts.count = (insize + parts.partsize - 1) / parts.partsize;
+  parts.independent = independent;
+  parts.settings = settings;
+  parts.outputs = (ucvector*)lodepng_malloc(parts.count * sizeof(ucvector));
+  parts.adlers = (unsigned*)lodepng_malloc(parts.count * sizeof(unsigned));
+  parts.errors = (unsigned*)lodepng_malloc(parts.count * sizeof(unsigned));
+  if(!parts.outputs || !parts.adlers || !parts.errors) error = 83; /*alloc fail*/
 
+  if(!error) {
+    unsigned adler = 1;
+    size_t size = out->size;
+    for(i = 0; i != parts.count; ++i) ucvector_init_buffer(&parts.outputs[i], 0, 0);
+    if(settings->run_parts) settings->run_parts(settings, parts.count, deflatePart, &parts);
+    else for(i = 0; i != parts.count; ++i) deflatePart(&parts, i);
+    for(i = 0; i != parts.count && !error; ++i) {
+      error = parts.errors[i];
+      size += parts.outputs[i].size;
+    }
+    if(!error && !ucvector_reserve(out, size + 4)) error = 83; /*alloc fail*/
+    for(i = 0; i != parts.count && !error; ++i) {
+      size_t partsize = LODEPNG_MIN(insize - i * parts.partsize, parts.partsize);
+      if(offsets) offsets[i] = out->size;
+      memcpy(out->data + out->size, parts.outputs[i].data, parts.outputs[i].size);
+      out->size += parts.outputs[i].size;
+      adler = adler32_combine(adler, parts.adlers[i], partsize);
+    }
+    if(!error) lodepng_add32bitInt(out, adler);
+    for(i = 0; i != parts.count; ++i) lodepng_free(parts.outputs[i].data);
+  }
+
+  lodepng_free(parts.outputs);
+  lodepng_free(parts.adlers);
+  lodepng_free(parts.errors);
+  return error;
+}
+
+static void zlib_add_header(ucvector* out) {
   /*zlib data: 1 byte CMF (CM+CINFO), 1 byte FLG, deflate data, 4 byte ADLER32 checksum of the Decompressed data*/
   unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
   unsigned FLEVEL = 0;
@@ -1972,11 +2778,31 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
   unsigned FCHECK = 31 - CMFFLG % 31;
   CMFFLG += FCHECK;
 
+  ucvector_push_back(out, (unsigned char)(CMFFLG >> 8));
+  ucvector_push_back(out, (unsigned char)(CMFFLG & 255));
+}
+
+unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                               size_t insize, const LodePNGCompressSettings* settings) {
+  /*initially, *out must be NULL and outsize 0, if you just give some random *out
+  that's pointing to a non allocated buffer, this'll crash*/
+  ucvector outv;
+  size_t i;
+  unsigned error;
+  unsigned char* deflatedata = 0;
+  size_t deflatesize = 0;
+
   /*ucvector-controlled version of the output buffer, for dynamic array*/
   ucvector_init_buffer(&outv, *out, *outsize);
 
-  ucvector_push_back(&outv, (unsigned char)(CMFFLG >> 8));
-  ucvector_push_back(&outv, (unsigned char)(CMFFLG & 255));
+  zlib_add_header(&outv);
+
+  if(settings->run_parts && settings->part_size && !settings->custom_deflate && insize > settings->part_size) {
+    error = zlib_compress_parts(&outv, in, insize, settings->part_size, 0, 0, settings);
+    *out = outv.data;
+    *outsize = outv.size;
+    return error;
+  }
 
   error = deflate(&deflatedata, &deflatesize, in, insize, settings);
 
@@ -2030,6 +2856,8 @@ static unsigned zlib_compress(unsigned char** out, size_t* outsize, const unsign
 
 /*this is a good tradeoff between speed and compression ratio*/
 #define DEFAULT_WINDOWSIZE 2048
+/*a few deflate blocks per part, the 32K of history each part compresses again is little next to it*/
+#define DEFAULT_PARTSIZE 262144
 
 void lodepng_compress_settings_init(LodePNGCompressSettings* settings) {
   /*compress with dynamic huffman tree (not in the mathematical sense, just not the predefined one)*/
@@ -2039,13 +2867,18 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings) {
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->level = 0;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
+
+  settings->part_size = DEFAULT_PARTSIZE;
+  settings->run_parts = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0, 0,
+                                                                   DEFAULT_PARTSIZE, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -2058,9 +2891,11 @@ void lodepng_decompress_settings_init(LodePNGDecompressSettings* settings) {
   settings->custom_zlib = 0;
   settings->custom_inflate = 0;
   settings->custom_context = 0;
+
+  settings->run_parts = 0;
 }
 
-const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0};
+const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0, 0};
 
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -2078,8 +2913,9 @@ const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0,
 
 
 #ifndef LODEPNG_NO_COMPILE_CRC
-/* CRC polynomial: 0xedb88320 */
-static unsigned lodepng_crc32_table[256] = {
+/* CRC polynomial: 0xedb88320. Table k is the CRC of a byte followed by k zero bytes, which
+lets slice-by-8 look up the 8 bytes of a step independently*/
+static const unsigned lodepng_crc32_table[8][256] = {{
            0u, 1996959894u, 3993919788u, 2567524794u,  124634137u, 1886057615u, 3915621685u, 2657392035u,
    249268274u, 2044508324u, 3772115230u, 2547177864u,  162941995u, 2125561021u, 3887607047u, 2428444049u,
    498536548u, 1789927666u, 4089016648u, 2227061214u,  450548861u, 1843258603u, 4107580753u, 2211677639u,
@@ -2112,15 +2948,344 @@ static unsigned lodepng_crc32_table[256] = {
   2932959818u, 3654703836u, 1088359270u,  936918000u, 2847714899u, 3736837829u, 1202900863u,  817233897u,
   3183342108u, 3401237130u, 1404277552u,  615818150u, 3134207493u, 3453421203u, 1423857449u,  601450431u,
   3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
-};
+}, {
+           0u,  421212481u,  842424962u,  724390851u, 1684849924u, 2105013317u, 1448781702u, 1329698503u,
+  3369699848u, 3519200073u, 4210026634u, 3824474571u, 2897563404u, 3048111693u, 2659397006u, 2274893007u,
+  1254232657u, 1406739216u, 2029285587u, 1643069842u,  783210325u,  934667796u,  479770071u,   92505238u,
+  2182846553u, 2600511768u, 2955803355u, 2838940570u, 3866582365u, 4285295644u, 3561045983u, 3445231262u,
+  2508465314u, 2359236067u, 2813478432u, 3198777185u, 4058571174u, 3908292839u, 3286139684u, 3670389349u,
+  1566420650u, 1145479147u, 1869335592u, 1987116393u,  959540142u,  539646703u,  185010476u,  303839341u,
+  3745920755u, 3327985586u, 3983561841u, 4100678960u, 3140154359u, 2721170102u, 2300350837u, 2416418868u,
+   396344571u,  243568058u,  631889529u, 1018359608u, 1945336319u, 1793607870u, 1103436669u, 1490954812u,
+  4034481925u, 3915546180u, 3259968903u, 3679722694u, 2484439553u, 2366552896u, 2787371139u, 3208174018u,
+   950060301u,  565965900u,  177645455u,  328046286u, 1556873225u, 1171730760u, 1861902987u, 2011255754u,
+  3132841300u, 2745199637u, 2290958294u, 2442530455u, 3738671184u, 3352078609u, 3974232786u, 4126854035u,
+  1919080284u, 1803150877u, 1079293406u, 1498383519u,  370020952u,  253043481u,  607678682u, 1025720731u,
+  1711106983u, 2095471334u, 1472923941u, 1322268772u,   26324643u,  411738082u,  866634785u,  717028704u,
+  2904875439u, 3024081134u, 2668790573u, 2248782444u, 3376948395u, 3495106026u, 4219356713u, 3798300520u,
+   792689142u,  908347575u,  487136116u,   68299317u, 1263779058u, 1380486579u, 2036719216u, 1618931505u,
+  3890672638u, 4278043327u, 3587215740u, 3435896893u, 2206873338u, 2593195963u, 2981909624u, 2829542713u,
+   998479947u,  580430090u,  162921161u,  279890824u, 1609522511u, 1190423566u, 1842954189u, 1958874764u,
+  4082766403u, 3930137346u, 3245109441u, 3631694208u, 2536953671u, 2385372678u, 2768287173u, 3155920004u,
+  1900120602u, 1750776667u, 1131931800u, 1517083097u,  355290910u,  204897887u,  656092572u, 1040194781u,
+  3113746450u, 2692952403u, 2343461520u, 2461357009u, 3723805974u, 3304059991u, 4022511508u, 4141455061u,
+  2919742697u, 3072101800u, 2620513899u, 2234183466u, 3396041197u, 3547351212u, 4166851439u, 3779471918u,
+  1725839073u, 2143618976u, 1424512099u, 1307796770u,   45282277u,  464110244u,  813994343u,  698327078u,
+  3838160568u, 4259225593u, 3606301754u, 3488152955u, 2158586812u, 2578602749u, 2996767038u, 2877569151u,
+   740041904u,  889656817u,  506086962u,  120682355u, 1215357364u, 1366020341u, 2051441462u, 1667084919u,
+  3422213966u, 3538019855u, 4190942668u, 3772220557u, 2945847882u, 3062702859u, 2644537544u, 2226864521u,
+    52649286u,  439905287u,  823476164u,  672009861u, 1733269570u, 2119477507u, 1434057408u, 1281543041u,
+  2167981343u, 2552493150u, 3004082077u, 2853541596u, 3847487515u, 4233048410u, 3613549209u, 3464057816u,
+  1239502615u, 1358593622u, 2077699477u, 1657543892u,  764250643u,  882293586u,  532408465u,  111204816u,
+  1585378284u, 1197851309u, 1816695150u, 1968414767u,  974272232u,  587794345u,  136598634u,  289367339u,
+  2527558116u, 2411481253u, 2760973158u, 3179948583u, 4073438432u, 3956313505u, 3237863010u, 3655790371u,
+   347922877u,  229101820u,  646611775u, 1066513022u, 1892689081u, 1774917112u, 1122387515u, 1543337850u,
+  3697634229u, 3313392372u, 3998419255u, 4148705398u, 3087642289u, 2702352368u, 2319436851u, 2468674930u
+}, {
+           0u,   29518391u,   59036782u,   38190681u,  118073564u,  114017003u,   76381362u,   89069189u,
+   236147128u,  265370511u,  228034006u,  206958561u,  152762724u,  148411219u,  178138378u,  190596925u,
+   472294256u,  501532999u,  530741022u,  509615401u,  456068012u,  451764635u,  413917122u,  426358261u,
+   305525448u,  334993663u,  296822438u,  275991697u,  356276756u,  352202787u,  381193850u,  393929805u,
+   944588512u,  965684439u, 1003065998u,  973863097u, 1061482044u, 1049003019u, 1019230802u, 1023561829u,
+   912136024u,  933002607u,  903529270u,  874031361u,  827834244u,  815125939u,  852716522u,  856752605u,
+   611050896u,  631869351u,  669987326u,  640506825u,  593644876u,  580921211u,  551983394u,  556069653u,
+   712553512u,  733666847u,  704405574u,  675154545u,  762387700u,  749958851u,  787859610u,  792175277u,
+  1889177024u, 1901651959u, 1931368878u, 1927033753u, 2006131996u, 1985040171u, 1947726194u, 1976933189u,
+  2122964088u, 2135668303u, 2098006038u, 2093965857u, 2038461604u, 2017599123u, 2047123658u, 2076625661u,
+  1824272048u, 1836991623u, 1866005214u, 1861914857u, 1807058540u, 1786244187u, 1748062722u, 1777547317u,
+  1655668488u, 1668093247u, 1630251878u, 1625932113u, 1705433044u, 1684323811u, 1713505210u, 1742760333u,
+  1222101792u, 1226154263u, 1263738702u, 1251046777u, 1339974652u, 1310460363u, 1281013650u, 1301863845u,
+  1187289752u, 1191637167u, 1161842422u, 1149379777u, 1103966788u, 1074747507u, 1112139306u, 1133218845u,
+  1425107024u, 1429406311u, 1467333694u, 1454888457u, 1408811148u, 1379576507u, 1350309090u, 1371438805u,
+  1524775400u, 1528845279u, 1499917702u, 1487177649u, 1575719220u, 1546255107u, 1584350554u, 1605185389u,
+  3778354048u, 3774312887u, 3803303918u, 3816007129u, 3862737756u, 3892238699u, 3854067506u, 3833203973u,
+  4012263992u, 4007927823u, 3970080342u, 3982554209u, 3895452388u, 3924658387u, 3953866378u, 3932773565u,
+  4245928176u, 4241609415u, 4271336606u, 4283762345u, 4196012076u, 4225268251u, 4187931714u, 4166823541u,
+  4076923208u, 4072833919u, 4035198246u, 4047918865u, 4094247316u, 4123732899u, 4153251322u, 4132437965u,
+  3648544096u, 3636082519u, 3673983246u, 3678331705u, 3732010428u, 3753090955u, 3723829714u, 3694611429u,
+  3614117080u, 3601426159u, 3572488374u, 3576541825u, 3496125444u, 3516976691u, 3555094634u, 3525581405u,
+  3311336976u, 3298595879u, 3336186494u, 3340255305u, 3260503756u, 3281337595u, 3251864226u, 3222399125u,
+  3410866088u, 3398419871u, 3368647622u, 3372945905u, 3427010420u, 3448139075u, 3485520666u, 3456284973u,
+  2444203584u, 2423127159u, 2452308526u, 2481530905u, 2527477404u, 2539934891u, 2502093554u, 2497740997u,
+  2679949304u, 2659102159u, 2620920726u, 2650438049u, 2562027300u, 2574714131u, 2603727690u, 2599670141u,
+  2374579504u, 2353749767u, 2383274334u, 2412743529u, 2323684844u, 2336421851u, 2298759554u, 2294686645u,
+  2207933576u, 2186809023u, 2149495014u, 2178734801u, 2224278612u, 2236720739u, 2266437690u, 2262135309u,
+  2850214048u, 2820717207u, 2858812622u, 2879680249u, 2934667388u, 2938704459u, 2909776914u, 2897069605u,
+  2817622296u, 2788420399u, 2759153014u, 2780249921u, 2700618180u, 2704950259u, 2742877610u, 2730399645u,
+  3049550800u, 3020298727u, 3057690558u, 3078802825u, 2999835404u, 3004150075u, 2974355298u, 2961925461u,
+  3151438440u, 3121956959u, 3092510214u, 3113327665u, 3168701108u, 3172786307u, 3210370778u, 3197646061u
+}, {
+           0u, 3099354981u, 2852767883u,  313896942u, 2405603159u,  937357362u,  627793884u, 2648127673u,
+  3316918511u, 2097696650u, 1874714724u, 3607201537u, 1255587768u, 4067088605u, 3772741427u, 1482887254u,
+  1343838111u, 3903140090u, 4195393300u, 1118632049u, 3749429448u, 1741137837u, 1970407491u, 3452858150u,
+  2511175536u,  756094997u, 1067759611u, 2266550430u,  449832999u, 2725482306u, 2965774508u,  142231497u,
+  2687676222u,  412010587u,  171665333u, 2995192016u,  793786473u, 2548850444u, 2237264098u, 1038456711u,
+  1703315409u, 3711623348u, 3482275674u, 1999841343u, 3940814982u, 1381529571u, 1089329165u, 4166106984u,
+  4029413537u, 1217896388u, 1512189994u, 3802027855u, 2135519222u, 3354724499u, 3577784189u, 1845280792u,
+   899665998u, 2367928107u, 2677414085u,  657096608u, 3137160985u,   37822588u,  284462994u, 2823350519u,
+  2601801789u,  598228824u,  824021174u, 2309093331u,  343330666u, 2898962447u, 3195996129u,  113467524u,
+  1587572946u, 3860600759u, 4104763481u, 1276501820u, 3519211397u, 1769898208u, 2076913422u, 3279374443u,
+  3406630818u, 1941006535u, 1627703081u, 3652755532u, 1148164341u, 4241751952u, 3999682686u, 1457141531u,
+   247015245u, 3053797416u, 2763059142u,  470583459u, 2178658330u,  963106687u,  735213713u, 2473467892u,
+   992409347u, 2207944806u, 2435792776u,  697522413u, 3024379988u,  217581361u,  508405983u, 2800865210u,
+  4271038444u, 1177467017u, 1419450215u, 3962007554u, 1911572667u, 3377213406u, 3690561584u, 1665525589u,
+  1799331996u, 3548628985u, 3241568279u, 2039091058u, 3831314379u, 1558270126u, 1314193216u, 4142438437u,
+  2928380019u,  372764438u,   75645176u, 3158189981u,  568925988u, 2572515393u, 2346768303u,  861712586u,
+  3982079547u, 1441124702u, 1196457648u, 4293663189u, 1648042348u, 3666298377u, 3358779879u, 1888390786u,
+   686661332u, 2421291441u, 2196002399u,  978858298u, 2811169155u,  523464422u,  226935048u, 3040519789u,
+  3175145892u,  100435649u,  390670639u, 2952089162u,  841119475u, 2325614998u, 2553003640u,  546822429u,
+  2029308235u, 3225988654u, 3539796416u, 1782671013u, 4153826844u, 1328167289u, 1570739863u, 3844338162u,
+  1298864389u, 4124540512u, 3882013070u, 1608431339u, 3255406162u, 2058742071u, 1744848601u, 3501990332u,
+  2296328682u,  811816591u,  584513889u, 2590678532u,  129869501u, 3204563416u, 2914283062u,  352848211u,
+   494030490u, 2781751807u, 3078325777u,  264757620u, 2450577869u,  715964072u,  941166918u, 2158327331u,
+  3636881013u, 1618608400u, 1926213374u, 3396585883u, 1470427426u, 4011365959u, 4255988137u, 1158766284u,
+  1984818694u, 3471935843u, 3695453837u, 1693991400u, 4180638033u, 1100160564u, 1395044826u, 3952793279u,
+  3019491049u,  189112716u,  435162722u, 2706139399u, 1016811966u, 2217162459u, 2526189877u,  774831696u,
+   643086745u, 2666061564u, 2354934034u,  887166583u, 2838900430u,  294275499u,   54519365u, 3145957664u,
+  3823145334u, 1532818963u, 1240029693u, 4048895640u, 1820460577u, 3560857924u, 3331051178u, 2117577167u,
+  3598663992u, 1858283101u, 2088143283u, 3301633750u, 1495127663u, 3785470218u, 4078182116u, 1269332353u,
+   332098007u, 2876706482u, 3116540252u,   25085497u, 2628386432u,  605395429u,  916469259u, 2384220526u,
+  2254837415u, 1054503362u,  745528876u, 2496903497u,  151290352u, 2981684885u, 2735556987u,  464596510u,
+  1137851976u, 4218313005u, 3923506883u, 1365741990u, 3434129695u, 1946996346u, 1723425172u, 3724871409u
+}, {
+           0u, 1029712304u, 2059424608u, 1201699536u, 4118849216u, 3370159984u, 2403399072u, 2988497936u,
+   812665793u,  219177585u, 1253054625u, 2010132753u, 3320900865u, 4170237105u, 3207642721u, 2186319825u,
+  1625331586u, 1568718386u,  438355170u,  658566482u, 2506109250u, 2818578674u, 4020265506u, 3535817618u,
+  1351670851u, 1844508147u,  709922595u,  389064339u, 2769320579u, 2557498163u, 3754961379u, 3803185235u,
+  3250663172u, 4238411444u, 3137436772u, 2254525908u,  876710340u,  153198708u, 1317132964u, 1944187668u,
+  4054934725u, 3436268917u, 2339452837u, 3054575125u,   70369797u,  961670069u, 2129760613u, 1133623509u,
+  2703341702u, 2621542710u, 3689016294u, 3867263574u, 1419845190u, 1774270454u,  778128678u,  318858390u,
+  2438067015u, 2888948471u, 3952189479u, 3606153623u, 1691440519u, 1504803895u,  504432359u,  594620247u,
+  1492342857u, 1704161785u,  573770537u,  525542041u, 2910060169u, 2417219385u, 3618876905u, 3939730521u,
+  1753420680u, 1440954936u,  306397416u,  790849880u, 2634265928u, 2690882808u, 3888375336u, 3668168600u,
+   940822475u,   91481723u, 1121164459u, 2142483739u, 3448989963u, 4042473659u, 3075684971u, 2318603227u,
+   140739594u,  889433530u, 1923340138u, 1338244826u, 4259521226u, 3229813626u, 2267247018u, 3124975642u,
+  2570221389u, 2756861693u, 3824297005u, 3734113693u, 1823658381u, 1372780605u,  376603373u,  722643805u,
+  2839690380u, 2485261628u, 3548540908u, 4007806556u, 1556257356u, 1638052860u,  637716780u,  459464860u,
+  4191346895u, 3300051327u, 2199040943u, 3195181599u,  206718479u,  825388991u, 1989285231u, 1274166495u,
+  3382881038u, 4106388158u, 3009607790u, 2382549470u, 1008864718u,   21111934u, 1189240494u, 2072147742u,
+  2984685714u, 2357631266u, 3408323570u, 4131834434u, 1147541074u, 2030452706u, 1051084082u,   63335554u,
+  2174155603u, 3170292451u, 4216760371u, 3325460867u, 1947622803u, 1232499747u,  248909555u,  867575619u,
+  3506841360u, 3966111392u, 2881909872u, 2527485376u,  612794832u,  434546784u, 1581699760u, 1663499008u,
+  3782634705u, 3692447073u, 2612412337u, 2799048193u,  351717905u,  697754529u, 1849071985u, 1398190273u,
+  1881644950u, 1296545318u,  182963446u,  931652934u, 2242328918u, 3100053734u, 4284967478u, 3255255942u,
+  1079497815u, 2100821479u,  983009079u,  133672583u, 3050795671u, 2293717799u, 3474399735u, 4067887175u,
+   281479188u,  765927844u, 1778867060u, 1466397380u, 3846680276u, 3626469220u, 2676489652u, 2733102084u,
+   548881365u,  500656741u, 1517752501u, 1729575173u, 3577210133u, 3898068133u, 2952246901u, 2459410373u,
+  3910527195u, 3564487019u, 2480257979u, 2931134987u,  479546907u,  569730987u, 1716854139u, 1530213579u,
+  3647316762u, 3825568426u, 2745561210u, 2663766474u,  753206746u,  293940330u, 1445287610u, 1799716618u,
+  2314567513u, 3029685993u, 4080348217u, 3461678473u, 2088098201u, 1091956777u,  112560889u, 1003856713u,
+  3112514712u, 2229607720u, 3276105720u, 4263857736u, 1275433560u, 1902492648u,  918929720u,  195422344u,
+   685033439u,  364179055u, 1377080511u, 1869921551u, 3713294623u, 3761522863u, 2811507327u, 2599689167u,
+   413436958u,  633644462u, 1650777982u, 1594160846u, 3978570462u, 3494118254u, 2548332990u, 2860797966u,
+  1211387997u, 1968470509u,  854852413u,  261368461u, 3182753437u, 2161434413u, 3346310653u, 4195650637u,
+  2017729436u, 1160000044u,   42223868u, 1071931724u, 2378480988u, 2963576044u, 4144295484u, 3395602316u
+}, {
+           0u, 3411858341u, 1304994059u, 2257875630u, 2609988118u, 1355649459u, 3596215069u,  486879416u,
+  3964895853u,  655315400u, 2711298918u, 1791488195u, 2009251963u, 3164476382u,  973758832u, 4048990933u,
+    64357019u, 3364540734u, 1310630800u, 2235723829u, 2554806413u, 1394316072u, 3582976390u,  517157411u,
+  4018503926u,  618222419u, 2722963965u, 1762783832u, 1947517664u, 3209171269u,  970744811u, 4068520014u,
+   128714038u, 3438335635u, 1248109629u, 2167961496u, 2621261600u, 1466012805u, 3522553387u,  447296910u,
+  3959392091u,  547575038u, 2788632144u, 1835791861u, 1886307661u, 3140622056u, 1034314822u, 4143626211u,
+    75106221u, 3475428360u, 1236444838u, 2196665603u, 2682996155u, 1421317662u, 3525567664u,  427767573u,
+  3895035328u,  594892389u, 2782995659u, 1857943406u, 1941489622u, 3101955187u, 1047553757u, 4113347960u,
+   257428076u, 3288652233u, 1116777319u, 2311878850u, 2496219258u, 1603640287u, 3640781169u,  308099796u,
+  3809183745u,  676813732u, 2932025610u, 1704983215u, 2023410199u, 3016104370u,  894593820u, 4262377657u,
+   210634999u, 3352484690u, 1095150076u, 2316991065u, 2535410401u, 1547934020u, 3671583722u,  294336591u,
+  3772615322u,  729897279u, 2903845777u, 1716123700u, 2068629644u, 2953845545u,  914647431u, 4258839074u,
+   150212442u, 3282623743u, 1161604689u, 2388688372u, 2472889676u, 1480171241u, 3735940167u,  368132066u,
+  3836185911u,  805002898u, 2842635324u, 1647574937u, 2134298401u, 3026852996u,  855535146u, 4188192143u,
+   186781121u, 3229539940u, 1189784778u, 2377547631u, 2427670487u, 1542429810u, 3715886812u,  371670393u,
+  3882979244u,  741170185u, 2864262823u, 1642462466u, 2095107514u, 3082559007u,  824732849u, 4201955092u,
+   514856152u, 3589064573u, 1400419795u, 2552522358u, 2233554638u, 1316849003u, 3370776517u,   62202976u,
+  4075001525u,  968836368u, 3207280574u, 1954014235u, 1769133219u, 2720925446u,  616199592u, 4024870413u,
+   493229635u, 3594175974u, 1353627464u, 2616354029u, 2264355925u, 1303087088u, 3409966430u,    6498043u,
+  4046820398u,  979978123u, 3170710821u, 2007099008u, 1789187640u, 2717386141u,  661419827u, 3962610838u,
+   421269998u, 3527459403u, 1423225061u, 2676515648u, 2190300152u, 1238466653u, 3477467891u,   68755798u,
+  4115633027u, 1041448998u, 3095868040u, 1943789869u, 1860096405u, 2776760880u,  588673182u, 3897205563u,
+   449450869u, 3516317904u, 1459794558u, 2623431131u, 2170245475u, 1242006214u, 3432247400u,  131015629u,
+  4137259288u, 1036337853u, 3142660115u, 1879958454u, 1829294862u, 2790523051u,  549483013u, 3952910752u,
+   300424884u, 3669282065u, 1545650111u, 2541513754u, 2323209378u, 1092980487u, 3350330793u,  216870412u,
+  4256931033u,  921128828u, 2960342482u, 2066738807u, 1714085583u, 2910195050u,  736264132u, 3770592353u,
+   306060335u, 3647131530u, 1610005796u, 2494197377u, 2309971513u, 1123257756u, 3295149874u,  255536279u,
+  4268596802u,  892423655u, 3013951305u, 2029645036u, 1711070292u, 2929725425u,  674528607u, 3815288570u,
+   373562242u, 3709388839u, 1535949449u, 2429577516u, 2379569556u, 1183418929u, 3223189663u,  188820282u,
+  4195850735u,  827017802u, 3084859620u, 2089020225u, 1636228089u, 2866415708u,  743340786u, 3876759895u,
+   361896217u, 3738094268u, 1482340370u, 2466671543u, 2382584591u, 1163888810u, 3284924932u,  144124321u,
+  4190215028u,  849168593u, 3020503679u, 2136336858u, 1649465698u, 2836138695u,  798521449u, 3838094284u
+}, {
+           0u, 2792819636u, 2543784233u,  837294749u, 4098827283u, 1379413927u, 1674589498u, 3316072078u,
+   871321191u, 2509784531u, 2758827854u,   34034938u, 3349178996u, 1641505216u, 1346337629u, 4131942633u,
+  1742642382u, 3249117050u, 4030828007u, 1446413907u, 2475800797u,  904311657u,   68069876u, 2725880384u,
+  1412551337u, 4064729373u, 3283010432u, 1708771380u, 2692675258u,  101317902u,  937551763u, 2442587175u,
+  3485284764u, 1774858792u, 1478633653u, 4266992385u, 1005723023u, 2642744891u, 2892827814u,  169477906u,
+  4233263099u, 1512406095u, 1808623314u, 3451546982u,  136139752u, 2926205020u, 2676114113u,  972376437u,
+  2825102674u,  236236518u, 1073525883u, 2576072655u, 1546420545u, 4200303349u, 3417542760u, 1841601500u,
+  2609703733u, 1039917185u,  202635804u, 2858742184u, 1875103526u, 3384067218u, 4166835727u, 1579931067u,
+  1141601657u, 3799809741u, 3549717584u, 1977839588u, 2957267306u,  372464350u,  668680259u, 2175552503u,
+  2011446046u, 3516084394u, 3766168119u, 1175200131u, 2209029901u,  635180217u,  338955812u, 2990736784u,
+   601221559u, 2242044419u, 3024812190u,  306049834u, 3617246628u, 1911408144u, 1074125965u, 3866285881u,
+   272279504u, 3058543716u, 2275784441u,  567459149u, 3832906691u, 1107462263u, 1944752874u, 3583875422u,
+  2343980261u,  767641425u,  472473036u, 3126744696u, 2147051766u, 3649987394u, 3899029983u, 1309766251u,
+  3092841090u,  506333494u,  801510315u, 2310084639u, 1276520081u, 3932237093u, 3683203000u, 2113813516u,
+  3966292011u, 1243601823u, 2079834370u, 3716205238u,  405271608u, 3192979340u, 2411259153u,  701492901u,
+  3750207052u, 2045810168u, 1209569125u, 4000285905u,  734575199u, 2378150379u, 3159862134u,  438345922u,
+  2283203314u,  778166598u,  529136603u, 3120492655u, 2086260449u, 3660498261u, 3955679176u, 1303499900u,
+  3153699989u,  495890209u,  744928700u, 2316418568u, 1337360518u, 3921775410u, 3626602927u, 2120129051u,
+  4022892092u, 1237286280u, 2018993941u, 3726666913u,  461853231u, 3186645403u, 2350400262u,  711936178u,
+  3693557851u, 2052076527u, 1270360434u, 3989775046u,  677911624u, 2384402428u, 3220639073u,  427820757u,
+  1202443118u, 3789347034u, 3493118535u, 1984154099u, 3018127229u,  362020041u,  612099668u, 2181885408u,
+  1950653705u, 3526596285u, 3822816288u, 1168934804u, 2148251930u,  645706414u,  395618355u, 2984485767u,
+   544559008u, 2248295444u, 3085590153u,  295523645u, 3560598451u, 1917673479u, 1134918298u, 3855773998u,
+   328860103u, 3052210803u, 2214924526u,  577903450u, 3889505748u, 1101147744u, 1883911421u, 3594338121u,
+  3424493451u, 1785369663u, 1535282850u, 4260726038u,  944946072u, 2653270060u, 2949491377u,  163225861u,
+  4294103532u, 1501944408u, 1752023237u, 3457862513u,  196998655u, 2915761739u, 2619532502u,  978710370u,
+  2881684293u,  229902577u, 1012666988u, 2586515928u, 1603020630u, 4193987810u, 3356702335u, 1852063179u,
+  2553040162u, 1046169238u,  263412747u, 2848217023u, 1818454321u, 3390333573u, 4227627032u, 1569420204u,
+    60859927u, 2782375331u, 2487203646u,  843627658u, 4159668740u, 1368951216u, 1617990445u, 3322386585u,
+   810543216u, 2520310724u, 2815490393u,   27783917u, 3288386659u, 1652017111u, 1402985802u, 4125677310u,
+  1685994201u, 3255382381u, 4091620336u, 1435902020u, 2419138250u,  910562686u,  128847843u, 2715354199u,
+  1469150398u, 4058414858u, 3222168983u, 1719234083u, 2749255853u,   94984985u,  876691844u, 2453031472u
+}, {
+           0u, 3433693342u, 1109723005u, 2391738339u, 2219446010u, 1222643300u, 3329165703u,  180685081u,
+  3555007413u,  525277995u, 2445286600u, 1567235158u, 1471092047u, 2600801745u,  361370162u, 3642757804u,
+  2092642603u, 2953916853u, 1050555990u, 4063508168u, 4176560081u,  878395215u, 3134470316u, 1987983410u,
+  2942184094u, 1676945920u, 3984272867u,  567356797u,  722740324u, 3887998202u, 1764827929u, 2778407815u,
+  4185285206u,  903635656u, 3142804779u, 2012833205u, 2101111980u, 2979425330u, 1058630609u, 4088621903u,
+   714308067u, 3862526333u, 1756790430u, 2753330688u, 2933487385u, 1651734407u, 3975966820u,  542535930u,
+  2244825981u, 1231508451u, 3353891840u,  188896414u,   25648519u, 3442302233u, 1134713594u, 2399689316u,
+  1445480648u, 2592229462u,  336416693u, 3634843435u, 3529655858u,  516441772u, 2420588879u, 1559052753u,
+   698204909u, 3845636723u, 1807271312u, 2803025166u, 2916600855u, 1635634313u, 4025666410u,  593021940u,
+  4202223960u,  919787974u, 3093159461u, 1962401467u, 2117261218u, 2996361020u, 1008193759u, 4038971457u,
+  1428616134u, 2576151384u,  386135227u, 3685348389u, 3513580860u,  499580322u, 2471098945u, 1608776415u,
+  2260985971u, 1248454893u, 3303468814u,  139259792u,   42591881u, 3458459159u, 1085071860u, 2349261162u,
+  3505103035u,  474062885u, 2463016902u, 1583654744u, 1419882049u, 2550902495u,  377792828u, 3660491170u,
+    51297038u, 3483679632u, 1093385331u, 2374089965u, 2269427188u, 1273935210u, 3311514249u,  164344343u,
+  2890961296u, 1627033870u, 4000683757u,  585078387u,  672833386u, 3836780532u, 1782552599u, 2794821769u,
+  2142603813u, 3005188795u, 1032883544u, 4047146438u, 4227826911u,  928351297u, 3118105506u, 1970307900u,
+  1396409818u, 2677114180u,  287212199u, 3719594553u, 3614542624u,  467372990u, 2505346141u, 1509854403u,
+  2162073199u, 1282711281u, 3271268626u,  240228748u,   76845205u, 3359543307u, 1186043880u, 2317064054u,
+   796964081u, 3811226735u, 1839575948u, 2702160658u, 2882189835u, 1734392469u, 3924802934u,  625327592u,
+  4234522436u,  818917338u, 3191908409u, 1927981223u, 2016387518u, 3028656416u,  973776579u, 4137723485u,
+  2857232268u, 1726474002u, 3899187441u,  616751215u,  772270454u, 3803048424u, 1814228491u, 2693328533u,
+  2041117753u, 3036871847u,  999160644u, 4146592730u, 4259508931u,  826864221u, 3217552830u, 1936586016u,
+  3606501031u,  442291769u, 2496909786u, 1484378436u, 1388107869u, 2652297411u,  278519584u, 3694387134u,
+    85183762u, 3384397196u, 1194773103u, 2342308593u, 2170143720u, 1307820918u, 3279733909u,  265733131u,
+  2057717559u, 3054258089u,  948125770u, 4096344276u, 4276898253u,  843467091u, 3167309488u, 1885556270u,
+  2839764098u, 1709792284u, 3949353983u,  667704161u,  755585656u, 3785577190u, 1865176325u, 2743489947u,
+   102594076u, 3401021058u, 1144549729u, 2291298815u, 2186770662u, 1325234296u, 3228729243u,  215514885u,
+  3589828009u,  424832311u, 2547870420u, 1534552650u, 1370645331u, 2635621325u,  328688686u, 3745342640u,
+  2211456353u, 1333405183u, 3254067740u,  224338562u,  127544219u, 3408931589u, 1170156774u, 2299866232u,
+  1345666772u, 2627681866u,  303053225u, 3736746295u, 3565105198u,  416624816u, 2522494803u, 1525692365u,
+  4285207626u,  868291796u, 3176010551u, 1910772649u, 2065767088u, 3079346734u,  956571085u, 4121828691u,
+   747507711u, 3760459617u, 1856702594u, 2717976604u, 2831417605u, 1684930971u, 3940615800u,  642451174u
+}};
+
+/*the CRC register r continued over the bytes, 8 at a time*/
+static unsigned crc32Slice8(unsigned r, const unsigned char* data, size_t length) {
+  const unsigned (*t)[256] = lodepng_crc32_table;
+  for(; length >= 8; length -= 8, data += 8) {
+    unsigned a = r ^ (data[0] | ((unsigned)data[1] << 8u) | ((unsigned)data[2] << 16u) | ((unsigned)data[3] << 24u));
+    r = t[7][a & 255u] ^ t[6][(a >> 8u) & 255u] ^ t[5][(a >> 16u) & 255u] ^ t[4][a >> 24u]
+      ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+  }
+  for(; length > 0; --length, ++data) r = t[0][(r ^ *data) & 255u] ^ (r >> 8u);
+  return r;
+}
+
+#ifdef LODEPNG_SIMD_X86
+/*
+Folds 64 bytes at a time with carry-less multiplications, then 16, and reduces the last 128
+bits to the CRC with Barrett reduction, after "Fast CRC Computation for Generic Polynomials
+Using PCLMULQDQ Instruction" by Intel. The constants are powers of x modulo the bit reflected
+polynomial. length must be a multiple of 16 and at least 64.
+*/
+LODEPNG_TARGET_PCLMUL
+static unsigned crc32PCLMUL(unsigned r, const unsigned char* data, size_t length) {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(-1, 0, -1, 0);
+  __m128i x1 = _mm_loadu_si128((const __m128i*)data);
+  __m128i x2 = _mm_loadu_si128((const __m128i*)(data + 16));
+  __m128i x3 = _mm_loadu_si128((const __m128i*)(data + 32));
+  __m128i x4 = _mm_loadu_si128((const __m128i*)(data + 48));
+  __m128i t;
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)r));
+  data += 64;
+  length -= 64;
+
+  for(; length >= 64; length -= 64, data += 64) {
+    __m128i y1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    __m128i y2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    __m128i y3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    __m128i y4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), y1);
+    x2 = _mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), y2);
+    x3 = _mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), y3);
+    x4 = _mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x11), y4);
+    x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data));
+    x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i*)(data + 16)));
+    x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i*)(data + 32)));
+    x4 = _mm_xor_si128(x4, _mm_loadu_si128((const __m128i*)(data + 48)));
+  }
+
+  /*fold the 4 registers into 1, then the remaining 16 byte blocks into it*/
+  t = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), t);
+  t = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), t);
+  t = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), t);
+  for(; length >= 16; length -= 16, data += 16) {
+    t = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), t);
+    x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data));
+  }
+
+  /*128 bits to 64*/
+  t = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+  t = _mm_srli_si128(x1, 4);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00), t);
+
+  /*Barrett reduction to 32*/
+  t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+  t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), poly, 0x00);
+  x1 = _mm_xor_si128(x1, t);
+  return (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif /*LODEPNG_SIMD_X86*/
+
+#ifdef LODEPNG_CRC32_ARM
+static unsigned crc32ARM(unsigned r, const unsigned char* data, size_t length) {
+  for(; length >= 8; length -= 8, data += 8) {
+    unsigned long long v;
+    memcpy(&v, data, 8);
+    r = __crc32d(r, v);
+  }
+  for(; length > 0; --length, ++data) r = __crc32b(r, *data);
+  return r;
+}
+#endif /*LODEPNG_CRC32_ARM*/
 
 /*Return the CRC of the bytes buf[0..len-1].*/
 unsigned lodepng_crc32(const unsigned char* data, size_t length) {
   unsigned r = 0xffffffffu;
-  size_t i;
-  for(i = 0; i < length; ++i) {
-    r = lodepng_crc32_table[(r ^ data[i]) & 0xff] ^ (r >> 8);
-  }
+#if defined(LODEPNG_CRC32_ARM)
+  r = crc32ARM(r, data, length);
+#else
+#ifdef LODEPNG_SIMD_X86
+  if(length >= 64 && (cpuFeatures() & LODEPNG_CPU_PCLMUL)) {
+    size_t folded = length & ~(size_t)15;
+    r = crc32PCLMUL(r, data, folded);
+    data += folded;
+    length -= folded;
+  }
+#endif /*LODEPNG_SIMD_X86*/
+  r = crc32Slice8(r, data, length);
+#endif
   return r ^ 0xffffffffu;
 }
 #else /* !LODEPNG_NO_COMPILE_CRC */
@@ -2769,71 +3934,73 @@ static void addColorBits(unsigned char* out, size_t index, unsigned bits, unsign
   else out[index * bits / 8] |= in;
 }
 
-typedef struct ColorTree ColorTree;
-
 /*
-One node of a color tree
-This is the data structure used to count the number of unique colors and to get a palette
-index for a color. It's like an octree, but because the alpha channel is used too, each
-node has 16 instead of 8 children.
+Palette indices of RGBA colors, to convert to a palette and to count the colors of an image. It
+is a hash table with open addressing in a fixed array: nobody adds more than 257 colors, a palette
+and one more to see that an image does not fit in one, so it stays about half empty and its
+lookups rarely probe more than a slot or two. The last color found is kept as well, images
+repeat colors a lot.
 */
-struct ColorTree {
-  ColorTree* children[16]; /*up to 16 pointers to ColorTree of next level*/
-  int index; /*the payload. Only has a meaningful value if this is in the last level*/
-};
+#define COLOR_TABLE_SIZE 512u /*a power of two*/
+
+typedef struct ColorTable {
+  unsigned colors[COLOR_TABLE_SIZE]; /*RGBA, R in the highest byte*/
+  short indices[COLOR_TABLE_SIZE]; /*-1 for an empty slot*/
+  unsigned count;
+  unsigned last_color;
+  int last_index;
+} ColorTable;
 
-static void color_tree_init(ColorTree* tree) {
-  int i;
-  for(i = 0; i != 16; ++i) tree->children[i] = 0;
-  tree->index = -1;
+static void color_table_init(ColorTable* table) {
+  unsigned i;
+  for(i = 0; i != COLOR_TABLE_SIZE; ++i) table->indices[i] = -1;
+  table->count = 0;
+  table->last_index = -1;
+  table->last_color = 0;
 }
 
-static void color_tree_cleanup(ColorTree* tree) {
-  int i;
-  for(i = 0; i != 16; ++i) {
-    if(tree->children[i]) {
-      color_tree_cleanup(tree->children[i]);
-      lodepng_free(tree->children[i]);
-    }
-  }
+static unsigned color_table_slot(unsigned color) {
+  return ((color * 2654435761u) & 0xffffffffu) >> 23u; /*9 bits, COLOR_TABLE_SIZE*/
 }
 
 /*returns -1 if color not present, its index otherwise*/
-static int color_tree_get(ColorTree* tree, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
-  int bit = 0;
-  for(bit = 0; bit < 8; ++bit) {
-    int i = 8 * ((r >> bit) & 1) + 4 * ((g >> bit) & 1) + 2 * ((b >> bit) & 1) + 1 * ((a >> bit) & 1);
-    if(!tree->children[i]) return -1;
-    else tree = tree->children[i];
+static int color_table_get(ColorTable* table, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+  unsigned color = ((unsigned)r << 24u) | ((unsigned)g << 16u) | ((unsigned)b << 8u) | a;
+  unsigned slot;
+  if(color == table->last_color && table->last_index >= 0) return table->last_index;
+  for(slot = color_table_slot(color); table->indices[slot] >= 0; slot = (slot + 1u) & (COLOR_TABLE_SIZE - 1u)) {
+    if(table->colors[slot] == color) {
+      table->last_color = color;
+      table->last_index = table->indices[slot];
+      return table->last_index;
+    }
   }
-  return tree ? tree->index : -1;
-}
-
-#ifdef LODEPNG_COMPILE_ENCODER
-static int color_tree_has(ColorTree* tree, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
-  return color_tree_get(tree, r, g, b, a) >= 0;
+  return -1;
 }
-#endif /*LODEPNG_COMPILE_ENCODER*/
 
-/*color is not allowed to already exist.
-Index should be >= 0 (it's signed to be compatible with using -1 for "doesn't exist")*/
-static void color_tree_add(ColorTree* tree,
-                           unsigned char r, unsigned char g, unsigned char b, unsigned char a, unsigned index) {
-  int bit;
-  for(bit = 0; bit < 8; ++bit) {
-    int i = 8 * ((r >> bit) & 1) + 4 * ((g >> bit) & 1) + 2 * ((b >> bit) & 1) + 1 * ((a >> bit) & 1);
-    if(!tree->children[i]) {
-      tree->children[i] = (ColorTree*)lodepng_malloc(sizeof(ColorTree));
-      color_tree_init(tree->children[i]);
+/*a color that is already present gets the new index. Returns 0 if the table is full, one slot stays
+empty to end the probing*/
+static unsigned color_table_add(ColorTable* table,
+                                unsigned char r, unsigned char g, unsigned char b, unsigned char a, unsigned index) {
+  unsigned color = ((unsigned)r << 24u) | ((unsigned)g << 16u) | ((unsigned)b << 8u) | a;
+  unsigned slot;
+  table->last_index = -1;
+  for(slot = color_table_slot(color); table->indices[slot] >= 0; slot = (slot + 1u) & (COLOR_TABLE_SIZE - 1u)) {
+    if(table->colors[slot] == color) {
+      table->indices[slot] = (short)index;
+      return 1;
     }
-    tree = tree->children[i];
   }
-  tree->index = (int)index;
+  if(table->count >= COLOR_TABLE_SIZE - 1u) return 0;
+  table->colors[slot] = color;
+  table->indices[slot] = (short)index;
+  ++table->count;
+  return 1;
 }
 
 /*put a pixel, given its RGBA color, into image of any color type*/
 static unsigned rgba8ToPixel(unsigned char* out, size_t i,
-                             const LodePNGColorMode* mode, ColorTree* tree /*for palette*/,
+                             const LodePNGColorMode* mode, ColorTable* table /*for palette*/,
                              unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
   if(mode->colortype == LCT_GREY) {
     unsigned char gray = r; /*((unsigned short)r + g + b) / 3;*/
@@ -2855,7 +4022,7 @@ static unsigned rgba8ToPixel(unsigned char* out, size_t i,
       out[i * 6 + 4] = out[i * 6 + 5] = b;
     }
   } else if(mode->colortype == LCT_PALETTE) {
-    int index = color_tree_get(tree, r, g, b, a);
+    int index = color_table_get(table, r, g, b, a);
     if(index < 0) return 82; /*color not in palette*/
     if(mode->bitdepth == 8) out[i] = index;
     else addColorBits(out, i, mode->bitdepth, (unsigned)index);
@@ -3124,11 +4291,237 @@ static void getPixelColorRGBA16(unsigned short* r, unsigned short* g, unsigned s
   }
 }
 
+/*
+Bulk conversions of the color mode pairs that decoding and encoding 8-bit images
+mostly ask for. Each gives the same bytes as the generic per pixel path below, the
+SIMD part does as many whole blocks as it can and the C loop finishes the rest.
+*/
+
+/*16 to 8 bit of the same color type keeps the most significant byte of every channel*/
+static void convert16To8(unsigned char* out, const unsigned char* in, size_t numbytes) {
+  size_t i = 0;
+#if defined(LODEPNG_SIMD_X86)
+  const __m128i low = _mm_set1_epi16(0x00ff);
+  for(; i + 16 <= numbytes; i += 16) {
+    __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 2)), low);
+    __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 2 + 16)), low);
+    _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+  }
+#elif defined(LODEPNG_SIMD_NEON)
+  for(; i + 16 <= numbytes; i += 16) vst1q_u8(out + i, vld2q_u8(in + i * 2).val[0]);
+#endif
+  for(; i != numbytes; ++i) out[i] = in[i * 2];
+}
+
+#ifdef LODEPNG_SIMD_X86
+LODEPNG_TARGET_SSSE3
+static size_t convertRGBA8ToRGB8SSSE3(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  size_t i = 0;
+  /*each store writes 4 bytes past its 4 pixels, the next store or the tail overwrites them*/
+  for(; i + 6 <= numpixels; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + i * 4));
+    _mm_storeu_si128((__m128i*)(out + i * 3), _mm_shuffle_epi8(v, shuffle));
+  }
+  return i;
+}
+
+LODEPNG_TARGET_SSSE3
+static size_t convertRGB8ToRGBA8SSSE3(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+  size_t i = 0;
+  /*each load reads 4 bytes past its 4 pixels*/
+  for(; i + 6 <= numpixels; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + i * 3));
+    _mm_storeu_si128((__m128i*)(out + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+  }
+  return i;
+}
+
+LODEPNG_TARGET_SSSE3
+static size_t convertRGB8ToGrey8SSSE3(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  const __m128i shuffle0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i shuffle1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+  const __m128i shuffle2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+  size_t i = 0;
+  for(; i + 16 <= numpixels; i += 16) {
+    __m128i v0 = _mm_loadu_si128((const __m128i*)(in + i * 3));
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(in + i * 3 + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i*)(in + i * 3 + 32));
+    __m128i r = _mm_or_si128(_mm_shuffle_epi8(v0, shuffle0), _mm_shuffle_epi8(v1, shuffle1));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_or_si128(r, _mm_shuffle_epi8(v2, shuffle2)));
+  }
+  return i;
+}
+
+LODEPNG_TARGET_SSSE3
+static size_t convertGrey8ToRGB8SSSE3(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  const __m128i shuffle0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+  const __m128i shuffle1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+  const __m128i shuffle2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+  size_t i = 0;
+  for(; i + 16 <= numpixels; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+    _mm_storeu_si128((__m128i*)(out + i * 3), _mm_shuffle_epi8(v, shuffle0));
+    _mm_storeu_si128((__m128i*)(out + i * 3 + 16), _mm_shuffle_epi8(v, shuffle1));
+    _mm_storeu_si128((__m128i*)(out + i * 3 + 32), _mm_shuffle_epi8(v, shuffle2));
+  }
+  return i;
+}
+#endif /*LODEPNG_SIMD_X86*/
+
+static void convertRGBA8ToRGB8(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  size_t i = 0;
+#if defined(LODEPNG_SIMD_X86)
+  if(cpuFeatures() & LODEPNG_CPU_SSSE3) i = convertRGBA8ToRGB8SSSE3(out, in, numpixels);
+#elif defined(LODEPNG_SIMD_NEON)
+  for(; i + 16 <= numpixels; i += 16) {
+    uint8x16x4_t v = vld4q_u8(in + i * 4);
+    uint8x16x3_t rgb;
+    rgb.val[0] = v.val[0];
+    rgb.val[1] = v.val[1];
+    rgb.val[2] = v.val[2];
+    vst3q_u8(out + i * 3, rgb);
+  }
+#endif
+  for(; i != numpixels; ++i) {
+    out[i * 3 + 0] = in[i * 4 + 0];
+    out[i * 3 + 1] = in[i * 4 + 1];
+    out[i * 3 + 2] = in[i * 4 + 2];
+  }
+}
+
+/*only without color key, opaque alpha for every pixel*/
+static void convertRGB8ToRGBA8(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  size_t i = 0;
+#if defined(LODEPNG_SIMD_X86)
+  if(cpuFeatures() & LODEPNG_CPU_SSSE3) i = convertRGB8ToRGBA8SSSE3(out, in, numpixels);
+#elif defined(LODEPNG_SIMD_NEON)
+  for(; i + 16 <= numpixels; i += 16) {
+    uint8x16x3_t v = vld3q_u8(in + i * 3);
+    uint8x16x4_t rgba;
+    rgba.val[0] = v.val[0];
+    rgba.val[1] = v.val[1];
+    rgba.val[2] = v.val[2];
+    rgba.val[3] = vdupq_n_u8(255);
+    vst4q_u8(out + i * 4, rgba);
+  }
+#endif
+  for(; i != numpixels; ++i) {
+    out[i * 4 + 0] = in[i * 3 + 0];
+    out[i * 4 + 1] = in[i * 3 + 1];
+    out[i * 4 + 2] = in[i * 3 + 2];
+    out[i * 4 + 3] = 255;
+  }
+}
+
+/*grey is the red channel, like rgba8ToPixel does*/
+static void convertRGBA8ToGrey8(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  size_t i = 0;
+#if defined(LODEPNG_SIMD_X86)
+  const __m128i red = _mm_set1_epi32(0xff);
+  for(; i + 16 <= numpixels; i += 16) {
+    __m128i v0 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 4)), red);
+    __m128i v1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 4 + 16)), red);
+    __m128i v2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 4 + 32)), red);
+    __m128i v3 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 4 + 48)), red);
+    __m128i lo = _mm_packs_epi32(v0, v1), hi = _mm_packs_epi32(v2, v3);
+    _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(LODEPNG_SIMD_NEON)
+  for(; i + 16 <= numpixels; i += 16) vst1q_u8(out + i, vld4q_u8(in + i * 4).val[0]);
+#endif
+  for(; i != numpixels; ++i) out[i] = in[i * 4];
+}
+
+static void convertRGB8ToGrey8(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  size_t i = 0;
+#if defined(LODEPNG_SIMD_X86)
+  if(cpuFeatures() & LODEPNG_CPU_SSSE3) i = convertRGB8ToGrey8SSSE3(out, in, numpixels);
+#elif defined(LODEPNG_SIMD_NEON)
+  for(; i + 16 <= numpixels; i += 16) vst1q_u8(out + i, vld3q_u8(in + i * 3).val[0]);
+#endif
+  for(; i != numpixels; ++i) out[i] = in[i * 3];
+}
+
+/*only without color key, opaque alpha for every pixel*/
+static void convertGrey8ToRGBA8(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  size_t i = 0;
+#if defined(LODEPNG_SIMD_X86)
+  const __m128i alpha = _mm_set1_epi8((char)0xff);
+  for(; i + 16 <= numpixels; i += 16) {
+    __m128i g = _mm_loadu_si128((const __m128i*)(in + i));
+    __m128i gg = _mm_unpacklo_epi8(g, g), ga = _mm_unpacklo_epi8(g, alpha);
+    _mm_storeu_si128((__m128i*)(out + i * 4), _mm_unpacklo_epi16(gg, ga));
+    _mm_storeu_si128((__m128i*)(out + i * 4 + 16), _mm_unpackhi_epi16(gg, ga));
+    gg = _mm_unpackhi_epi8(g, g);
+    ga = _mm_unpackhi_epi8(g, alpha);
+    _mm_storeu_si128((__m128i*)(out + i * 4 + 32), _mm_unpacklo_epi16(gg, ga));
+    _mm_storeu_si128((__m128i*)(out + i * 4 + 48), _mm_unpackhi_epi16(gg, ga));
+  }
+#elif defined(LODEPNG_SIMD_NEON)
+  for(; i + 16 <= numpixels; i += 16) {
+    uint8x16x4_t rgba;
+    rgba.val[0] = rgba.val[1] = rgba.val[2] = vld1q_u8(in + i);
+    rgba.val[3] = vdupq_n_u8(255);
+    vst4q_u8(out + i * 4, rgba);
+  }
+#endif
+  for(; i != numpixels; ++i) {
+    out[i * 4 + 0] = out[i * 4 + 1] = out[i * 4 + 2] = in[i];
+    out[i * 4 + 3] = 255;
+  }
+}
+
+static void convertGrey8ToRGB8(unsigned char* out, const unsigned char* in, size_t numpixels) {
+  size_t i = 0;
+#if defined(LODEPNG_SIMD_X86)
+  if(cpuFeatures() & LODEPNG_CPU_SSSE3) i = convertGrey8ToRGB8SSSE3(out, in, numpixels);
+#elif defined(LODEPNG_SIMD_NEON)
+  for(; i + 16 <= numpixels; i += 16) {
+    uint8x16x3_t rgb;
+    rgb.val[0] = rgb.val[1] = rgb.val[2] = vld1q_u8(in + i);
+    vst3q_u8(out + i * 3, rgb);
+  }
+#endif
+  for(; i != numpixels; ++i) out[i * 3 + 0] = out[i * 3 + 1] = out[i * 3 + 2] = in[i];
+}
+
+/*returns 1 if the pair has a bulk conversion and out was written, 0 to use the generic path*/
+static unsigned convertFast(unsigned char* out, const unsigned char* in,
+                            const LodePNGColorMode* mode_out, const LodePNGColorMode* mode_in,
+                            size_t numpixels) {
+  LodePNGColorType in_type = mode_in->colortype, out_type = mode_out->colortype;
+  if(mode_in->bitdepth == 16 && mode_out->bitdepth == 8) {
+    if(in_type != out_type) return 0;
+    convert16To8(out, in, numpixels * getNumColorChannels(in_type));
+    return 1;
+  }
+  if(mode_in->bitdepth != 8 || mode_out->bitdepth != 8) return 0;
+  if(in_type == LCT_RGBA && out_type == LCT_RGB) {
+    convertRGBA8ToRGB8(out, in, numpixels);
+  } else if(in_type == LCT_RGB && out_type == LCT_RGBA && !mode_in->key_defined) {
+    convertRGB8ToRGBA8(out, in, numpixels);
+  } else if(in_type == LCT_RGBA && out_type == LCT_GREY) {
+    convertRGBA8ToGrey8(out, in, numpixels);
+  } else if(in_type == LCT_RGB && out_type == LCT_GREY) {
+    convertRGB8ToGrey8(out, in, numpixels);
+  } else if(in_type == LCT_GREY && out_type == LCT_RGBA && !mode_in->key_defined) {
+    convertGrey8ToRGBA8(out, in, numpixels);
+  } else if(in_type == LCT_GREY && out_type == LCT_RGB) {
+    convertGrey8ToRGB8(out, in, numpixels);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
 unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
                          const LodePNGColorMode* mode_out, const LodePNGColorMode* mode_in,
                          unsigned w, unsigned h) {
   size_t i;
-  ColorTree tree;
+  ColorTable table;
   size_t numpixels = (size_t)w * (size_t)h;
   unsigned error = 0;
 
@@ -3138,6 +4531,8 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
     return 0;
   }
 
+  if(convertFast(out, in, mode_out, mode_in, numpixels)) return 0;
+
   if(mode_out->colortype == LCT_PALETTE) {
     size_t palettesize = mode_out->palettesize;
     const unsigned char* palette = mode_out->palette;
@@ -3158,10 +4553,10 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
       }
     }
     if(palettesize < palsize) palsize = palettesize;
-    color_tree_init(&tree);
+    color_table_init(&table);
     for(i = 0; i != palsize; ++i) {
       const unsigned char* p = &palette[i * 4];
-      color_tree_add(&tree, p[0], p[1], p[2], p[3], (unsigned)i);
+      color_table_add(&table, p[0], p[1], p[2], p[3], (unsigned)i);
     }
   }
 
@@ -3179,15 +4574,11 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
     unsigned char r = 0, g = 0, b = 0, a = 0;
     for(i = 0; i != numpixels; ++i) {
       getPixelColorRGBA8(&r, &g, &b, &a, in, i, mode_in);
-      error = rgba8ToPixel(out, i, mode_out, &tree, r, g, b, a);
+      error = rgba8ToPixel(out, i, mode_out, &table, r, g, b, a);
       if (error) break;
     }
   }
 
-  if(mode_out->colortype == LCT_PALETTE) {
-    color_tree_cleanup(&tree);
-  }
-
   return error;
 }
 
@@ -3287,7 +4678,7 @@ unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
                                    const LodePNGColorMode* mode_in) {
   unsigned error = 0;
   size_t i;
-  ColorTree tree;
+  ColorTable table;
   size_t numpixels = (size_t)w * (size_t)h;
 
   /* mark things as done already if it would be impossible to have a more expensive case */
@@ -3302,9 +4693,9 @@ unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
 
   profile->numpixels += numpixels;
 
-  color_tree_init(&tree);
+  color_table_init(&table);
 
-  /*If the profile was already filled in from previous data, fill its palette in tree
+  /*If the profile was already filled in from previous data, fill its palette in table
   and mark things as done already if we know they are the most expensive case already*/
   if(profile->alpha) alpha_done = 1;
   if(profile->colored) colored_done = 1;
@@ -3315,7 +4706,7 @@ unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
   if(!numcolors_done) {
     for(i = 0; i < profile->numcolors; i++) {
       const unsigned char* color = &profile->palette[i * 4];
-      color_tree_add(&tree, color[0], color[1], color[2], color[3], i);
+      color_table_add(&table, color[0], color[1], color[2], color[3], i);
     }
   }
 
@@ -3418,8 +4809,8 @@ unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
       }
 
       if(!numcolors_done) {
-        if(!color_tree_has(&tree, r, g, b, a)) {
-          color_tree_add(&tree, r, g, b, a, profile->numcolors);
+        if(color_table_get(&table, r, g, b, a) < 0) {
+          color_table_add(&table, r, g, b, a, profile->numcolors);
           if(profile->numcolors < 256) {
             unsigned char* p = profile->palette;
             unsigned n = profile->numcolors;
@@ -3455,7 +4846,6 @@ unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
     profile->key_b += (profile->key_b << 8);
   }
 
-  color_tree_cleanup(&tree);
   return error;
 }
 
@@ -3689,6 +5079,239 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
+#if defined(LODEPNG_UNFILTER_SSE2) || defined(LODEPNG_UNFILTER_NEON)
+/*
+The kernels below reconstruct all channels of a 3 or 4 byte pixel at once. Sub,
+Average and Paeth depend on the pixel to the left, so they still step one pixel
+at a time; Up and the 4-byte Sub work on 16 bytes at a time. The left and upper
+left pixels start at zero, which gives the same result as the special cased first
+pixel of the C version.
+*/
+static unsigned loadPixel(const unsigned char* p, size_t bpp) {
+  unsigned v;
+  if(bpp == 4) {
+    memcpy(&v, p, 4);
+    return v;
+  }
+  /*built in a register, a 3 byte memcpy goes through the stack and stalls store forwarding*/
+  return p[0] | ((unsigned)p[1] << 8u) | ((unsigned)p[2] << 16u);
+}
+
+static void storePixel(unsigned char* p, unsigned v, size_t bpp) {
+  if(bpp == 4) {
+    memcpy(p, &v, 4);
+    return;
+  }
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8u);
+  p[2] = (unsigned char)(v >> 16u);
+}
+#endif /*LODEPNG_UNFILTER_SSE2 || LODEPNG_UNFILTER_NEON*/
+
+#ifdef LODEPNG_UNFILTER_SSE2
+static void unfilterUpSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                           size_t length) {
+  size_t i = 0;
+  for(; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(precon + i));
+    _mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(x, b));
+  }
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+
+static void unfilterSubSSE2(unsigned char* recon, const unsigned char* scanline, size_t bpp, size_t length) {
+  __m128i a = _mm_setzero_si128();
+  size_t i = 0;
+  if(bpp == 4) {
+    /*prefix sum over the four pixels of a register, plus the last pixel of the previous one*/
+    for(; i + 16 <= length; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+      x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+      x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+      x = _mm_add_epi8(x, a);
+      _mm_storeu_si128((__m128i*)(recon + i), x);
+      a = _mm_shuffle_epi32(x, 0xFF);
+    }
+  }
+  for(; i != length; i += bpp) {
+    a = _mm_add_epi8(a, _mm_cvtsi32_si128((int)loadPixel(scanline + i, bpp)));
+    storePixel(recon + i, (unsigned)_mm_cvtsi128_si32(a), bpp);
+  }
+}
+
+static void unfilterAverageSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                size_t bpp, size_t length) {
+  const __m128i one = _mm_set1_epi8(1);
+  __m128i a = _mm_setzero_si128();
+  size_t i;
+  for(i = 0; i != length; i += bpp) {
+    __m128i b = _mm_cvtsi32_si128((int)loadPixel(precon + i, bpp));
+    __m128i x = _mm_cvtsi32_si128((int)loadPixel(scanline + i, bpp));
+    /*_mm_avg_epu8 rounds up, the filter rounds down*/
+    __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+    a = _mm_add_epi8(x, average);
+    storePixel(recon + i, (unsigned)_mm_cvtsi128_si32(a), bpp);
+  }
+}
+
+static __m128i absSSE2(__m128i x) {
+  return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+/*the channels are widened to 16 bits, so a + b - 2c can't overflow*/
+static __m128i paethSSE2(__m128i a, __m128i b, __m128i c, __m128i pa, __m128i pb, __m128i pc) {
+  __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+  __m128i usea = _mm_cmpeq_epi16(smallest, pa);
+  __m128i useb = _mm_cmpeq_epi16(smallest, pb);
+  /*same tie breaking as paethPredictor: a before b before c*/
+  __m128i nearest = _mm_or_si128(_mm_and_si128(useb, b), _mm_andnot_si128(useb, c));
+  return _mm_or_si128(_mm_and_si128(usea, a), _mm_andnot_si128(usea, nearest));
+}
+
+/*ABS is the 16-bit absolute value the instruction set offers*/
+#define LODEPNG_UNFILTER_PAETH_SSE(ABS) {\
+  const __m128i zero = _mm_setzero_si128();\
+  __m128i a = zero, c = zero;\
+  size_t i;\
+  for(i = 0; i != length; i += bpp) {\
+    __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)loadPixel(precon + i, bpp)), zero);\
+    __m128i x = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)loadPixel(scanline + i, bpp)), zero);\
+    __m128i p = _mm_sub_epi16(b, c);\
+    __m128i q = _mm_sub_epi16(a, c);\
+    /*the high byte of every lane stays zero, so a byte add wraps like the C version*/\
+    a = _mm_add_epi8(x, paethSSE2(a, b, c, ABS(p), ABS(q), ABS(_mm_add_epi16(p, q))));\
+    c = b;\
+    storePixel(recon + i, (unsigned)_mm_cvtsi128_si32(_mm_packus_epi16(a, a)), bpp);\
+  }\
+}
+
+static void unfilterPaethSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                              size_t bpp, size_t length) LODEPNG_UNFILTER_PAETH_SSE(absSSE2)
+
+LODEPNG_TARGET_SSSE3
+static void unfilterPaethSSSE3(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                               size_t bpp, size_t length) LODEPNG_UNFILTER_PAETH_SSE(_mm_abs_epi16)
+
+/*returns 1 if the scanline was reconstructed, 0 to leave it to the C version*/
+static int unfilterScanlineSIMD(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                size_t bytewidth, unsigned char filterType, size_t length) {
+  if(filterType == 2 && precon) {
+    unfilterUpSSE2(recon, scanline, precon, length);
+    return 1;
+  }
+  if(bytewidth != 3 && bytewidth != 4) return 0;
+  if(filterType == 1) {
+    if(bytewidth == 4) unfilterSubSSE2(recon, scanline, 4, length);
+    else unfilterSubSSE2(recon, scanline, 3, length);
+    return 1;
+  }
+  if(!precon) return 0;
+  if(filterType == 3) {
+    if(bytewidth == 4) unfilterAverageSSE2(recon, scanline, precon, 4, length);
+    else unfilterAverageSSE2(recon, scanline, precon, 3, length);
+    return 1;
+  }
+  if(filterType == 4) {
+    if(cpuFeatures() & LODEPNG_CPU_SSSE3) {
+      if(bytewidth == 4) unfilterPaethSSSE3(recon, scanline, precon, 4, length);
+      else unfilterPaethSSSE3(recon, scanline, precon, 3, length);
+    } else {
+      if(bytewidth == 4) unfilterPaethSSE2(recon, scanline, precon, 4, length);
+      else unfilterPaethSSE2(recon, scanline, precon, 3, length);
+    }
+    return 1;
+  }
+  return 0;
+}
+#endif /*LODEPNG_UNFILTER_SSE2*/
+
+#ifdef LODEPNG_UNFILTER_NEON
+static uint8x8_t loadPixelNEON(const unsigned char* p, size_t bpp) {
+  return vcreate_u8((unsigned long long)loadPixel(p, bpp));
+}
+
+static void storePixelNEON(unsigned char* p, uint8x8_t v, size_t bpp) {
+  storePixel(p, vget_lane_u32(vreinterpret_u32_u8(v), 0), bpp);
+}
+
+static void unfilterUpNEON(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                           size_t length) {
+  size_t i = 0;
+  for(; i + 16 <= length; i += 16) {
+    vst1q_u8(recon + i, vaddq_u8(vld1q_u8(scanline + i), vld1q_u8(precon + i)));
+  }
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+
+static void unfilterSubNEON(unsigned char* recon, const unsigned char* scanline, size_t bpp, size_t length) {
+  uint8x8_t a = vdup_n_u8(0);
+  size_t i;
+  for(i = 0; i != length; i += bpp) {
+    a = vadd_u8(a, loadPixelNEON(scanline + i, bpp));
+    storePixelNEON(recon + i, a, bpp);
+  }
+}
+
+static void unfilterAverageNEON(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                size_t bpp, size_t length) {
+  uint8x8_t a = vdup_n_u8(0);
+  size_t i;
+  for(i = 0; i != length; i += bpp) {
+    /*vhadd rounds down like the filter*/
+    a = vadd_u8(loadPixelNEON(scanline + i, bpp), vhadd_u8(a, loadPixelNEON(precon + i, bpp)));
+    storePixelNEON(recon + i, a, bpp);
+  }
+}
+
+static void unfilterPaethNEON(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                              size_t bpp, size_t length) {
+  uint8x8_t a = vdup_n_u8(0), c = vdup_n_u8(0);
+  size_t i;
+  for(i = 0; i != length; i += bpp) {
+    uint8x8_t b = loadPixelNEON(precon + i, bpp);
+    uint16x8_t pa = vabdl_u8(b, c);
+    uint16x8_t pb = vabdl_u8(a, c);
+    uint16x8_t pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));
+    uint16x8_t smallest = vminq_u16(pc, vminq_u16(pa, pb));
+    /*same tie breaking as paethPredictor: a before b before c*/
+    uint8x8_t usea = vmovn_u16(vceqq_u16(smallest, pa));
+    uint8x8_t useb = vmovn_u16(vceqq_u16(smallest, pb));
+    uint8x8_t nearest = vbsl_u8(usea, a, vbsl_u8(useb, b, c));
+    a = vadd_u8(loadPixelNEON(scanline + i, bpp), nearest);
+    c = b;
+    storePixelNEON(recon + i, a, bpp);
+  }
+}
+
+/*returns 1 if the scanline was reconstructed, 0 to leave it to the C version*/
+static int unfilterScanlineSIMD(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                size_t bytewidth, unsigned char filterType, size_t length) {
+  if(filterType == 2 && precon) {
+    unfilterUpNEON(recon, scanline, precon, length);
+    return 1;
+  }
+  if(bytewidth != 3 && bytewidth != 4) return 0;
+  if(filterType == 1) {
+    if(bytewidth == 4) unfilterSubNEON(recon, scanline, 4, length);
+    else unfilterSubNEON(recon, scanline, 3, length);
+    return 1;
+  }
+  if(!precon) return 0;
+  if(filterType == 3) {
+    if(bytewidth == 4) unfilterAverageNEON(recon, scanline, precon, 4, length);
+    else unfilterAverageNEON(recon, scanline, precon, 3, length);
+    return 1;
+  }
+  if(filterType == 4) {
+    if(bytewidth == 4) unfilterPaethNEON(recon, scanline, precon, 4, length);
+    else unfilterPaethNEON(recon, scanline, precon, 3, length);
+    return 1;
+  }
+  return 0;
+}
+#endif /*LODEPNG_UNFILTER_NEON*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
                                  size_t bytewidth, unsigned char filterType, size_t length) {
   /*
@@ -3701,6 +5324,9 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   */
 
   size_t i;
+#if defined(LODEPNG_UNFILTER_SSE2) || defined(LODEPNG_UNFILTER_NEON)
+  if(unfilterScanlineSIMD(recon, scanline, precon, bytewidth, filterType, length)) return 0;
+#endif
   switch(filterType) {
     case 0:
       for(i = 0; i != length; ++i) recon[i] = scanline[i];
@@ -4261,6 +5887,29 @@ static unsigned readChunk_iCCP(LodePNGInfo* info, const LodePNGDecompressSetting
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
+/*whether the CRC of a known chunk is checked when it is read*/
+static unsigned checkChunkCrc(const LodePNGDecoderSettings* settings, const unsigned char* chunk) {
+  if(settings->ignore_crc) return 0;
+  if(settings->crc_critical_only && lodepng_chunk_ancillary(chunk)) return 0;
+  /*lazily checked IDAT chunks are left to idatCrcError*/
+  if(settings->lazy_crc && !settings->zlibsettings.ignore_adler32 && lodepng_chunk_type_equals(chunk, "IDAT")) {
+    return 0;
+  }
+  return 1;
+}
+
+/*with lazy_crc, called once the IDAT data failed to decode: returns 57 if an IDAT chunk is corrupt,
+which is the better error than how the corruption broke the zlib data*/
+static unsigned idatCrcError(const LodePNGDecoderSettings* settings, const segvector* idat) {
+  size_t i;
+  if(!settings->lazy_crc || settings->ignore_crc || settings->zlibsettings.ignore_adler32) return 0;
+  for(i = 0; i != idat->size; ++i) {
+    /*the segments are the data of the chunks, which starts 8 bytes into them*/
+    if(lodepng_chunk_check_crc(idat->data[i].data - 8)) return 57; /*invalid CRC*/
+  }
+  return 0;
+}
+
 unsigned lodepng_inspect_chunk(LodePNGState* state, size_t pos,
                                const unsigned char* in, size_t insize) {
   const unsigned char* chunk = in + pos;
@@ -4306,7 +5955,7 @@ unsigned lodepng_inspect_chunk(LodePNGState* state, size_t pos,
     unhandled = 1;
   }
 
-  if(!error && !unhandled && !state->decoder.ignore_crc) {
+  if(!error && !unhandled && checkChunkCrc(&state->decoder, chunk)) {
     if(lodepng_chunk_check_crc(chunk)) return 57; /*invalid CRC*/
   }
 
@@ -4314,16 +5963,13 @@ unsigned lodepng_inspect_chunk(LodePNGState* state, size_t pos,
 }
 
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize) {
+/*reads all chunks after IHDR into state->info_png and lists where the IDAT data is in in, sets state->error.
+If index is not null, it receives the data of the prIX chunk*/
+static void decodeChunks(segvector* idat, LodePNGSegment* index, LodePNGState* state,
+                         const unsigned char* in, size_t insize) {
   unsigned char IEND = 0;
   const unsigned char* chunk;
-  size_t i;
-  ucvector idat; /*the data from idat chunks*/
-  ucvector scanlines;
-  size_t predict;
-  size_t outsize = 0;
+  size_t idatsize = 0;
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4331,23 +5977,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-
-  /* safe output values in case error happens */
-  *out = 0;
-  *w = *h = 0;
-
-  state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
-  if(state->error) return;
-
-  if(lodepng_pixel_overflow(*w, *h, &state->info_png.color, &state->info_raw)) {
-    CERROR_RETURN(state->error, 92); /*overflow possible due to amount of pixels*/
-  }
-
-  ucvector_init(&idat);
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
-  /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
-  IDAT data is put at the start of the in buffer*/
+  /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk*/
   while(!IEND && !state->error) {
     unsigned chunkLength;
     const unsigned char* data; /*the data in the chunk*/
@@ -4376,17 +6008,21 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
     /*IDAT chunk, containing compressed image data*/
     if(lodepng_chunk_type_equals(chunk, "IDAT")) {
-      size_t oldsize = idat.size;
-      size_t newsize;
-      if(lodepng_addofl(oldsize, chunkLength, &newsize)) CERROR_BREAK(state->error, 95);
-      if(!ucvector_resize(&idat, newsize)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-      for(i = 0; i != chunkLength; ++i) idat.data[oldsize + i] = data[i];
+      if(lodepng_addofl(idatsize, chunkLength, &idatsize)) CERROR_BREAK(state->error, 95);
+      if(!segvector_push_back(idat, data, chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     } else if(lodepng_chunk_type_equals(chunk, "IEND")) {
       /*IEND chunk*/
       IEND = 1;
+    } else if(lodepng_chunk_type_equals(chunk, "prIX")) {
+      /*where the parts of the IDAT data start, only valid for the data it was written with so never kept
+      with the unknown chunks*/
+      if(index) {
+        index->data = data;
+        index->size = chunkLength;
+      }
     } else if(lodepng_chunk_type_equals(chunk, "PLTE")) {
       /*palette chunk (PLTE)*/
       state->error = readChunk_PLTE(&state->info_png.color, data, chunkLength);
@@ -4458,13 +6094,212 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     }
 
-    if(!state->decoder.ignore_crc && !unknown) /*check CRC if wanted, only on known chunk types*/ {
+    if(!unknown && checkChunkCrc(&state->decoder, chunk)) /*check CRC if wanted, only on known chunk types*/ {
       if(lodepng_chunk_check_crc(chunk)) CERROR_BREAK(state->error, 57); /*invalid CRC*/
     }
 
     if(!IEND) chunk = lodepng_chunk_next_const(chunk);
   }
+}
+
+/*the parts of an image with a prIX chunk, inflated and then unfiltered by run_parts*/
+typedef struct IndexedParts {
+  const LodePNGDecompressSettings* settings;
+  const segvector* idat;
+  const unsigned char* index; /*first row and deflate data offset of every part after the first*/
+  size_t count;
+  size_t idatsize;
+  unsigned w, h, bpp;
+  size_t stride; /*bytes per scanline, with the filter type byte*/
+  unsigned char* scanlines;
+  unsigned char* out; /*0 to unfilter the scanlines in place*/
+  unsigned* adlers;
+  unsigned* errors;
+} IndexedParts;
+
+/*rows y0 to y1 and the deflate data from byte start to end of part i*/
+static void getIndexedPart(const IndexedParts* parts, size_t i, unsigned* y0, unsigned* y1,
+                           size_t* start, size_t* end) {
+  *y0 = i ? lodepng_read32bitInt(parts->index + 8 * (i - 1)) : 0;
+  *start = i ? lodepng_read32bitInt(parts->index + 8 * (i - 1) + 4) : 2;
+  *y1 = i + 1 != parts->count ? lodepng_read32bitInt(parts->index + 8 * i) : parts->h;
+  *end = i + 1 != parts->count ? lodepng_read32bitInt(parts->index + 8 * i + 4) : parts->idatsize - 4;
+}
+
+typedef struct InflatedPart {
+  unsigned char* data;
+  size_t size;
+  size_t filled;
+  unsigned adler;
+  unsigned check_adler;
+} InflatedPart;
+
+static unsigned inflatedPartConsume(void* user, const unsigned char* data, size_t size) {
+  InflatedPart* part = (InflatedPart*)user;
+  if(size > part->size - part->filled) return 91; /*decompressed size doesn't match prediction*/
+  memcpy(part->data + part->filled, data, size);
+  if(part->check_adler) part->adler = update_adler32(part->adler, data, (unsigned)size);
+  part->filled += size;
+  return 0;
+}
+
+static void inflateIndexedPart(void* task_data, size_t i) {
+  IndexedParts* parts = (IndexedParts*)task_data;
+  LodePNGBitReader reader;
+  LodePNGInflateSink sink;
+  InflatedPart part;
+  ucvector window;
+  unsigned y0, y1;
+  size_t start, end;
+  unsigned error;
+
+  getIndexedPart(parts, i, &y0, &y1, &start, &end);
+  part.data = parts->scanlines + y0 * parts->stride;
+  part.size = (y1 - y0) * parts->stride;
+  part.filled = 0;
+  part.adler = 1;
+  part.check_adler = !parts->settings->ignore_adler32;
+  sink.consume = inflatedPartConsume;
+  sink.user = &part;
+  sink.consumed = 0;
+  /*the input ends where the next part starts, which a part other than the last must reach exactly*/
+  LodePNGBitReader_initSegments(&reader, parts->idat->data, parts->idat->size);
+  reader.size = end;
+  reader.bitsize = end * 8;
+  reader.bp = start * 8;
+  ucvector_init(&window);
+  error = inflatev(&window, &reader, &sink, i + 1 != parts->count);
+  ucvector_cleanup(&window);
+  if(!error && (part.filled != part.size || (i + 1 != parts->count && reader.bp != reader.bitsize))) {
+    error = 91; /*decompressed size doesn't match prediction*/
+  }
+  parts->adlers[i] = part.adler;
+  parts->errors[i] = error;
+}
+
+static void unfilterIndexedPart(void* task_data, size_t i) {
+  IndexedParts* parts = (IndexedParts*)task_data;
+  unsigned y0, y1;
+  size_t start, end;
+  unsigned char* in;
+  getIndexedPart(parts, i, &y0, &y1, &start, &end);
+  in = parts->scanlines + y0 * parts->stride;
+  parts->errors[i] = unfilter(parts->out ? parts->out + y0 * (parts->stride - 1) : in, in, parts->w, y1 - y0,
+                              parts->bpp);
+}
+
+/*decodes a non-interlaced image whose IDAT data the prIX chunk index splits into parts, inflating and
+unfiltering them with settings->run_parts. scanlines must have room for all scanlines. Returns 0 when out
+holds the image, nonzero if the index does not match the data, which then must be decoded in one piece*/
+static unsigned decodeIndexed(unsigned char* out, unsigned char* scanlines, unsigned w, unsigned h,
+                              const LodePNGInfo* info_png, const LodePNGDecompressSettings* settings,
+                              const segvector* idat, const LodePNGSegment* index) {
+  IndexedParts parts;
+  LodePNGBitReader reader;
+  unsigned char bytes[4];
+  unsigned y0 = 0, y1;
+  size_t start = 2, end;
+  size_t i;
+  unsigned adler = 1, padded = 0, error = 0;
+
+  parts.settings = settings;
+  parts.idat = idat;
+  parts.index = index->data;
+  parts.count = index->size / 8 + 1;
+  parts.idatsize = 0;
+  for(i = 0; i != idat->size; ++i) parts.idatsize += idat->data[i].size;
+  parts.w = w;
+  parts.h = h;
+  parts.bpp = lodepng_get_bpp(&info_png->color);
+  parts.stride = lodepng_get_raw_size_idat(w, 1, &info_png->color);
+  parts.scanlines = scanlines;
+  parts.out = out;
+
+  /*the parts must cover the rows and the deflate data in order, and the zlib header must be valid*/
+  if(index->size == 0 || index->size % 8 != 0 || parts.idatsize < 6 || parts.bpp == 0) return 1;
+  for(i = 0; i + 1 != parts.count; ++i) {
+    y1 = lodepng_read32bitInt(parts.index + 8 * i);
+    end = lodepng_read32bitInt(parts.index + 8 * i + 4);
+    if(y1 <= y0 || y1 >= h || end <= start || end >= parts.idatsize - 4) return 1;
+    y0 = y1;
+    start = end;
+  }
+  LodePNGBitReader_initSegments(&reader, idat->data, idat->size);
+  copyBytes(&reader, bytes, 0, 2);
+  error = zlib_check_header(bytes, parts.idatsize);
+  if(error) return error;
+  /*removePaddingBits leaves the bits after the last pixel as they are*/
+  out[lodepng_get_raw_size(w, h, &info_png->color) - 1] = 0;
+
+  parts.adlers = (unsigned*)lodepng_malloc(parts.count * sizeof(unsigned));
+  parts.errors = (unsigned*)lodepng_malloc(parts.count * sizeof(unsigned));
+  if(!parts.adlers || !parts.errors) error = 83; /*alloc fail*/
+
+  if(!error) {
+    settings->run_parts(settings, parts.count, inflateIndexedPart, &parts);
+    for(i = 0; i != parts.count && !error; ++i) {
+      getIndexedPart(&parts, i, &y0, &y1, &start, &end);
+      error = parts.errors[i];
+      adler = adler32_combine(adler, parts.adlers[i], (y1 - y0) * parts.stride);
+      /*a part that starts with a filter on the scanline above can't be unfiltered on its own*/
+      if(y0 && scanlines[y0 * parts.stride] > 1) parts.out = 0;
+    }
+  }
+  if(!error && !settings->ignore_adler32) {
+    copyBytes(&reader, bytes, parts.idatsize - 4, 4);
+    if(adler != lodepng_read32bitInt(bytes)) error = 58; /*error, adler checksum not correct*/
+  }
+
+  if(!error && !parts.out) {
+    error = postProcessScanlines(out, scanlines, w, h, info_png);
+  } else if(!error) {
+    /*rows with padding bits are unfiltered in place and packed after all parts are done*/
+    padded = parts.bpp < 8 && w * parts.bpp != ((w * parts.bpp + 7) / 8) * 8;
+    if(padded) parts.out = 0;
+    settings->run_parts(settings, parts.count, unfilterIndexedPart, &parts);
+    for(i = 0; i != parts.count && !error; ++i) error = parts.errors[i];
+    if(!error && padded) {
+      for(i = 0; i != parts.count; ++i) {
+        getIndexedPart(&parts, i, &y0, &y1, &start, &end);
+        memmove(scanlines + y0 * (parts.stride - 1), scanlines + y0 * parts.stride, (y1 - y0) * (parts.stride - 1));
+      }
+      removePaddingBits(out, scanlines, w * parts.bpp, (parts.stride - 1) * 8, h);
+    }
+  }
+
+  lodepng_free(parts.adlers);
+  lodepng_free(parts.errors);
+  return error;
+}
+
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize) {
+  size_t i;
+  segvector idat; /*where the data of the idat chunks is*/
+  LodePNGSegment index; /*the prIX chunk*/
+  ucvector scanlines;
+  size_t predict;
+  size_t outsize = 0;
+  unsigned indexed = 0; /*whether decodeIndexed decoded the image*/
+  unsigned chunkerror; /*an error while reading the chunks, the data was not decoded then*/
 
+  /* safe output values in case error happens */
+  *out = 0;
+  *w = *h = 0;
+
+  state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
+  if(state->error) return;
+
+  if(lodepng_pixel_overflow(*w, *h, &state->info_png.color, &state->info_raw)) {
+    CERROR_RETURN(state->error, 92); /*overflow possible due to amount of pixels*/
+  }
+
+  segvector_init(&idat);
+  index.data = 0;
+  index.size = 0;
+  decodeChunks(&idat, &index, state, in, insize);
+  chunkerror = state->error;
   ucvector_init(&scanlines);
   /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
   If the decompressed size does not match the prediction, the image must be corrupt.*/
@@ -4482,24 +6317,50 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     if(*w > 1) predict += lodepng_get_raw_size_idat((*w + 0) >> 1, (*h + 1) >> 1, color);
     predict += lodepng_get_raw_size_idat((*w + 0), (*h + 0) >> 1, color);
   }
-  if(!state->error && !ucvector_reserve(&scanlines, predict)) state->error = 83; /*alloc fail*/
-  if(!state->error) {
-    state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
-                                   idat.size, &state->decoder.zlibsettings);
-    if(!state->error && scanlines.size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
-  }
-  ucvector_cleanup(&idat);
-
   if(!state->error) {
     outsize = lodepng_get_raw_size(*w, *h, &state->info_png.color);
     *out = (unsigned char*)lodepng_malloc(outsize);
     if(!*out) state->error = 83; /*alloc fail*/
   }
   if(!state->error) {
+    const LodePNGDecompressSettings* settings = &state->decoder.zlibsettings;
+    if(settings->custom_zlib || settings->custom_inflate) {
+      /*custom decompressors take the IDAT data in one piece*/
+      ucvector joined;
+      ucvector_init(&joined);
+      for(i = 0; !state->error && i != idat.size; ++i) {
+        size_t oldsize = joined.size;
+        if(!ucvector_resize(&joined, oldsize + idat.data[i].size)) state->error = 83; /*alloc fail*/
+        else if(idat.data[i].size) memcpy(joined.data + oldsize, idat.data[i].data, idat.data[i].size);
+      }
+      if(!state->error) {
+        state->error = zlib_decompress(&scanlines.data, &scanlines.size, joined.data, joined.size, settings);
+      }
+      ucvector_cleanup(&joined);
+    } else {
+      /*the inflater wants room for a longest match past its position, with it a valid stream never reallocates*/
+      if(!ucvector_reserve(&scanlines, predict + 258)) state->error = 83; /*alloc fail*/
+      else {
+        if(index.data && settings->run_parts && state->info_png.interlace_method == 0) {
+          indexed = !decodeIndexed(*out, scanlines.data, *w, *h, &state->info_png, settings, &idat, &index);
+        }
+        if(!indexed) state->error = zlib_decompress_segments(&scanlines, idat.data, idat.size, settings, 0);
+      }
+    }
+    if(!state->error && !indexed && scanlines.size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
+  }
+
+  if(!state->error && !indexed) {
     for(i = 0; i < outsize; i++) (*out)[i] = 0;
     state->error = postProcessScanlines(*out, scanlines.data, *w, *h, &state->info_png);
   }
+  if(state->error && !chunkerror && idatCrcError(&state->decoder, &idat)) state->error = 57;
+  segvector_cleanup(&idat);
   ucvector_cleanup(&scanlines);
+  if(state->error) {
+    lodepng_free(*out);
+    *out = 0;
+  }
 }
 
 unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
@@ -4540,6 +6401,162 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
   return state->error;
 }
 
+/*state of lodepng_decode_rows, fed by the inflator through rowDecoderConsume*/
+typedef struct RowDecoder {
+  const LodePNGState* state;
+  unsigned w, h;
+  unsigned y; /*next row to complete*/
+  size_t bytewidth;
+  size_t linebytes; /*without the filter type byte*/
+  unsigned char* lines; /*two scanlines with filter type byte, row y is filled at (y & 1)*/
+  size_t filled; /*bytes of row y received so far*/
+  unsigned char* converted; /*one row in info_raw, 0 if info_png's colortype is passed through*/
+  LodePNGRowCallback callback;
+  void* user;
+} RowDecoder;
+
+static unsigned rowDecoderConsume(void* user, const unsigned char* data, size_t size) {
+  RowDecoder* decoder = (RowDecoder*)user;
+  size_t stride = decoder->linebytes + 1;
+  while(size) {
+    unsigned char* line = decoder->lines + (decoder->y & 1u) * stride;
+    const unsigned char* prevline = decoder->y ? decoder->lines + ((decoder->y - 1u) & 1u) * stride + 1 : 0;
+    const unsigned char* row = line + 1;
+    size_t amount = LODEPNG_MIN(size, stride - decoder->filled);
+    unsigned error;
+    if(decoder->y == decoder->h) return 91; /*decompressed size doesn't match prediction*/
+    memcpy(line + decoder->filled, data, amount);
+    decoder->filled += amount;
+    data += amount;
+    size -= amount;
+    if(decoder->filled != stride) break;
+
+    /*unfiltered in place, the previous row was unfiltered the same way*/
+    error = unfilterScanline(line + 1, line + 1, prevline, decoder->bytewidth, line[0], decoder->linebytes);
+    if(error) return error;
+    if(decoder->converted) {
+      error = lodepng_convert(decoder->converted, row, &decoder->state->info_raw,
+                              &decoder->state->info_png.color, decoder->w, 1);
+      if(error) return error;
+      row = decoder->converted;
+    }
+    error = decoder->callback(decoder->user, row, decoder->y, decoder->w, decoder->h);
+    if(error) return error;
+    ++decoder->y;
+    decoder->filled = 0;
+  }
+  return 0;
+}
+
+/*lodepng_decode_rows for what can't be streamed: decodes the whole image and hands out its rows*/
+static unsigned decodeRowsWhole(unsigned* w, unsigned* h, LodePNGState* state,
+                                const unsigned char* in, size_t insize,
+                                LodePNGRowCallback callback, void* user) {
+  unsigned char* image = 0;
+  unsigned char* row = 0;
+  size_t linebits, linebytes;
+  unsigned y;
+  unsigned error = lodepng_decode(&image, w, h, state, in, insize);
+  linebits = (size_t)(*w) * lodepng_get_bpp(&state->info_raw);
+  linebytes = (linebits + 7u) / 8u;
+  /*raw images pack rows of less than 8 bits per pixel without padding, rows are passed byte aligned*/
+  if(!error && linebits % 8u != 0) {
+    row = (unsigned char*)lodepng_malloc(linebytes);
+    if(!row) error = 83; /*alloc fail*/
+  }
+  for(y = 0; !error && y < *h; ++y) {
+    if(row) {
+      size_t ibp = y * linebits, obp = 0, x;
+      for(x = 0; x != linebits; ++x) setBitOfReversedStream(&obp, row, readBitFromReversedStream(&ibp, image));
+      error = callback(user, row, y, *w, *h);
+    }
+    else error = callback(user, image + y * linebytes, y, *w, *h);
+  }
+  lodepng_free(row);
+  lodepng_free(image);
+  return error;
+}
+
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             LodePNGRowCallback callback, void* user) {
+  segvector idat;
+  LodePNGSegment index; /*the prIX chunk*/
+  ucvector window;
+  RowDecoder decoder;
+  LodePNGInflateSink sink;
+  unsigned bpp;
+
+  *w = *h = 0;
+  state->error = lodepng_inspect(w, h, state, in, insize);
+  if(state->error) return state->error;
+  if(lodepng_pixel_overflow(*w, *h, &state->info_png.color, &state->info_raw)) {
+    CERROR_RETURN_ERROR(state->error, 92); /*overflow possible due to amount of pixels*/
+  }
+  /*Adam7 rows only complete in the last pass, and custom decompressors need all data at once*/
+  if(state->info_png.interlace_method != 0
+     || state->decoder.zlibsettings.custom_zlib || state->decoder.zlibsettings.custom_inflate) {
+    state->error = decodeRowsWhole(w, h, state, in, insize, callback, user);
+    return state->error;
+  }
+
+  segvector_init(&idat);
+  index.data = 0;
+  index.size = 0;
+  decodeChunks(&idat, &index, state, in, insize);
+  /*an indexed image decodes faster in parallel parts than streamed*/
+  if(!state->error && index.data && state->decoder.zlibsettings.run_parts) {
+    segvector_cleanup(&idat);
+    state->error = decodeRowsWhole(w, h, state, in, insize, callback, user);
+    return state->error;
+  }
+
+  decoder.state = state;
+  decoder.w = *w;
+  decoder.h = *h;
+  decoder.y = 0;
+  bpp = lodepng_get_bpp(&state->info_png.color);
+  decoder.bytewidth = (bpp + 7u) / 8u;
+  decoder.linebytes = lodepng_get_raw_size_idat(*w, 1, &state->info_png.color) - 1u;
+  decoder.lines = 0;
+  decoder.filled = 0;
+  decoder.converted = 0;
+  decoder.callback = callback;
+  decoder.user = user;
+
+  /*same color handling as lodepng_decode*/
+  if(!state->error && !state->decoder.color_convert) {
+    state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+  } else if(!state->error && !lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)) {
+    if(!(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA)
+       && !(state->info_raw.bitdepth == 8)) {
+      state->error = 56; /*unsupported color mode conversion*/
+    } else {
+      decoder.converted = (unsigned char*)lodepng_malloc(lodepng_get_raw_size(*w, 1, &state->info_raw));
+      if(!decoder.converted) state->error = 83; /*alloc fail*/
+    }
+  }
+  if(!state->error) {
+    decoder.lines = (unsigned char*)lodepng_malloc(2 * (decoder.linebytes + 1u));
+    if(!decoder.lines) state->error = 83; /*alloc fail*/
+  }
+  if(!state->error) {
+    sink.consume = rowDecoderConsume;
+    sink.user = &decoder;
+    sink.consumed = 0;
+    ucvector_init(&window);
+    state->error = zlib_decompress_segments(&window, idat.data, idat.size, &state->decoder.zlibsettings, &sink);
+    ucvector_cleanup(&window);
+    if(!state->error && (decoder.y != decoder.h || decoder.filled)) state->error = 91; /*decompressed size doesn't match prediction*/
+    if(state->error && idatCrcError(&state->decoder, &idat)) state->error = 57;
+  }
+
+  lodepng_free(decoder.lines);
+  lodepng_free(decoder.converted);
+  segvector_cleanup(&idat);
+  return state->error;
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth) {
   unsigned error;
@@ -4593,6 +6610,8 @@ void lodepng_decoder_settings_init(LodePNGDecoderSettings* settings) {
   settings->ignore_crc = 0;
   settings->ignore_critical = 0;
   settings->ignore_end = 0;
+  settings->lazy_crc = 0;
+  settings->crc_critical_only = 0;
   lodepng_decompress_settings_init(&settings->zlibsettings);
 }
 
@@ -4738,6 +6757,36 @@ static unsigned addChunk_IDAT(ucvector* out, const unsigned char* data, size_t d
   return error;
 }
 
+/*the IDAT chunk deflated in parts of rows scanlines that each start with an empty window, after the prIX
+chunk that lists where they start*/
+static unsigned addChunks_prIX_IDAT(ucvector* out, const unsigned char* data, size_t datasize, size_t stride,
+                                    unsigned rows, LodePNGCompressSettings* zlibsettings) {
+  ucvector zlibdata, index;
+  size_t partsize = stride * rows;
+  size_t count = (datasize + partsize - 1) / partsize;
+  size_t i;
+  unsigned error = 0;
+  size_t* offsets = (size_t*)lodepng_malloc(count * sizeof(size_t));
+  if(!offsets) return 83; /*alloc fail*/
+
+  ucvector_init(&zlibdata);
+  ucvector_init(&index);
+  zlib_add_header(&zlibdata);
+  error = zlib_compress_parts(&zlibdata, data, datasize, partsize, 1, offsets, zlibsettings);
+  /*the first part starts at row 0 right after the zlib header and is not listed*/
+  for(i = 1; !error && i != count; ++i) {
+    lodepng_add32bitInt(&index, (unsigned)(i * rows));
+    lodepng_add32bitInt(&index, (unsigned)offsets[i]);
+  }
+  if(!error) error = addChunk(out, "prIX", index.data, index.size);
+  if(!error) error = addChunk(out, "IDAT", zlibdata.data, zlibdata.size);
+  ucvector_cleanup(&zlibdata);
+  ucvector_cleanup(&index);
+  lodepng_free(offsets);
+
+  return error;
+}
+
 static unsigned addChunk_IEND(ucvector* out) {
   unsigned error = 0;
   error = addChunk(out, "IEND", 0, 0);
@@ -5183,6 +7232,29 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   return error;
 }
 
+/*refilters the first scanline of every part of rows scanlines with Sub if its filter looks at the scanline
+above, so that the parts of an indexed image unfilter on their own*/
+static void filterPartStarts(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                             unsigned bpp, unsigned rows) {
+  size_t linebytes = (w * bpp + 7) / 8;
+  size_t bytewidth = (bpp + 7) / 8;
+  unsigned y;
+  for(y = rows; y < h; y += rows) {
+    unsigned char* line = &out[(1 + linebytes) * y];
+    if(line[0] > 1) {
+      line[0] = 1;
+      filterScanline(line + 1, &in[linebytes * y], 0, linebytes, bytewidth, 1);
+    }
+  }
+}
+
+/*index_rows of the settings if the image gets an index, 0 if its IDAT data is deflated in one piece*/
+static unsigned getIndexRows(const LodePNGInfo* info_png, unsigned h, const LodePNGEncoderSettings* settings) {
+  if(info_png->interlace_method != 0 || h <= settings->index_rows) return 0;
+  if(settings->zlibsettings.custom_zlib || settings->zlibsettings.custom_deflate) return 0;
+  return settings->index_rows;
+}
+
 static void addPaddingBits(unsigned char* out, const unsigned char* in,
                            size_t olinebits, size_t ilinebits, unsigned h) {
   /*The opposite of the removePaddingBits function
@@ -5263,6 +7335,7 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
   *) if adam7: 1) Adam7_interlace 2) 7x add padding bits 3) 7x filter
   */
   unsigned bpp = lodepng_get_bpp(&info_png->color);
+  unsigned rows = getIndexRows(info_png, h, settings);
   unsigned error = 0;
 
   if(info_png->interlace_method == 0) {
@@ -5278,11 +7351,13 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
         if(!error) {
           addPaddingBits(padded, in, ((w * bpp + 7) / 8) * 8, w * bpp, h);
           error = filter(*out, padded, w, h, &info_png->color, settings);
+          if(!error && rows) filterPartStarts(*out, padded, w, h, bpp, rows);
         }
         lodepng_free(padded);
       } else {
         /*we can immediately filter into the out buffer, no other steps needed*/
         error = filter(*out, in, w, h, &info_png->color, settings);
+        if(!error && rows) filterPartStarts(*out, in, w, h, bpp, rows);
       }
     }
   } else /*interlace_method is 1 (Adam7)*/ {
@@ -5497,6 +7572,7 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
   else preProcessScanlines(&data, &datasize, image, w, h, &info, &state->encoder);
 
   /* output all PNG chunks */ {
+    unsigned index_rows = getIndexRows(&info, h, &state->encoder);
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     size_t i;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -5546,7 +7622,11 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
     }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     /*IDAT (multiple IDAT chunks must be consecutive)*/
-    state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings);
+    if(index_rows) {
+      state->error = addChunks_prIX_IDAT(&outv, data, datasize, datasize / h, index_rows,
+                                         &state->encoder.zlibsettings);
+    }
+    else state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings);
     if(state->error) goto cleanup;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     /*tIME*/
@@ -5665,6 +7745,7 @@ void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings) {
   settings->auto_convert = 1;
   settings->force_palette = 0;
   settings->predefined_filters = 0;
+  settings->index_rows = 0;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   settings->add_id = 0;
   settings->text_compression = 1;
@@ -5786,6 +7867,8 @@ const char* lodepng_error_text(unsigned code) {
     case 102: return "not allowed to set grayscale ICC profile with colored pixels by PNG specification";
     case 103: return "invalid palette index in bKGD chunk. Maybe it came before PLTE chunk?";
     case 104: return "invalid bKGD color while encoding (e.g. palette index out of range)";
+    case 105: return "compression level must be 0 to 9";
+    case 106: return "compression levels 1 to 9 can't compress 4 GB or more at once";
   }
   return "unknown error code";
 }
@@ -5916,6 +7999,21 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
   return decode(out, w, h, state, in.empty() ? 0 : &in[0], in.size());
 }
 
+static unsigned rowCallbackTrampoline(void* user, const unsigned char* row, unsigned y, unsigned w, unsigned h) {
+  return (*static_cast<const RowCallback*>(user))(row, y, w, h);
+}
+
+unsigned decode_rows(unsigned& w, unsigned& h, State& state,
+                     const unsigned char* in, size_t insize, const RowCallback& callback) {
+  return lodepng_decode_rows(&w, &h, &state, in, insize, rowCallbackTrampoline,
+                             const_cast<RowCallback*>(&callback));
+}
+
+unsigned decode_rows(unsigned& w, unsigned& h, State& state,
+                     const std::vector<unsigned char>& in, const RowCallback& callback) {
+  return decode_rows(w, h, state, in.empty() ? 0 : &in[0], in.size(), callback);
+}
+
 #ifdef LODEPNG_COMPILE_DISK
 unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h, const std::string& filename,
                 LodePNGColorType colortype, unsigned bitdepth) {
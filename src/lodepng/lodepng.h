@@ -90,6 +90,7 @@ source files with custom allocators.*/
 #endif
 
 #ifdef LODEPNG_COMPILE_CPP
+#include <functional>
 #include <vector>
 #include <string>
 #endif /*LODEPNG_COMPILE_CPP*/
@@ -275,6 +276,15 @@ struct LodePNGDecompressSettings {
                              const LodePNGDecompressSettings*);
 
   const void* custom_context; /*optional custom settings for custom functions*/
+
+  /*Decode images with a prIX chunk (see index_rows of LodePNGEncoderSettings) in parts that
+  run_parts can run in parallel, e.g. on a thread pool (default: null, decode in one piece).
+  run_parts must call task(task_data, i) once for every i below count, in any order and on
+  any threads, and return when all calls are done. If the index does not match the data, the
+  image is decoded in one piece after all. lodepng_decode_rows decodes such images whole instead
+  of streaming them. Not used with custom_zlib or custom_inflate*/
+  void (*run_parts)(const LodePNGDecompressSettings* settings, size_t count,
+                    void (*task)(void* task_data, size_t i), void* task_data);
 };
 
 extern const LodePNGDecompressSettings lodepng_default_decompress_settings;
@@ -295,6 +305,9 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
   unsigned minmatch; /*mininum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  /*compression level from 1 (fastest) to 9 (smallest) like zlib's, searches with a faster
+  matcher than the four settings above, which it replaces. Default: 0, use those settings*/
+  unsigned level;
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -308,6 +321,16 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
                              const LodePNGCompressSettings*);
 
   const void* custom_context; /*optional custom settings for custom functions*/
+
+  /*Compress in parts of part_size bytes (default: 256K) that run_parts can run in parallel,
+  e.g. on a thread pool (default: null, compress in one piece). run_parts must call
+  task(task_data, i) once for every i below count, in any order and on any threads, and
+  return when all calls are done. Each part is primed with the 32K before it and all but
+  the last end with a sync flush, so the result is one standard zlib stream, the same
+  however the parts were run. Not used with custom_deflate or for input of one part*/
+  size_t part_size;
+  void (*run_parts)(const LodePNGCompressSettings* settings, size_t count,
+                    void (*task)(void* task_data, size_t i), void* task_data);
 };
 
 extern const LodePNGCompressSettings lodepng_default_compress_settings;
@@ -622,6 +645,12 @@ typedef struct LodePNGDecoderSettings {
   unsigned ignore_crc; /*ignore CRC checksums*/
   unsigned ignore_critical; /*ignore unknown critical chunks*/
   unsigned ignore_end; /*ignore issues at end of file if possible (missing IEND chunk, too large chunk, ...)*/
+  /*for trusted files, e.g. the application's own assets, when ignore_crc is off (default of both: false):
+  lazy_crc only checks the CRCs of IDAT chunks if their data fails to decode, to still report error 57,
+  the adler32 of the zlib data covers them otherwise (so with ignore_adler32 they are checked as usual).
+  crc_critical_only skips the CRCs of ancillary chunks*/
+  unsigned lazy_crc;
+  unsigned crc_critical_only;
   /* TODO: make a system involving warnings with levels and a strict mode instead. Other potentially recoverable
      errors: srgb rendering intent value, size of content of ancillary chunks, more than 79 characters for some
      strings, placement/combination rules for ancillary chunks, crc of unknown chunks, allowed characters
@@ -713,6 +742,15 @@ typedef struct LodePNGEncoderSettings {
   /*force creating a PLTE chunk if colortype is 2 or 6 (= a suggested palette).
   If colortype is 3, PLTE is _always_ created.*/
   unsigned force_palette;
+
+  /*If not 0, the IDAT data of a non-interlaced image is deflated in parts of index_rows
+  scanlines that each start with an empty window, and whose first scanline is filtered with
+  None or Sub. The private chunk prIX before the IDAT chunks lists where the parts start: for
+  every part after the first, its first row and the offset of its deflate data in the zlib
+  stream, as 4 byte big endian integers. Other decoders skip the chunk, lodepng decodes the
+  parts in parallel when the decompress settings have run_parts. Costs a little compression.
+  Not used with custom_zlib or custom_deflate. Default: 0*/
+  unsigned index_rows;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   /*add LodePNG identifier and version as a text chunk, for debugging*/
   unsigned add_id;
@@ -766,6 +804,26 @@ information is placed in the info_png field of the LodePNGState.
 unsigned lodepng_inspect(unsigned* w, unsigned* h,
                          LodePNGState* state,
                          const unsigned char* in, size_t insize);
+
+/*
+Receives one decoded row of lodepng_decode_rows in the info_raw color type. Rows
+start at a byte boundary even when a pixel has less than 8 bits, and are only
+valid during the call. A nonzero return value stops decoding and is returned.
+*/
+typedef unsigned (*LodePNGRowCallback)(void* user, const unsigned char* row, unsigned y, unsigned w, unsigned h);
+
+/*
+Same as lodepng_decode, but the image is streamed to callback row by row, top to
+bottom, instead of into one buffer. Scanlines are inflated, unfiltered and converted
+as the data comes in, and the IDAT chunks are read in place from in, so only
+a 96K inflate window and a few rows are held in memory. Together with a memory mapped
+file, the PNG is never copied at all. Interlaced images, images with a prIX index when
+the decompress settings have run_parts, and settings with custom_zlib or custom_inflate,
+are decoded whole first and then handed out row by row.
+*/
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             LodePNGRowCallback callback, void* user);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 /*
@@ -979,6 +1037,13 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
 unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
                 State& state,
                 const std::vector<unsigned char>& in);
+
+/* Same as lodepng_decode_rows, w and h are set before the first row arrives. callback must not throw. */
+typedef std::function<unsigned(const unsigned char* row, unsigned y, unsigned w, unsigned h)> RowCallback;
+unsigned decode_rows(unsigned& w, unsigned& h, State& state,
+                     const unsigned char* in, size_t insize, const RowCallback& callback);
+unsigned decode_rows(unsigned& w, unsigned& h, State& state,
+                     const std::vector<unsigned char>& in, const RowCallback& callback);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -1727,6 +1792,8 @@ state.decoder.zlibsettings.custom_...: use custom inflate function
 state.decoder.ignore_crc: ignore CRC checksums
 state.decoder.ignore_critical: ignore unknown critical chunks
 state.decoder.ignore_end: ignore missing IEND chunk. May fail if this corruption causes other errors
+state.decoder.lazy_crc: check IDAT CRCs only when the image data fails to decode
+state.decoder.crc_critical_only: don't check the CRCs of ancillary chunks
 state.decoder.color_convert: convert internal PNG color to chosen one
 state.decoder.read_text_chunks: whether to read in text metadata chunks
 state.decoder.remember_unknown_chunks: whether to read in unknown chunks
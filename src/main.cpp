@@ -1,13 +1,49 @@
 #include <exception>
 #include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
 #include "application.hpp"
+#include "util/log.hpp"
 
 int GLOBAL_NUM_THREADS = 1;
 int GLOBAL_NUM_ENTITIES = 250;
-bool GLOBAL_TESTING = true;
+bool GLOBAL_CPU_PATHS = false;
+bool GLOBAL_TRACE = false;
+// 0 picks a seed from the clock, the seed in use is printed at start-up
+uint64_t GLOBAL_SEED = 0;
+std::string GLOBAL_RECORD_FILE = "";
+std::string GLOBAL_REPLAY_FILE = "";
+// shared memory segment read by MetricsView, "none" to turn publishing off
+std::string GLOBAL_METRICS_NAME = "3d3_metrics";
 
 int main(int argc, char *argv[])
 {
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "--seed")
+			GLOBAL_SEED = std::strtoull(argv[i + 1], nullptr, 10);
+		else if (arg == "--record")
+			GLOBAL_RECORD_FILE = argv[i + 1];
+		else if (arg == "--replay")
+			GLOBAL_REPLAY_FILE = argv[i + 1];
+		else if (arg == "--log-level")
+		{
+			LogLevel level;
+			if (Logger::parseLevel(argv[i + 1], level))
+				Logger::get().setLevel(level);
+			else
+				std::cerr << "unknown log level " << argv[i + 1] << std::endl;
+		}
+		else if (arg == "--log")
+			Logger::get().setFile(argv[i + 1]);
+		else if (arg == "--metrics")
+			GLOBAL_METRICS_NAME = std::string(argv[i + 1]) == "none" ? "" : argv[i + 1];
+		else
+			std::cerr << "unknown option " << arg << std::endl;
+	}
+
 	Application app;
 	try
 	{
@@ -15,6 +51,7 @@ int main(int argc, char *argv[])
 	}
 	catch (const std::exception& e)
 	{
+		Logger::get().shutdown();
 		std::cerr << e.what() << std::endl;
 		system("pause");
 		return EXIT_FAILURE;
@@ -0,0 +1,45 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include "mapgen.hpp"
+#include "../util/timer.hpp"
+
+// MapGen <spec> [output.png] [level]
+//   spec: gen:<maze|rooms|field|spiral>:<w>x<h>[:seed=<n>][:density=<f>]
+//   level: PNG compression, 1 fastest to 9 smallest, 0 or left out lodepng's default
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: MapGen gen:<maze|rooms|field|spiral>:<w>x<h>[:seed=<n>][:density=<f>] [output.png] [level 1-9]\n");
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		MapSpec spec = parseMapSpec(argv[1]);
+		std::string output = argc > 2 ? argv[2] : mapSpecName(spec) + ".png";
+		int level = argc > 3 ? atoi(argv[3]) : 0;
+		if (level < 0 || level > 9)
+			throw std::runtime_error("the compression level must be 0 to 9");
+
+		Timer timer;
+		GeneratedMap map = generateMap(spec);
+		double generateTime = timer.restart();
+		writeMapPng(map, output, static_cast<unsigned>(level));
+		double writeTime = timer.elapsed();
+
+		size_t walls = 0;
+		for (uint8_t c : map.cells)
+			walls += c;
+		printf("%s: %u x %u, %.1f%% walls, generated in %.2f s, written in %.2f s\n",
+			output.c_str(), map.dims.x, map.dims.y, 100.0 * walls / map.cells.size(), generateTime, writeTime);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
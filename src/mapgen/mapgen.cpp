@@ -0,0 +1,326 @@
+#include "mapgen.hpp"
+#include "../util/random.hpp"
+#include "../util/mythreadpool.hpp"
+#include "../lodepng/lodepng.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+
+static const uint8_t FREE = 0;
+static const uint8_t WALL = 1;
+
+static const char* KIND_NAMES[MAP_KIND_COUNT] = { "maze", "rooms", "field", "spiral" };
+
+const char* mapKindName(MapKind kind)
+{
+	return kind < MAP_KIND_COUNT ? KIND_NAMES[kind] : "unknown";
+}
+
+bool isMapSpec(const std::string& text)
+{
+	return text.compare(0, 4, "gen:") == 0;
+}
+
+MapSpec parseMapSpec(const std::string& text)
+{
+	if (!isMapSpec(text))
+		throw std::runtime_error("not a map spec: " + text);
+
+	std::vector<std::string> parts;
+	size_t begin = 4;
+	while (begin <= text.size())
+	{
+		size_t end = text.find(':', begin);
+		if (end == std::string::npos)
+			end = text.size();
+		parts.push_back(text.substr(begin, end - begin));
+		begin = end + 1;
+	}
+	if (parts.size() < 2)
+		throw std::runtime_error("map spec needs a kind and a size: " + text);
+
+	MapSpec spec;
+	int kind = 0;
+	while (kind < MAP_KIND_COUNT && parts[0] != KIND_NAMES[kind])
+		kind++;
+	if (kind == MAP_KIND_COUNT)
+		throw std::runtime_error("unknown map kind: " + parts[0]);
+	spec.kind = static_cast<MapKind>(kind);
+
+	size_t x = parts[1].find('x');
+	if (x == std::string::npos)
+		throw std::runtime_error("map size must be <w>x<h>: " + parts[1]);
+	spec.width = static_cast<uint32_t>(std::strtoul(parts[1].substr(0, x).c_str(), nullptr, 10));
+	spec.height = static_cast<uint32_t>(std::strtoul(parts[1].substr(x + 1).c_str(), nullptr, 10));
+
+	for (size_t i = 2; i < parts.size(); i++)
+	{
+		const std::string& p = parts[i];
+		if (p.compare(0, 5, "seed=") == 0)
+			spec.seed = std::strtoull(p.c_str() + 5, nullptr, 10);
+		else if (p.compare(0, 8, "density=") == 0)
+			spec.density = static_cast<float>(std::atof(p.c_str() + 8));
+		else
+			throw std::runtime_error("unknown map spec option: " + p);
+	}
+	return spec;
+}
+
+std::string mapSpecName(const MapSpec& spec)
+{
+	char buf[128];
+	snprintf(buf, sizeof(buf), "%s_%ux%u_s%llu_d%.3f", mapKindName(spec.kind), spec.width, spec.height,
+		static_cast<unsigned long long>(spec.seed), spec.density);
+	return buf;
+}
+
+// Recursive backtracker without a stack: while generating, a visited node
+// stores the direction back to its parent, so backtracking just follows it.
+static void generateMaze(GeneratedMap& map, Xoshiro256& rng, float density)
+{
+	const int w = map.dims.x, h = map.dims.y;
+	const int nodesX = (w - 1) / 2, nodesY = (h - 1) / 2;
+	if (nodesX < 1 || nodesY < 1)
+		throw std::runtime_error("maze needs at least 3x3 cells");
+
+	const int dx[4] = { 1, 0, -1, 0 };
+	const int dy[4] = { 0, 1, 0, -1 };
+	const uint8_t VISITED = 2; // VISITED + direction to the parent
+	const uint8_t ROOT = VISITED + 4;
+	std::fill(map.cells.begin(), map.cells.end(), WALL);
+
+	auto cell = [&](int x, int y) -> uint8_t& { return map.cells[size_t(y) * w + x]; };
+	int cx = 2 * rng.below(nodesX) + 1;
+	int cy = 2 * rng.below(nodesY) + 1;
+	cell(cx, cy) = ROOT;
+
+	while (true)
+	{
+		int options[4];
+		int count = 0;
+		for (int d = 0; d < 4; d++)
+		{
+			int nx = cx + 2 * dx[d], ny = cy + 2 * dy[d];
+			if (nx >= 1 && ny >= 1 && nx < 2 * nodesX + 1 && ny < 2 * nodesY + 1 && cell(nx, ny) == WALL)
+				options[count++] = d;
+		}
+
+		if (count > 0)
+		{
+			int d = options[rng.below(count)];
+			cell(cx + dx[d], cy + dy[d]) = FREE;
+			cx += 2 * dx[d];
+			cy += 2 * dy[d];
+			cell(cx, cy) = VISITED + ((d + 2) & 3);
+			continue;
+		}
+
+		uint8_t v = cell(cx, cy);
+		if (v == ROOT)
+			break;
+		int back = v - VISITED;
+		cx += 2 * dx[back];
+		cy += 2 * dy[back];
+	}
+
+	for (int y = 1; y < 2 * nodesY + 1; y += 2)
+		for (int x = 1; x < 2 * nodesX + 1; x += 2)
+			cell(x, y) = FREE;
+
+	// knock out extra walls between nodes to add loops
+	if (density > 0.0f)
+	{
+		for (int y = 1; y < 2 * nodesY; y++)
+		{
+			for (int x = 1 + (y & 1); x < 2 * nodesX; x += 2)
+			{
+				if (cell(x, y) == WALL && rng.chance(density))
+					cell(x, y) = FREE;
+			}
+		}
+	}
+}
+
+static void generateRooms(GeneratedMap& map, Xoshiro256& rng, float density)
+{
+	const uint32_t w = map.dims.x, h = map.dims.y;
+	if (w < 8 || h < 8)
+		throw std::runtime_error("rooms need at least 8x8 cells");
+	std::fill(map.cells.begin(), map.cells.end(), WALL);
+
+	const uint32_t minSide = 3;
+	const uint32_t maxSide = std::max<uint32_t>(4, std::min<uint32_t>(48, std::min(w, h) / 8));
+	const double target = std::max(0.01, std::min(1.0, double(density))) * w * h;
+
+	struct Room { uint32_t x, y, w, h; };
+	std::vector<Room> rooms;
+	double covered = 0.0;
+	size_t attempts = static_cast<size_t>(target / (minSide * minSide)) + 16;
+	while ((covered < target || rooms.size() < 2) && attempts-- > 0)
+	{
+		Room r;
+		r.w = minSide + rng.below(maxSide - minSide + 1);
+		r.h = minSide + rng.below(maxSide - minSide + 1);
+		r.w = std::min(r.w, w - 2);
+		r.h = std::min(r.h, h - 2);
+		r.x = 1 + rng.below(w - r.w - 1);
+		r.y = 1 + rng.below(h - r.h - 1);
+		for (uint32_t y = r.y; y < r.y + r.h; y++)
+			std::fill_n(map.cells.begin() + size_t(y) * w + r.x, r.w, FREE);
+		rooms.push_back(r);
+		covered += double(r.w) * r.h;
+	}
+
+	// visit rooms in a serpentine over horizontal bands so that consecutive
+	// rooms are close and corridors stay short on big maps
+	const uint32_t band = 2 * maxSide;
+	std::sort(rooms.begin(), rooms.end(), [band](const Room& a, const Room& b)
+	{
+		uint32_t ba = a.y / band, bb = b.y / band;
+		if (ba != bb)
+			return ba < bb;
+		return (ba & 1) ? a.x > b.x : a.x < b.x;
+	});
+
+	auto hline = [&](uint32_t y, uint32_t xa, uint32_t xb)
+	{
+		for (uint32_t x = std::min(xa, xb); x <= std::max(xa, xb); x++)
+			map.cells[size_t(y) * w + x] = FREE;
+	};
+	auto vline = [&](uint32_t x, uint32_t ya, uint32_t yb)
+	{
+		for (uint32_t y = std::min(ya, yb); y <= std::max(ya, yb); y++)
+			map.cells[size_t(y) * w + x] = FREE;
+	};
+
+	// L shaped corridors, horizontal or vertical leg first
+	for (size_t i = 1; i < rooms.size(); i++)
+	{
+		uint32_t ax = rooms[i - 1].x + rooms[i - 1].w / 2, ay = rooms[i - 1].y + rooms[i - 1].h / 2;
+		uint32_t bx = rooms[i].x + rooms[i].w / 2, by = rooms[i].y + rooms[i].h / 2;
+		if (rng.below(2))
+		{
+			hline(ay, ax, bx);
+			vline(bx, ay, by);
+		}
+		else
+		{
+			vline(ax, ay, by);
+			hline(by, ax, bx);
+		}
+	}
+}
+
+static void generateField(GeneratedMap& map, Xoshiro256& rng, float density)
+{
+	for (auto& c : map.cells)
+		c = rng.chance(density) ? WALL : FREE;
+}
+
+// Rings inset by 1, 3, 5, ... with one gap each, alternating between the
+// top left and bottom right. Reaching the centre means walking half of
+// every ring while the Manhattan heuristic keeps pointing inwards.
+static void generateSpiral(GeneratedMap& map)
+{
+	const int w = map.dims.x, h = map.dims.y;
+	std::fill(map.cells.begin(), map.cells.end(), FREE);
+	auto cell = [&](int x, int y) -> uint8_t& { return map.cells[size_t(y) * w + x]; };
+
+	for (int k = 0;; k++)
+	{
+		int inset = 2 * k + 1;
+		int x0 = inset, y0 = inset, x1 = w - 1 - inset, y1 = h - 1 - inset;
+		if (x1 - x0 < 2 || y1 - y0 < 2)
+			break;
+		for (int x = x0; x <= x1; x++)
+		{
+			cell(x, y0) = WALL;
+			cell(x, y1) = WALL;
+		}
+		for (int y = y0; y <= y1; y++)
+		{
+			cell(x0, y) = WALL;
+			cell(x1, y) = WALL;
+		}
+		if (k & 1)
+			cell(x1 - 1, y1) = FREE;
+		else
+			cell(x0 + 1, y0) = FREE;
+	}
+}
+
+GeneratedMap generateMap(const MapSpec& spec)
+{
+	if (spec.width == 0 || spec.height == 0 || spec.width > MAPGEN_MAX_SIZE || spec.height > MAPGEN_MAX_SIZE)
+		throw std::runtime_error("map size must be between 1 and " + std::to_string(MAPGEN_MAX_SIZE));
+
+	GeneratedMap map;
+	map.dims = uvec2(spec.width, spec.height);
+	map.cells.assign(size_t(spec.width) * spec.height, FREE);
+
+	Xoshiro256 rng(spec.seed * 0x9e3779b97f4a7c15ull + spec.kind);
+	switch (spec.kind)
+	{
+	case MAP_MAZE:
+		generateMaze(map, rng, spec.density);
+		break;
+	case MAP_ROOMS:
+		generateRooms(map, rng, spec.density);
+		break;
+	case MAP_FIELD:
+		generateField(map, rng, spec.density);
+		break;
+	case MAP_SPIRAL:
+		generateSpiral(map);
+		break;
+	default:
+		throw std::runtime_error("unknown map kind");
+	}
+	return map;
+}
+
+// run_parts of LodePNGCompressSettings on the MyThreadPool in custom_context
+static void runDeflateParts(const LodePNGCompressSettings* settings, size_t count,
+	void (*task)(void* taskData, size_t i), void* taskData)
+{
+	MyThreadPool* pool = static_cast<MyThreadPool*>(const_cast<void*>(settings->custom_context));
+	for (size_t i = 0; i < count; i++)
+		pool->submit([task, taskData, i] { task(taskData, i); });
+	pool->waitForAll();
+}
+
+void writeMapPng(const GeneratedMap& map, const std::string& filename, unsigned level)
+{
+	// 1 bit per cell, rows are not padded
+	std::vector<unsigned char> bits((map.cells.size() + 7) / 8, 0);
+	for (size_t i = 0; i < map.cells.size(); i++)
+	{
+		if (map.cells[i] == WALL)
+			bits[i >> 3] |= 0x80 >> (i & 7);
+	}
+	lodepng::State state;
+	state.info_raw.colortype = LCT_GREY;
+	state.info_raw.bitdepth = 1;
+	// large maps take seconds to deflate on one thread, their parts are spread
+	// over all cores, the calling thread helps while it waits. The parts are
+	// indexed so that loading them can inflate them in parallel as well
+	MyThreadPool pool;
+	LodePNGCompressSettings& zlib = state.encoder.zlibsettings;
+	zlib.level = level;
+	if (bits.size() > zlib.part_size)
+	{
+		pool.init(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		zlib.custom_context = &pool;
+		zlib.run_parts = runDeflateParts;
+		size_t stride = (map.dims.x + 7) / 8 + 1;
+		state.encoder.index_rows = static_cast<unsigned>(std::max<size_t>(1, zlib.part_size / stride));
+	}
+	std::vector<unsigned char> png;
+	unsigned error = lodepng::encode(png, bits, map.dims.x, map.dims.y, state);
+	if (!error)
+		error = lodepng::save_file(png, filename);
+	if (error)
+		throw std::runtime_error("failed to write " + filename + ": " + lodepng_error_text(error));
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../entity.h"
+
+// Deterministic map generator for scaling benchmarks. The same spec and
+// seed always give the same map. Cells are 0 = free, 1 = wall, the same
+// as World::origMap.
+enum MapKind
+{
+	MAP_MAZE,   // perfect maze, density = fraction of extra walls knocked out (loops)
+	MAP_ROOMS,  // rooms joined by corridors, density = share of the area covered by rooms
+	MAP_FIELD,  // open field, density = chance of a cell being an obstacle
+	MAP_SPIRAL, // nested rings with alternating gaps, A*'s worst case
+	MAP_KIND_COUNT
+};
+
+struct MapSpec
+{
+	MapKind kind = MAP_FIELD;
+	uint32_t width = 256;
+	uint32_t height = 256;
+	uint64_t seed = 1;
+	float density = 0.2f;
+};
+
+struct GeneratedMap
+{
+	uvec2 dims;
+	std::vector<uint8_t> cells;
+};
+
+// sizes up to MAPGEN_MAX_SIZE per side
+#define MAPGEN_MAX_SIZE 16384
+
+const char* mapKindName(MapKind kind);
+// "gen:<kind>:<w>x<h>[:seed=<n>][:density=<f>]", e.g. gen:maze:4096x4096:seed=3
+bool isMapSpec(const std::string& text);
+MapSpec parseMapSpec(const std::string& text);
+// short name usable as a file name
+std::string mapSpecName(const MapSpec& spec);
+
+GeneratedMap generateMap(const MapSpec& spec);
+// 1-bit grey PNG, walls white so World::init reads them as walls. level 1
+// (fastest) to 9 (smallest) picks a zlib-like compression level, 0 lodepng's default
+void writeMapPng(const GeneratedMap& map, const std::string& filename, unsigned level = 0);
@@ -0,0 +1,224 @@
+#include "mapimage.hpp"
+#include "lodepng/lodepng.h"
+#include "util/mappedfile.hpp"
+#include "util/mythreadpool.hpp"
+#include "util/log.hpp"
+#include "util/tsc.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+// run_parts of LodePNGDecompressSettings on the MyThreadPool in custom_context,
+// which only starts its threads for a PNG that has parts
+static void runInflateParts(const LodePNGDecompressSettings* settings, size_t count,
+	void (*task)(void* taskData, size_t i), void* taskData)
+{
+	MyThreadPool* pool = static_cast<MyThreadPool*>(const_cast<void*>(settings->custom_context));
+	if (pool->threadCount() == 0)
+		pool->init(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	for (size_t i = 0; i < count; i++)
+		pool->submit([task, taskData, i] { task(taskData, i); });
+	pool->waitForAll();
+}
+
+GeneratedMap MapImage::occupancy() const
+{
+	GeneratedMap map;
+	map.dims = uvec2(width, height);
+	map.cells.resize(grey.size());
+	for (size_t i = 0; i < grey.size(); i++)
+		map.cells[i] = grey[i] == 255 ? 1 : 0;
+	return map;
+}
+
+MapImageCache& MapImageCache::get()
+{
+	static MapImageCache cache;
+	return cache;
+}
+
+std::shared_ptr<const MapImage> MapImageCache::load(const std::string& path)
+{
+	std::error_code error;
+	Key key;
+	key.size = std::filesystem::file_size(path, error);
+	if (error)
+		throw std::runtime_error("could not open " + path + ": " + error.message());
+	key.mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto found = mEntries.find(path);
+	if (found != mEntries.end() && found->second.key == key)
+		return found->second.image;
+
+	uint64_t start = tsc::now();
+	std::shared_ptr<MapImage> image = std::make_shared<MapImage>();
+	const std::string sidecar = path + ".raw";
+	if (readSidecar(sidecar, key, *image))
+	{
+		LOG_INFO("mapimage", "%s: %u x %u from %s in %.1f ms", path.c_str(), image->width, image->height,
+			sidecar.c_str(), tsc::toSeconds(tsc::now() - start) * 1000);
+	}
+	else
+	{
+		// the PNG is inflated straight out of the mapped file and its rows are
+		// converted to grey into the image, lodepng itself only holds a few scanlines.
+		// Large maps written by MapGen are indexed and inflate on all cores instead
+		std::unique_ptr<MappedFile> png(MappedFile::open(path));
+		if (!png)
+			throw std::runtime_error("could not map " + path);
+		MyThreadPool pool;
+		lodepng::State state;
+		state.info_raw.colortype = LCT_GREY;
+		state.info_raw.bitdepth = 8;
+		state.decoder.zlibsettings.custom_context = &pool;
+		state.decoder.zlibsettings.run_parts = runInflateParts;
+		// maps are our own assets, the adler32 of the image data is check enough
+		// and the IDAT CRCs are only read to explain a failed decode
+		state.decoder.lazy_crc = 1;
+		unsigned width = 0, height = 0;
+		unsigned code = lodepng::decode_rows(width, height, state, png->data(), png->size(),
+			[&](const unsigned char* row, unsigned y, unsigned w, unsigned h)
+		{
+			if (y == 0)
+				image->grey.resize(size_t(w) * h);
+			memcpy(&image->grey[size_t(y) * w], row, w);
+			return 0u;
+		});
+		if (code)
+			throw std::runtime_error("could not decode " + path + ": " + lodepng_error_text(code));
+		image->width = width;
+		image->height = height;
+		LOG_INFO("mapimage", "%s: %u x %u decoded in %.1f ms", path.c_str(), width, height,
+			tsc::toSeconds(tsc::now() - start) * 1000);
+		writeSidecar(sidecar, key, *image);
+	}
+
+	Entry& entry = mEntries[path];
+	entry.key = key;
+	entry.image = image;
+	return image;
+}
+
+void MapImageCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mEntries.clear();
+}
+
+template <typename T>
+static bool readValue(std::istream& in, T& value)
+{
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+static void writeValue(std::ostream& out, const T& value)
+{
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+bool MapImageCache::readSidecar(const std::string& path, const Key& key, MapImage& image)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		return false;
+
+	uint32_t magic = 0, version = 0;
+	Key stored;
+	uint8_t format = 0;
+	if (!readValue(in, magic) || !readValue(in, version) || !readValue(in, stored.size) || !readValue(in, stored.mtime) ||
+		!readValue(in, image.width) || !readValue(in, image.height) || !readValue(in, format))
+		return false;
+	// a sidecar of an older PNG is silently replaced
+	if (magic != MAGIC || version != VERSION || !(stored == key) || format > FORMAT_BITS)
+		return false;
+
+	// the header is trusted only if the file holds exactly the pixels it promises
+	size_t count = size_t(image.width) * image.height;
+	size_t payload = format == FORMAT_BITS ? (count + 7) / 8 : count;
+	std::error_code error;
+	if (count == 0 || std::filesystem::file_size(path, error) != uint64_t(in.tellg()) + payload || error)
+		return false;
+	image.grey.resize(count);
+	if (format == FORMAT_GREY8)
+		return static_cast<bool>(in.read(reinterpret_cast<char*>(image.grey.data()), count));
+
+	std::vector<uint8_t> bits((count + 7) / 8);
+	if (!in.read(reinterpret_cast<char*>(bits.data()), bits.size()))
+		return false;
+	uint8_t* out = image.grey.data();
+	for (size_t i = 0; i < count; i += 8)
+	{
+		uint8_t byte = bits[i >> 3];
+		size_t n = count - i < 8 ? count - i : 8;
+		for (size_t b = 0; b < n; b++)
+			out[i + b] = (byte & (0x80 >> b)) ? 255 : 0;
+	}
+	return true;
+}
+
+void MapImageCache::writeSidecar(const std::string& path, const Key& key, const MapImage& image)
+{
+	bool binary = true;
+	for (uint8_t v : image.grey)
+	{
+		if (v != 0 && v != 255)
+		{
+			binary = false;
+			break;
+		}
+	}
+
+	// written under another name and renamed, a crash never leaves half a sidecar
+	const std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			LOG_WARN("mapimage", "could not write %s, the map will be decoded again next time", path.c_str());
+			return;
+		}
+		writeValue(out, MAGIC);
+		writeValue(out, VERSION);
+		writeValue(out, key.size);
+		writeValue(out, key.mtime);
+		writeValue(out, image.width);
+		writeValue(out, image.height);
+		writeValue(out, static_cast<uint8_t>(binary ? FORMAT_BITS : FORMAT_GREY8));
+		if (binary)
+		{
+			std::vector<uint8_t> bits((image.grey.size() + 7) / 8, 0);
+			for (size_t i = 0; i < image.grey.size(); i++)
+			{
+				if (image.grey[i])
+					bits[i >> 3] |= 0x80 >> (i & 7);
+			}
+			out.write(reinterpret_cast<const char*>(bits.data()), bits.size());
+		}
+		else
+		{
+			out.write(reinterpret_cast<const char*>(image.grey.data()), image.grey.size());
+		}
+		if (!out)
+		{
+			out.close();
+			std::error_code error;
+			std::filesystem::remove(temporary, error);
+			LOG_WARN("mapimage", "could not write %s, the map will be decoded again next time", path.c_str());
+			return;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+	{
+		std::filesystem::remove(temporary, error);
+		LOG_WARN("mapimage", "could not write %s, the map will be decoded again next time", path.c_str());
+	}
+}
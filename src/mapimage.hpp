@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mapgen/mapgen.hpp"
+
+// A map PNG decoded to 8-bit grey. Colour images keep their red channel,
+// which is what World always thresholded.
+struct MapImage
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> grey;
+
+	// white is a wall, everything else is free
+	GeneratedMap occupancy() const;
+};
+
+// Decodes every map PNG once for both the world's occupancy grid and the
+// renderer's R8 texture. Entries are keyed by path, size and modification
+// time, so an edited PNG is decoded again.
+//
+// A decoded image is also written next to the PNG as <png>.raw and read
+// back instead of inflating the PNG on the next start. Layout, little endian:
+//   "MRAW" u32 version, u64 pngSize, i64 pngMtime, u32 width, u32 height,
+//   u8 format, pixels: FORMAT_GREY8 one byte per pixel, FORMAT_BITS one bit
+//   per pixel (MSB first, rows not padded) for images that are only 0 and 255
+class MapImageCache
+{
+public:
+	static MapImageCache& get();
+
+	// throws std::runtime_error when the file can't be read or decoded
+	std::shared_ptr<const MapImage> load(const std::string& path);
+	// drops the decoded images, sidecars stay on disk
+	void clear();
+
+private:
+	static constexpr uint32_t MAGIC = 0x5741524d; // "MRAW"
+	static constexpr uint32_t VERSION = 1;
+	enum Format : uint8_t
+	{
+		FORMAT_GREY8,
+		FORMAT_BITS
+	};
+
+	struct Key
+	{
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		bool operator==(const Key& other) const { return size == other.size && mtime == other.mtime; }
+	};
+
+	struct Entry
+	{
+		Key key;
+		std::shared_ptr<const MapImage> image;
+	};
+
+	static bool readSidecar(const std::string& path, const Key& key, MapImage& image);
+	static void writeSidecar(const std::string& path, const Key& key, const MapImage& image);
+
+	std::mutex mMutex;
+	std::unordered_map<std::string, Entry> mEntries;
+};
@@ -0,0 +1,164 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include "../util/metrics.hpp"
+#include "../util/sharedmemory.hpp"
+
+// MetricsView [segment] [--interval ms] [--once]
+//
+// Reads the segment published by MetricsRegistry (3d3_metrics by default)
+// through a read-only mapping and prints rates every interval. Rates are
+// taken over the publisher's own timestamps, so a late reader does not skew
+// them.
+
+static const metrics::Header* openSegment(SharedMemory*& memory, const std::string& name)
+{
+	memory = SharedMemory::open(name, true);
+	if (!memory)
+		return nullptr;
+	const metrics::Header* header = static_cast<const metrics::Header*>(memory->data());
+	if (memory->size() < sizeof(metrics::Header) || header->magic != metrics::MAGIC || header->version != metrics::VERSION)
+	{
+		delete memory;
+		memory = nullptr;
+		return nullptr;
+	}
+	return header;
+}
+
+static void printSample(const std::string& name, const metrics::Header* header, const metrics::Sample& previous, const metrics::Sample& current)
+{
+	double dt = (current.publishNs - previous.publishNs) * 1e-9;
+	auto rate = [&](size_t i, int value) -> double
+	{
+		if (dt <= 0.0 || i >= previous.metrics.size())
+			return 0.0;
+		return (current.metrics[i].values[value] - previous.metrics[i].values[value]) / dt;
+	};
+
+	printf("[%s] pid %llu, %.2f s\n", name.c_str(), static_cast<unsigned long long>(header->pid), dt);
+	printf("  %-20s %12s %12s\n", "counter", "total", "per s");
+	for (size_t i = 0; i < current.metrics.size(); i++)
+	{
+		const metrics::Sample::Metric& m = current.metrics[i];
+		if (m.type == metrics::TYPE_COUNTER)
+			printf("  %-20s %12.0f %12.1f\n", m.name.c_str(), m.values[0], rate(i, 0));
+	}
+	printf("  %-20s %12s\n", "gauge", "value");
+	for (size_t i = 0; i < current.metrics.size(); i++)
+	{
+		const metrics::Sample::Metric& m = current.metrics[i];
+		if (m.type == metrics::TYPE_GAUGE)
+			printf("  %-20s %12.2f\n", m.name.c_str(), m.values[0]);
+	}
+	printf("  %-20s %12s %12s %9s %9s %9s %9s\n", "latency [ms]", "count", "per s", "mean", "p50", "p99", "max");
+	for (size_t i = 0; i < current.metrics.size(); i++)
+	{
+		const metrics::Sample::Metric& m = current.metrics[i];
+		if (m.type != metrics::TYPE_HISTOGRAM || m.values[metrics::HISTOGRAM_COUNT] == 0)
+			continue;
+		printf("  %-20s %12.0f %12.1f %9.3f %9.3f %9.3f %9.3f\n", m.name.c_str(),
+			m.values[metrics::HISTOGRAM_COUNT], rate(i, metrics::HISTOGRAM_COUNT),
+			m.values[metrics::HISTOGRAM_MEAN], m.values[metrics::HISTOGRAM_P50],
+			m.values[metrics::HISTOGRAM_P99], m.values[metrics::HISTOGRAM_MAX]);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+	std::string name = "3d3_metrics";
+	int intervalMs = 1000;
+	bool once = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--interval" && i + 1 < argc)
+			intervalMs = std::max(10, atoi(argv[++i]));
+		else if (arg == "--once")
+			once = true;
+		else if (arg[0] != '-')
+			name = arg;
+		else
+		{
+			printf("usage: MetricsView [segment] [--interval ms] [--once]\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	SharedMemory* memory = nullptr;
+	const metrics::Header* header = nullptr;
+	bool waiting = false;
+	metrics::Sample previous;
+	auto lastChange = std::chrono::steady_clock::now();
+
+	for (;;)
+	{
+		if (!header)
+		{
+			header = openSegment(memory, name);
+			if (!header)
+			{
+				if (!waiting)
+					printf("waiting for %s...\n", name.c_str());
+				waiting = true;
+				std::this_thread::sleep_for(std::chrono::milliseconds(500));
+				continue;
+			}
+			waiting = false;
+			if (!metrics::readSample(header, previous))
+				previous = metrics::Sample();
+			lastChange = std::chrono::steady_clock::now();
+			if (once)
+			{
+				// rates need a second publication
+				std::this_thread::sleep_for(std::chrono::milliseconds(std::max<uint32_t>(header->intervalMs, 10) * 2));
+			}
+			else
+			{
+				continue;
+			}
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+		}
+
+		metrics::Sample current;
+		if (!metrics::readSample(header, current))
+		{
+			printf("[%s] publisher keeps the segment busy, skipped\n", name.c_str());
+			continue;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (current.publishCount == previous.publishCount)
+		{
+			// the owner is gone or stuck, look for a new segment
+			if (now - lastChange > std::chrono::seconds(3))
+			{
+				printf("[%s] no publication for 3 s\n", name.c_str());
+				delete memory;
+				memory = nullptr;
+				header = nullptr;
+				if (once)
+					return EXIT_FAILURE;
+			}
+			continue;
+		}
+		lastChange = now;
+
+		printSample(name, header, previous, current);
+		previous = std::move(current);
+		if (once)
+			break;
+	}
+
+	delete memory;
+	return EXIT_SUCCESS;
+}
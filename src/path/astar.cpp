@@ -0,0 +1,125 @@
+#include "astar.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+
+AstarScratch& AstarScratch::local()
+{
+	thread_local AstarScratch scratch;
+	return scratch;
+}
+
+static uint32_t manhattan(uvec2 a, uvec2 b)
+{
+	return std::abs(int(a.x) - int(b.x)) + std::abs(int(a.y) - int(b.y));
+}
+
+bool solvePath(const unsigned int* map, uvec2 dims, uvec2 start, uvec2 goal,
+	ivec2* steps, AstarScratch& scratch, uint32_t maxExpanded)
+{
+	for (int i = 0; i < PATH_STEPS; i++)
+		steps[i] = ivec2(0, 0);
+
+	size_t cells = size_t(dims.x) * dims.y;
+	if (start.x >= dims.x || start.y >= dims.y || goal.x >= dims.x || goal.y >= dims.y)
+		return false;
+
+	if (scratch.visited.size() != cells)
+	{
+		scratch.gscore.assign(cells, 0);
+		scratch.cameFrom.assign(cells, 0);
+		scratch.visited.assign(cells, 0);
+		scratch.stamp = 0;
+	}
+	// stamp*2 = seen, stamp*2+1 = closed
+	if (++scratch.stamp >= 0x7fffffff)
+	{
+		std::fill(scratch.visited.begin(), scratch.visited.end(), 0);
+		scratch.stamp = 1;
+	}
+	const uint32_t seen = scratch.stamp * 2;
+	const uint32_t closed = seen + 1;
+
+	auto index = [&dims](uint32_t x, uint32_t y) { return y * dims.x + x; };
+	auto push = [&scratch](uint32_t f, uint32_t cell)
+	{
+		scratch.open.push_back((uint64_t(f) << 32) | cell);
+		std::push_heap(scratch.open.begin(), scratch.open.end(), std::greater<uint64_t>());
+	};
+
+	uint32_t startIdx = index(start.x, start.y);
+	uint32_t goalIdx = index(goal.x, goal.y);
+	scratch.open.clear();
+	scratch.gscore[startIdx] = 0;
+	scratch.cameFrom[startIdx] = startIdx;
+	scratch.visited[startIdx] = seen;
+	push(manhattan(start, goal), startIdx);
+
+	uint32_t best = startIdx;
+	uint32_t bestH = manhattan(start, goal);
+	uint32_t expanded = 0;
+	bool found = false;
+
+	while (!scratch.open.empty() && expanded < maxExpanded)
+	{
+		std::pop_heap(scratch.open.begin(), scratch.open.end(), std::greater<uint64_t>());
+		uint32_t cell = uint32_t(scratch.open.back());
+		scratch.open.pop_back();
+		if (scratch.visited[cell] == closed)
+			continue;
+		scratch.visited[cell] = closed;
+		expanded++;
+
+		uvec2 pos(cell % dims.x, cell / dims.x);
+		uint32_t h = manhattan(pos, goal);
+		if (h < bestH)
+		{
+			bestH = h;
+			best = cell;
+		}
+		if (cell == goalIdx)
+		{
+			found = true;
+			break;
+		}
+
+		const int dx[4] = { 0, 0, 1, -1 };
+		const int dy[4] = { 1, -1, 0, 0 };
+		for (int i = 0; i < 4; i++)
+		{
+			int nx = int(pos.x) + dx[i];
+			int ny = int(pos.y) + dy[i];
+			if (nx < 0 || ny < 0 || nx >= int(dims.x) || ny >= int(dims.y))
+				continue;
+			uint32_t n = index(nx, ny);
+			if (map[n] != 0 || scratch.visited[n] == closed)
+				continue;
+			uint32_t g = scratch.gscore[cell] + 1;
+			if (scratch.visited[n] == seen && g >= scratch.gscore[n])
+				continue;
+			scratch.visited[n] = seen;
+			scratch.gscore[n] = g;
+			scratch.cameFrom[n] = cell;
+			push(g + manhattan(uvec2(nx, ny), goal), n);
+		}
+	}
+
+	// walk back from the target; the last PATH_STEPS moves seen here are the
+	// first ones of the path and land in slots [n-1 .. 0]
+	uint32_t target = found ? goalIdx : best;
+	uint32_t length = scratch.gscore[target];
+	uint32_t skip = length > PATH_STEPS ? length - PATH_STEPS : 0;
+	uint32_t cell = target;
+	for (uint32_t i = 0; i < skip; i++)
+		cell = scratch.cameFrom[cell];
+	int s = 0;
+	while (cell != startIdx && s < PATH_STEPS)
+	{
+		uint32_t prev = scratch.cameFrom[cell];
+		steps[s] = ivec2(int(cell % dims.x) - int(prev % dims.x), int(cell / dims.x) - int(prev / dims.x));
+		cell = prev;
+		s++;
+	}
+	return found;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "pathtypes.hpp"
+
+// Per-thread working memory for solvePath, sized to the map on first use.
+// Visited state is versioned so nothing is cleared between queries.
+struct AstarScratch
+{
+	std::vector<uint32_t> gscore;
+	std::vector<uint32_t> cameFrom;
+	std::vector<uint32_t> visited;
+	std::vector<uint64_t> open; // binary heap of (fscore << 32 | cell)
+	uint32_t stamp = 0;
+
+	static AstarScratch& local();
+};
+
+// 4-connected A* with a Manhattan heuristic. Writes PATH_STEPS moves to
+// steps in the compact back-to-front layout. If the goal is not reached
+// within maxExpanded nodes the path leads to the closest cell found.
+// Returns true if the goal was reached.
+bool solvePath(const unsigned int* map, uvec2 dims, uvec2 start, uvec2 goal,
+	ivec2* steps, AstarScratch& scratch, uint32_t maxExpanded = 1u << 20);
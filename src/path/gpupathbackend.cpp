@@ -0,0 +1,80 @@
+#include "gpupathbackend.hpp"
+#include "../renderer/renderer.hpp"
+#include "../util/memory.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void GpuPathBackend::submit(PathRequest* request)
+{
+	std::lock_guard<std::mutex> lock(mQueueMutex);
+	mQueue.push_back(request);
+}
+
+void GpuPathBackend::poll()
+{
+	MemoryScope memoryScope(MEM_PATH);
+	if (mCurrent)
+	{
+		if (!mRenderer.computeFinished())
+			return;
+		mRenderer.finishCompute();
+		mRoundTrip.record(mSubmitTimer.elapsed());
+		// the device wrote steps for the starts of this part only
+		memcpy(&mCurrent->result.steps[mOffset * PATH_STEPS], mRenderer.getSteps(), mStarts.size() * PATH_STEPS * sizeof(ivec2));
+		mOffset += mStarts.size();
+		if (mOffset < mCurrent->batch.queries.size())
+		{
+			submitPart();
+			return;
+		}
+		service->complete(mCurrent);
+		mCurrent = nullptr;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mQueueMutex);
+		if (mQueue.empty())
+			return;
+		mCurrent = mQueue.front();
+		mQueue.pop_front();
+	}
+
+	// the shader has a single goal per dispatch
+	const PathBatch& batch = mCurrent->batch;
+	for (auto& q : batch.queries)
+	{
+		if (q.goal.x != batch.queries[0].goal.x || q.goal.y != batch.queries[0].goal.y)
+			throw std::runtime_error("GpuPathBackend: all queries in a batch must share one goal");
+	}
+	if (batch.queries.empty())
+	{
+		service->complete(mCurrent);
+		mCurrent = nullptr;
+		return;
+	}
+	if (size_t(batch.dims.x) * batch.dims.y * sizeof(unsigned int) != mRenderer.getComputeMapSize())
+		throw std::runtime_error("GpuPathBackend: the map does not match the size given to initCompute");
+	if (mRenderer.getComputeEntityCount() == 0)
+		throw std::runtime_error("GpuPathBackend: initCompute made no room for entities");
+
+	mOffset = 0;
+	submitPart();
+}
+
+void GpuPathBackend::submitPart()
+{
+	const PathBatch& batch = mCurrent->batch;
+	size_t count = std::min(batch.queries.size() - mOffset, mRenderer.getComputeEntityCount());
+	mStarts.clear();
+	for (size_t q = mOffset; q < mOffset + count; q++)
+		mStarts.push_back(batch.queries[q].start);
+
+	uvec2 dims = batch.dims;
+	uvec2 goal = batch.queries[0].goal;
+	mRenderer.mapComputeMemory(const_cast<unsigned int*>(batch.map), mStarts.data(), &dims, &goal,
+		mRenderer.getComputeMapSize(), mStarts.size() * sizeof(uvec2));
+	mSubmitTimer.restart();
+	mRenderer.submitCompute();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "pathservice.hpp"
+#include "../util/histogram.hpp"
+#include "../util/timer.hpp"
+
+class Renderer;
+
+// Runs batches through Renderer's compute pipeline. The device buffers are
+// sized for one batch, so batches are queued and the next one is submitted
+// once poll() sees the previous transfer fence signalled. A batch with more
+// queries than initCompute made room for is dispatched in parts, a batch on
+// a map of another size is rejected.
+class GpuPathBackend : public PathBackend
+{
+public:
+	explicit GpuPathBackend(Renderer& renderer) :
+		mRenderer(renderer),
+		mRoundTrip(LatencyRegistry::get().histogram("compute"))
+	{}
+	const char* name() const override { return "gpu"; }
+	void submit(PathRequest* request) override;
+	void poll() override;
+private:
+	void submitPart();
+
+	Renderer& mRenderer;
+	std::mutex mQueueMutex;
+	std::deque<PathRequest*> mQueue;
+	PathRequest* mCurrent = nullptr;
+	// first query of the part in flight
+	size_t mOffset = 0;
+	std::vector<uvec2> mStarts;
+	// submitCompute to finishCompute
+	LatencyHistogram& mRoundTrip;
+	Timer mSubmitTimer;
+};
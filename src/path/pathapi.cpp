@@ -0,0 +1,224 @@
+#include "pathapi.h"
+#include "astar.hpp"
+#include "shmring.hpp"
+#include "../util/mythreadpool.hpp"
+#include "../lodepng/lodepng.h"
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+
+static_assert(sizeof(ps_ivec2) == sizeof(ivec2), "ps_ivec2 must match ivec2");
+static_assert(sizeof(ps_uvec2) == sizeof(uvec2), "ps_uvec2 must match uvec2");
+static_assert(PS_PATH_STEPS == PATH_STEPS, "step count must match the solver");
+
+struct ps_service
+{
+	std::vector<unsigned int> map;
+	uvec2 dims;
+	MyThreadPool pool;
+	unsigned int threads = 0;
+};
+
+struct ps_ring
+{
+	ShmRing* shm;
+};
+
+// splits the batch over the pool, the calling thread takes part too
+static void solveBatch(ps_service* service, const ps_query* queries, uint32_t count, ps_ivec2* steps)
+{
+	const uint32_t chunk = 16;
+	auto solveRange = [service, queries, steps](uint32_t begin, uint32_t end)
+	{
+		AstarScratch& scratch = AstarScratch::local();
+		for (uint32_t q = begin; q < end; q++)
+		{
+			uvec2 start(queries[q].start.x, queries[q].start.y);
+			uvec2 goal(queries[q].goal.x, queries[q].goal.y);
+			solvePath(service->map.data(), service->dims, start, goal,
+				reinterpret_cast<ivec2*>(steps + size_t(q) * PS_PATH_STEPS), scratch);
+		}
+	};
+
+	if (service->threads == 0 || count <= chunk)
+	{
+		solveRange(0, count);
+		return;
+	}
+	for (uint32_t begin = 0; begin < count; begin += chunk)
+	{
+		uint32_t end = std::min(count, begin + chunk);
+		service->pool.submit([solveRange, begin, end] { solveRange(begin, end); });
+	}
+	service->pool.waitForAll();
+}
+
+extern "C" {
+
+ps_service* ps_create(const uint32_t* map, uint32_t width, uint32_t height, uint32_t threads)
+{
+	if (!map || width == 0 || height == 0)
+		return nullptr;
+	ps_service* service = new ps_service();
+	service->map.assign(map, map + size_t(width) * height);
+	service->dims = uvec2(width, height);
+	service->threads = threads;
+	if (threads > 0)
+		service->pool.init(threads);
+	return service;
+}
+
+ps_service* ps_create_from_png(const char* filename, uint32_t threads)
+{
+	std::vector<unsigned char> image;
+	unsigned width, height;
+	if (lodepng::decode(image, width, height, filename, LCT_RGBA) != 0)
+		return nullptr;
+
+	std::vector<uint32_t> map(size_t(width) * height);
+	for (size_t i = 0; i < map.size(); i++)
+		map[i] = image[i * 4] == 255 ? 1 : 0;
+	return ps_create(map.data(), width, height, threads);
+}
+
+void ps_destroy(ps_service* service)
+{
+	delete service;
+}
+
+int ps_solve(ps_service* service, const ps_query* queries, uint32_t count, ps_ivec2* steps, double* latency)
+{
+	if (!service || (count > 0 && (!queries || !steps)))
+		return PS_ERROR;
+	auto start = std::chrono::steady_clock::now();
+	solveBatch(service, queries, count, steps);
+	if (latency)
+		*latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return PS_OK;
+}
+
+ps_ring* ps_ring_create(const char* name, uint32_t slots, uint32_t maxQueries)
+{
+	ShmRing* shm = ShmRing::create(name, slots, maxQueries);
+	return shm ? new ps_ring{ shm } : nullptr;
+}
+
+ps_ring* ps_ring_open(const char* name)
+{
+	ShmRing* shm = ShmRing::open(name);
+	return shm ? new ps_ring{ shm } : nullptr;
+}
+
+void ps_ring_close(ps_ring* ring)
+{
+	if (!ring)
+		return;
+	delete ring->shm;
+	delete ring;
+}
+
+uint32_t ps_ring_max_queries(const ps_ring* ring)
+{
+	return ring->shm->maxQueries();
+}
+
+ps_query* ps_ring_acquire(ps_ring* ring, uint32_t count, uint64_t* ticket)
+{
+	ShmRing::Header* h = ring->shm->header();
+	if (count > ring->shm->maxQueries())
+		return nullptr;
+
+	uint64_t pos = h->head.load(std::memory_order_relaxed);
+	while (true)
+	{
+		ShmRing::Slot* slot = ring->shm->slot(pos);
+		uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+		int64_t diff = int64_t(seq - pos);
+		if (diff == 0)
+		{
+			if (h->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				slot->count = count;
+				slot->status = PS_OK;
+				*ticket = pos;
+				return ring->shm->queries(slot);
+			}
+		}
+		else if (diff < 0)
+		{
+			return nullptr; // full
+		}
+		else
+		{
+			pos = h->head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void ps_ring_commit(ps_ring* ring, uint64_t ticket)
+{
+	ShmRing::Slot* slot = ring->shm->slot(ticket);
+	slot->submitNs = ShmRing::nowNs();
+	slot->sequence.store(ticket + 1, std::memory_order_release);
+}
+
+int ps_ring_poll(ps_ring* ring, uint64_t ticket, const ps_ivec2** steps, uint32_t* count, double* latency)
+{
+	ShmRing::Slot* slot = ring->shm->slot(ticket);
+	if (slot->sequence.load(std::memory_order_acquire) != ticket + 2)
+		return PS_PENDING;
+	if (slot->status != PS_OK)
+		return PS_ERROR;
+	if (steps)
+		*steps = ring->shm->steps(slot);
+	if (count)
+		*count = slot->count;
+	if (latency)
+		*latency = slot->latency;
+	return PS_OK;
+}
+
+void ps_ring_release(ps_ring* ring, uint64_t ticket)
+{
+	ShmRing::Slot* slot = ring->shm->slot(ticket);
+	slot->sequence.store(ticket + ring->shm->slotCount(), std::memory_order_release);
+}
+
+uint32_t ps_serve(ps_service* service, ps_ring* ring, uint32_t maxBatches)
+{
+	ShmRing::Header* h = ring->shm->header();
+	uint64_t tail = h->tail.load(std::memory_order_relaxed);
+	uint32_t served = 0;
+	while (served < maxBatches)
+	{
+		ShmRing::Slot* slot = ring->shm->slot(tail);
+		if (slot->sequence.load(std::memory_order_acquire) != tail + 1)
+			break;
+
+		// the count comes from the client, read it once and never trust it past the slot
+		uint32_t count = slot->count;
+		auto start = std::chrono::steady_clock::now();
+		if (count <= ring->shm->maxQueries())
+		{
+			slot->status = PS_OK;
+			solveBatch(service, ring->shm->queries(slot), count, ring->shm->steps(slot));
+		}
+		else
+		{
+			slot->status = PS_ERROR;
+		}
+		slot->solveTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slot->doneNs = ShmRing::nowNs();
+		slot->latency = (slot->doneNs - slot->submitNs) * 1e-9;
+		slot->sequence.store(tail + 2, std::memory_order_release);
+
+		tail++;
+		h->tail.store(tail, std::memory_order_relaxed);
+		served++;
+	}
+	return served;
+}
+
+}
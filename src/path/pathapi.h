@@ -0,0 +1,80 @@
+#ifndef PATHAPI_H
+#define PATHAPI_H
+
+/*
+ * C interface of the path service library (PathService.dll / libpathservice).
+ *
+ * A service owns a map and a worker pool. Batches are either solved
+ * directly with ps_solve or submitted through a named shared-memory ring:
+ * a client process acquires a slot, writes its queries straight into
+ * shared memory, commits, and later reads the steps from the same slot.
+ * One server thread calls ps_serve to drain the ring. Any number of
+ * client threads or processes may submit (MPSC).
+ *
+ * Steps use the same compact form as the compute shader: PS_PATH_STEPS
+ * moves per query, stored back to front, (0,0) for unused slots.
+ */
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(PATHAPI_EXPORTS)
+#    define PATHAPI __declspec(dllexport)
+#  elif defined(PATHAPI_STATIC)
+#    define PATHAPI
+#  else
+#    define PATHAPI __declspec(dllimport)
+#  endif
+#else
+#  define PATHAPI __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PS_PATH_STEPS 20
+
+#define PS_OK 0
+#define PS_PENDING 1
+#define PS_ERROR -1
+
+typedef struct ps_uvec2 { uint32_t x, y; } ps_uvec2;
+typedef struct ps_ivec2 { int32_t x, y; } ps_ivec2;
+typedef struct ps_query { ps_uvec2 start; ps_uvec2 goal; } ps_query;
+
+typedef struct ps_service ps_service;
+typedef struct ps_ring ps_ring;
+
+/* map: width*height cells, 0 = free, anything else = wall. Copied. */
+PATHAPI ps_service* ps_create(const uint32_t* map, uint32_t width, uint32_t height, uint32_t threads);
+/* same thresholding as World::init: red == 255 is a wall */
+PATHAPI ps_service* ps_create_from_png(const char* filename, uint32_t threads);
+PATHAPI void ps_destroy(ps_service* service);
+
+/* Solves count queries into steps[count * PS_PATH_STEPS]. */
+PATHAPI int ps_solve(ps_service* service, const ps_query* queries, uint32_t count, ps_ivec2* steps, double* latency);
+
+/* slots must be a power of two >= 4. The creator unlinks the segment on close. */
+PATHAPI ps_ring* ps_ring_create(const char* name, uint32_t slots, uint32_t maxQueries);
+PATHAPI ps_ring* ps_ring_open(const char* name);
+PATHAPI void ps_ring_close(ps_ring* ring);
+PATHAPI uint32_t ps_ring_max_queries(const ps_ring* ring);
+
+/* Client side. acquire returns NULL when the ring is full or count is too large. */
+PATHAPI ps_query* ps_ring_acquire(ps_ring* ring, uint32_t count, uint64_t* ticket);
+PATHAPI void ps_ring_commit(ps_ring* ring, uint64_t ticket);
+/* PS_OK when done: steps points into shared memory and stays valid until release.
+   PS_ERROR when the server refused the batch (count above the ring's maximum);
+   the slot must still be released. */
+PATHAPI int ps_ring_poll(ps_ring* ring, uint64_t ticket, const ps_ivec2** steps, uint32_t* count, double* latency);
+PATHAPI void ps_ring_release(ps_ring* ring, uint64_t ticket);
+
+/* Server side, single thread. Solves up to maxBatches committed batches in order. */
+PATHAPI uint32_t ps_serve(ps_service* service, ps_ring* ring, uint32_t maxBatches);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+#include "pathservice.hpp"
+#include "astar.hpp"
+#include "../util/scheduler.hpp"
+#include "../util/trace.hpp"
+#include "../util/memory.hpp"
+
+#include <thread>
+#include <algorithm>
+
+void PathSolve::await_suspend(coro::coroutine_handle<> handle)
+{
+	request.waiter = handle;
+	service.submit(&request);
+}
+
+PathService::PathService(std::unique_ptr<PathBackend> backend) :
+	mBackend(std::move(backend)),
+	mLatency(LatencyRegistry::get().histogram("path_batch")),
+	mBatchCounter(MetricsRegistry::get().counter("path_batches")),
+	mPathCounter(MetricsRegistry::get().counter("paths")),
+	mInFlightGauge(MetricsRegistry::get().gauge("path_in_flight"))
+{
+	mBackend->service = this;
+}
+
+PathResult PathService::solveNow(PathBatch batch)
+{
+	PathRequest request;
+	request.batch = std::move(batch);
+	submit(&request);
+	while (!request.done)
+	{
+		if (poll() == 0 && !request.done)
+			std::this_thread::yield();
+	}
+	return std::move(request.result);
+}
+
+void PathService::submit(PathRequest* request)
+{
+	MemoryScope memoryScope(MEM_PATH);
+	request->done = false;
+	request->submitted = std::chrono::steady_clock::now();
+	request->result.steps.assign(request->batch.queries.size() * PATH_STEPS, ivec2(0, 0));
+	mInFlight++;
+	mBackend->submit(request);
+}
+
+void PathService::complete(PathRequest* request)
+{
+	request->finished = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(mCompletedMutex);
+	mCompleted.push_back(request);
+}
+
+size_t PathService::poll()
+{
+	mBackend->poll();
+
+	{
+		std::lock_guard<std::mutex> lock(mCompletedMutex);
+		mResuming.swap(mCompleted);
+	}
+	size_t count = mResuming.size();
+	for (PathRequest* request : mResuming)
+	{
+		request->result.latency = std::chrono::duration<double>(request->finished - request->submitted).count();
+		mLatency.record(request->result.latency);
+		mBatchCounter.add();
+		mPathCounter.add(request->batch.queries.size());
+		TraceRecorder::get().addTrackZone("path batches", mBackend->name(),
+			std::chrono::duration_cast<std::chrono::nanoseconds>(request->submitted.time_since_epoch()).count(),
+			std::chrono::duration_cast<std::chrono::nanoseconds>(request->finished.time_since_epoch()).count());
+		request->done = true;
+		mInFlight--;
+		// may destroy the request, do not touch it afterwards
+		if (request->waiter)
+			request->waiter.resume();
+	}
+	mResuming.clear();
+	mInFlightGauge.set(static_cast<double>(mInFlight.load()));
+	return count;
+}
+
+CpuPathBackend::CpuPathBackend(Scheduler& scheduler, unsigned int chunkSize) :
+	mScheduler(scheduler),
+	mChunkSize(std::max(1u, chunkSize))
+{
+}
+
+void CpuPathBackend::submit(PathRequest* request)
+{
+	if (mScheduler.workerCount() == 0)
+	{
+		mInline.push_back(request);
+		return;
+	}
+
+	size_t count = request->batch.queries.size();
+	if (count == 0)
+	{
+		service->complete(request);
+		return;
+	}
+
+	// one background task per worker, each working through its slice chunk by chunk
+	size_t parts = std::min<size_t>(mScheduler.workerCount(), (count + mChunkSize - 1) / mChunkSize);
+	size_t perPart = (count + parts - 1) / parts;
+	auto remaining = std::make_shared<std::atomic<size_t>>(parts);
+	PathService* svc = service;
+	unsigned int chunkSize = mChunkSize;
+
+	for (size_t p = 0; p < parts; p++)
+	{
+		size_t begin = p * perPart;
+		size_t end = std::min(count, begin + perPart);
+		auto cursor = std::make_shared<size_t>(begin);
+		mScheduler.submitBackground([=]
+		{
+			TRACE_SCOPE("path chunk");
+			MemoryScope memoryScope(MEM_PATH);
+			const PathBatch& batch = request->batch;
+			size_t chunkEnd = std::min(end, *cursor + chunkSize);
+			AstarScratch& scratch = AstarScratch::local();
+			for (size_t q = *cursor; q < chunkEnd; q++)
+			{
+				const PathQuery& query = batch.queries[q];
+				solvePath(batch.map, batch.dims, query.start, query.goal, &request->result.steps[q * PATH_STEPS], scratch);
+			}
+			*cursor = chunkEnd;
+			if (chunkEnd < end)
+				return true;
+			if (remaining->fetch_sub(1) == 1)
+				svc->complete(request);
+			return false;
+		});
+	}
+}
+
+void CpuPathBackend::poll()
+{
+	if (mInline.empty())
+		return;
+
+	TRACE_SCOPE("path batch inline");
+	MemoryScope memoryScope(MEM_PATH);
+	std::vector<PathRequest*> requests;
+	requests.swap(mInline);
+	AstarScratch& scratch = AstarScratch::local();
+	for (PathRequest* request : requests)
+	{
+		const PathBatch& batch = request->batch;
+		for (size_t q = 0; q < batch.queries.size(); q++)
+		{
+			const PathQuery& query = batch.queries[q];
+			solvePath(batch.map, batch.dims, query.start, query.goal, &request->result.steps[q * PATH_STEPS], scratch);
+		}
+		service->complete(request);
+	}
+}
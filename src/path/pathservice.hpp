@@ -0,0 +1,109 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include "pathtypes.hpp"
+#include "../util/coroutine.hpp"
+#include "../util/histogram.hpp"
+#include "../util/metrics.hpp"
+
+class Scheduler;
+class PathService;
+
+// One batch in flight. Lives in the awaiting coroutine's frame (or on the
+// stack of solveNow) until the service resumes it.
+struct PathRequest
+{
+	PathBatch batch;
+	PathResult result;
+	coro::coroutine_handle<> waiter;
+	std::chrono::steady_clock::time_point submitted;
+	std::chrono::steady_clock::time_point finished;
+	bool done = false;
+};
+
+class PathBackend
+{
+public:
+	virtual ~PathBackend() = default;
+	virtual const char* name() const = 0;
+	// Start solving. result.steps is already sized; call
+	// service->complete(request) from any thread when it is filled.
+	virtual void submit(PathRequest* request) = 0;
+	// Called from PathService::poll on the owning thread.
+	virtual void poll() {}
+protected:
+	friend class PathService;
+	PathService* service = nullptr;
+};
+
+// Awaitable returned by PathService::solve:
+//   PathResult r = co_await pathService.solve(std::move(batch));
+class PathSolve
+{
+public:
+	PathSolve(PathService& service, PathBatch batch) : service(service)
+	{
+		request.batch = std::move(batch);
+	}
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(coro::coroutine_handle<> handle);
+	PathResult await_resume() { return std::move(request.result); }
+private:
+	PathService& service;
+	PathRequest request;
+};
+
+// Front end for path queries. Coroutines awaiting solve() are resumed from
+// poll(), so they always continue on the thread that drives the service
+// (the simulation thread), never on a worker.
+class PathService
+{
+public:
+	explicit PathService(std::unique_ptr<PathBackend> backend);
+
+	PathSolve solve(PathBatch batch)
+	{
+		return PathSolve(*this, std::move(batch));
+	}
+	// Blocking variant for start-up, polls until the batch is done.
+	PathResult solveNow(PathBatch batch);
+
+	// Returns the number of batches that completed and were resumed.
+	size_t poll();
+	size_t inFlight() const { return mInFlight.load(); }
+	const char* backendName() const { return mBackend->name(); }
+
+	void submit(PathRequest* request);
+	// thread safe, called by backends
+	void complete(PathRequest* request);
+private:
+	std::unique_ptr<PathBackend> mBackend;
+	std::mutex mCompletedMutex;
+	std::vector<PathRequest*> mCompleted;
+	std::vector<PathRequest*> mResuming;
+	std::atomic<size_t> mInFlight{ 0 };
+	LatencyHistogram& mLatency;
+	MetricCounter& mBatchCounter;
+	MetricCounter& mPathCounter;
+	MetricGauge& mInFlightGauge;
+};
+
+// Solves batches with solvePath on the scheduler's workers as chunked
+// background work, so recording deadlines still go first. Without workers
+// the chunks run inline in poll().
+class CpuPathBackend : public PathBackend
+{
+public:
+	explicit CpuPathBackend(Scheduler& scheduler, unsigned int chunkSize = 16);
+	const char* name() const override { return "cpu"; }
+	void submit(PathRequest* request) override;
+	void poll() override;
+private:
+	Scheduler& mScheduler;
+	unsigned int mChunkSize;
+	std::vector<PathRequest*> mInline;
+};
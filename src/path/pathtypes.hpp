@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include "../entity.h"
+
+// Every query returns this many steps, the same layout the compute shader
+// writes: moves are deltas stored back to front, so the first move is the
+// highest non-zero slot and unused slots at the end are (0,0).
+#define PATH_STEPS 20
+
+struct PathQuery
+{
+	uvec2 start;
+	uvec2 goal;
+};
+
+struct PathBatch
+{
+	// not owned, 0 = free, 1 = wall, row major
+	const unsigned int* map = nullptr;
+	uvec2 dims;
+	std::vector<PathQuery> queries;
+};
+
+struct PathResult
+{
+	// queries.size() * PATH_STEPS
+	std::vector<ivec2> steps;
+	// submit to completion, seconds
+	double latency = 0.0;
+};
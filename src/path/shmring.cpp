@@ -0,0 +1,103 @@
+#include "shmring.hpp"
+#include "../util/sharedmemory.hpp"
+
+#include <chrono>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring needs lock-free 64-bit atomics in shared memory");
+static_assert(sizeof(ShmRing::Slot) % 8 == 0, "slot header must keep queries aligned");
+
+static size_t slotStride(uint32_t maxQueries)
+{
+	size_t size = sizeof(ShmRing::Slot) + maxQueries * sizeof(ps_query) + size_t(maxQueries) * PS_PATH_STEPS * sizeof(ps_ivec2);
+	return (size + 63) & ~size_t(63);
+}
+
+uint64_t ShmRing::nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ShmRing* ShmRing::create(const std::string& name, uint32_t slots, uint32_t maxQueries)
+{
+	if (slots < 4 || (slots & (slots - 1)) != 0 || maxQueries == 0)
+		return nullptr;
+
+	size_t stride = slotStride(maxQueries);
+	size_t size = sizeof(Header) + stride * slots;
+
+	SharedMemory* memory = SharedMemory::create(name, size);
+	if (!memory)
+		return nullptr;
+	ShmRing* ring = new ShmRing();
+	ring->mMemory = memory;
+	ring->mHeader = static_cast<Header*>(memory->data());
+	ring->mSlotCount = slots;
+	ring->mMaxQueries = maxQueries;
+	ring->mSlotStride = stride;
+
+	Header* h = ring->mHeader;
+	h->slotCount = slots;
+	h->maxQueries = maxQueries;
+	h->slotStride = stride;
+	h->head.store(0);
+	h->tail.store(0);
+	for (uint32_t i = 0; i < slots; i++)
+		ring->slot(i)->sequence.store(i, std::memory_order_relaxed);
+	h->version = VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	h->magic = MAGIC;
+	return ring;
+}
+
+ShmRing* ShmRing::open(const std::string& name)
+{
+	SharedMemory* memory = SharedMemory::open(name);
+	if (!memory)
+		return nullptr;
+	Header* h = static_cast<Header*>(memory->data());
+	if (memory->size() < sizeof(Header) || h->magic != MAGIC || h->version != VERSION)
+	{
+		delete memory;
+		return nullptr;
+	}
+
+	// a truncated or foreign segment must not hand out slots past its end
+	uint32_t slots = h->slotCount;
+	uint32_t maxQueries = h->maxQueries;
+	size_t stride = slotStride(maxQueries);
+	if (slots == 0 || (slots & (slots - 1)) != 0 || maxQueries == 0 || h->slotStride != stride
+		|| (memory->size() - sizeof(Header)) / stride < slots)
+	{
+		delete memory;
+		return nullptr;
+	}
+
+	ShmRing* ring = new ShmRing();
+	ring->mMemory = memory;
+	ring->mHeader = h;
+	ring->mSlotCount = slots;
+	ring->mMaxQueries = maxQueries;
+	ring->mSlotStride = stride;
+	return ring;
+}
+
+ShmRing::~ShmRing()
+{
+	delete mMemory;
+}
+
+ShmRing::Slot* ShmRing::slot(uint64_t pos) const
+{
+	uint64_t index = pos & (mSlotCount - 1);
+	return reinterpret_cast<Slot*>(reinterpret_cast<char*>(mHeader) + sizeof(Header) + index * mSlotStride);
+}
+
+ps_query* ShmRing::queries(Slot* slot) const
+{
+	return reinterpret_cast<ps_query*>(slot + 1);
+}
+
+ps_ivec2* ShmRing::steps(Slot* slot) const
+{
+	return reinterpret_cast<ps_ivec2*>(queries(slot) + mMaxQueries);
+}
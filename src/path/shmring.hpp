@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include "pathapi.h"
+
+class SharedMemory;
+
+// Batch ring living in a named shared-memory segment.
+//
+// Slot i is used by ring positions i, i + slotCount, ... and its sequence
+// number encodes the state for position pos:
+//   pos      free, a producer may claim it
+//   pos + 1  committed, queries are written
+//   pos + 2  solved, steps are written
+// Releasing sets it to pos + slotCount, freeing it for the next lap.
+class ShmRing
+{
+public:
+	static const uint32_t MAGIC = 0x50534852; // "PSHR"
+	static const uint32_t VERSION = 2;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t slotCount;
+		uint32_t maxQueries;
+		uint64_t slotStride;
+		char pad0[40];
+		std::atomic<uint64_t> head; // next position to claim
+		char pad1[56];
+		std::atomic<uint64_t> tail; // next position the server solves
+		char pad2[56];
+	};
+
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence;
+		uint32_t count;
+		int32_t status; // PS_OK, or PS_ERROR for a batch the server refused
+		uint64_t submitNs; // steady clock, shared by all processes
+		uint64_t doneNs;
+		double latency;
+		double solveTime;
+		// followed by ps_query[maxQueries] and ps_ivec2[maxQueries * PS_PATH_STEPS]
+	};
+
+	static ShmRing* create(const std::string& name, uint32_t slots, uint32_t maxQueries);
+	static ShmRing* open(const std::string& name);
+	~ShmRing();
+
+	Header* header() const { return mHeader; }
+	// checked when the ring is created or opened, later writes to the
+	// header by another process do not change them
+	uint32_t slotCount() const { return mSlotCount; }
+	uint32_t maxQueries() const { return mMaxQueries; }
+	Slot* slot(uint64_t pos) const;
+	ps_query* queries(Slot* slot) const;
+	ps_ivec2* steps(Slot* slot) const;
+
+	static uint64_t nowNs();
+private:
+	ShmRing() = default;
+
+	Header* mHeader = nullptr;
+	SharedMemory* mMemory = nullptr;
+	uint32_t mSlotCount = 0;
+	uint32_t mMaxQueries = 0;
+	size_t mSlotStride = 0;
+};
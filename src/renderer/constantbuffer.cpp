@@ -1,4 +1,5 @@
 #include "constantbuffer.hpp"
+#include "vulkanmemory.hpp"
 
 #include <iostream>
 #include <stdexcept>
@@ -13,8 +14,8 @@ ConstantBufferVK::ConstantBufferVK(size_t size, VkDevice device, VkPhysicalDevic
 
 ConstantBufferVK::~ConstantBufferVK()
 {
-	vkDestroyBuffer(_device, _handle, nullptr);
-	vkFreeMemory(_device, cBufferMemory, nullptr);
+	vkDestroyBuffer(_device, _handle, vulkanAllocator());
+	freeDeviceMemory(_device, cBufferMemory);
 }
 
 void ConstantBufferVK::init()
@@ -25,7 +26,7 @@ void ConstantBufferVK::init()
 	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateBuffer(_device, &bufferInfo, nullptr, &_handle) != VK_SUCCESS)
+	if (vkCreateBuffer(_device, &bufferInfo, vulkanAllocator(), &_handle) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create constant buffer!");
 	}
@@ -48,7 +49,7 @@ void ConstantBufferVK::init()
 	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	allocInfo.allocationSize = size;
 	allocInfo.memoryTypeIndex = choice;
-	if (vkAllocateMemory(_device, &allocInfo, nullptr, &cBufferMemory) != VK_SUCCESS)
+	if (allocateDeviceMemory(_device, &allocInfo, &cBufferMemory) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to allocate constant buffer memory!");
 	}
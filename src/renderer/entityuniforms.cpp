@@ -0,0 +1,54 @@
+#include "entityuniforms.hpp"
+
+#include <unordered_map>
+#include <cstdint>
+
+uint32_t buildEntityUniforms(const std::vector<Entity>& toDraw, float* posBuffer, int stride)
+{
+	struct DrawObject
+	{
+		int count;
+		vec2 pos;
+	};
+
+	uint32_t drawCount = 0;
+	Entity goal;
+	std::unordered_map<uint64_t, DrawObject> posCount;
+	for (int i = 0; i < toDraw.size(); i++)
+	{
+		if (!toDraw[i].isGoal)
+		{
+			uint64_t x = toDraw[i].pos.x;
+			uint64_t y = toDraw[i].pos.y;
+			uint64_t id = x | (y << 32);
+			posCount[id].count++;
+			posCount[id].pos = toDraw[i].pos;
+		}
+		else
+		{
+			goal = toDraw[i];
+		}
+	}
+
+	for (int i = 0; i < toDraw.size(); i++)
+	{
+		uint64_t x = toDraw[i].pos.x;
+		uint64_t y = toDraw[i].pos.y;
+		uint64_t id = x | (y << 32);
+		auto obj = posCount[id];
+
+		int index = i * stride;
+		posBuffer[index]     = obj.pos.x;
+		posBuffer[index + 1] = obj.pos.y;
+		posBuffer[index + 2] = obj.count;
+		drawCount++;
+	}
+
+	int index = drawCount * stride;
+	posBuffer[index]     = goal.pos.x;
+	posBuffer[index + 1] = goal.pos.y;
+	posBuffer[index + 2] = 0;
+	drawCount++;
+
+	return drawCount;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <vector>
+#include "../entity.h"
+
+// CPU side of Renderer::updateUniformBuffer, kept free of Vulkan so it can
+// be benchmarked on its own. Writes (x, y, count) for every entity at
+// index * stride floats, followed by the goal, and returns the number of
+// entries written. posBuffer must hold (toDraw.size() + 1) * stride floats.
+uint32_t buildEntityUniforms(const std::vector<Entity>& toDraw, float* posBuffer, int stride);
@@ -9,6 +9,12 @@
 #include <array>
 #include <unordered_map>
 #include <functional>
+#include <algorithm>
+#include "../util/topology.hpp"
+#include "../util/log.hpp"
+#include "../util/memory.hpp"
+#include "entityuniforms.hpp"
+#include "vulkanmemory.hpp"
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -49,7 +55,7 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 	const char* msg,
 	void* userData)
 {
-	std::cerr << "VL: " << msg << "\n" << std::endl;
+	LOG_LIMITED(LEVEL_WARN, 20, "validation", "%s", msg);
 	return VK_FALSE;
 }
 const std::vector<const char*> validationLayers = {
@@ -62,9 +68,7 @@ const std::vector<const char*> deviceExtensions = {
 
 void Renderer::init(const std::string& map)
 {
-	std::cout << "/////////////////////////\n";
-	std::cout << "//     init vulkan     //\n";
-	std::cout << "/////////////////////////\n";
+	LOG_INFO("renderer", "init vulkan");
 	createWindow();
 	createInstance();
 	createSurface();
@@ -89,22 +93,41 @@ void Renderer::init(const std::string& map)
 	createGraphicsPipeline(); 
 	createCommandBuffers();
 	createSyncObjects();
+	calibrateGpuClock();
 
-	benchmarkDrawValues.reserve(NUM_BENCHMARK_FRAMES * 2);
-	benchmarkRecordValues.reserve(NUM_BENCHMARK_FRAMES);
+	scheduler.pinWorkers();
 
-	posBuffer = new float[(uniformBufferAlignment/sizeof(float)) * MAX_DRAW_ENTITIES];
+	// filled by the main thread every frame, keep it on that thread's node
+	posBuffer = topology::ThreadArena::local().allocArray<float>((uniformBufferAlignment/sizeof(float)) * MAX_DRAW_ENTITIES);
 
-	std::cout << "/////////////////////////\n";
-	std::cout << "//   done init vulkan  //\n";
-	std::cout << "/////////////////////////\n";
+	LOG_INFO("renderer", "done init vulkan");
 }
 
 void Renderer::render()
 {
+	MemoryScope memoryScope(MEM_RENDERER);
+	if (!firstFrame)
+		frameLatency.record(frameTimer.restart());
+	else
+		frameTimer.restart();
+	firstFrame = false;
+
 	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
 	vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
+	// this frame slot's previous submission is done, so its timestamps are
+	// ready without stalling on the frame we are about to record
+	if (queryPoolUsed[currentFrame])
+	{
+		uint64_t timeStamps[2]{};
+		if (vkGetQueryPoolResults(device, queryPools[currentFrame], 0, 2, sizeof(timeStamps), timeStamps,
+			sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		{
+			lastGpuFrameTime = (timeStamps[1] - timeStamps[0]) * double(timestampPeriod) * 1e-9;
+			TraceRecorder::get().addTrackZone("gpu graphics", "frame", gpuToCpuNs(timeStamps[0]), gpuToCpuNs(timeStamps[1]));
+		}
+	}
+
 	updateUniformBuffer();
 
 	std::vector<std::function<void(void)>> tasks;
@@ -120,6 +143,8 @@ void Renderer::render()
 		//std::cout << "\t(start, end) = (" << start << ", " << end << ")\n";
 		tasks.push_back([this, i, start, end]
 		{
+			TRACE_SCOPE("record entities");
+			MemoryScope memoryScope(MEM_RENDERER);
 			int index = commandIndex(i);
 			vkResetCommandPool(device, commandPools[index], 0);
 
@@ -161,14 +186,15 @@ void Renderer::render()
 		});
 	}
 
-	recordTimer.restart();
+	uint64_t recordStart = tsc::now();
+	auto recordDeadline = Scheduler::Clock::now() + RECORD_BUDGET;
 	if (GLOBAL_NUM_THREADS >= 1)
 	{
 		if (GLOBAL_NUM_THREADS > 1)
 		{
 			for (int i = 1; i < tasks.size(); i++)
 			{
-				threadPool.queueTask(tasks[i]);
+				scheduler.submitDeadline(tasks[i], recordDeadline);
 			}
 		}
 		tasks[0]();
@@ -177,8 +203,10 @@ void Renderer::render()
 	{
 		throw std::runtime_error("GLOBAL_NUM_THREADS must be larger than one");
 	}
-	threadPool.waitForTasks();
-	benchmarkRecordValues.push_back(recordTimer.elapsed());
+	scheduler.waitForDeadlineTasks();
+	uint64_t recordTicks = tsc::now() - recordStart;
+	lastRecordTime = tsc::toSeconds(recordTicks);
+	recordLatency.recordTicks(recordTicks);
 
 	uint32_t imageIndex;
 	vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -308,50 +336,26 @@ void Renderer::render()
 	if (computeQueueSameAsGraphicsAndPresent())
 		queueMutex.unlock();
 
+	frameCounter.add();
+	Scheduler::QueueDepths depths = scheduler.queueDepths();
+	deadlineQueueGauge.set(depths.deadline);
+	backgroundQueueGauge.set(depths.background);
 
 	if (fpsTimer.elapsed() > 1.0)
 	{
 		double time = fpsTimer.restart();
+		Scheduler::Stats stats = scheduler.stats();
 		std::string fps = "Vulkan | FPS: " + std::to_string(fpsFrameCount/time);
+		fps += " | missed deadlines: " + std::to_string(stats.missedDeadlines);
+		fps += " | deferred bg: " + std::to_string(stats.deferredTime * 1000.0) + " ms";
+		fps += " | p99 frame: " + std::to_string(frameLatency.snapshot().percentile(0.99) * 1000.0) + " ms";
 		glfwSetWindowTitle(window, fps.c_str());
 		fpsFrameCount = 0;
 	}
 	fpsFrameCount++;
 
 
-	uint32_t timeStamps[2]{};
-	
-	vkGetQueryPoolResults(
-		device,
-		queryPools[currentFrame],
-		0, 2,
-		2 * sizeof(uint32_t),
-		timeStamps,
-		sizeof(uint32_t),
-		VK_QUERY_RESULT_WAIT_BIT);
-
-	if (GLOBAL_TESTING)
-	{
-		if (benchmarkFrameCount < NUM_BENCHMARK_FRAMES)
-		{
-			if (benchmarkFrameCount == 0)
-			{
-				benchmarkFirstDraw = timeStamps[0];
-			}
-			uint32_t frameStart = (timeStamps[0] - benchmarkFirstDraw) * this->timestampToNsScaling;
-			uint32_t frameEnd = (timeStamps[1] - benchmarkFirstDraw) * this->timestampToNsScaling;
-
-			benchmarkDrawValues.push_back(frameStart);
-			benchmarkDrawValues.push_back(frameEnd);
-
-			benchmarkFrameCount++;
-			if (benchmarkFrameCount >= NUM_BENCHMARK_FRAMES)
-			{
-				saveBenchmarkValues();
-			}
-		}
-	}
-	
+	queryPoolUsed[currentFrame] = true;
 
 	toDraw.clear();
 	drawCount = 0;
@@ -363,42 +367,41 @@ void Renderer::cleanup()
 {
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-		vkDestroyFence(device, inFlightFences[i], nullptr);
+		vkDestroySemaphore(device, renderFinishedSemaphores[i], vulkanAllocator());
+		vkDestroySemaphore(device, imageAvailableSemaphores[i], vulkanAllocator());
+		vkDestroyFence(device, inFlightFences[i], vulkanAllocator());
 	}
-	vkDestroyPipeline(device, entityGraphicsPipeline, nullptr);
-	vkDestroyPipeline(device, mapGraphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyPipeline(device, entityGraphicsPipeline, vulkanAllocator());
+	vkDestroyPipeline(device, mapGraphicsPipeline, vulkanAllocator());
+	vkDestroyPipelineLayout(device, pipelineLayout, vulkanAllocator());
 
 	//compute
-	vkDestroyPipeline(device, computePipeline, nullptr);
-	vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
-	vkDestroySemaphore(device, sem_computeDone, nullptr);
-	vkDestroySemaphore(device, sem_transferToDevice, nullptr);
-	vkFreeMemory(device, computeMemory_dst, nullptr);
-	vkFreeMemory(device, computeMemory_src, nullptr);
-	vkDestroyBuffer(device, map_buffer_dst, nullptr);
-	vkDestroyBuffer(device, map_buffer_src, nullptr);
-	vkDestroyBuffer(device, entity_buffer_dst, nullptr);
-	vkDestroyBuffer(device, entity_buffer_src, nullptr);
-	vkDestroyBuffer(device, steps_buffer_dst, nullptr);
-	vkDestroyBuffer(device, steps_buffer_src, nullptr);
-	vkDestroyBuffer(device, dimsgoal_buffer_dst, nullptr);
-	vkDestroyBuffer(device, dimsgoal_buffer_src, nullptr);
-
-	vkDestroyDescriptorPool(device, computeDescriptorPool, nullptr);
-	vkDestroyFence(device, fen_transfer, nullptr);
-	vkDestroyCommandPool(device, computeCommandPool, nullptr);
-	vkDestroyDescriptorSetLayout(device, computeDescriptorSetLayout, nullptr);
-
-	delete astarSteps;
-
-	for (int i = 0; i < 3; i++)
-		vkDestroyQueryPool(device, queryPools[i], nullptr);
-	vkDestroyDevice(device, nullptr);
+	vkDestroyPipeline(device, computePipeline, vulkanAllocator());
+	vkDestroyPipelineLayout(device, computePipelineLayout, vulkanAllocator());
+	vkDestroySemaphore(device, sem_computeDone, vulkanAllocator());
+	vkDestroySemaphore(device, sem_transferToDevice, vulkanAllocator());
+	freeDeviceMemory(device, computeMemory_dst);
+	freeDeviceMemory(device, computeMemory_src);
+	vkDestroyBuffer(device, map_buffer_dst, vulkanAllocator());
+	vkDestroyBuffer(device, map_buffer_src, vulkanAllocator());
+	vkDestroyBuffer(device, entity_buffer_dst, vulkanAllocator());
+	vkDestroyBuffer(device, entity_buffer_src, vulkanAllocator());
+	vkDestroyBuffer(device, steps_buffer_dst, vulkanAllocator());
+	vkDestroyBuffer(device, steps_buffer_src, vulkanAllocator());
+	vkDestroyBuffer(device, dimsgoal_buffer_dst, vulkanAllocator());
+	vkDestroyBuffer(device, dimsgoal_buffer_src, vulkanAllocator());
+
+	vkDestroyDescriptorPool(device, computeDescriptorPool, vulkanAllocator());
+	vkDestroyFence(device, fen_transfer, vulkanAllocator());
+	vkDestroyCommandPool(device, computeCommandPool, vulkanAllocator());
+	vkDestroyDescriptorSetLayout(device, computeDescriptorSetLayout, vulkanAllocator());
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		vkDestroyQueryPool(device, queryPools[i], vulkanAllocator());
+	vkDestroyQueryPool(device, computeQueryPool, vulkanAllocator());
+	vkDestroyDevice(device, vulkanAllocator());
 	vkDestroySurfaceKHR(instance, surface, nullptr);
-	vkDestroyInstance(instance, nullptr);
+	vkDestroyInstance(instance, vulkanAllocator());
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
@@ -462,7 +465,7 @@ void Renderer::createInstance()
 	}
 
 
-	if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS)
+	if (vkCreateInstance(&createInfo, vulkanAllocator(), &instance) != VK_SUCCESS)
 		throw std::runtime_error("failed to create instance!");
 
 	if (enableValidationLayers)
@@ -489,11 +492,11 @@ void Renderer::createInstance()
 		std::vector<VkExtensionProperties> extensions(extensionCount);
 
 		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
-		std::cout << "available extensions:" << std::endl;
+		LOG_DEBUG("renderer", "available extensions:");
 
 		for (const auto& extension : extensions)
 		{
-			std::cout << "\t" << extension.extensionName << std::endl;
+			LOG_DEBUG("renderer", "\t%s", extension.extensionName);
 		}
 	}
 }
@@ -574,7 +577,7 @@ void Renderer::createLogicalDevice()
 	createInfo.enabledLayerCount = validationLayers.size();
 	createInfo.ppEnabledLayerNames = validationLayers.data();
 
-	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
+	if (vkCreateDevice(physicalDevice, &createInfo, vulkanAllocator(), &device) != VK_SUCCESS)
 		throw std::runtime_error("failed to create logical device!");
 
 	vkGetDeviceQueue(device, familyIndices.graphicsFamily, 0, &graphicsQueue);
@@ -582,10 +585,10 @@ void Renderer::createLogicalDevice()
 	vkGetDeviceQueue(device, familyIndices.computeFamily,  0, &computeQueue);
 	vkGetDeviceQueue(device, familyIndices.transferFamily, 0, &transferQueue);
 
-	std::cout << "Graphics QueuePtr: " << graphicsQueue << "\n";
-	std::cout << "Present  QueuePtr: " << presentQueue << "\n";
-	std::cout << "Compute  QueuePtr: " << computeQueue << "\n";
-	std::cout << "Transfer QueuePtr: " << transferQueue << "\n";
+	LOG_DEBUG("renderer", "graphics queue %p", (void*)graphicsQueue);
+	LOG_DEBUG("renderer", "present  queue %p", (void*)presentQueue);
+	LOG_DEBUG("renderer", "compute  queue %p", (void*)computeQueue);
+	LOG_DEBUG("renderer", "transfer queue %p", (void*)transferQueue);
 	
 }
 
@@ -597,8 +600,8 @@ void Renderer::createSwapChain()
 	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
 	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-	std::cout << "minImageCount " << swapChainSupport.capabilities.minImageCount << "\n";
-	std::cout << "maxImageCount " << swapChainSupport.capabilities.maxImageCount << "\n";
+	LOG_DEBUG("renderer", "minImageCount %u, maxImageCount %u",
+		swapChainSupport.capabilities.minImageCount, swapChainSupport.capabilities.maxImageCount);
 	uint32_t imageCount = MAX_FRAMES_IN_FLIGHT;
 	if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
 		imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -641,7 +644,7 @@ void Renderer::createSwapChain()
 	createInfo.oldSwapchain = oldSwapChain;
 
 	VkSwapchainKHR newSwapChain;
-	if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &newSwapChain) != VK_SUCCESS)
+	if (vkCreateSwapchainKHR(device, &createInfo, vulkanAllocator(), &newSwapChain) != VK_SUCCESS)
 		throw std::runtime_error("failed to create swap chain!");
 
 	swapChain = newSwapChain;
@@ -674,7 +677,7 @@ void Renderer::createImageViews()
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
-		if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS)
+		if (vkCreateImageView(device, &createInfo, vulkanAllocator(), &swapChainImageViews[i]) != VK_SUCCESS)
 			throw std::runtime_error("failed to create image views!");
 	}
 }
@@ -721,7 +724,7 @@ void Renderer::createRenderPass()
 	renderPassInfo.dependencyCount = 1;
 	renderPassInfo.pDependencies = &dependency;
 
-	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+	if (vkCreateRenderPass(device, &renderPassInfo, vulkanAllocator(), &renderPass) != VK_SUCCESS)
 		throw std::runtime_error("failed to create render pass!");
 }
 
@@ -744,7 +747,7 @@ void Renderer::createFramebuffers()
 		framebufferInfo.height = swapChainExtent.height;
 		framebufferInfo.layers = 1;
 
-		if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
+		if (vkCreateFramebuffer(device, &framebufferInfo, vulkanAllocator(), &swapChainFramebuffers[i]) != VK_SUCCESS)
 			throw std::runtime_error("failed to create framebuffer!");
 	}
 }
@@ -771,7 +774,7 @@ void Renderer::createDescriptorSetLayout()
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 	layoutInfo.pBindings = bindings.data();
 
-	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, vulkanAllocator(), &descriptorSetLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create descriptor set layout!");
 	}
@@ -791,7 +794,7 @@ void Renderer::createDescriptorPool()
 	poolInfo.pPoolSizes = poolSizes.data();
 	poolInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
 
-	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	if (vkCreateDescriptorPool(device, &poolInfo, vulkanAllocator(), &descriptorPool) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create descriptor pool!");
 	}
@@ -853,7 +856,7 @@ void Renderer::createTransferCommandBuffer() {
 	};
 	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-	vkCreateCommandPool(device, &commandPoolCreateInfo, 0, &transferCommandPool);
+	vkCreateCommandPool(device, &commandPoolCreateInfo, vulkanAllocator(), &transferCommandPool);
 
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
 	  VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -867,7 +870,7 @@ void Renderer::createTransferCommandBuffer() {
 	VkResult res2 = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &transferCommandBuffer2);
 
 	if (res != VK_SUCCESS) {
-		printf("Failed to allocate transfer command buffer.\n");
+		LOG_ERROR("renderer", "failed to allocate transfer command buffer");
 	}
 }
 
@@ -896,16 +899,18 @@ void Renderer::transferComputeDataToHost() {
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitDstStageMask = &stageFlags;
 
-	vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	// fen_transfer signals when the steps are back in host memory
+	vkQueueSubmit(transferQueue, 1, &submitInfo, fen_transfer);
+}
 
-	vkQueueWaitIdle(transferQueue);
+void Renderer::readComputeDataFromHost() {
 	//vkResetCommandPool(device, transferCommandPool, 0);
 	//delete astarSteps;
 	//int stepLen = numEntities * preComputedSteps;
 	//astarSteps = new ivec2[stepLen];
 	void* data;
 	vkMapMemory(device, computeMemory_src, 0, memorySize, 0, &data);
-	memcpy(astarSteps, (void*)((uintptr_t)data + mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps), stepsSize);
+	memcpy(astarSteps.data(), (void*)((uintptr_t)data + mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps), stepsSize);
 	vkUnmapMemory(device, computeMemory_src);
 
 	for (int i = 0; i < numEntities; i++) {
@@ -921,50 +926,9 @@ void Renderer::transferComputeDataToHost() {
 
 void Renderer::updateUniformBuffer()
 {
-	struct DrawObject
-	{
-		int count;
-		vec2 pos;
-	};
-
-	Entity goal;
-	std::unordered_map<uint64_t, DrawObject> posCount;
-	for (int i = 0; i < toDraw.size(); i++)
-	{
-		if (!toDraw[i].isGoal)
-		{
-			uint64_t x = toDraw[i].pos.x;
-			uint64_t y = toDraw[i].pos.y;
-			uint64_t id = x | (y << 32);
-			posCount[id].count++;
-			posCount[id].pos = toDraw[i].pos;
-		}
-		else
-		{
-			goal = toDraw[i];
-		}
-	}
-
+	TRACE_SCOPE("uniform build");
 	int stride = uniformBufferAlignment / sizeof(float);
-	for (int i = 0; i < toDraw.size(); i++)
-	{
-		uint64_t x = toDraw[i].pos.x;
-		uint64_t y = toDraw[i].pos.y;
-		uint64_t id = x | (y << 32);
-		auto obj = posCount[id];
-
-		int index = i * stride;
-		posBuffer[index]     = obj.pos.x;
-		posBuffer[index + 1] = obj.pos.y;
-		posBuffer[index + 2] = obj.count;
-		drawCount++;
-	}
-
-	int index = drawCount * stride;
-	posBuffer[index]     = goal.pos.x;
-	posBuffer[index + 1] = goal.pos.y;
-	posBuffer[index + 2] = 0;
-	drawCount++;
+	drawCount = buildEntityUniforms(toDraw, posBuffer, stride);
 
 	void* data;
 	vkMapMemory(device, uniformBuffersMemory[currentFrame], 0, (uniformBufferAlignment) * MAX_DRAW_ENTITIES, 0, &data);
@@ -1014,16 +978,17 @@ void Renderer::transferComputeDataToDevice() {
 
 void Renderer::mapComputeMemory(void* map, void* entities, uvec2* dims, uvec2* goal, size_t mapSize, size_t entitiesSize)
 {
-	void *payload;
-	//delete astarSteps;
-	int stepLen = numEntities * preComputedSteps;
-	astarSteps = new ivec2[stepLen];
+	// the buffers keep the layout initCompute made for the full entity count,
+	// a smaller batch only fills the front of the entity buffer
+	size_t dimsGoalOffset = this->mapSize + alignOffsetEntity + this->entitiesSize + alignOffsetSteps + stepsSize + alignOffsetDimsGoal;
+	dispatchCount = static_cast<uint32_t>(entitiesSize / sizeof(uvec2));
 
+	void *payload;
 	VkResult res = vkMapMemory(device, computeMemory_src, 0, memorySize, 0, &payload);
 	memcpy(payload, map, mapSize);
-	memcpy((void*)((uintptr_t)payload + mapSize + alignOffsetEntity), entities, entitiesSize);
-	memcpy((void*)((uintptr_t)payload + mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps + stepsSize + alignOffsetDimsGoal), dims, sizeof(uvec2));
-	memcpy((void*)((uintptr_t)payload + mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps + stepsSize + alignOffsetDimsGoal + sizeof(uvec2)), goal, sizeof(uvec2));
+	memcpy((void*)((uintptr_t)payload + this->mapSize + alignOffsetEntity), entities, entitiesSize);
+	memcpy((void*)((uintptr_t)payload + dimsGoalOffset), dims, sizeof(uvec2));
+	memcpy((void*)((uintptr_t)payload + dimsGoalOffset + sizeof(uvec2)), goal, sizeof(uvec2));
 	vkUnmapMemory(device, computeMemory_src);
 	
 	/*res = vkBindBufferMemory(device, map_buffer_src, computeMemory_src, 0);
@@ -1123,6 +1088,16 @@ void Renderer::mapComputeMemory(void* map, void* entities, uvec2* dims, uvec2* g
 }
 
 void Renderer::executeCompute() {
+	submitCompute();
+	vkWaitForFences(device, 1, &fen_transfer, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	finishCompute();
+}
+
+bool Renderer::computeFinished() {
+	return vkGetFenceStatus(device, fen_transfer) == VK_SUCCESS;
+}
+
+void Renderer::submitCompute() {
 	transferComputeDataToDevice();
 	//vkResetFences(device, 1, &fen_transfer);
 	VkCommandBufferBeginInfo commandBufferBeginInfo = {
@@ -1148,7 +1123,7 @@ void Renderer::executeCompute() {
 	vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
 		computePipelineLayout, 0, 1, &computeDescriptorSet, 0, 0);
 
-	vkCmdDispatch(computeCommandBuffer, numEntities, 1, 1);
+	vkCmdDispatch(computeCommandBuffer, dispatchCount, 1, 1);
 
 	//////////////////////
 	vkCmdWriteTimestamp(computeCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, computeQueryPool, 1);
@@ -1192,33 +1167,19 @@ void Renderer::executeCompute() {
 
 	//vkQueueWaitIdle(computeQueue);
 	transferComputeDataToHost();
+}
 
+void Renderer::finishCompute() {
+	vkResetFences(device, 1, &fen_transfer);
+	readComputeDataFromHost();
 
-	uint32_t timeStamps[2]{};
-	vkGetQueryPoolResults(
-		device,
-		computeQueryPool,
-		0, 2,
-		2 * sizeof(uint32_t),
-		timeStamps,
-		sizeof(uint32_t),
-		VK_QUERY_RESULT_WAIT_BIT);
-	
-	if (GLOBAL_TESTING)
+	// the fence has signalled so the timestamps are available without waiting
+	uint64_t timeStamps[2]{};
+	if (vkGetQueryPoolResults(device, computeQueryPool, 0, 2, sizeof(timeStamps), timeStamps,
+		sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS)
 	{
-		if (benchmarkFrameCount < NUM_BENCHMARK_FRAMES)
-		{
-			if (benchmarkIsFirstCompute)
-			{
-				benchmarkIsFirstCompute = false;
-				benchmarkFirstCompute = timeStamps[0];
-			}
-			for (int i = 0; i < 2; i++)
-			{
-				uint32_t time = (timeStamps[i] - benchmarkFirstCompute) * this->timestampToNsScaling;
-				benchmarkComputeValues.push_back(time);
-			}
-		}
+		lastComputeGpuTime = (timeStamps[1] - timeStamps[0]) * double(timestampPeriod) * 1e-9;
+		TraceRecorder::get().addTrackZone("gpu compute", "path compute", gpuToCpuNs(timeStamps[0]), gpuToCpuNs(timeStamps[1]));
 	}
 }
 
@@ -1230,8 +1191,9 @@ void Renderer::initCompute(size_t sizeMap, size_t sizeEntites)
 	//size_t sizeofentity = sizeof(Entity2);
 
 	numEntities = sizeEntites / sizeof(uvec2);
+	dispatchCount = numEntities;
 	int stepLen = numEntities * preComputedSteps;
-	astarSteps = new ivec2[stepLen];
+	astarSteps.assign(stepLen, ivec2());
 	stepsSize = stepLen * sizeof(ivec2);
 
 	VkBufferCreateInfo bufferCreateInfo;
@@ -1244,22 +1206,22 @@ void Renderer::initCompute(size_t sizeMap, size_t sizeEntites)
 	bufferCreateInfo.flags = 0;
 	bufferCreateInfo.pNext = 0;
 
-	if (vkCreateBuffer(device, &bufferCreateInfo, 0, &map_buffer_src) != VK_SUCCESS) {
-		printf("failed to create buffer!\n");
+	if (vkCreateBuffer(device, &bufferCreateInfo, vulkanAllocator(), &map_buffer_src) != VK_SUCCESS) {
+		LOG_ERROR("renderer", "failed to create buffer!");
 	}
-	vkCreateBuffer(device, &bufferCreateInfo, 0, &map_buffer_dst);
+	vkCreateBuffer(device, &bufferCreateInfo, vulkanAllocator(), &map_buffer_dst);
 
 	bufferCreateInfo.size = sizeEntites;
-	vkCreateBuffer(device, &bufferCreateInfo, 0, &entity_buffer_src);
-	vkCreateBuffer(device, &bufferCreateInfo, 0, &entity_buffer_dst);
+	vkCreateBuffer(device, &bufferCreateInfo, vulkanAllocator(), &entity_buffer_src);
+	vkCreateBuffer(device, &bufferCreateInfo, vulkanAllocator(), &entity_buffer_dst);
 
 	bufferCreateInfo.size = stepsSize;
-	vkCreateBuffer(device, &bufferCreateInfo, 0, &steps_buffer_src);
-	vkCreateBuffer(device, &bufferCreateInfo, 0, &steps_buffer_dst);
+	vkCreateBuffer(device, &bufferCreateInfo, vulkanAllocator(), &steps_buffer_src);
+	vkCreateBuffer(device, &bufferCreateInfo, vulkanAllocator(), &steps_buffer_dst);
 
 	bufferCreateInfo.size = 2 * sizeof(uvec2);
-	vkCreateBuffer(device, &bufferCreateInfo, 0, &dimsgoal_buffer_dst);
-	vkCreateBuffer(device, &bufferCreateInfo, 0, &dimsgoal_buffer_src);
+	vkCreateBuffer(device, &bufferCreateInfo, vulkanAllocator(), &dimsgoal_buffer_dst);
+	vkCreateBuffer(device, &bufferCreateInfo, vulkanAllocator(), &dimsgoal_buffer_src);
 
 	VkMemoryRequirements reqs;
 	
@@ -1305,29 +1267,35 @@ void Renderer::initCompute(size_t sizeMap, size_t sizeEntites)
 	  memoryTypeIndex
 	};
 
-	if (vkAllocateMemory(device, &memoryAllocateInfo, 0, &computeMemory_dst) == VK_SUCCESS) {
-		printf("Allocated compute destination memory!\n");
+	if (allocateDeviceMemory(device, &memoryAllocateInfo, &computeMemory_dst) == VK_SUCCESS) {
+		LOG_DEBUG("renderer", "allocated compute destination memory");
 	}
 	else {
-		printf("Failed to allocate compute memory!\n");
+		LOG_ERROR("renderer", "failed to allocate compute destination memory!");
 	}
 	
-	if (vkAllocateMemory(device, &memoryAllocateInfo, 0, &computeMemory_src) == VK_SUCCESS) {
-		printf("Allocated compute source memory!\n");
+	if (allocateDeviceMemory(device, &memoryAllocateInfo, &computeMemory_src) == VK_SUCCESS) {
+		LOG_DEBUG("renderer", "allocated compute source memory");
 	}
 	else {
-		printf("Failed to allocate compute memory!\n");
+		LOG_ERROR("renderer", "failed to allocate compute source memory!");
 	}
 
-	VkResult res = vkBindBufferMemory(device, map_buffer_src, computeMemory_src, 0);
-	res = vkBindBufferMemory(device, entity_buffer_src, computeMemory_src, mapSize + alignOffsetEntity);
-	res = vkBindBufferMemory(device, steps_buffer_src, computeMemory_src, mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps);
-	res = vkBindBufferMemory(device, dimsgoal_buffer_src, computeMemory_src, mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps + stepsSize + alignOffsetDimsGoal);
-
-	res = vkBindBufferMemory(device, map_buffer_dst, computeMemory_dst, 0);
-	res = vkBindBufferMemory(device, entity_buffer_dst, computeMemory_dst, mapSize + alignOffsetEntity);
-	res = vkBindBufferMemory(device, steps_buffer_dst, computeMemory_dst, mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps);
-	res = vkBindBufferMemory(device, dimsgoal_buffer_dst, computeMemory_dst, mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps + stepsSize + alignOffsetDimsGoal);
+	// src and dst share one layout, each buffer at its offset in both allocations
+	const VkDeviceSize bindOffsets[4] = {
+	  0,
+	  mapSize + alignOffsetEntity,
+	  mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps,
+	  mapSize + alignOffsetEntity + entitiesSize + alignOffsetSteps + stepsSize + alignOffsetDimsGoal
+	};
+	const VkBuffer srcBuffers[4] = { map_buffer_src, entity_buffer_src, steps_buffer_src, dimsgoal_buffer_src };
+	const VkBuffer dstBuffers[4] = { map_buffer_dst, entity_buffer_dst, steps_buffer_dst, dimsgoal_buffer_dst };
+	for (int i = 0; i < 4; i++) {
+		if (vkBindBufferMemory(device, srcBuffers[i], computeMemory_src, bindOffsets[i]) != VK_SUCCESS)
+			LOG_ERROR("renderer", "failed to bind compute source buffer %d!", i);
+		if (vkBindBufferMemory(device, dstBuffers[i], computeMemory_dst, bindOffsets[i]) != VK_SUCCESS)
+			LOG_ERROR("renderer", "failed to bind compute destination buffer %d!", i);
+	}
 
 	VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[4] = {
 	  {
@@ -1368,8 +1336,8 @@ void Renderer::initCompute(size_t sizeMap, size_t sizeEntites)
 	  descriptorSetLayoutBindings
 	};
 
-	if (vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, 0, &computeDescriptorSetLayout) != VK_SUCCESS) {
-		printf("Failed to create compute descriptor set layout!\n");
+	if (vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, vulkanAllocator(), &computeDescriptorSetLayout) != VK_SUCCESS) {
+		LOG_ERROR("renderer", "failed to create compute descriptor set layout!");
 	}
 
 	VkSemaphoreCreateInfo semaphoreCreateInfo;
@@ -1377,14 +1345,14 @@ void Renderer::initCompute(size_t sizeMap, size_t sizeEntites)
 	semaphoreCreateInfo.flags = 0;
 	semaphoreCreateInfo.pNext = NULL;
 
-	vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &sem_transferToDevice);
-	vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &sem_computeDone);
+	vkCreateSemaphore(device, &semaphoreCreateInfo, vulkanAllocator(), &sem_transferToDevice);
+	vkCreateSemaphore(device, &semaphoreCreateInfo, vulkanAllocator(), &sem_computeDone);
 
 	VkFenceCreateInfo fenceInfo;
 	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 	fenceInfo.flags = 0;
 	fenceInfo.pNext = NULL;
-	vkCreateFence(device, &fenceInfo, 0, &fen_transfer);
+	vkCreateFence(device, &fenceInfo, vulkanAllocator(), &fen_transfer);
 
 	createComputePipeline();
 	createComputeDescriptorSets();
@@ -1402,7 +1370,7 @@ void Renderer::createComputePipeline() {
 	  0,
 	  0
 	};
-	vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, 0, &computePipelineLayout);
+	vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, vulkanAllocator(), &computePipelineLayout);
 
 	VkShaderModule shader_module = createShaderModule("shader.comp");
 
@@ -1424,7 +1392,7 @@ void Renderer::createComputePipeline() {
 	  0
 	};
 
-	vkCreateComputePipelines(device, 0, 1, &computePipelineCreateInfo, 0, &computePipeline);
+	vkCreateComputePipelines(device, 0, 1, &computePipelineCreateInfo, vulkanAllocator(), &computePipeline);
 }
 
 void Renderer::createComputeDescriptorSets() {
@@ -1442,7 +1410,7 @@ void Renderer::createComputeDescriptorSets() {
 	  &descriptorPoolSize
 	};
 
-	vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, 0, &computeDescriptorPool);
+	vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, vulkanAllocator(), &computeDescriptorPool);
 
 	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
 	  VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
@@ -1464,7 +1432,7 @@ void Renderer::createComputeCommandPools() {
 	};
 	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-	vkCreateCommandPool(device, &commandPoolCreateInfo, 0, &computeCommandPool);
+	vkCreateCommandPool(device, &commandPoolCreateInfo, vulkanAllocator(), &computeCommandPool);
 
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
 	  VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -1568,7 +1536,7 @@ void Renderer::createGraphicsPipeline()
 	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
 	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
 
-	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, vulkanAllocator(), &pipelineLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create pipeline layout!");
 	}
@@ -1610,11 +1578,11 @@ void Renderer::createGraphicsPipeline()
 
 		pipelineInfo.pStages = shaderStages;
 
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &entityGraphicsPipeline) != VK_SUCCESS)
+		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, vulkanAllocator(), &entityGraphicsPipeline) != VK_SUCCESS)
 			throw std::runtime_error("failed to create graphics pipeline!");
 
-		vkDestroyShaderModule(device, fragShaderModule, nullptr);
-		vkDestroyShaderModule(device, vertShaderModule, nullptr);
+		vkDestroyShaderModule(device, fragShaderModule, vulkanAllocator());
+		vkDestroyShaderModule(device, vertShaderModule, vulkanAllocator());
 	}
 
 	{
@@ -1637,11 +1605,11 @@ void Renderer::createGraphicsPipeline()
 
 		pipelineInfo.pStages = shaderStages;
 
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mapGraphicsPipeline) != VK_SUCCESS)
+		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, vulkanAllocator(), &mapGraphicsPipeline) != VK_SUCCESS)
 			throw std::runtime_error("failed to create graphics pipeline!");
 
-		vkDestroyShaderModule(device, fragShaderModule, nullptr);
-		vkDestroyShaderModule(device, vertShaderModule, nullptr);
+		vkDestroyShaderModule(device, fragShaderModule, vulkanAllocator());
+		vkDestroyShaderModule(device, vertShaderModule, vulkanAllocator());
 	}
 
 
@@ -1661,7 +1629,7 @@ void Renderer::createCommandPools()
 		poolInfo.flags = 0; // Optional
 		for (int i = 0; i < numCommandPools; i++)
 		{
-			if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPools[i]) != VK_SUCCESS)
+			if (vkCreateCommandPool(device, &poolInfo, vulkanAllocator(), &commandPools[i]) != VK_SUCCESS)
 			{
 				throw std::runtime_error("failed to create a entity command pool!");
 			}
@@ -1677,7 +1645,7 @@ void Renderer::createCommandPools()
 		poolInfo.flags = 0; // Optional
 		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 		{
-			if (vkCreateCommandPool(device, &poolInfo, nullptr, &mainCommandPools[i]) != VK_SUCCESS)
+			if (vkCreateCommandPool(device, &poolInfo, vulkanAllocator(), &mainCommandPools[i]) != VK_SUCCESS)
 			{
 				throw std::runtime_error("failed to create main command pool!");
 			}
@@ -1693,7 +1661,7 @@ void Renderer::createCommandPools()
 		poolInfo.flags = 0; // Optional
 		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 		{
-			if (vkCreateCommandPool(device, &poolInfo, nullptr, &mapCommandPools[i]) != VK_SUCCESS)
+			if (vkCreateCommandPool(device, &poolInfo, vulkanAllocator(), &mapCommandPools[i]) != VK_SUCCESS)
 			{
 				throw std::runtime_error("failed to create main command pool!");
 			}
@@ -1705,7 +1673,7 @@ void Renderer::createCommandPools()
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
 		poolInfo.flags = 0; // Optional
-		if (vkCreateCommandPool(device, &poolInfo, nullptr, &singleTimeCommandsPool) != VK_SUCCESS)
+		if (vkCreateCommandPool(device, &poolInfo, vulkanAllocator(), &singleTimeCommandsPool) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create singleTimeCommandsPool!");
 		}
@@ -1782,9 +1750,9 @@ void Renderer::createSyncObjects()
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		if ((vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) |
-			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) |
-			vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i])) != VK_SUCCESS)
+		if ((vkCreateSemaphore(device, &semaphoreInfo, vulkanAllocator(), &imageAvailableSemaphores[i]) |
+			vkCreateSemaphore(device, &semaphoreInfo, vulkanAllocator(), &renderFinishedSemaphores[i]) |
+			vkCreateFence(device, &fenceInfo, vulkanAllocator(), &inFlightFences[i])) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create synchronization objects for a frame!");
 		}
@@ -1810,7 +1778,7 @@ void Renderer::createSampler()
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
 	samplerInfo.maxLod = 0.0f;
-	if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS)
+	if (vkCreateSampler(device, &samplerInfo, vulkanAllocator(), &textureSampler) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create texture sampler!");
 	}
@@ -1819,7 +1787,7 @@ void Renderer::createSampler()
 void Renderer::createUniformBuffers()
 {
 
-	std::cout << "uniformBufferAlignment: " << uniformBufferAlignment << "\n";
+	LOG_INFO("renderer", "uniformBufferAlignment: %u", uniformBufferAlignment);
 
 	VkDeviceSize bufferSize = uniformBufferAlignment * MAX_DRAW_ENTITIES;
 
@@ -1835,6 +1803,7 @@ void Renderer::createUniformBuffers()
 void Renderer::createQueryPool()
 {
 	queryPools.resize(MAX_FRAMES_IN_FLIGHT);
+	queryPoolUsed.assign(MAX_FRAMES_IN_FLIGHT, false);
 	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
 		VkQueryPoolCreateInfo createInfo;
@@ -1843,7 +1812,7 @@ void Renderer::createQueryPool()
 		createInfo.flags = 0;
 		createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
 		createInfo.queryCount = 2;
-		vkCreateQueryPool(device, &createInfo, nullptr, &queryPools[i]);
+		vkCreateQueryPool(device, &createInfo, vulkanAllocator(), &queryPools[i]);
 	}
 
 	VkQueryPoolCreateInfo createInfo;
@@ -1852,7 +1821,7 @@ void Renderer::createQueryPool()
 	createInfo.flags = 0;
 	createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
 	createInfo.queryCount = 2;
-	vkCreateQueryPool(device, &createInfo, nullptr, &computeQueryPool);
+	vkCreateQueryPool(device, &createInfo, vulkanAllocator(), &computeQueryPool);
 }
 
 void Renderer::calcUniformBufferAlignment()
@@ -1864,11 +1833,32 @@ void Renderer::calcUniformBufferAlignment()
 		uniformBufferAlignment = (uniformBufferAlignment + minAlignment - 1) & ~(minAlignment - 1);
 }
 
+void Renderer::calibrateGpuClock()
+{
+	// the timestamp lands somewhere between submit and the end of the wait,
+	// the midpoint is good to a fraction of the submit latency
+	VkCommandBuffer cmd = beginSingleTimeCommands();
+	vkCmdResetQueryPool(cmd, queryPools[0], 0, 2);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPools[0], 0);
+	int64_t cpuBefore = TraceRecorder::nowNs();
+	endSingleTimeCommands(cmd);
+	int64_t cpuAfter = TraceRecorder::nowNs();
+
+	uint64_t ticks = 0;
+	if (vkGetQueryPoolResults(device, queryPools[0], 0, 1, sizeof(ticks), &ticks,
+		sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS)
+	{
+		LOG_WARN("renderer", "could not calibrate the GPU clock");
+		return;
+	}
+	gpuClockOffsetNs = (cpuBefore + cpuAfter) / 2 - static_cast<int64_t>(double(ticks) * timestampPeriod);
+}
+
 void Renderer::getVkLimits()
 {
 	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-	timestampToNsScaling = properties.limits.timestampPeriod;
+	timestampPeriod = properties.limits.timestampPeriod;
 }
 
 bool Renderer::isDeviceSuitable(VkPhysicalDevice device)
@@ -2011,7 +2001,7 @@ VkShaderModule Renderer::createShaderModule(const std::string& filepath)
 	createInfo.pCode = reinterpret_cast<const uint32_t*>(spv.data());
 
 	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	if (vkCreateShaderModule(device, &createInfo, vulkanAllocator(), &shaderModule) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create shader module!");
 	}
@@ -2027,7 +2017,7 @@ void Renderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemor
 	bufferInfo.usage = usage;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+	if (vkCreateBuffer(device, &bufferInfo, vulkanAllocator(), &buffer) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create buffer!");
 	}
@@ -2040,7 +2030,7 @@ void Renderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemor
 	allocInfo.allocationSize = memRequirements.size;
 	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+	if (allocateDeviceMemory(device, &allocInfo, &bufferMemory) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to allocate buffer memory!");
 	}
@@ -2098,74 +2088,3 @@ void Renderer::endSingleTimeCommands(VkCommandBuffer commandBuffer)
 
 	vkFreeCommandBuffers(device, singleTimeCommandsPool, 1, &commandBuffer);
 }
-
-void Renderer::saveBenchmarkValues()
-{
-	{
-		std::string result;
-		auto dlen = benchmarkDrawValues.size();
-		auto clen = benchmarkComputeValues.size();
-		for (int i = 0; i < glm::max(dlen, clen); i++)
-		{
-			result += std::to_string(benchmarkDrawValues[i]) + "\t1\t";
-			if(i >= 2 && i < clen)
-				result += std::to_string(benchmarkComputeValues[i]) + "\t2";
-			result += "\n";
-		}
-		std::ofstream file("benchmark.txt");
-		file << result;
-		file.close();
-		std::cout << "saved benchmark data" << std::endl;	
-	}
-
-	
-	{
-		uint64_t avgDraw = 0;
-		for (int i = 0; i < benchmarkDrawValues.size(); i+=2)
-		{
-			auto start = benchmarkDrawValues[i];
-			auto end = benchmarkDrawValues[i+1];
-			avgDraw += static_cast<uint64_t>(end - start);
-		}
-		avgDraw /= benchmarkDrawValues.size();
-
-		uint64_t avgCompute = 0;
-		for (int i = 0; i < benchmarkComputeValues.size(); i += 2)
-		{
-			auto start = benchmarkComputeValues[i];
-			auto end = benchmarkComputeValues[i + 1];
-			avgCompute += static_cast<uint64_t>(end - start);
-		}
-		avgCompute /= benchmarkComputeValues.size();
-
-		std::string toWrite;
-
-	}
-
-	{
-		
-		double avgRecord = 0;
-		for (int i = 0; i < benchmarkRecordValues.size(); i++)
-		{
-			avgRecord += benchmarkRecordValues[i];
-		}
-		avgRecord *= 1000;
-		avgRecord /= benchmarkRecordValues.size();
-
-
-		std::string filename = "recordtime_E";
-		filename += std::to_string(GLOBAL_NUM_ENTITIES);
-		filename += "_T" + std::to_string(GLOBAL_NUM_THREADS);
-		filename += ".txt";
-		std::ofstream file(filename);
-		file << std::to_string(avgRecord);
-		file.close();
-	}
-
-
-
-	//system("pause");
-
-	exit(0);
-}
-
@@ -3,15 +3,17 @@
 #include <vector>
 #include "../entity.h"
 #include "../world.h"
-#include "../util/Threadpool.h"
+#include "../util/scheduler.hpp"
 #include "../util/timer.hpp"
+#include "../util/histogram.hpp"
+#include "../util/metrics.hpp"
+#include "../util/trace.hpp"
 #include "texture2D.hpp"
 #include "constantbuffer.hpp"
 #include <mutex>
 
 extern int GLOBAL_NUM_THREADS;
 extern int GLOBAL_NUM_ENTITIES;
-extern bool GLOBAL_TESTING;
 
 #define MAX_DRAW_ENTITIES 256
 #define NUM_UNIFORM_FLOATS 3
@@ -41,7 +43,12 @@ class Renderer
 {
 public:
 	Renderer() : 
-		threadPool(GLOBAL_NUM_THREADS-1), 
+		scheduler(GLOBAL_NUM_THREADS-1), 
+		frameLatency(LatencyRegistry::get().histogram("frame")),
+		recordLatency(LatencyRegistry::get().histogram("record")),
+		frameCounter(MetricsRegistry::get().counter("frames")),
+		deadlineQueueGauge(MetricsRegistry::get().gauge("deadline_queue")),
+		backgroundQueueGauge(MetricsRegistry::get().gauge("background_queue")),
 		texture(this)
 	{}
 
@@ -53,12 +60,42 @@ public:
 
 	bool windowShouldClose();
 
+	// shared with background path work, recording always goes first
+	Scheduler& getScheduler() {
+		return scheduler;
+	}
+
 	void initCompute(size_t sizeMap, size_t sizeEntites);
 	void mapComputeMemory(void* map, void* entities, uvec2* dims, uvec2* goal, size_t mapSize, size_t entitySize);
+	// blocking, submitCompute + wait + finishCompute
 	void executeCompute();
+	// asynchronous variant: submit, poll computeFinished(), then finishCompute()
+	// copies the steps into getSteps()
+	void submitCompute();
+	bool computeFinished();
+	void finishCompute();
 
 	ivec2* getSteps() {
-		return astarSteps;
+		return astarSteps.data();
+	}
+	// sizes the compute buffers were created for by initCompute
+	size_t getComputeMapSize() const {
+		return mapSize;
+	}
+	size_t getComputeEntityCount() const {
+		return static_cast<size_t>(numEntities);
+	}
+
+	// seconds, CPU time recording the entity command buffers
+	double getLastRecordTime() const {
+		return lastRecordTime;
+	}
+	// seconds, GPU time of the last finished frame / compute dispatch
+	double getLastGpuFrameTime() const {
+		return lastGpuFrameTime;
+	}
+	double getLastComputeGpuTime() const {
+		return lastComputeGpuTime;
 	}
 private:
 	void createWindow();
@@ -93,6 +130,7 @@ private:
 	void createTransferCommandBuffer();
 	void transferComputeDataToDevice();
 	void transferComputeDataToHost();
+	void readComputeDataFromHost();
 
 	void updateUniformBuffer();
 
@@ -126,23 +164,35 @@ private:
 	int width = 800;
 	int height = 600;
 	GLFWwindow* window;
-	threadpool::Threadpool threadPool;
+	Scheduler scheduler;
 	std::vector<Entity> toDraw;
 	uint32_t drawCount = 0;
 	float* posBuffer;
 
 
-	// benchmark values
-	const uint32_t NUM_BENCHMARK_FRAMES = 500;
-	uint32_t benchmarkFrameCount = 0;
-	uint32_t benchmarkFirstDraw;
-	bool benchmarkIsFirstCompute = true;
-	uint32_t benchmarkFirstCompute = 0;
-	std::vector<uint32_t> benchmarkDrawValues;
-	std::vector<uint32_t> benchmarkComputeValues;
-	Timer recordTimer;
-	std::vector<double> benchmarkRecordValues;
-	void saveBenchmarkValues();
+	// last measured values, read by the benchmark target
+	double lastRecordTime = 0.0;
+	double lastGpuFrameTime = 0.0;
+	double lastComputeGpuTime = 0.0;
+
+	// GPU timestamps to the TraceRecorder clock, measured once at init
+	int64_t gpuClockOffsetNs = 0;
+	void calibrateGpuClock();
+	int64_t gpuToCpuNs(uint64_t ticks) const
+	{
+		return static_cast<int64_t>(double(ticks) * timestampPeriod) + gpuClockOffsetNs;
+	}
+
+	LatencyHistogram& frameLatency;
+	LatencyHistogram& recordLatency;
+	MetricCounter& frameCounter;
+	MetricGauge& deadlineQueueGauge;
+	MetricGauge& backgroundQueueGauge;
+	Timer frameTimer;
+	bool firstFrame = true;
+
+	// command buffer recording has to be done this long after it starts
+	const std::chrono::microseconds RECORD_BUDGET{ 4000 };
 
 	Timer fpsTimer;
 	double fpsFrameCount;
@@ -194,9 +244,12 @@ private:
 	uint32_t timestampValidBitsGraphicsQueue;
 	uint32_t timestampValidBitsPresentQueue;
 	std::vector<VkQueryPool> queryPools;
-	uint32_t timestampToNsScaling;
+	std::vector<bool> queryPoolUsed;
+	float timestampPeriod; // ns per timestamp tick
 
-	VkQueryPool computeQueryPool;
+	// compute handles are null until created, cleanup() destroys them
+	// unconditionally and initCompute may never have run (benchmark record stage)
+	VkQueryPool computeQueryPool = VK_NULL_HANDLE;
 
 
 	VkDebugReportCallbackEXT callback;
@@ -204,15 +257,17 @@ private:
 	QueueFamilyIndices familyIndices;
 
 	//transfer
-	VkCommandPool transferCommandPool;
-	VkCommandBuffer transferCommandBuffer;
-	VkCommandBuffer transferCommandBuffer2;
+	VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+	VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+	VkCommandBuffer transferCommandBuffer2 = VK_NULL_HANDLE;
 
-	VkFence fen_transfer;
+	VkFence fen_transfer = VK_NULL_HANDLE;
 
 	//compute
 	int preComputedSteps = 20;
 	int numEntities = 0;
+	// entities of the batch last passed to mapComputeMemory, at most numEntities
+	uint32_t dispatchCount = 0;
 	size_t mapSize;
 	size_t entitiesSize;
 	size_t stepsSize;
@@ -220,29 +275,29 @@ private:
 
 	uint32_t uniformBufferAlignment;
 
-	VkSemaphore sem_transferToDevice;
-	VkSemaphore sem_computeDone;
-
-	VkDeviceMemory computeMemory_dst;
-	VkDeviceMemory computeMemory_src;
-	VkBuffer map_buffer_dst;
-	VkBuffer map_buffer_src;
-	VkBuffer entity_buffer_dst;
-	VkBuffer entity_buffer_src;
-	VkBuffer steps_buffer_dst;
-	VkBuffer steps_buffer_src;
-	VkBuffer dimsgoal_buffer_src;
-	VkBuffer dimsgoal_buffer_dst;
-
-	ivec2* astarSteps;
-
-	VkDescriptorSetLayout computeDescriptorSetLayout;
-	VkDescriptorSet computeDescriptorSet;
-	VkPipelineLayout computePipelineLayout;
-	VkPipeline computePipeline;
-	VkDescriptorPool computeDescriptorPool;
-	VkCommandPool computeCommandPool;
-	VkCommandBuffer computeCommandBuffer;
+	VkSemaphore sem_transferToDevice = VK_NULL_HANDLE;
+	VkSemaphore sem_computeDone = VK_NULL_HANDLE;
+
+	VkDeviceMemory computeMemory_dst = VK_NULL_HANDLE;
+	VkDeviceMemory computeMemory_src = VK_NULL_HANDLE;
+	VkBuffer map_buffer_dst = VK_NULL_HANDLE;
+	VkBuffer map_buffer_src = VK_NULL_HANDLE;
+	VkBuffer entity_buffer_dst = VK_NULL_HANDLE;
+	VkBuffer entity_buffer_src = VK_NULL_HANDLE;
+	VkBuffer steps_buffer_dst = VK_NULL_HANDLE;
+	VkBuffer steps_buffer_src = VK_NULL_HANDLE;
+	VkBuffer dimsgoal_buffer_src = VK_NULL_HANDLE;
+	VkBuffer dimsgoal_buffer_dst = VK_NULL_HANDLE;
+
+	std::vector<ivec2> astarSteps;
+
+	VkDescriptorSetLayout computeDescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSet computeDescriptorSet = VK_NULL_HANDLE;
+	VkPipelineLayout computePipelineLayout = VK_NULL_HANDLE;
+	VkPipeline computePipeline = VK_NULL_HANDLE;
+	VkDescriptorPool computeDescriptorPool = VK_NULL_HANDLE;
+	VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+	VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
 	VkWriteDescriptorSet computeWriteDescriptorSet[3];
 
 	int alignOffsetEntity = 0;
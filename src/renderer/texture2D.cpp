@@ -1,10 +1,11 @@
 #include "texture2D.hpp"
 
-#include "../lodepng/lodepng.h"
+#include "../mapimage.hpp"
 #include <string>
 #include <iostream>
 #include <vector>
 #include "renderer.hpp"
+#include "vulkanmemory.hpp"
 
 void Texture2D::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
 {
@@ -107,7 +108,7 @@ VkImageView Texture2D::createImageView(VkImage image, VkFormat format)
 	viewInfo.subresourceRange.layerCount = 1;
 
 	VkImageView imageView;
-	if (vkCreateImageView(renderer->device, &viewInfo, nullptr, &imageView) != VK_SUCCESS)
+	if (vkCreateImageView(renderer->device, &viewInfo, vulkanAllocator(), &imageView) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create texture image view!");
 	}
@@ -122,14 +123,12 @@ void Texture2D::createTextureImageView()
 
 void Texture2D::loadFromFile(const std::string& filename)
 {
-	std::vector<unsigned char> image;
-	unsigned error = lodepng::decode(image, width, height, filename, LCT_GREY);
-	if (error != 0)
-	{
-		throw std::runtime_error("Could not load texture : " + filename +"\n");
-	}
+	// decoded once for the world's occupancy grid as well
+	std::shared_ptr<const MapImage> image = MapImageCache::get().load(filename);
+	width = image->width;
+	height = image->height;
 
-	VkDeviceSize imageSize = width * height * 4;
+	VkDeviceSize imageSize = image->grey.size();
 
 
 	VkBuffer stagingBuffer;
@@ -144,7 +143,7 @@ void Texture2D::loadFromFile(const std::string& filename)
 		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-		if (vkCreateBuffer(renderer->device, &bufferInfo, nullptr, &stagingBuffer) != VK_SUCCESS)
+		if (vkCreateBuffer(renderer->device, &bufferInfo, vulkanAllocator(), &stagingBuffer) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create buffer!");
 		}
@@ -168,7 +167,7 @@ void Texture2D::loadFromFile(const std::string& filename)
 			}
 		}
 
-		if (vkAllocateMemory(renderer->device, &allocInfo, nullptr, &stagingBufferMemory) != VK_SUCCESS)
+		if (allocateDeviceMemory(renderer->device, &allocInfo, &stagingBufferMemory) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to allocate buffer memory!");
 		}
@@ -178,7 +177,7 @@ void Texture2D::loadFromFile(const std::string& filename)
 
 		void* data;
 		vkMapMemory(renderer->device, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, image.data(), image.size());
+		memcpy(data, image->grey.data(), image->grey.size());
 		vkUnmapMemory(renderer->device, stagingBufferMemory);
 	}
 
@@ -198,7 +197,7 @@ void Texture2D::loadFromFile(const std::string& filename)
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.flags = 0; // Optional
 
-	if (vkCreateImage(renderer->device, &imageInfo, nullptr, &textureImage) != VK_SUCCESS)
+	if (vkCreateImage(renderer->device, &imageInfo, vulkanAllocator(), &textureImage) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create image!");
 	}
@@ -227,7 +226,7 @@ void Texture2D::loadFromFile(const std::string& filename)
 
 
 
-		if (vkAllocateMemory(renderer->device, &allocInfo, nullptr, &textureImageMemory) != VK_SUCCESS)
+		if (allocateDeviceMemory(renderer->device, &allocInfo, &textureImageMemory) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to allocate image memory!");
 		}
@@ -241,8 +240,8 @@ void Texture2D::loadFromFile(const std::string& filename)
 
 	transitionImageLayout(textureImage, VK_FORMAT_R8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-	vkDestroyBuffer(renderer->device, stagingBuffer, nullptr);
-	vkFreeMemory(renderer->device, stagingBufferMemory, nullptr);
+	vkDestroyBuffer(renderer->device, stagingBuffer, vulkanAllocator());
+	freeDeviceMemory(renderer->device, stagingBufferMemory);
 
 	createTextureImageView();
 }
\ No newline at end of file
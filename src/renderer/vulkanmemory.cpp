@@ -0,0 +1,78 @@
+#include "vulkanmemory.hpp"
+#include "../util/memory.hpp"
+
+#include <mutex>
+#include <unordered_map>
+
+static VKAPI_ATTR void* VKAPI_CALL vulkanAllocation(void*, size_t size, size_t alignment, VkSystemAllocationScope)
+{
+	return memory::allocate(size, alignment, MEM_VULKAN);
+}
+
+static VKAPI_ATTR void* VKAPI_CALL vulkanReallocation(void*, void* original, size_t size, size_t alignment, VkSystemAllocationScope)
+{
+	if (size == 0)
+	{
+		memory::release(original);
+		return nullptr;
+	}
+	return memory::reallocate(original, size, alignment, MEM_VULKAN);
+}
+
+static VKAPI_ATTR void VKAPI_CALL vulkanFree(void*, void* block)
+{
+	memory::release(block);
+}
+
+// executable memory the driver allocates itself, only reported
+static VKAPI_ATTR void VKAPI_CALL vulkanInternalAllocation(void*, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+	memory::track(MEM_VULKAN, static_cast<int64_t>(size));
+}
+
+static VKAPI_ATTR void VKAPI_CALL vulkanInternalFree(void*, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+	memory::track(MEM_VULKAN, -static_cast<int64_t>(size));
+}
+
+const VkAllocationCallbacks* vulkanAllocator()
+{
+	static const VkAllocationCallbacks callbacks = {
+		nullptr,
+		vulkanAllocation,
+		vulkanReallocation,
+		vulkanFree,
+		vulkanInternalAllocation,
+		vulkanInternalFree
+	};
+	return &callbacks;
+}
+
+static std::mutex deviceMemoryMutex;
+static std::unordered_map<VkDeviceMemory, VkDeviceSize> deviceMemorySizes;
+
+VkResult allocateDeviceMemory(VkDevice device, const VkMemoryAllocateInfo* info, VkDeviceMemory* deviceMemory)
+{
+	VkResult result = vkAllocateMemory(device, info, vulkanAllocator(), deviceMemory);
+	if (result == VK_SUCCESS)
+	{
+		std::lock_guard<std::mutex> lock(deviceMemoryMutex);
+		deviceMemorySizes[*deviceMemory] = info->allocationSize;
+		memory::track(MEM_DEVICE, static_cast<int64_t>(info->allocationSize));
+	}
+	return result;
+}
+
+void freeDeviceMemory(VkDevice device, VkDeviceMemory deviceMemory)
+{
+	if (deviceMemory == VK_NULL_HANDLE)
+		return;
+	vkFreeMemory(device, deviceMemory, vulkanAllocator());
+	std::lock_guard<std::mutex> lock(deviceMemoryMutex);
+	auto it = deviceMemorySizes.find(deviceMemory);
+	if (it != deviceMemorySizes.end())
+	{
+		memory::track(MEM_DEVICE, -static_cast<int64_t>(it->second));
+		deviceMemorySizes.erase(it);
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// Host memory the driver allocates for objects created with these
+// callbacks is charged to MEM_VULKAN. Objects must be destroyed with the
+// same callbacks they were created with.
+const VkAllocationCallbacks* vulkanAllocator();
+
+// vkAllocateMemory / vkFreeMemory, accounting the device memory as MEM_DEVICE
+VkResult allocateDeviceMemory(VkDevice device, const VkMemoryAllocateInfo* info, VkDeviceMemory* deviceMemory);
+void freeDeviceMemory(VkDevice device, VkDeviceMemory deviceMemory);
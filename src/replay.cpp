@@ -0,0 +1,267 @@
+#include "replay.hpp"
+#include "world.h"
+#include "util/log.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+
+uint64_t ReplayLog::mapHash(const World& world)
+{
+	uvec2 dims = world.getMapDims();
+	return fnv1a(FNV_OFFSET, world.getMap(), size_t(dims.x) * dims.y * sizeof(unsigned int));
+}
+
+uint64_t ReplayLog::stateHash(const World& world)
+{
+	uint64_t hash = FNV_OFFSET;
+	uint64_t tick = world.getTick();
+	hash = fnv1a(hash, &tick, sizeof(tick));
+	hash = fnv1a(hash, &world.goal, sizeof(world.goal));
+	hash = fnv1a(hash, world.entities.data(), world.entities.size() * sizeof(uvec2));
+	return hash;
+}
+
+ReplayLog::~ReplayLog()
+{
+	if (mOut.is_open())
+		mOut.close();
+}
+
+void ReplayLog::startRecording(const std::string& filename, const World& world)
+{
+	mOut.open(filename, std::ios::binary | std::ios::trunc);
+	if (!mOut)
+		throw std::runtime_error("could not open replay log " + filename);
+	mMode = MODE_RECORD;
+
+	uvec2 dims = world.getMapDims();
+	write(MAGIC);
+	write(VERSION);
+	write(world.getSeed());
+	write(dims.x);
+	write(dims.y);
+	write(mapHash(world));
+	write(static_cast<uint32_t>(world.entities.size()));
+	for (const uvec2& e : world.entities)
+	{
+		write(e.x);
+		write(e.y);
+	}
+	write(world.goal.x);
+	write(world.goal.y);
+}
+
+void ReplayLog::recordGoal(uint64_t tick, uvec2 goal, bool duringUpdate)
+{
+	if (!recording())
+		return;
+	write(static_cast<uint8_t>(duringUpdate ? RECORD_GOAL_REACHED : RECORD_GOAL_RESET));
+	write(tick);
+	write(goal.x);
+	write(goal.y);
+}
+
+void ReplayLog::recordSteps(uint64_t tick, const ivec2* steps, size_t count)
+{
+	if (!recording())
+		return;
+	write(static_cast<uint8_t>(RECORD_STEPS));
+	write(tick);
+	write(static_cast<uint32_t>(count));
+
+	std::vector<char> bytes;
+	bytes.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		ivec2 s = steps[i];
+		if (s.x >= -1 && s.x <= 1 && s.y >= -1 && s.y <= 1)
+		{
+			bytes.push_back(static_cast<char>((s.x + 1) * 3 + (s.y + 1)));
+		}
+		else
+		{
+			bytes.push_back(static_cast<char>(0xff));
+			bytes.insert(bytes.end(), reinterpret_cast<const char*>(&s.x), reinterpret_cast<const char*>(&s.x) + 4);
+			bytes.insert(bytes.end(), reinterpret_cast<const char*>(&s.y), reinterpret_cast<const char*>(&s.y) + 4);
+		}
+	}
+	mOut.write(bytes.data(), bytes.size());
+}
+
+void ReplayLog::finish(const World& world)
+{
+	if (!recording())
+		return;
+	write(static_cast<uint8_t>(RECORD_END));
+	write(world.getTick());
+	write(stateHash(world));
+	mOut.close();
+	mMode = MODE_OFF;
+	LOG_INFO("replay", "recorded %llu ticks", (unsigned long long)world.getTick());
+}
+
+// bounds checked little reader over the loaded file
+class ReplayReader
+{
+public:
+	ReplayReader(const std::vector<char>& data) : mData(data) {}
+	template<typename T>
+	T read()
+	{
+		if (mPos + sizeof(T) > mData.size())
+			throw std::runtime_error("replay log is truncated");
+		T value;
+		memcpy(&value, mData.data() + mPos, sizeof(T));
+		mPos += sizeof(T);
+		return value;
+	}
+	bool atEnd() const { return mPos >= mData.size(); }
+private:
+	const std::vector<char>& mData;
+	size_t mPos = 0;
+};
+
+void ReplayLog::load(const std::string& filename)
+{
+	std::ifstream in(filename, std::ios::binary);
+	if (!in)
+		throw std::runtime_error("could not open replay log " + filename);
+	std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	ReplayReader reader(data);
+	if (reader.read<uint32_t>() != MAGIC || reader.read<uint32_t>() != VERSION)
+		throw std::runtime_error("not a replay log: " + filename);
+	mSeed = reader.read<uint64_t>();
+	mDims.x = reader.read<uint32_t>();
+	mDims.y = reader.read<uint32_t>();
+	mMapHash = reader.read<uint64_t>();
+	uint32_t entityCount = reader.read<uint32_t>();
+	mStartEntities.resize(entityCount);
+	for (uvec2& e : mStartEntities)
+	{
+		e.x = reader.read<uint32_t>();
+		e.y = reader.read<uint32_t>();
+	}
+	mStartGoal.x = reader.read<uint32_t>();
+	mStartGoal.y = reader.read<uint32_t>();
+
+	bool ended = false;
+	while (!ended && !reader.atEnd())
+	{
+		uint8_t type = reader.read<uint8_t>();
+		uint64_t tick = reader.read<uint64_t>();
+		switch (type)
+		{
+		case RECORD_GOAL_REACHED:
+		case RECORD_GOAL_RESET:
+		{
+			uvec2 goal;
+			goal.x = reader.read<uint32_t>();
+			goal.y = reader.read<uint32_t>();
+			if (type == RECORD_GOAL_REACHED)
+				mReachedGoals.push_back(goal);
+			else
+				mGoalResets.push_back({ tick, goal });
+			break;
+		}
+		case RECORD_STEPS:
+		{
+			StepsEvent event;
+			event.tick = tick;
+			event.steps.resize(reader.read<uint32_t>());
+			for (ivec2& s : event.steps)
+			{
+				uint8_t code = reader.read<uint8_t>();
+				if (code == 0xff)
+				{
+					s.x = reader.read<int32_t>();
+					s.y = reader.read<int32_t>();
+				}
+				else
+				{
+					s.x = code / 3 - 1;
+					s.y = code % 3 - 1;
+				}
+			}
+			mSteps.push_back(std::move(event));
+			break;
+		}
+		case RECORD_END:
+			mEndTick = tick;
+			mEndHash = reader.read<uint64_t>();
+			ended = true;
+			break;
+		default:
+			throw std::runtime_error("corrupt replay log: " + filename);
+		}
+	}
+	if (!ended)
+		throw std::runtime_error("replay log has no end record: " + filename);
+
+	mMode = MODE_PLAY;
+	rewind();
+	LOG_INFO("replay", "loaded %llu ticks, %zu path batches, seed %llu",
+		(unsigned long long)mEndTick, mSteps.size(), (unsigned long long)mSeed);
+}
+
+void ReplayLog::restore(World& world) const
+{
+	uvec2 dims = world.getMapDims();
+	if (dims.x != mDims.x || dims.y != mDims.y || mapHash(world) != mMapHash)
+		throw std::runtime_error("replay log was recorded on a different map");
+	if (world.entities.size() != mStartEntities.size())
+		throw std::runtime_error("replay log was recorded with " + std::to_string(mStartEntities.size()) + " entities");
+	world.entities = mStartEntities;
+	world.setGoal(mStartGoal);
+}
+
+uvec2 ReplayLog::nextReachedGoal()
+{
+	if (mNextReached >= mReachedGoals.size())
+		throw std::runtime_error("replay diverged: no recorded goal left");
+	return mReachedGoals[mNextReached++];
+}
+
+bool ReplayLog::goalResetAt(uint64_t tick, uvec2& goal)
+{
+	if (mNextReset >= mGoalResets.size() || mGoalResets[mNextReset].tick > tick)
+		return false;
+	goal = mGoalResets[mNextReset++].goal;
+	return true;
+}
+
+ReplayLog::StepsEvent* ReplayLog::stepsAt(uint64_t tick)
+{
+	if (mNextSteps >= mSteps.size() || mSteps[mNextSteps].tick > tick)
+		return nullptr;
+	return &mSteps[mNextSteps++];
+}
+
+void ReplayLog::rewind()
+{
+	mNextReached = mNextReset = mNextSteps = 0;
+}
+
+bool ReplayLog::verify(const World& world) const
+{
+	bool match = world.getTick() == mEndTick && stateHash(world) == mEndHash;
+	if (match)
+		LOG_INFO("replay", "state matches the recording after %llu ticks", (unsigned long long)world.getTick());
+	else
+		LOG_ERROR("replay", "state differs from the recording after %llu ticks", (unsigned long long)world.getTick());
+	return match;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "entity.h"
+
+class World;
+
+// Binary log of one simulation run: the world's start state, every goal
+// change and every set of path steps, each stamped with the simulation
+// tick (number of World::updateEntities calls) it took effect at.
+//
+// Playing a log back feeds the recorded goals and steps into the world at
+// the same ticks, so the run repeats bit for bit without solving any path.
+//
+// File layout, little endian:
+//   "RPLY" u32 version, u64 seed, u32 width, u32 height, u64 mapHash,
+//   u32 entityCount, entityCount * (u32 x, u32 y), u32 goalX, u32 goalY
+//   records: u8 type, u64 tick, payload
+//     GOAL_REACHED  u32 x, u32 y   new goal picked inside updateEntities
+//     GOAL_RESET    u32 x, u32 y   new goal picked between ticks
+//     STEPS  u32 count, count steps: one byte (dx+1)*3+(dy+1) for unit moves,
+//            else 0xff, i32 x, i32 y
+//     END    u64 state hash
+class ReplayLog
+{
+public:
+	enum Mode
+	{
+		MODE_OFF,
+		MODE_RECORD,
+		MODE_PLAY
+	};
+
+	struct StepsEvent
+	{
+		uint64_t tick;
+		std::vector<ivec2> steps;
+	};
+
+	ReplayLog() = default;
+	~ReplayLog();
+
+	Mode mode() const { return mMode; }
+	bool recording() const { return mMode == MODE_RECORD; }
+	bool playing() const { return mMode == MODE_PLAY; }
+
+	// Call after World::init, writes the header from the world's state.
+	void startRecording(const std::string& filename, const World& world);
+	void recordGoal(uint64_t tick, uvec2 goal, bool duringUpdate);
+	void recordSteps(uint64_t tick, const ivec2* steps, size_t count);
+	void finish(const World& world);
+
+	// Loads the whole log. restore() puts a freshly initialised world with
+	// the same map into the recorded start state.
+	void load(const std::string& filename);
+	void restore(World& world) const;
+	// next goal picked inside updateEntities, in order
+	uvec2 nextReachedGoal();
+	// Between ticks: call these until they return false / nullptr to get
+	// the goal resets and steps that took effect before this tick.
+	bool goalResetAt(uint64_t tick, uvec2& goal);
+	StepsEvent* stepsAt(uint64_t tick);
+	// back to the first event, to play the log again
+	void rewind();
+	bool finished(uint64_t tick) const { return mMode == MODE_PLAY && tick >= mEndTick; }
+	// compares against the hash recorded at the end, prints the outcome
+	bool verify(const World& world) const;
+
+	const std::vector<StepsEvent>& stepsEvents() const { return mSteps; }
+	uint64_t seed() const { return mSeed; }
+	size_t entityCount() const { return mStartEntities.size(); }
+	uint64_t endTick() const { return mEndTick; }
+
+	static uint64_t mapHash(const World& world);
+	static uint64_t stateHash(const World& world);
+private:
+	ReplayLog(const ReplayLog&) = delete;
+	ReplayLog& operator=(const ReplayLog&) = delete;
+
+	static constexpr uint32_t MAGIC = 0x594c5052; // "RPLY"
+	static constexpr uint32_t VERSION = 1;
+	enum RecordType : uint8_t
+	{
+		RECORD_GOAL_REACHED = 1,
+		RECORD_GOAL_RESET = 2,
+		RECORD_STEPS = 3,
+		RECORD_END = 4
+	};
+	struct GoalEvent
+	{
+		uint64_t tick;
+		uvec2 goal;
+	};
+
+	template<typename T>
+	void write(const T& value)
+	{
+		mOut.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	Mode mMode = MODE_OFF;
+	std::ofstream mOut;
+
+	uint64_t mSeed = 0;
+	uvec2 mDims;
+	uint64_t mMapHash = 0;
+	std::vector<uvec2> mStartEntities;
+	uvec2 mStartGoal;
+	std::vector<uvec2> mReachedGoals;
+	std::vector<GoalEvent> mGoalResets;
+	std::vector<StepsEvent> mSteps;
+	uint64_t mEndTick = 0;
+	uint64_t mEndHash = 0;
+	size_t mNextReached = 0;
+	size_t mNextReset = 0;
+	size_t mNextSteps = 0;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <exception>
+
+// C++20 coroutines where available, the Coroutines TS (/await) on older MSVC.
+#if defined(__cpp_impl_coroutine) || defined(__cpp_lib_coroutine)
+#include <coroutine>
+namespace coro = std;
+#elif defined(_RESUMABLE_FUNCTIONS_SUPPORTED)
+#include <experimental/coroutine>
+namespace coro = std::experimental;
+#else
+#error "coroutine support required: compile with /std:c++latest /await or -std=c++20"
+#endif
+
+// Fire-and-forget coroutine. Runs eagerly until its first co_await and
+// frees its frame when it returns, so the caller keeps no handle.
+struct DetachedTask
+{
+	struct promise_type
+	{
+		DetachedTask get_return_object() { return {}; }
+		coro::suspend_never initial_suspend() noexcept { return {}; }
+		coro::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
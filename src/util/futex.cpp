@@ -0,0 +1,54 @@
+#include "futex.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#else
+#include <thread>
+#endif
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+
+namespace futex
+{
+	void wait(std::atomic<uint32_t>* addr, uint32_t expected)
+	{
+#if defined(_WIN32)
+		WaitOnAddress(reinterpret_cast<volatile VOID*>(addr), &expected, sizeof(uint32_t), INFINITE);
+#elif defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+		if (addr->load(std::memory_order_acquire) == expected)
+			std::this_thread::yield();
+#endif
+	}
+
+	void wakeOne(std::atomic<uint32_t>* addr)
+	{
+#if defined(_WIN32)
+		WakeByAddressSingle(reinterpret_cast<PVOID>(addr));
+#elif defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+		(void)addr;
+#endif
+	}
+
+	void wakeAll(std::atomic<uint32_t>* addr)
+	{
+#if defined(_WIN32)
+		WakeByAddressAll(reinterpret_cast<PVOID>(addr));
+#elif defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+		(void)addr;
+#endif
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Thin wrapper around the OS address-wait primitive:
+// futex on Linux, WaitOnAddress on Windows, yield loop elsewhere.
+namespace futex
+{
+	// Blocks while *addr == expected. May return spuriously, always re-check.
+	void wait(std::atomic<uint32_t>* addr, uint32_t expected);
+	void wakeOne(std::atomic<uint32_t>* addr);
+	void wakeAll(std::atomic<uint32_t>* addr);
+}
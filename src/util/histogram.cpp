@@ -0,0 +1,195 @@
+#include "histogram.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static_assert(LatencyHistogram::BUCKET_COUNT == (LatencyHistogram::MAX_BITS - LatencyHistogram::SUB_BITS + 1) * LatencyHistogram::SUB_COUNT,
+	"bucket layout");
+
+static int highestBit(uint64_t v)
+{
+	int bit = 0;
+	while (v >>= 1)
+		bit++;
+	return bit;
+}
+
+// small per-thread number used to pick a shard, shared by all histograms
+static unsigned int threadSlot()
+{
+	static std::atomic<unsigned int> nextSlot{ 0 };
+	thread_local unsigned int slot = nextSlot.fetch_add(1) % LatencyHistogram::MAX_SHARDS;
+	return slot;
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t ns)
+{
+	const uint64_t limit = (uint64_t(1) << MAX_BITS) - 1;
+	if (ns > limit)
+		ns = limit;
+	if (ns < 2 * SUB_COUNT)
+		return static_cast<size_t>(ns);
+	int shift = highestBit(ns) - SUB_BITS;
+	return static_cast<size_t>(shift) * SUB_COUNT + static_cast<size_t>(ns >> shift);
+}
+
+uint64_t LatencyHistogram::bucketLow(size_t bucket)
+{
+	if (bucket < 2 * SUB_COUNT)
+		return bucket;
+	size_t shift = bucket / SUB_COUNT - 1;
+	uint64_t mantissa = bucket - shift * SUB_COUNT;
+	return mantissa << shift;
+}
+
+uint64_t LatencyHistogram::bucketHigh(size_t bucket)
+{
+	if (bucket < 2 * SUB_COUNT)
+		return bucket;
+	size_t shift = bucket / SUB_COUNT - 1;
+	return bucketLow(bucket) + (uint64_t(1) << shift) - 1;
+}
+
+LatencyHistogram::Shard::Shard()
+{
+	for (auto& c : counts)
+		c.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram::LatencyHistogram(const std::string& name) :
+	mName(name)
+{
+	for (auto& s : mShards)
+		s.store(nullptr, std::memory_order_relaxed);
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+	for (auto& s : mShards)
+		delete s.load();
+}
+
+LatencyHistogram::Shard* LatencyHistogram::localShard()
+{
+	std::atomic<Shard*>& slot = mShards[threadSlot()];
+	Shard* shard = slot.load(std::memory_order_acquire);
+	if (shard)
+		return shard;
+
+	Shard* created = new Shard();
+	if (slot.compare_exchange_strong(shard, created, std::memory_order_acq_rel))
+		return created;
+	delete created; // another thread on the same slot won
+	return shard;
+}
+
+void LatencyHistogram::recordNs(uint64_t ns)
+{
+	Shard* shard = localShard();
+	shard->counts[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+	shard->count.fetch_add(1, std::memory_order_relaxed);
+	shard->sum.fetch_add(ns, std::memory_order_relaxed);
+	uint64_t max = shard->max.load(std::memory_order_relaxed);
+	while (ns > max && !shard->max.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+	{
+	}
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+	Snapshot snap;
+	snap.counts.assign(BUCKET_COUNT, 0);
+	for (const auto& slot : mShards)
+	{
+		const Shard* shard = slot.load(std::memory_order_acquire);
+		if (!shard)
+			continue;
+		for (int b = 0; b < BUCKET_COUNT; b++)
+			snap.counts[b] += shard->counts[b].load(std::memory_order_relaxed);
+		snap.sum += shard->sum.load(std::memory_order_relaxed);
+		snap.max = std::max(snap.max, shard->max.load(std::memory_order_relaxed));
+	}
+	// count from the buckets so percentiles stay consistent with them
+	for (uint64_t c : snap.counts)
+		snap.count += c;
+	return snap;
+}
+
+double LatencyHistogram::Snapshot::percentile(double p) const
+{
+	if (count == 0)
+		return 0.0;
+	uint64_t rank = static_cast<uint64_t>(std::ceil(p * count));
+	rank = std::min(count, std::max<uint64_t>(rank, 1));
+
+	uint64_t seen = 0;
+	for (size_t b = 0; b < counts.size(); b++)
+	{
+		seen += counts[b];
+		if (seen >= rank)
+			return std::min(bucketHigh(b), max) * 1e-9;
+	}
+	return max * 1e-9;
+}
+
+double LatencyHistogram::Snapshot::mean() const
+{
+	return count ? (double(sum) / count) * 1e-9 : 0.0;
+}
+
+LatencyRegistry& LatencyRegistry::get()
+{
+	static LatencyRegistry registry;
+	return registry;
+}
+
+LatencyHistogram& LatencyRegistry::histogram(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& h : mHistograms)
+	{
+		if (h->name() == name)
+			return *h;
+	}
+	mHistograms.emplace_back(new LatencyHistogram(name));
+	return *mHistograms.back();
+}
+
+std::vector<LatencyHistogram*> LatencyRegistry::histograms() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::vector<LatencyHistogram*> list;
+	for (auto& h : mHistograms)
+		list.push_back(h.get());
+	return list;
+}
+
+void LatencyRegistry::report(FILE* out) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	fprintf(out, "%-14s %10s %10s %10s %10s %10s %10s %10s\n",
+		"latency [ms]", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+	for (auto& h : mHistograms)
+	{
+		LatencyHistogram::Snapshot s = h->snapshot();
+		if (s.count == 0)
+			continue;
+		fprintf(out, "%-14s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+			h->name().c_str(), static_cast<unsigned long long>(s.count),
+			s.mean() * 1000, s.percentile(0.5) * 1000, s.percentile(0.9) * 1000,
+			s.percentile(0.99) * 1000, s.percentile(0.999) * 1000, s.max * 1e-6);
+	}
+}
+
+void LatencyRegistry::writeReport(const std::string& filename) const
+{
+	FILE* file = fopen(filename.c_str(), "w");
+	if (!file)
+	{
+		LOG_ERROR("latency", "could not write %s", filename.c_str());
+		return;
+	}
+	report(file);
+	fclose(file);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "tsc.hpp"
+
+// Latency recorder with HDR-histogram style log-linear buckets.
+//
+// Values below 2 * SUB_COUNT ns get a bucket each, above that every power
+// of two is split into SUB_COUNT linear buckets, so the relative error stays
+// below 1 / SUB_COUNT (~3%) from nanoseconds up to 2^MAX_BITS ns (~18 min).
+//
+// Every recording thread gets its own shard, so record() is a few relaxed
+// atomic adds on memory no other thread writes. snapshot() merges the
+// shards; it may race with writers and miss the samples being recorded,
+// which is fine for reporting.
+class LatencyHistogram
+{
+public:
+	static const int SUB_BITS = 5;
+	static const int SUB_COUNT = 1 << SUB_BITS;
+	static const int MAX_BITS = 40;
+	static const int BUCKET_COUNT = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+	// threads beyond this share shards, still correct but contended
+	static const int MAX_SHARDS = 64;
+
+	struct Snapshot
+	{
+		std::vector<uint64_t> counts;
+		uint64_t count = 0;
+		uint64_t sum = 0; // ns
+		uint64_t max = 0; // ns
+
+		// seconds, p in [0, 1]
+		double percentile(double p) const;
+		double mean() const;
+	};
+
+	explicit LatencyHistogram(const std::string& name);
+	~LatencyHistogram();
+
+	void recordNs(uint64_t ns);
+	void record(double seconds)
+	{
+		recordNs(seconds > 0.0 ? static_cast<uint64_t>(seconds * 1e9) : 0);
+	}
+	// tsc::now() difference
+	void recordTicks(uint64_t ticks)
+	{
+		recordNs(tsc::toNs(ticks));
+	}
+
+	Snapshot snapshot() const;
+	const std::string& name() const { return mName; }
+
+	static size_t bucketOf(uint64_t ns);
+	static uint64_t bucketLow(size_t bucket);
+	static uint64_t bucketHigh(size_t bucket);
+private:
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	struct alignas(64) Shard
+	{
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> sum{ 0 };
+		std::atomic<uint64_t> max{ 0 };
+		std::atomic<uint64_t> counts[BUCKET_COUNT];
+		Shard();
+	};
+	Shard* localShard();
+
+	std::string mName;
+	std::atomic<Shard*> mShards[MAX_SHARDS];
+};
+
+// Named histograms shared across the program. Creating one takes a lock,
+// callers keep the reference and record without it.
+class LatencyRegistry
+{
+public:
+	static LatencyRegistry& get();
+
+	LatencyHistogram& histogram(const std::string& name);
+	// histograms are never removed, the pointers stay valid
+	std::vector<LatencyHistogram*> histograms() const;
+
+	// p50/p90/p99/p99.9/max in ms for every histogram that has samples
+	void report(FILE* out) const;
+	void writeReport(const std::string& filename) const;
+private:
+	LatencyRegistry() = default;
+
+	mutable std::mutex mMutex;
+	std::vector<std::unique_ptr<LatencyHistogram>> mHistograms;
+};
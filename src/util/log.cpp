@@ -0,0 +1,271 @@
+#include "log.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+// how long a message may sit in a ring before the flush thread writes it
+static const std::chrono::milliseconds FLUSH_INTERVAL(20);
+
+Logger& Logger::get()
+{
+	static Logger logger;
+	return logger;
+}
+
+Logger::Logger() :
+	mEpoch(tsc::now())
+{
+	mRunning = true;
+	mFlushThread = std::thread(&Logger::flushFunction, this);
+}
+
+Logger::~Logger()
+{
+	shutdown();
+	if (mFile)
+		fclose(mFile);
+}
+
+const char* Logger::levelName(LogLevel level)
+{
+	switch (level)
+	{
+	case LEVEL_DEBUG: return "debug";
+	case LEVEL_INFO: return "info";
+	case LEVEL_WARN: return "warn";
+	case LEVEL_ERROR: return "error";
+	default: return "off";
+	}
+}
+
+bool Logger::parseLevel(const std::string& text, LogLevel& level)
+{
+	for (int l = LEVEL_DEBUG; l <= LEVEL_OFF; l++)
+	{
+		if (text == levelName(static_cast<LogLevel>(l)))
+		{
+			level = static_cast<LogLevel>(l);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Logger::setFile(const std::string& filename)
+{
+	std::lock_guard<std::mutex> lock(mFlushMutex);
+	if (mFile)
+		fclose(mFile);
+	mFile = nullptr;
+	if (filename.empty())
+		return true;
+	mFile = fopen(filename.c_str(), "w");
+	if (!mFile)
+		printf("[log] could not open %s\n", filename.c_str());
+	return mFile != nullptr;
+}
+
+Logger::ThreadRing& Logger::localRing()
+{
+	thread_local ThreadRing* ring = nullptr;
+	if (ring)
+		return *ring;
+
+	std::lock_guard<std::mutex> lock(mRingMutex);
+	mRings.emplace_back(new ThreadRing());
+	ring = mRings.back().get();
+	ring->tid = static_cast<uint32_t>(mRings.size());
+	ring->name = "thread " + std::to_string(ring->tid);
+	ring->records.reset(new Record[THREAD_RECORDS]);
+	return *ring;
+}
+
+void Logger::setThreadName(const std::string& name)
+{
+	ThreadRing& ring = localRing();
+	std::lock_guard<std::mutex> lock(mRingMutex);
+	ring.name = name;
+}
+
+void Logger::log(LogLevel level, const char* tag, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vlog(level, tag, format, args);
+	va_end(args);
+}
+
+void Logger::vlog(LogLevel level, const char* tag, const char* format, va_list args)
+{
+	if (!enabled(level))
+		return;
+
+	ThreadRing& ring = localRing();
+	if (!mRunning.load(std::memory_order_acquire))
+	{
+		// after shutdown, nothing drains the rings any more
+		Record record;
+		record.ticks = tsc::now();
+		record.tag = tag;
+		record.level = level;
+		vsnprintf(record.text, MESSAGE_SIZE, format, args);
+		std::lock_guard<std::mutex> lock(mFlushMutex);
+		std::string name;
+		{
+			std::lock_guard<std::mutex> ringLock(mRingMutex);
+			name = ring.name;
+		}
+		writeRecord(record, name);
+		fflush(stdout);
+		return;
+	}
+
+	uint64_t head = ring.head.load(std::memory_order_relaxed);
+	uint64_t used = head - ring.tail.load(std::memory_order_acquire);
+	if (used >= THREAD_RECORDS)
+	{
+		ring.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	Record& record = ring.records[head & (THREAD_RECORDS - 1)];
+	record.ticks = tsc::now();
+	record.tag = tag;
+	record.level = level;
+	vsnprintf(record.text, MESSAGE_SIZE, format, args);
+	ring.head.store(head + 1, std::memory_order_release);
+
+	// errors should show up before a possible crash, full rings before they drop
+	if (level >= LEVEL_WARN || used + 1 >= THREAD_RECORDS / 2)
+		wake();
+}
+
+void Logger::wake()
+{
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mWake = true;
+	}
+	mWakeCond.notify_one();
+}
+
+void Logger::flush()
+{
+	std::lock_guard<std::mutex> lock(mFlushMutex);
+	drain();
+}
+
+void Logger::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		if (mStop)
+			return;
+		mStop = true;
+	}
+	mWakeCond.notify_one();
+	if (mFlushThread.joinable())
+		mFlushThread.join();
+	mRunning.store(false, std::memory_order_release);
+	flush();
+}
+
+void Logger::flushFunction()
+{
+	setThreadName("log");
+	for (;;)
+	{
+		bool stop;
+		{
+			std::unique_lock<std::mutex> lock(mWakeMutex);
+			mWakeCond.wait_for(lock, FLUSH_INTERVAL, [this] { return mWake || mStop; });
+			mWake = false;
+			stop = mStop;
+		}
+		flush();
+		if (stop)
+			break;
+	}
+}
+
+void Logger::drain()
+{
+	struct Drained
+	{
+		ThreadRing* ring;
+		uint64_t head;
+		std::string name;
+	};
+	std::vector<Drained> rings;
+	{
+		std::lock_guard<std::mutex> lock(mRingMutex);
+		for (auto& ring : mRings)
+			rings.push_back({ ring.get(), ring->head.load(std::memory_order_acquire), ring->name });
+	}
+
+	// records are merged by time, each ring on its own is already in order
+	mPending.clear();
+	for (const Drained& d : rings)
+	{
+		for (uint64_t pos = d.ring->tail.load(std::memory_order_relaxed); pos < d.head; pos++)
+			mPending.push_back({ &d.ring->records[pos & (THREAD_RECORDS - 1)], &d.name });
+	}
+	std::stable_sort(mPending.begin(), mPending.end(), [](const Pending& a, const Pending& b)
+	{
+		return a.record->ticks < b.record->ticks;
+	});
+	for (const Pending& p : mPending)
+		writeRecord(*p.record, *p.thread);
+	bool wrote = !mPending.empty();
+	mPending.clear();
+
+	for (const Drained& d : rings)
+	{
+		d.ring->tail.store(d.head, std::memory_order_release);
+		uint64_t dropped = d.ring->dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped)
+		{
+			Record record;
+			record.ticks = tsc::now();
+			record.tag = "log";
+			record.level = LEVEL_WARN;
+			snprintf(record.text, MESSAGE_SIZE, "%llu messages dropped, ring full", static_cast<unsigned long long>(dropped));
+			writeRecord(record, d.name);
+			wrote = true;
+		}
+	}
+
+	if (wrote)
+	{
+		fflush(stdout);
+		if (mFile)
+			fflush(mFile);
+	}
+}
+
+void Logger::writeRecord(const Record& record, const std::string& thread)
+{
+	double seconds = record.ticks > mEpoch ? tsc::toSeconds(record.ticks - mEpoch) : 0.0;
+	const char* format = "%11.6f %-5s [%s] %s: %s\n";
+	printf(format, seconds, levelName(record.level), thread.c_str(), record.tag, record.text);
+	if (mFile)
+		fprintf(mFile, format, seconds, levelName(record.level), thread.c_str(), record.tag, record.text);
+}
+
+bool LogRateLimit::allow(uint32_t& suppressed)
+{
+	uint64_t now = tsc::now();
+	uint64_t start = mWindowStart.load(std::memory_order_relaxed);
+	if (start == 0 || tsc::toSeconds(now - start) >= 1.0)
+	{
+		if (mWindowStart.compare_exchange_strong(start, now, std::memory_order_relaxed))
+			mCount.store(0, std::memory_order_relaxed);
+	}
+	if (mCount.fetch_add(1, std::memory_order_relaxed) < mPerSecond)
+	{
+		suppressed = mSuppressed.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+	mSuppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
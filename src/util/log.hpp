@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tsc.hpp"
+
+enum LogLevel
+{
+	LEVEL_DEBUG,
+	LEVEL_INFO,
+	LEVEL_WARN,
+	LEVEL_ERROR,
+	LEVEL_OFF
+};
+
+// Asynchronous logger, keeps formatting and I/O out of hot loops.
+//
+// A message is formatted into a fixed size record in the calling thread's
+// own single-producer ring, so logging is a vsnprintf and a release store,
+// no lock and no system call. A background thread drains all rings every
+// few milliseconds, orders the records by timestamp and writes them to
+// stdout and the log file. A full ring drops the message and counts it;
+// the drop count is written with the next flush.
+//
+// Tags are not copied, pass string literals.
+class Logger
+{
+public:
+	static const uint32_t THREAD_RECORDS = 1 << 10;
+	static const size_t MESSAGE_SIZE = 240;
+
+	static Logger& get();
+
+	void setLevel(LogLevel level) { mLevel.store(level, std::memory_order_relaxed); }
+	LogLevel level() const { return mLevel.load(std::memory_order_relaxed); }
+	bool enabled(LogLevel level) const { return level >= this->level(); }
+	// also write to this file, empty to stop
+	bool setFile(const std::string& filename);
+	void setThreadName(const std::string& name);
+
+	void log(LogLevel level, const char* tag, const char* format, ...);
+	void vlog(LogLevel level, const char* tag, const char* format, va_list args);
+
+	// blocks until everything logged before the call is written
+	void flush();
+	// final flush, stops the background thread; later messages are written
+	// synchronously
+	void shutdown();
+
+	static const char* levelName(LogLevel level);
+	// "debug", "info", "warn", "error" or "off", false if unknown
+	static bool parseLevel(const std::string& text, LogLevel& level);
+private:
+	Logger();
+	~Logger();
+
+	struct Record
+	{
+		uint64_t ticks;
+		const char* tag;
+		LogLevel level;
+		char text[MESSAGE_SIZE];
+	};
+	struct ThreadRing
+	{
+		uint32_t tid;
+		std::string name;
+		std::unique_ptr<Record[]> records;
+		std::atomic<uint64_t> head{ 0 }; // written by the owning thread
+		std::atomic<uint64_t> tail{ 0 }; // written by the flush thread
+		std::atomic<uint64_t> dropped{ 0 };
+	};
+	struct Pending
+	{
+		const Record* record;
+		const std::string* thread;
+	};
+
+	ThreadRing& localRing();
+	void wake();
+	void flushFunction();
+	// drains every ring, called with mFlushMutex held
+	void drain();
+	void writeRecord(const Record& record, const std::string& thread);
+
+	std::atomic<LogLevel> mLevel{ LEVEL_INFO };
+	uint64_t mEpoch;
+
+	std::mutex mRingMutex;
+	std::vector<std::unique_ptr<ThreadRing>> mRings;
+
+	// serialises drains and output
+	std::mutex mFlushMutex;
+	FILE* mFile = nullptr;
+	std::vector<Pending> mPending;
+
+	std::mutex mWakeMutex;
+	std::condition_variable mWakeCond;
+	bool mWake = false;
+	bool mStop = false;
+	std::atomic<bool> mRunning{ false };
+	std::thread mFlushThread;
+};
+
+// Lets through at most perSecond messages per second from one call site,
+// the rest are counted and reported with the next message that passes.
+class LogRateLimit
+{
+public:
+	explicit LogRateLimit(uint32_t perSecond) : mPerSecond(perSecond) {}
+	// suppressed: messages dropped since the last one allowed
+	bool allow(uint32_t& suppressed);
+private:
+	uint32_t mPerSecond;
+	std::atomic<uint64_t> mWindowStart{ 0 };
+	std::atomic<uint32_t> mCount{ 0 };
+	std::atomic<uint32_t> mSuppressed{ 0 };
+};
+
+#define LOG_MESSAGE(level, tag, ...) \
+	do { \
+		if (Logger::get().enabled(level)) \
+			Logger::get().log(level, tag, __VA_ARGS__); \
+	} while (0)
+
+#define LOG_DEBUG(tag, ...) LOG_MESSAGE(LEVEL_DEBUG, tag, __VA_ARGS__)
+#define LOG_INFO(tag, ...) LOG_MESSAGE(LEVEL_INFO, tag, __VA_ARGS__)
+#define LOG_WARN(tag, ...) LOG_MESSAGE(LEVEL_WARN, tag, __VA_ARGS__)
+#define LOG_ERROR(tag, ...) LOG_MESSAGE(LEVEL_ERROR, tag, __VA_ARGS__)
+
+// rate limited per call site, for messages inside loops
+#define LOG_LIMITED(level, perSecond, tag, ...) \
+	do { \
+		static LogRateLimit logLimit_(perSecond); \
+		uint32_t logSuppressed_ = 0; \
+		if (Logger::get().enabled(level) && logLimit_.allow(logSuppressed_)) \
+		{ \
+			Logger::get().log(level, tag, __VA_ARGS__); \
+			if (logSuppressed_) \
+				Logger::get().log(level, tag, "(%u similar messages suppressed)", logSuppressed_); \
+		} \
+	} while (0)
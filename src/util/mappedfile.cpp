@@ -0,0 +1,88 @@
+#include "mappedfile.hpp"
+
+#include <cstdint>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile* MappedFile::open(const std::string& path)
+{
+	MappedFile* file = new MappedFile();
+	if (!file->map(path))
+	{
+		delete file;
+		return nullptr;
+	}
+	return file;
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::map(const std::string& path)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	mFile = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || uint64_t(size.QuadPart) > SIZE_MAX)
+		return false;
+	mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mMapping)
+		return false;
+	mData = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!mData)
+		return false;
+	mSize = size_t(size.QuadPart);
+	return true;
+}
+
+MappedFile::~MappedFile()
+{
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMapping)
+		CloseHandle(mMapping);
+	if (mFile)
+		CloseHandle(mFile);
+}
+
+#else
+
+bool MappedFile::map(const std::string& path)
+{
+	mFd = ::open(path.c_str(), O_RDONLY);
+	if (mFd < 0)
+		return false;
+	struct stat st;
+	if (fstat(mFd, &st) != 0 || st.st_size <= 0 || uint64_t(st.st_size) > SIZE_MAX)
+		return false;
+	size_t size = (size_t)st.st_size;
+	void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, mFd, 0);
+	if (p == MAP_FAILED)
+		return false;
+	// read front to back by the decoder
+	madvise(p, size, MADV_SEQUENTIAL);
+	mData = static_cast<const unsigned char*>(p);
+	mSize = size;
+	return true;
+}
+
+MappedFile::~MappedFile()
+{
+	if (mData)
+		munmap(const_cast<unsigned char*>(mData), mSize);
+	if (mFd >= 0)
+		close(mFd);
+}
+
+#endif
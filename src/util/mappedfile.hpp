@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file, mapped instead of read: nothing is copied
+// into the heap and pages are only brought in as they are touched.
+class MappedFile
+{
+public:
+	// nullptr if the file can't be opened, is empty or can't be mapped
+	static MappedFile* open(const std::string& path);
+	~MappedFile();
+
+	const unsigned char* data() const { return mData; }
+	size_t size() const { return mSize; }
+private:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	bool map(const std::string& path);
+
+	const unsigned char* mData = nullptr;
+	size_t mSize = 0;
+#if defined(_WIN32)
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFd = -1;
+#endif
+};
@@ -0,0 +1,295 @@
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "log.hpp"
+#include "tsc.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+namespace
+{
+	// in front of every tracked block
+	struct BlockHeader
+	{
+		uint64_t size;
+		uint32_t offset; // from the start of the malloc block to the user pointer
+		uint8_t tag;
+		uint8_t pad[3];
+	};
+	static_assert(sizeof(BlockHeader) == 16, "the header keeps the default alignment of 16");
+	const size_t HEADER_SIZE = sizeof(BlockHeader);
+
+	struct alignas(64) TagCounters
+	{
+		std::atomic<uint64_t> live{ 0 };
+		std::atomic<uint64_t> peak{ 0 };
+		std::atomic<uint64_t> allocations{ 0 };
+		std::atomic<uint64_t> frees{ 0 };
+		std::atomic<uint64_t> allocatedBytes{ 0 };
+	};
+
+	// constant initialised, operator new may run before any constructor
+	TagCounters sCounters[MEM_TAG_COUNT];
+	thread_local MemoryTag tCurrentTag = MEM_UNTAGGED;
+
+	// a window only counts as growth past this many bytes over the streak
+	const uint64_t MIN_GROWTH = 64 * 1024;
+
+	void charge(MemoryTag tag, uint64_t bytes)
+	{
+		TagCounters& c = sCounters[tag];
+		uint64_t live = c.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		c.allocations.fetch_add(1, std::memory_order_relaxed);
+		c.allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+		uint64_t peak = c.peak.load(std::memory_order_relaxed);
+		while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+			;
+	}
+
+	void credit(MemoryTag tag, uint64_t bytes)
+	{
+		TagCounters& c = sCounters[tag];
+		c.live.fetch_sub(bytes, std::memory_order_relaxed);
+		c.frees.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	BlockHeader* headerOf(void* ptr)
+	{
+		return reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - HEADER_SIZE);
+	}
+
+	struct TagState
+	{
+		uint64_t windowStartLive = 0;
+		uint64_t streakStartLive = 0;
+		uint32_t streak = 0;
+		uint64_t reportedAllocations = 0;
+		MetricGauge* liveGauge = nullptr;
+		MetricGauge* peakGauge = nullptr;
+		MetricCounter* allocationCounter = nullptr;
+		uint64_t publishedAllocations = 0;
+	};
+
+	struct MonitorState
+	{
+		std::mutex mutex;
+		bool initialised = false;
+		uint32_t frames = 0;
+		uint64_t lastReport = 0;
+		TagState tags[MEM_TAG_COUNT];
+	};
+
+	MonitorState& monitor()
+	{
+		static MonitorState state;
+		return state;
+	}
+
+	void initialiseMonitor(MonitorState& m)
+	{
+		if (m.initialised)
+			return;
+		m.initialised = true;
+		m.lastReport = tsc::now();
+		for (int t = 0; t < MEM_TAG_COUNT; t++)
+		{
+			MemoryTag tag = static_cast<MemoryTag>(t);
+			std::string name = std::string("mem_") + memory::tagName(tag);
+			TagState& s = m.tags[t];
+			s.liveGauge = &MetricsRegistry::get().gauge(name + "_mb");
+			s.peakGauge = &MetricsRegistry::get().gauge(name + "_peak_mb");
+			s.allocationCounter = &MetricsRegistry::get().counter(name + "_allocs");
+			s.windowStartLive = s.streakStartLive = memory::stats(tag).live;
+		}
+	}
+}
+
+memory::Stats memory::stats(MemoryTag tag)
+{
+	const TagCounters& c = sCounters[tag];
+	Stats s;
+	s.live = c.live.load(std::memory_order_relaxed);
+	s.peak = c.peak.load(std::memory_order_relaxed);
+	s.allocations = c.allocations.load(std::memory_order_relaxed);
+	s.frees = c.frees.load(std::memory_order_relaxed);
+	s.allocatedBytes = c.allocatedBytes.load(std::memory_order_relaxed);
+	return s;
+}
+
+const char* memory::tagName(MemoryTag tag)
+{
+	switch (tag)
+	{
+	case MEM_UNTAGGED: return "untagged";
+	case MEM_WORLD: return "world";
+	case MEM_PATH: return "path";
+	case MEM_RENDERER: return "renderer";
+	case MEM_LODEPNG: return "lodepng";
+	case MEM_VULKAN: return "vulkan";
+	case MEM_DEVICE: return "device";
+	default: return "?";
+	}
+}
+
+MemoryTag memory::currentTag()
+{
+	return tCurrentTag;
+}
+
+void memory::setCurrentTag(MemoryTag tag)
+{
+	tCurrentTag = tag;
+}
+
+void* memory::allocate(size_t size, size_t alignment, MemoryTag tag)
+{
+	if (alignment < HEADER_SIZE)
+		alignment = HEADER_SIZE;
+	size_t extra = alignment > HEADER_SIZE ? alignment : 0;
+	char* raw = static_cast<char*>(malloc(size + HEADER_SIZE + extra));
+	if (!raw)
+		return nullptr;
+
+	uintptr_t user = (reinterpret_cast<uintptr_t>(raw) + HEADER_SIZE + alignment - 1) & ~(uintptr_t(alignment) - 1);
+	BlockHeader* header = reinterpret_cast<BlockHeader*>(user - HEADER_SIZE);
+	header->size = size;
+	header->offset = static_cast<uint32_t>(user - reinterpret_cast<uintptr_t>(raw));
+	header->tag = tag;
+	charge(tag, size);
+	return reinterpret_cast<void*>(user);
+}
+
+void* memory::reallocate(void* ptr, size_t size, size_t alignment, MemoryTag tag)
+{
+	if (!ptr)
+		return allocate(size, alignment, tag);
+
+	BlockHeader* header = headerOf(ptr);
+	uint64_t oldSize = header->size;
+	MemoryTag oldTag = static_cast<MemoryTag>(header->tag);
+	if (alignment <= HEADER_SIZE && header->offset == HEADER_SIZE)
+	{
+		char* raw = static_cast<char*>(realloc(header, size + HEADER_SIZE));
+		if (!raw)
+			return nullptr;
+		header = reinterpret_cast<BlockHeader*>(raw);
+		header->size = size;
+		header->tag = tag;
+		credit(oldTag, oldSize);
+		charge(tag, size);
+		return raw + HEADER_SIZE;
+	}
+
+	// over-aligned, realloc could move the block off the alignment
+	void* moved = allocate(size, alignment, tag);
+	if (!moved)
+		return nullptr;
+	memcpy(moved, ptr, size < oldSize ? size : static_cast<size_t>(oldSize));
+	release(ptr);
+	return moved;
+}
+
+void memory::release(void* ptr)
+{
+	if (!ptr)
+		return;
+	BlockHeader* header = headerOf(ptr);
+	credit(static_cast<MemoryTag>(header->tag), header->size);
+	free(static_cast<char*>(ptr) - header->offset);
+}
+
+void memory::track(MemoryTag tag, int64_t bytes)
+{
+	if (bytes >= 0)
+		charge(tag, static_cast<uint64_t>(bytes));
+	else
+		credit(tag, static_cast<uint64_t>(-bytes));
+}
+
+void memory::frame(uint32_t windowFrames, uint32_t growthWindows)
+{
+	MonitorState& m = monitor();
+	std::lock_guard<std::mutex> lock(m.mutex);
+	initialiseMonitor(m);
+
+	for (int t = 0; t < MEM_TAG_COUNT; t++)
+	{
+		Stats s = stats(static_cast<MemoryTag>(t));
+		TagState& state = m.tags[t];
+		state.liveGauge->set(s.live / (1024.0 * 1024.0));
+		state.peakGauge->set(s.peak / (1024.0 * 1024.0));
+		state.allocationCounter->add(s.allocations - state.publishedAllocations);
+		state.publishedAllocations = s.allocations;
+	}
+
+	if (++m.frames < windowFrames)
+		return;
+	m.frames = 0;
+
+	for (int t = 0; t < MEM_TAG_COUNT; t++)
+	{
+		MemoryTag tag = static_cast<MemoryTag>(t);
+		TagState& state = m.tags[t];
+		uint64_t live = stats(tag).live;
+		if (live > state.windowStartLive)
+		{
+			state.streak++;
+			if (state.streak >= growthWindows && live - state.streakStartLive >= MIN_GROWTH)
+			{
+				LOG_WARN("memory", "%s grew for %u windows of %u frames, %.1f KiB -> %.1f KiB",
+					tagName(tag), state.streak, windowFrames, state.streakStartLive / 1024.0, live / 1024.0);
+				state.streak = 0;
+				state.streakStartLive = live;
+			}
+		}
+		else
+		{
+			state.streak = 0;
+			state.streakStartLive = live;
+		}
+		state.windowStartLive = live;
+	}
+}
+
+void memory::report(FILE* out)
+{
+	MonitorState& m = monitor();
+	std::lock_guard<std::mutex> lock(m.mutex);
+	initialiseMonitor(m);
+
+	uint64_t now = tsc::now();
+	double seconds = tsc::toSeconds(now - m.lastReport);
+	m.lastReport = now;
+
+	fprintf(out, "%-14s %12s %12s %12s %12s\n", "memory", "live [KiB]", "peak [KiB]", "allocs", "allocs/s");
+	for (int t = 0; t < MEM_TAG_COUNT; t++)
+	{
+		Stats s = stats(static_cast<MemoryTag>(t));
+		TagState& state = m.tags[t];
+		double rate = seconds > 0.0 ? (s.allocations - state.reportedAllocations) / seconds : 0.0;
+		state.reportedAllocations = s.allocations;
+		if (s.allocations == 0)
+			continue;
+		fprintf(out, "%-14s %12.1f %12.1f %12llu %12.1f\n", tagName(static_cast<MemoryTag>(t)),
+			s.live / 1024.0, s.peak / 1024.0, static_cast<unsigned long long>(s.allocations), rate);
+	}
+}
+
+// LODEPNG_NO_COMPILE_ALLOCATORS makes lodepng call these instead of its own
+void* lodepng_malloc(size_t size)
+{
+	return memory::allocate(size, 0, MEM_LODEPNG);
+}
+
+void* lodepng_realloc(void* ptr, size_t new_size)
+{
+	return memory::reallocate(ptr, new_size, 0, MEM_LODEPNG);
+}
+
+void lodepng_free(void* ptr)
+{
+	memory::release(ptr);
+}
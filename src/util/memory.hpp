@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Subsystems allocations are charged to. A thread charges the tag of its
+// innermost MemoryScope, lodepng and the Vulkan driver always charge their
+// own.
+enum MemoryTag : uint8_t
+{
+	MEM_UNTAGGED,
+	MEM_WORLD,
+	MEM_PATH,
+	MEM_RENDERER,
+	MEM_LODEPNG,
+	MEM_VULKAN, // host memory the driver allocates through our callbacks
+	MEM_DEVICE, // vkAllocateMemory, not part of the process heap
+	MEM_TAG_COUNT
+};
+
+// Tagged allocation accounting.
+//
+// Every tracked block carries a small header with its size and tag, so a
+// free is credited to the subsystem that allocated it, whichever scope it
+// happens in. Counters are relaxed atomics per tag; the global operator new
+// hook (memoryhook.cpp) only exists in targets that link it.
+namespace memory
+{
+	struct Stats
+	{
+		uint64_t live = 0;           // bytes
+		uint64_t peak = 0;
+		uint64_t allocations = 0;
+		uint64_t frees = 0;
+		uint64_t allocatedBytes = 0; // total, including freed blocks
+	};
+
+	Stats stats(MemoryTag tag);
+	const char* tagName(MemoryTag tag);
+
+	MemoryTag currentTag();
+	void setCurrentTag(MemoryTag tag);
+
+	// alignment 0 means the default of 16, ptr may be null in reallocate
+	void* allocate(size_t size, size_t alignment, MemoryTag tag);
+	void* reallocate(void* ptr, size_t size, size_t alignment, MemoryTag tag);
+	void release(void* ptr);
+	// accounting only, for memory allocated elsewhere; bytes < 0 is a free
+	void track(MemoryTag tag, int64_t bytes);
+
+	// Call once per frame. Every windowFrames frames, the live bytes of each
+	// tag are compared with the previous window; a tag that grew for
+	// growthWindows windows in a row is reported as a warning. Also keeps
+	// the mem_* metrics up to date.
+	void frame(uint32_t windowFrames = 120, uint32_t growthWindows = 3);
+	// live, peak and allocation rate since the previous report
+	void report(FILE* out);
+}
+
+// Charges allocations of the current thread to tag until it goes out of
+// scope, scopes nest.
+class MemoryScope
+{
+public:
+	explicit MemoryScope(MemoryTag tag) : mPrevious(memory::currentTag()) { memory::setCurrentTag(tag); }
+	~MemoryScope() { memory::setCurrentTag(mPrevious); }
+	MemoryScope(const MemoryScope&) = delete;
+	MemoryScope& operator=(const MemoryScope&) = delete;
+private:
+	MemoryTag mPrevious;
+};
@@ -0,0 +1,66 @@
+#include "memory.hpp"
+
+#include <new>
+
+// Replaces the global operator new and delete so every C++ allocation is
+// charged to the calling thread's MemoryScope. Only link this into targets
+// that want the accounting, it costs a header and a few atomics per block.
+
+void* operator new(size_t size)
+{
+	void* ptr = memory::allocate(size, 0, memory::currentTag());
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return memory::allocate(size, 0, memory::currentTag());
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return memory::allocate(size, 0, memory::currentTag());
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* ptr = memory::allocate(size, static_cast<size_t>(alignment), memory::currentTag());
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return memory::allocate(size, static_cast<size_t>(alignment), memory::currentTag());
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return memory::allocate(size, static_cast<size_t>(alignment), memory::currentTag());
+}
+
+void operator delete(void* ptr) noexcept { memory::release(ptr); }
+void operator delete[](void* ptr) noexcept { memory::release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { memory::release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { memory::release(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { memory::release(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { memory::release(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { memory::release(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { memory::release(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { memory::release(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { memory::release(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { memory::release(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { memory::release(ptr); }
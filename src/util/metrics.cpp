@@ -0,0 +1,244 @@
+#include "metrics.hpp"
+#include "histogram.hpp"
+#include "sharedmemory.hpp"
+#include "trace.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "metrics need lock-free 64-bit atomics in shared memory");
+static_assert(sizeof(metrics::Entry) % 8 == 0, "entries must keep their values aligned");
+
+static uint64_t toBits(double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double fromBits(uint64_t bits)
+{
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+bool metrics::readSample(const Header* header, Sample& sample, int maxTries)
+{
+	for (int tries = 0; tries < maxTries; tries++)
+	{
+		uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		uint32_t count = std::min(header->count.load(std::memory_order_relaxed), MAX_METRICS);
+		sample.metrics.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const Entry& entry = header->entries[i];
+			Sample::Metric& metric = sample.metrics[i];
+			metric.name.assign(entry.name, strnlen(entry.name, NAME_SIZE));
+			metric.type = static_cast<Type>(entry.type);
+			for (uint32_t v = 0; v < VALUE_COUNT; v++)
+				metric.values[v] = fromBits(entry.values[v].load(std::memory_order_relaxed));
+		}
+		sample.publishNs = header->publishNs.load(std::memory_order_relaxed);
+		sample.publishCount = header->publishCount.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (header->sequence.load(std::memory_order_relaxed) == sequence)
+			return true;
+	}
+	return false;
+}
+
+MetricsRegistry& MetricsRegistry::get()
+{
+	static MetricsRegistry registry;
+	return registry;
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+	stopPublishing();
+}
+
+MetricCounter& MetricsRegistry::counter(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& c : mCounters)
+	{
+		if (c.first == name)
+			return *c.second;
+	}
+	mCounters.emplace_back(name, std::unique_ptr<MetricCounter>(new MetricCounter()));
+	return *mCounters.back().second;
+}
+
+MetricGauge& MetricsRegistry::gauge(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& g : mGauges)
+	{
+		if (g.first == name)
+			return *g.second;
+	}
+	mGauges.emplace_back(name, std::unique_ptr<MetricGauge>(new MetricGauge()));
+	return *mGauges.back().second;
+}
+
+bool MetricsRegistry::startPublishing(const std::string& segment, std::chrono::milliseconds interval)
+{
+	stopPublishing();
+
+	SharedMemory* memory = SharedMemory::create(segment, sizeof(metrics::Header));
+	if (!memory)
+	{
+		LOG_WARN("metrics", "could not create shared memory segment %s", segment.c_str());
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mPublishMutex);
+		mSegment = memory;
+		mPublished.clear();
+		mWarnedFull = false;
+		mStop = false;
+
+		metrics::Header* h = static_cast<metrics::Header*>(memory->data());
+		h->maxMetrics = metrics::MAX_METRICS;
+		h->intervalMs = static_cast<uint32_t>(interval.count());
+		h->pid = static_cast<uint64_t>(getpid());
+		h->version = metrics::VERSION;
+		std::atomic_thread_fence(std::memory_order_release);
+		h->magic = metrics::MAGIC;
+	}
+
+	publish();
+	mPublisher = std::thread(&MetricsRegistry::publisherFunction, this, interval);
+	LOG_INFO("metrics", "publishing to %s every %lld ms", segment.c_str(), static_cast<long long>(interval.count()));
+	return true;
+}
+
+void MetricsRegistry::stopPublishing()
+{
+	{
+		std::lock_guard<std::mutex> lock(mPublishMutex);
+		mStop = true;
+	}
+	mStopCond.notify_all();
+	if (mPublisher.joinable())
+		mPublisher.join();
+
+	std::lock_guard<std::mutex> lock(mPublishMutex);
+	delete mSegment;
+	mSegment = nullptr;
+}
+
+void MetricsRegistry::publisherFunction(std::chrono::milliseconds interval)
+{
+	TraceRecorder::get().setThreadName("metrics");
+	std::unique_lock<std::mutex> lock(mPublishMutex);
+	while (!mStop)
+	{
+		if (mStopCond.wait_for(lock, interval, [this] { return mStop; }))
+			break;
+		lock.unlock();
+		publish();
+		lock.lock();
+	}
+}
+
+int MetricsRegistry::publishedIndex(metrics::Type type, const void* metric, const std::string& name)
+{
+	for (size_t i = 0; i < mPublished.size(); i++)
+	{
+		if (mPublished[i].metric == metric)
+			return static_cast<int>(i);
+	}
+	if (mPublished.size() >= metrics::MAX_METRICS)
+	{
+		if (!mWarnedFull)
+			LOG_WARN("metrics", "more than %u metrics, %s is not published", metrics::MAX_METRICS, name.c_str());
+		mWarnedFull = true;
+		return -1;
+	}
+
+	// the name is written with the next publication, before count covers it
+	metrics::Entry& entry = static_cast<metrics::Header*>(mSegment->data())->entries[mPublished.size()];
+	memset(entry.name, 0, sizeof(entry.name));
+	memcpy(entry.name, name.data(), std::min<size_t>(name.size(), metrics::NAME_SIZE - 1));
+	entry.type = type;
+	mPublished.push_back({ type, metric });
+	return static_cast<int>(mPublished.size() - 1);
+}
+
+void MetricsRegistry::publish()
+{
+	struct Values
+	{
+		int index;
+		double values[metrics::VALUE_COUNT];
+	};
+
+	std::lock_guard<std::mutex> publishLock(mPublishMutex);
+	if (!mSegment)
+		return;
+	metrics::Header* h = static_cast<metrics::Header*>(mSegment->data());
+
+	// Everything is gathered before the write section so readers retry as
+	// little as possible, histogram snapshots merge every shard. New entries
+	// lie beyond count, readers don't look at them yet.
+	std::vector<Values> values;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (auto& c : mCounters)
+		{
+			int index = publishedIndex(metrics::TYPE_COUNTER, c.second.get(), c.first);
+			if (index >= 0)
+				values.push_back({ index, { static_cast<double>(c.second->value()) } });
+		}
+		for (auto& g : mGauges)
+		{
+			int index = publishedIndex(metrics::TYPE_GAUGE, g.second.get(), g.first);
+			if (index >= 0)
+				values.push_back({ index, { g.second->value() } });
+		}
+	}
+	for (LatencyHistogram* histogram : LatencyRegistry::get().histograms())
+	{
+		int index = publishedIndex(metrics::TYPE_HISTOGRAM, histogram, histogram->name());
+		if (index < 0)
+			continue;
+		LatencyHistogram::Snapshot s = histogram->snapshot();
+		values.push_back({ index, { static_cast<double>(s.count), s.mean() * 1000, s.percentile(0.5) * 1000,
+			s.percentile(0.99) * 1000, s.max * 1e-6 } });
+	}
+
+	uint64_t sequence = h->sequence.load(std::memory_order_relaxed);
+	h->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (const Values& v : values)
+	{
+		for (uint32_t i = 0; i < metrics::VALUE_COUNT; i++)
+			h->entries[v.index].values[i].store(toBits(v.values[i]), std::memory_order_relaxed);
+	}
+	h->count.store(static_cast<uint32_t>(mPublished.size()), std::memory_order_relaxed);
+	h->publishNs.store(static_cast<uint64_t>(TraceRecorder::nowNs()), std::memory_order_relaxed);
+	h->publishCount.store(h->publishCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	h->sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class SharedMemory;
+class LatencyHistogram;
+
+// Monotonic count, rates are computed by the reader.
+class MetricCounter
+{
+public:
+	void add(uint64_t n = 1) { mValue.fetch_add(n, std::memory_order_relaxed); }
+	uint64_t value() const { return mValue.load(std::memory_order_relaxed); }
+private:
+	std::atomic<uint64_t> mValue{ 0 };
+};
+
+// Last set value, e.g. a queue depth.
+class MetricGauge
+{
+public:
+	void set(double value) { mValue.store(value, std::memory_order_relaxed); }
+	double value() const { return mValue.load(std::memory_order_relaxed); }
+private:
+	std::atomic<double> mValue{ 0.0 };
+};
+
+// Layout of the published segment, shared with MetricsView.
+//
+// There is a single writer, the publisher thread. It makes the sequence
+// odd, rewrites the values and makes it even again; a reader copies
+// everything between two reads of the sequence and retries when they differ
+// or are odd, so it never blocks or writes to the process it watches.
+// Entries are only ever appended, a name never changes once count covers it.
+namespace metrics
+{
+	static const uint32_t MAGIC = 0x5254454d; // "METR"
+	static const uint32_t VERSION = 1;
+	static const uint32_t MAX_METRICS = 128;
+	static const uint32_t NAME_SIZE = 40;
+	static const uint32_t VALUE_COUNT = 5;
+
+	enum Type : uint32_t
+	{
+		TYPE_COUNTER = 1,   // values[0] total
+		TYPE_GAUGE = 2,     // values[0] value
+		TYPE_HISTOGRAM = 3  // values count, mean, p50, p99, max, times in ms
+	};
+
+	enum HistogramValue
+	{
+		HISTOGRAM_COUNT,
+		HISTOGRAM_MEAN,
+		HISTOGRAM_P50,
+		HISTOGRAM_P99,
+		HISTOGRAM_MAX
+	};
+
+	struct Entry
+	{
+		char name[NAME_SIZE];
+		uint32_t type;
+		uint32_t pad;
+		std::atomic<uint64_t> values[VALUE_COUNT]; // double bits
+	};
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t maxMetrics;
+		uint32_t intervalMs;
+		uint64_t pid;
+		char pad0[40];
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> publishNs; // publisher's steady clock
+		std::atomic<uint64_t> publishCount;
+		std::atomic<uint32_t> count;
+		uint32_t pad1;
+		char pad2[32];
+		Entry entries[MAX_METRICS];
+	};
+
+	// consistent copy of one publication
+	struct Sample
+	{
+		struct Metric
+		{
+			std::string name;
+			Type type;
+			double values[VALUE_COUNT];
+		};
+		uint64_t publishNs = 0;
+		uint64_t publishCount = 0;
+		std::vector<Metric> metrics;
+	};
+
+	// false if no consistent copy could be taken within maxTries
+	bool readSample(const Header* header, Sample& sample, int maxTries = 1000);
+}
+
+// Named counters and gauges, published together with the LatencyRegistry
+// histograms to a shared-memory segment for external monitoring
+// (MetricsView). Creating a metric takes a lock, callers keep the reference
+// and update it with a relaxed atomic.
+class MetricsRegistry
+{
+public:
+	static MetricsRegistry& get();
+
+	MetricCounter& counter(const std::string& name);
+	MetricGauge& gauge(const std::string& name);
+
+	// Creates the segment and publishes from a background thread every
+	// interval until stopPublishing(). False if the segment can't be made.
+	bool startPublishing(const std::string& segment, std::chrono::milliseconds interval);
+	void stopPublishing();
+	// one publication, normally called by the publisher thread
+	void publish();
+private:
+	MetricsRegistry() = default;
+	~MetricsRegistry();
+
+	struct Published
+	{
+		metrics::Type type;
+		const void* metric;
+	};
+	void publisherFunction(std::chrono::milliseconds interval);
+	int publishedIndex(metrics::Type type, const void* metric, const std::string& name);
+
+	std::mutex mMutex;
+	std::vector<std::pair<std::string, std::unique_ptr<MetricCounter>>> mCounters;
+	std::vector<std::pair<std::string, std::unique_ptr<MetricGauge>>> mGauges;
+
+	// publisher state
+	std::mutex mPublishMutex;
+	std::condition_variable mStopCond;
+	bool mStop = false;
+	std::thread mPublisher;
+	SharedMemory* mSegment = nullptr;
+	std::vector<Published> mPublished;
+	bool mWarnedFull = false;
+};
@@ -1,71 +1,177 @@
 #include "mythreadpool.hpp"
+#include "futex.hpp"
 
-#include <iostream>
+MyThreadPool::TaskRing::TaskRing() :
+	cells(new Cell[RING_CAPACITY]),
+	enqueuePos(0),
+	dequeuePos(0)
+{
+	static_assert((RING_CAPACITY & (RING_CAPACITY - 1)) == 0, "RING_CAPACITY must be a power of two");
+	for (size_t i = 0; i < RING_CAPACITY; i++)
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+}
 
-void MyThreadPool::init(size_t numThreads)
+bool MyThreadPool::TaskRing::push(std::function<void()>& task)
 {
-	taskRunning.resize(numThreads);
-	tasks.resize(numThreads);
-	for (int i = 0; i < numThreads; i++)
+	size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	while (true)
 	{
-		cvs.push_back(new std::condition_variable());
-		mutexes.push_back(new std::mutex());
-		mainMutexes.push_back(new std::mutex());
+		Cell& cell = cells[pos & (RING_CAPACITY - 1)];
+		size_t seq = cell.sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0)
+		{
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell.task = std::move(task);
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0)
+		{
+			return false; // full
+		}
+		else
+		{
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
 	}
-	for (int i = 0; i < numThreads; i++)
+}
+
+bool MyThreadPool::TaskRing::pop(std::function<void()>& task)
+{
+	size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	while (true)
 	{
-		threads.push_back(std::thread(&MyThreadPool::threadfunc, this, i));
+		Cell& cell = cells[pos & (RING_CAPACITY - 1)];
+		size_t seq = cell.sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (diff == 0)
+		{
+			if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				task = std::move(cell.task);
+				cell.task = nullptr;
+				cell.sequence.store(pos + RING_CAPACITY, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0)
+		{
+			return false; // empty
+		}
+		else
+		{
+			pos = dequeuePos.load(std::memory_order_relaxed);
+		}
 	}
 }
 
+MyThreadPool::~MyThreadPool()
+{
+	if (!running.exchange(false))
+		return;
+	workSignal.fetch_add(1);
+	futex::wakeAll(&workSignal);
+	for (auto& t : threads)
+		t.join();
+}
+
+void MyThreadPool::init(size_t numThreads)
+{
+	if (numThreads == 0)
+		numThreads = 1;
+	running = true;
+	for (size_t i = 0; i < numThreads; i++)
+		rings.push_back(std::unique_ptr<TaskRing>(new TaskRing()));
+	for (size_t i = 0; i < numThreads; i++)
+		threads.push_back(std::thread(&MyThreadPool::threadfunc, this, (int)i));
+}
+
 void MyThreadPool::submit(std::function<void()> task)
 {
-	if (numInUse == threads.size())
-	{
-		throw std::runtime_error("Cannot submit more tasks to thread pool, all threads occupied! (call waitForAll())");
-	}
-	numInUse++;
+	pending.fetch_add(1);
 
-	int id = nextThread();
+	size_t id = nextThread();
+	while (true)
 	{
-		std::lock_guard<std::mutex> lock(*mutexes[id]);
-		taskRunning[id] = true;
-		tasks[id] = task;
+		bool pushed = false;
+		for (size_t i = 0; i < rings.size() && !pushed; i++)
+			pushed = rings[(id + i) % rings.size()]->push(task);
+		if (pushed)
+			break;
+
+		// backpressure: every ring is full, make room by doing work here
+		if (!tryRunOne(id))
+			std::this_thread::yield();
 	}
-	cvs[id]->notify_one();
+
+	workSignal.fetch_add(1);
+	if (sleepers.load() > 0)
+		futex::wakeOne(&workSignal);
 }
 
 void MyThreadPool::waitForAll()
 {
-	for (int i = 0; i < threads.size(); i++)
+	while (tryRunOne(0))
+		;
+
+	waiters.fetch_add(1);
+	uint32_t p;
+	while ((p = pending.load()) != 0)
+		futex::wait(&pending, p);
+	waiters.fetch_sub(1);
+}
+
+bool MyThreadPool::tryRunOne(size_t first)
+{
+	std::function<void()> task;
+	for (size_t i = 0; i < rings.size(); i++)
 	{
-		std::cout << "waiting for thread " << i << "\n";
-		std::unique_lock<std::mutex> lock(*mainMutexes[i]);
-		while (taskRunning[i])
-			cvs[i]->wait(lock, [this, i] { return !taskRunning[i]; });
+		if (rings[(first + i) % rings.size()]->pop(task))
+		{
+			task();
+			finishTask();
+			return true;
+		}
 	}
-	std::cout << "///////////////////\n";
-	numInUse = 0;
+	return false;
+}
+
+void MyThreadPool::finishTask()
+{
+	if (pending.fetch_sub(1) == 1 && waiters.load() > 0)
+		futex::wakeAll(&pending);
 }
 
 void MyThreadPool::threadfunc(int id)
 {
-	while (running)
+	while (true)
 	{
+		if (tryRunOne(id))
+			continue;
+
+		sleepers.fetch_add(1);
+		uint32_t signal = workSignal.load();
+		if (!running.load())
 		{
-			std::unique_lock<std::mutex> lock(*mutexes[id]);
-			while(!taskRunning[id])
-				cvs[id]->wait(lock, [this, id] { return taskRunning[id]; });
+			sleepers.fetch_sub(1);
+			break;
 		}
+		// re-check after announcing ourselves so a concurrent submit is not missed
+		std::function<void()> task;
+		bool found = false;
+		for (size_t i = 0; i < rings.size() && !found; i++)
+			found = rings[(id + i) % rings.size()]->pop(task);
+		if (!found)
+			futex::wait(&workSignal, signal);
+		sleepers.fetch_sub(1);
 
-		tasks[id]();
-
+		if (found)
 		{
-			std::lock_guard<std::mutex> lock(*mainMutexes[id]);
-			taskRunning[id] = false;
+			task();
+			finishTask();
 		}
-
-		cvs[id]->notify_one();
 	}
 }
-
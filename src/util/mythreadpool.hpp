@@ -1,36 +1,80 @@
 #pragma once
 
 #include <thread>
-#include <condition_variable>
-#include <unordered_map>
 #include <vector>
+#include <memory>
 #include <functional>
 #include <atomic>
+#include <cstdint>
 
+// Fixed-size pool where every worker owns a bounded lock-free task ring.
+// submit() round-robins over the rings, idle workers steal from their
+// neighbours and waitForAll() is a single futex wait on the pending counter.
+// When every ring is full the submitting thread runs queued work itself
+// until a slot frees up, so fan-out larger than the pool never fails.
 class MyThreadPool
 {
 public:
+	static const size_t RING_CAPACITY = 256; // must be a power of two
+
+	MyThreadPool() = default;
+	~MyThreadPool();
+
 	void init(size_t numThreads = 4);
 	void submit(std::function<void()> task);
 
+	// Blocks until every submitted task has finished. The caller helps
+	// draining the rings before it goes to sleep.
 	void waitForAll();
+
+	size_t threadCount() const
+	{
+		return threads.size();
+	}
 private:
+	MyThreadPool(const MyThreadPool&) = delete;
+	MyThreadPool& operator=(const MyThreadPool&) = delete;
+
+	// Bounded MPMC ring (Vyukov). Each cell carries a sequence number that
+	// tells producers and consumers whether it is free or filled.
+	class TaskRing
+	{
+	public:
+		TaskRing();
+		bool push(std::function<void()>& task);
+		bool pop(std::function<void()>& task);
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			std::function<void()> task;
+		};
+		std::unique_ptr<Cell[]> cells;
+		char pad0[64];
+		std::atomic<size_t> enqueuePos;
+		char pad1[64];
+		std::atomic<size_t> dequeuePos;
+		char pad2[64];
+	};
+
 	void threadfunc(int id);
+	bool tryRunOne(size_t first);
+	void finishTask();
 
-	int nextThread()
+	size_t nextThread()
 	{
-		currThread = (currThread + 1) % threads.size();
-		return currThread;
+		return currThread.fetch_add(1, std::memory_order_relaxed) % rings.size();
 	}
-	int currThread = 0;
-	int numInUse = 0;
+	std::atomic<size_t> currThread{ 0 };
 
-	bool running = true;
+	std::atomic<bool> running{ false };
 	std::vector<std::thread> threads;
-	std::vector<std::mutex*> mutexes;
-	std::vector<std::mutex*> mainMutexes;
-	std::vector<std::condition_variable*> cvs;
-	std::vector<bool> taskRunning;
+	std::vector<std::unique_ptr<TaskRing>> rings;
 
-	std::vector<std::function<void()>> tasks;
-};
\ No newline at end of file
+	// tasks submitted but not yet finished, waitForAll() sleeps on this
+	std::atomic<uint32_t> pending{ 0 };
+	// bumped on every submit, idle workers sleep on this
+	std::atomic<uint32_t> workSignal{ 0 };
+	std::atomic<uint32_t> sleepers{ 0 };
+	std::atomic<uint32_t> waiters{ 0 };
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+// xoshiro256** seeded through splitmix64. Same sequence on every platform
+// and standard library, unlike rand() and the std distributions.
+class Xoshiro256
+{
+public:
+	using result_type = uint64_t;
+
+	explicit Xoshiro256(uint64_t seed = 1)
+	{
+		reseed(seed);
+	}
+
+	void reseed(uint64_t seed)
+	{
+		for (auto& s : mState)
+		{
+			seed += 0x9e3779b97f4a7c15ull;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			s = z ^ (z >> 31);
+		}
+	}
+
+	uint64_t next()
+	{
+		const uint64_t result = rotl(mState[1] * 5, 7) * 9;
+		const uint64_t t = mState[1] << 17;
+		mState[2] ^= mState[0];
+		mState[3] ^= mState[1];
+		mState[1] ^= mState[2];
+		mState[0] ^= mState[3];
+		mState[2] ^= t;
+		mState[3] = rotl(mState[3], 45);
+		return result;
+	}
+	uint64_t operator()() { return next(); }
+
+	// [0, n), multiply-shift without rejection; the bias is below 2^-32 * n
+	uint32_t below(uint32_t n)
+	{
+		return static_cast<uint32_t>((static_cast<uint64_t>(next() >> 32) * n) >> 32);
+	}
+	// [0, 1)
+	double uniform()
+	{
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+	bool chance(double p)
+	{
+		return uniform() < p;
+	}
+
+	static constexpr uint64_t min() { return 0; }
+	static constexpr uint64_t max() { return ~uint64_t(0); }
+private:
+	static uint64_t rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t mState[4];
+};
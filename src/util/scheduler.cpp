@@ -0,0 +1,193 @@
+#include "scheduler.hpp"
+#include "topology.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+
+Scheduler::Scheduler(unsigned int nWorkers)
+{
+	for (unsigned int i = 0; i < nWorkers; i++)
+		mWorkers.emplace_back(&Scheduler::workerFunction, this, i);
+}
+
+Scheduler::~Scheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWorkCond.notify_all();
+	for (auto& worker : mWorkers)
+		worker.join();
+}
+
+void Scheduler::pinWorkers()
+{
+	for (unsigned int i = 0; i < mWorkers.size(); i++)
+		topology::Placement::get().pinThread(mWorkers[i], topology::ROLE_RECORD, i);
+}
+
+void Scheduler::submitDeadline(std::function<void()> task, Clock::time_point deadline)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mDeadlineHeap.push_back({ std::move(task), deadline });
+		std::push_heap(mDeadlineHeap.begin(), mDeadlineHeap.end(), std::greater<DeadlineTask>());
+		mDeadlineQueued++;
+	}
+	mWorkCond.notify_one();
+}
+
+void Scheduler::submitBackground(std::function<bool()> chunkedTask)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		BackgroundTask task;
+		task.fn = std::move(chunkedTask);
+		mBackground.push_back(std::move(task));
+	}
+	mWorkCond.notify_one();
+}
+
+void Scheduler::waitForDeadlineTasks()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		if (!mDeadlineHeap.empty())
+		{
+			std::pop_heap(mDeadlineHeap.begin(), mDeadlineHeap.end(), std::greater<DeadlineTask>());
+			DeadlineTask task = std::move(mDeadlineHeap.back());
+			mDeadlineHeap.pop_back();
+			mDeadlineQueued--;
+			mDeadlineInProgress++;
+			lock.unlock();
+			runDeadline(task);
+			lock.lock();
+			continue;
+		}
+		if (mDeadlineInProgress == 0)
+			break;
+		mDoneCond.wait(lock);
+	}
+}
+
+void Scheduler::waitForAll()
+{
+	waitForDeadlineTasks();
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDoneCond.wait(lock, [this]
+	{
+		return mDeadlineHeap.empty() && mBackground.empty()
+			&& mDeadlineInProgress == 0 && mBackgroundInProgress == 0;
+	});
+}
+
+Scheduler::Stats Scheduler::stats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void Scheduler::resetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStats = Stats();
+}
+
+Scheduler::QueueDepths Scheduler::queueDepths() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	QueueDepths depths;
+	depths.deadline = static_cast<unsigned int>(mDeadlineHeap.size());
+	depths.background = static_cast<unsigned int>(mBackground.size());
+	return depths;
+}
+
+void Scheduler::runDeadline(DeadlineTask& task)
+{
+	task.fn();
+	auto finished = Clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStats.deadlineTasks++;
+		if (finished > task.deadline)
+		{
+			double late = std::chrono::duration<double>(finished - task.deadline).count();
+			mStats.missedDeadlines++;
+			mStats.worstLateness = std::max(mStats.worstLateness, late);
+		}
+		mDeadlineInProgress--;
+	}
+	mDoneCond.notify_all();
+}
+
+void Scheduler::runBackground(BackgroundTask& task)
+{
+	uint64_t chunks = 0;
+	bool more = true;
+	while (more)
+	{
+		more = task.fn();
+		chunks++;
+		if (more && mDeadlineQueued.load() > 0)
+			break;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStats.backgroundChunks += chunks;
+		if (more)
+		{
+			// yield to deadline work, continue at the next chunk later
+			mStats.preemptions++;
+			task.preempted = true;
+			task.requeuedAt = Clock::now();
+			mBackground.push_front(std::move(task));
+		}
+		else
+		{
+			mStats.backgroundTasks++;
+		}
+		mBackgroundInProgress--;
+	}
+	if (more)
+		mWorkCond.notify_one();
+	mDoneCond.notify_all();
+}
+
+void Scheduler::workerFunction(unsigned int index)
+{
+	TraceRecorder::get().setThreadName("worker " + std::to_string(index));
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWorkCond.wait(lock, [this] { return mStop || !mDeadlineHeap.empty() || !mBackground.empty(); });
+		if (mStop)
+			break;
+
+		if (!mDeadlineHeap.empty())
+		{
+			std::pop_heap(mDeadlineHeap.begin(), mDeadlineHeap.end(), std::greater<DeadlineTask>());
+			DeadlineTask task = std::move(mDeadlineHeap.back());
+			mDeadlineHeap.pop_back();
+			mDeadlineQueued--;
+			mDeadlineInProgress++;
+			lock.unlock();
+			runDeadline(task);
+			lock.lock();
+		}
+		else
+		{
+			BackgroundTask task = std::move(mBackground.front());
+			mBackground.pop_front();
+			mBackgroundInProgress++;
+			if (task.preempted)
+				mStats.deferredTime += std::chrono::duration<double>(Clock::now() - task.requeuedAt).count();
+			lock.unlock();
+			runBackground(task);
+			lock.lock();
+		}
+	}
+}
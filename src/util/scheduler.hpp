@@ -0,0 +1,108 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+// Two-class task scheduler shared by frame-critical and background work.
+//
+// Deadline tasks (command buffer recording) sit in an earliest-deadline-first
+// heap and are always drained before anything else. Background tasks (path
+// batches) are split into chunks: the task is called once per chunk and
+// returns true while work remains. Between chunks the worker checks for
+// pending deadline work and, if there is any, requeues the background task
+// and picks up the deadline task instead.
+class Scheduler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats
+	{
+		uint64_t deadlineTasks = 0;
+		uint64_t missedDeadlines = 0;
+		double worstLateness = 0.0;   // seconds past deadline
+		uint64_t backgroundTasks = 0; // finished background tasks
+		uint64_t backgroundChunks = 0;
+		uint64_t preemptions = 0;     // background tasks put back for deadline work
+		double deferredTime = 0.0;    // seconds background tasks spent requeued
+	};
+
+	// queued, not yet started
+	struct QueueDepths
+	{
+		unsigned int deadline = 0;
+		unsigned int background = 0;
+	};
+
+	explicit Scheduler(unsigned int nWorkers);
+	~Scheduler();
+
+	// Pins the workers as ROLE_RECORD. Workers may start before placement
+	// is configured, so call this after Placement::configure.
+	void pinWorkers();
+
+	void submitDeadline(std::function<void()> task, Clock::time_point deadline);
+	void submitBackground(std::function<bool()> chunkedTask);
+
+	// Blocks until no deadline work is queued or running. The calling
+	// thread runs queued deadline tasks itself while it waits.
+	void waitForDeadlineTasks();
+	// Blocks until both queues are empty and every worker is idle.
+	void waitForAll();
+
+	Stats stats() const;
+	void resetStats();
+	QueueDepths queueDepths() const;
+
+	unsigned int workerCount() const
+	{
+		return static_cast<unsigned int>(mWorkers.size());
+	}
+private:
+	Scheduler(const Scheduler&) = delete;
+	Scheduler& operator=(const Scheduler&) = delete;
+
+	struct DeadlineTask
+	{
+		std::function<void()> fn;
+		Clock::time_point deadline;
+		bool operator>(const DeadlineTask& other) const
+		{
+			return deadline > other.deadline;
+		}
+	};
+	struct BackgroundTask
+	{
+		std::function<bool()> fn;
+		bool preempted = false;
+		Clock::time_point requeuedAt;
+	};
+
+	void workerFunction(unsigned int index);
+	void runDeadline(DeadlineTask& task);
+	void runBackground(BackgroundTask& task);
+
+	std::vector<std::thread> mWorkers;
+	std::vector<DeadlineTask> mDeadlineHeap;
+	std::deque<BackgroundTask> mBackground;
+
+	// protects both queues, the in-progress counters and mStats
+	mutable std::mutex mMutex;
+	std::condition_variable mWorkCond;
+	std::condition_variable mDoneCond;
+
+	// read without the lock between background chunks
+	std::atomic<unsigned int> mDeadlineQueued{ 0 };
+	unsigned int mDeadlineInProgress = 0;
+	unsigned int mBackgroundInProgress = 0;
+	bool mStop = false;
+
+	Stats mStats;
+};
@@ -0,0 +1,124 @@
+#include "sharedmemory.hpp"
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+SharedMemory* SharedMemory::create(const std::string& name, size_t size)
+{
+	SharedMemory* memory = new SharedMemory();
+	memory->mOwner = true;
+	if (size == 0 || !memory->map(name, size, true, false))
+	{
+		delete memory;
+		return nullptr;
+	}
+	return memory;
+}
+
+SharedMemory* SharedMemory::open(const std::string& name, bool readOnly)
+{
+	SharedMemory* memory = new SharedMemory();
+	if (!memory->map(name, 0, false, readOnly))
+	{
+		delete memory;
+		return nullptr;
+	}
+	return memory;
+}
+
+#if defined(_WIN32)
+
+bool SharedMemory::map(const std::string& name, size_t size, bool create, bool readOnly)
+{
+	mName = "Local\\" + name;
+	DWORD access = readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
+	if (create)
+	{
+		mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			DWORD(uint64_t(size) >> 32), DWORD(size & 0xffffffff), mName.c_str());
+	}
+	else
+	{
+		mMapping = OpenFileMappingA(access, FALSE, mName.c_str());
+	}
+	if (!mMapping)
+		return false;
+	mData = MapViewOfFile(mMapping, access, 0, 0, size);
+	if (!mData)
+		return false;
+	if (create)
+	{
+		std::memset(mData, 0, size);
+	}
+	else
+	{
+		MEMORY_BASIC_INFORMATION info;
+		if (VirtualQuery(mData, &info, sizeof(info)) == 0)
+			return false;
+		size = info.RegionSize;
+	}
+	mSize = size;
+	return true;
+}
+
+SharedMemory::~SharedMemory()
+{
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMapping)
+		CloseHandle(mMapping);
+}
+
+#else
+
+bool SharedMemory::map(const std::string& name, size_t size, bool create, bool readOnly)
+{
+	mName = name[0] == '/' ? name : "/" + name;
+	if (create)
+		shm_unlink(mName.c_str());
+	int flags = create ? (O_CREAT | O_EXCL | O_RDWR) : (readOnly ? O_RDONLY : O_RDWR);
+	mFd = shm_open(mName.c_str(), flags, 0600);
+	if (mFd < 0)
+		return false;
+	if (create)
+	{
+		if (ftruncate(mFd, (off_t)size) != 0)
+			return false;
+	}
+	else
+	{
+		struct stat st;
+		if (fstat(mFd, &st) != 0 || st.st_size == 0)
+			return false;
+		size = (size_t)st.st_size;
+	}
+	void* p = mmap(nullptr, size, readOnly ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, mFd, 0);
+	if (p == MAP_FAILED)
+		return false;
+	mData = p;
+	mSize = size;
+	return true;
+}
+
+SharedMemory::~SharedMemory()
+{
+	if (mData)
+		munmap(mData, mSize);
+	if (mFd >= 0)
+		close(mFd);
+	if (mOwner && !mName.empty())
+		shm_unlink(mName.c_str());
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Named shared-memory segment: CreateFileMapping on Windows ("Local\" names),
+// shm_open everywhere else. The creating process owns the name and removes
+// it when the segment is destroyed.
+class SharedMemory
+{
+public:
+	// zero filled; replaces a stale segment left behind by a crashed owner
+	static SharedMemory* create(const std::string& name, size_t size);
+	// maps the whole segment, nullptr if it does not exist
+	static SharedMemory* open(const std::string& name, bool readOnly = false);
+	~SharedMemory();
+
+	void* data() const { return mData; }
+	size_t size() const { return mSize; }
+private:
+	SharedMemory() = default;
+	SharedMemory(const SharedMemory&) = delete;
+	SharedMemory& operator=(const SharedMemory&) = delete;
+	bool map(const std::string& name, size_t size, bool create, bool readOnly);
+
+	void* mData = nullptr;
+	size_t mSize = 0;
+	std::string mName;
+	bool mOwner = false;
+#if defined(_WIN32)
+	void* mMapping = nullptr;
+#else
+	int mFd = -1;
+#endif
+};
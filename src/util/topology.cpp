@@ -0,0 +1,455 @@
+#include "topology.hpp"
+#include "log.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace topology
+{
+	const char* roleName(ThreadRole role)
+	{
+		switch (role)
+		{
+		case ROLE_MAIN: return "main";
+		case ROLE_SIMULATION: return "simulation";
+		case ROLE_RECORD: return "record";
+		default: return "unknown";
+		}
+	}
+
+	static std::string trim(const std::string& s)
+	{
+		size_t b = s.find_first_not_of(" \t\r\n");
+		size_t e = s.find_last_not_of(" \t\r\n");
+		if (b == std::string::npos)
+			return "";
+		return s.substr(b, e - b + 1);
+	}
+
+	std::vector<int> parseCpuList(const std::string& list)
+	{
+		std::vector<int> result;
+		std::stringstream ss(list);
+		std::string part;
+		while (std::getline(ss, part, ','))
+		{
+			part = trim(part);
+			if (part.empty())
+				continue;
+			size_t dash = part.find('-');
+			int first = std::atoi(part.substr(0, dash).c_str());
+			int last = dash == std::string::npos ? first : std::atoi(part.substr(dash + 1).c_str());
+			for (int i = first; i <= last; i++)
+				result.push_back(i);
+		}
+		return result;
+	}
+
+#if defined(__linux__)
+	static bool readSysFile(const std::string& path, std::string& out)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+		std::getline(file, out);
+		out = trim(out);
+		return true;
+	}
+
+	static int readSysInt(const std::string& path, int fallback)
+	{
+		std::string s;
+		if (!readSysFile(path, s) || s.empty())
+			return fallback;
+		return std::atoi(s.c_str());
+	}
+#endif
+
+	const Topology& Topology::system()
+	{
+		static Topology topo = [] { Topology t; t.detect(); return t; }();
+		return topo;
+	}
+
+	void Topology::detect()
+	{
+		mCpus.clear();
+#if defined(__linux__)
+		std::string online;
+		std::vector<int> ids;
+		if (readSysFile("/sys/devices/system/cpu/online", online))
+			ids = parseCpuList(online);
+
+		std::map<int, int> cpuNode;
+		std::string nodesOnline;
+		if (readSysFile("/sys/devices/system/node/online", nodesOnline))
+		{
+			for (int node : parseCpuList(nodesOnline))
+			{
+				std::string cpulist;
+				if (readSysFile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", cpulist))
+					for (int cpu : parseCpuList(cpulist))
+						cpuNode[cpu] = node;
+			}
+		}
+
+		std::map<std::pair<int, int>, int> coreIds;
+		std::map<int, int> coreThreads;
+		for (int id : ids)
+		{
+			std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+			Cpu cpu;
+			cpu.id = id;
+			cpu.package = readSysInt(base + "physical_package_id", 0);
+			int coreId = readSysInt(base + "core_id", id);
+			auto key = std::make_pair(cpu.package, coreId);
+			auto it = coreIds.find(key);
+			if (it == coreIds.end())
+				it = coreIds.emplace(key, (int)coreIds.size()).first;
+			cpu.core = it->second;
+			cpu.smtIndex = coreThreads[cpu.core]++;
+			cpu.node = cpuNode.count(id) ? cpuNode[id] : 0;
+			mCpus.push_back(cpu);
+		}
+		mCoreCount = (int)coreIds.size();
+		std::vector<int> nodes;
+		for (auto& n : cpuNode)
+			nodes.push_back(n.second);
+		std::sort(nodes.begin(), nodes.end());
+		mNodeCount = std::max(1, (int)(std::unique(nodes.begin(), nodes.end()) - nodes.begin()));
+#elif defined(_WIN32)
+		DWORD length = 0;
+		GetLogicalProcessorInformation(nullptr, &length);
+		std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if (!info.empty() && GetLogicalProcessorInformation(info.data(), &length))
+		{
+			std::map<int, int> cpuNode;
+			std::map<int, int> cpuPackage;
+			int package = 0;
+			for (auto& i : info)
+			{
+				if (i.Relationship == RelationNumaNode)
+				{
+					for (int b = 0; b < 64; b++)
+						if (i.ProcessorMask & (ULONG_PTR(1) << b))
+							cpuNode[b] = (int)i.NumaNode.NodeNumber;
+					mNodeCount = std::max(mNodeCount, (int)i.NumaNode.NodeNumber + 1);
+				}
+				else if (i.Relationship == RelationProcessorPackage)
+				{
+					for (int b = 0; b < 64; b++)
+						if (i.ProcessorMask & (ULONG_PTR(1) << b))
+							cpuPackage[b] = package;
+					package++;
+				}
+			}
+			int core = 0;
+			for (auto& i : info)
+			{
+				if (i.Relationship != RelationProcessorCore)
+					continue;
+				int smt = 0;
+				for (int b = 0; b < 64; b++)
+				{
+					if (!(i.ProcessorMask & (ULONG_PTR(1) << b)))
+						continue;
+					Cpu cpu;
+					cpu.id = b;
+					cpu.core = core;
+					cpu.smtIndex = smt++;
+					cpu.node = cpuNode[b];
+					cpu.package = cpuPackage[b];
+					mCpus.push_back(cpu);
+				}
+				core++;
+			}
+			mCoreCount = std::max(1, core);
+		}
+#endif
+		if (mCpus.empty())
+		{
+			unsigned int n = std::max(1u, std::thread::hardware_concurrency());
+			for (unsigned int i = 0; i < n; i++)
+			{
+				Cpu cpu;
+				cpu.id = (int)i;
+				cpu.core = (int)i;
+				mCpus.push_back(cpu);
+			}
+			mCoreCount = (int)n;
+			mNodeCount = 1;
+		}
+		std::sort(mCpus.begin(), mCpus.end(), [](const Cpu& a, const Cpu& b) { return a.id < b.id; });
+	}
+
+	int Topology::nodeOf(int cpu) const
+	{
+		for (auto& c : mCpus)
+			if (c.id == cpu)
+				return c.node;
+		return 0;
+	}
+
+	std::vector<int> Topology::placementOrder() const
+	{
+		std::vector<Cpu> sorted = mCpus;
+		std::stable_sort(sorted.begin(), sorted.end(), [](const Cpu& a, const Cpu& b)
+		{
+			if (a.smtIndex != b.smtIndex) return a.smtIndex < b.smtIndex;
+			if (a.node != b.node) return a.node < b.node;
+			return a.core < b.core;
+		});
+		std::vector<int> order;
+		for (auto& c : sorted)
+			order.push_back(c.id);
+		return order;
+	}
+
+	bool ThreadConfig::loadFromFile(const std::string& filename)
+	{
+		std::ifstream file(filename);
+		if (!file)
+			return false;
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			line = trim(line.substr(0, line.find('#')));
+			size_t eq = line.find('=');
+			if (line.empty() || eq == std::string::npos)
+				continue;
+			std::string key = trim(line.substr(0, eq));
+			std::string value = trim(line.substr(eq + 1));
+
+			if (key == "pin")
+				pin = value == "1" || value == "true" || value == "on";
+			else if (key == "arena_kb")
+				arenaSize = (size_t)std::atoll(value.c_str()) * 1024;
+			else
+			{
+				for (int r = 0; r < ROLE_COUNT; r++)
+				{
+					if (key == roleName((ThreadRole)r))
+						cpus[r] = value == "auto" ? std::vector<int>() : parseCpuList(value);
+				}
+			}
+		}
+		return true;
+	}
+
+	Placement& Placement::get()
+	{
+		static Placement placement;
+		return placement;
+	}
+
+	void Placement::configure(const ThreadConfig& config, unsigned int recordThreads)
+	{
+		mConfig = config;
+		for (auto& r : mResolved)
+			r.clear();
+		if (!config.pin)
+			return;
+
+		const Topology& topo = Topology::system();
+		std::vector<int> order = topo.placementOrder();
+
+		// explicitly configured cpus are taken out of the auto pool
+		for (int r = 0; r < ROLE_COUNT; r++)
+			for (int cpu : config.cpus[r])
+				order.erase(std::remove(order.begin(), order.end(), cpu), order.end());
+		if (order.empty())
+			order = topo.placementOrder();
+
+		unsigned int counts[ROLE_COUNT] = { 1, 1, recordThreads };
+		std::copy(counts, counts + ROLE_COUNT, mThreads);
+		size_t next = 0;
+		for (int r = 0; r < ROLE_COUNT; r++)
+		{
+			if (!config.cpus[r].empty())
+			{
+				mResolved[r] = config.cpus[r];
+				continue;
+			}
+			for (unsigned int i = 0; i < counts[r]; i++)
+				mResolved[r].push_back(order[next++ % order.size()]);
+		}
+
+		LOG_INFO("topology", "%zu cpus, %d cores, %d nodes", topo.cpus().size(), topo.coreCount(), topo.nodeCount());
+		for (int r = 0; r < ROLE_COUNT; r++)
+		{
+			std::string cpus;
+			for (int cpu : mResolved[r])
+				cpus += " " + std::to_string(cpu);
+			LOG_INFO("topology", "%s:%s", roleName((ThreadRole)r), cpus.c_str());
+		}
+	}
+
+	std::vector<int> Placement::cpusFor(ThreadRole role, unsigned int index) const
+	{
+		const std::vector<int>& cpus = mResolved[role];
+		if (!mConfig.pin || cpus.empty())
+			return {};
+		// a role with as many cpus as threads gets one cpu per thread,
+		// otherwise the whole set is shared
+		if (cpus.size() == mThreads[role])
+			return { cpus[index % cpus.size()] };
+		return cpus;
+	}
+
+	bool Placement::pinCurrentThread(ThreadRole role, unsigned int index)
+	{
+		std::vector<int> cpus = cpusFor(role, index);
+		if (cpus.empty())
+			return false;
+		bool ok = setCurrentAffinity(cpus);
+		ThreadArena::local().reserve(mConfig.arenaSize);
+		return ok;
+	}
+
+	bool Placement::pinThread(std::thread& thread, ThreadRole role, unsigned int index)
+	{
+		std::vector<int> cpus = cpusFor(role, index);
+		if (cpus.empty())
+			return false;
+		return setAffinity(thread.native_handle(), cpus);
+	}
+
+	bool setAffinity(std::thread::native_handle_type handle, const std::vector<int>& cpus)
+	{
+#if defined(_WIN32)
+		DWORD_PTR mask = 0;
+		for (int cpu : cpus)
+			if (cpu >= 0 && cpu < 64)
+				mask |= DWORD_PTR(1) << cpu;
+		return SetThreadAffinityMask((HANDLE)handle, mask) != 0;
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : cpus)
+			if (cpu >= 0 && cpu < CPU_SETSIZE)
+				CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+#else
+		(void)handle;
+		(void)cpus;
+		return false;
+#endif
+	}
+
+	bool setCurrentAffinity(const std::vector<int>& cpus)
+	{
+#if defined(_WIN32)
+		return setAffinity(GetCurrentThread(), cpus);
+#elif defined(__linux__)
+		return setAffinity(pthread_self(), cpus);
+#else
+		(void)cpus;
+		return false;
+#endif
+	}
+
+	int currentCpu()
+	{
+#if defined(_WIN32)
+		return (int)GetCurrentProcessorNumber();
+#elif defined(__linux__)
+		return sched_getcpu();
+#else
+		return 0;
+#endif
+	}
+
+	ThreadArena& ThreadArena::local()
+	{
+		thread_local ThreadArena arena;
+		return arena;
+	}
+
+	ThreadArena::~ThreadArena()
+	{
+		for (auto& c : mChunks)
+		{
+#if defined(_WIN32)
+			VirtualFree(c.data, 0, MEM_RELEASE);
+#elif defined(__linux__)
+			munmap(c.data, c.size);
+#else
+			std::free(c.data);
+#endif
+		}
+	}
+
+	void ThreadArena::reserve(size_t bytes)
+	{
+		if (mCapacity - mUsed < bytes)
+			addChunk(bytes);
+	}
+
+	void ThreadArena::addChunk(size_t bytes)
+	{
+		mNode = Topology::system().nodeOf(currentCpu());
+		Chunk chunk;
+		chunk.size = bytes;
+		chunk.offset = 0;
+#if defined(_WIN32)
+		chunk.data = (char*)VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, (DWORD)mNode);
+#elif defined(__linux__)
+		void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		chunk.data = p == MAP_FAILED ? nullptr : (char*)p;
+		// default policy is local allocation, touching from the pinned thread places the pages
+		if (chunk.data)
+			std::memset(chunk.data, 0, bytes);
+#else
+		chunk.data = (char*)std::malloc(bytes);
+#endif
+		if (!chunk.data)
+			throw std::bad_alloc();
+		mChunks.push_back(chunk);
+		mCapacity += bytes;
+	}
+
+	void* ThreadArena::alloc(size_t bytes, size_t alignment)
+	{
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			for (; mCurrent < mChunks.size(); mCurrent++)
+			{
+				Chunk& c = mChunks[mCurrent];
+				size_t offset = (c.offset + alignment - 1) & ~(alignment - 1);
+				if (offset + bytes <= c.size)
+				{
+					mUsed += offset + bytes - c.offset;
+					c.offset = offset + bytes;
+					return c.data + offset;
+				}
+			}
+			addChunk(std::max(bytes + alignment, mChunks.empty() ? bytes + alignment : mChunks.back().size));
+			mCurrent = mChunks.size() - 1;
+		}
+		throw std::bad_alloc();
+	}
+
+	void ThreadArena::reset()
+	{
+		for (auto& c : mChunks)
+			c.offset = 0;
+		mUsed = 0;
+		mCurrent = 0;
+	}
+}
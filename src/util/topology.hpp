@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <cstddef>
+
+// CPU topology detection and per-role thread placement.
+// On Linux cores, SMT siblings and NUMA nodes come from /sys, on Windows
+// from GetLogicalProcessorInformation. Elsewhere every cpu is its own core
+// on node 0 and pinning is a no-op.
+namespace topology
+{
+	struct Cpu
+	{
+		int id = 0;
+		int core = 0;     // globally unique physical core index
+		int package = 0;
+		int node = 0;
+		int smtIndex = 0; // 0 for the first hardware thread of a core
+	};
+
+	enum ThreadRole
+	{
+		ROLE_MAIN,       // window, uniform build and primary command buffer
+		ROLE_SIMULATION, // Application::astarComputeThread
+		ROLE_RECORD,     // Renderer scheduler workers, which also run the path batches
+		ROLE_COUNT
+	};
+
+	const char* roleName(ThreadRole role);
+
+	class Topology
+	{
+	public:
+		// detected once, on first use
+		static const Topology& system();
+
+		const std::vector<Cpu>& cpus() const { return mCpus; }
+		int nodeCount() const { return mNodeCount; }
+		int coreCount() const { return mCoreCount; }
+		int nodeOf(int cpu) const;
+
+		// one hardware thread per physical core first (node by node),
+		// then the remaining SMT siblings
+		std::vector<int> placementOrder() const;
+	private:
+		void detect();
+
+		std::vector<Cpu> mCpus;
+		int mNodeCount = 1;
+		int mCoreCount = 1;
+	};
+
+	// Loaded from a plain "key = value" file, e.g.
+	//   pin = 1
+	//   main = 0
+	//   simulation = 1
+	//   record = 2-5
+	//   arena_kb = 4096
+	// Cpu lists use the /sys syntax ("0,2,4-7"), "auto" lets placement pick.
+	struct ThreadConfig
+	{
+		bool pin = false;
+		std::vector<int> cpus[ROLE_COUNT];
+		size_t arenaSize = 4 * 1024 * 1024;
+
+		bool loadFromFile(const std::string& filename);
+	};
+
+	// Resolves a ThreadConfig against the detected topology and pins threads.
+	class Placement
+	{
+	public:
+		static Placement& get();
+
+		void configure(const ThreadConfig& config, unsigned int recordThreads);
+		const ThreadConfig& config() const { return mConfig; }
+		bool enabled() const { return mConfig.pin; }
+
+		// cpus a role's index-th thread may run on, empty when unpinned
+		std::vector<int> cpusFor(ThreadRole role, unsigned int index = 0) const;
+
+		// pins the calling thread and prepares its arena on the local node
+		bool pinCurrentThread(ThreadRole role, unsigned int index = 0);
+		bool pinThread(std::thread& thread, ThreadRole role, unsigned int index = 0);
+	private:
+		ThreadConfig mConfig;
+		std::vector<int> mResolved[ROLE_COUNT];
+		unsigned int mThreads[ROLE_COUNT] = {};
+	};
+
+	// Pin by native handle, used for threads we did not start ourselves.
+	bool setAffinity(std::thread::native_handle_type handle, const std::vector<int>& cpus);
+	bool setCurrentAffinity(const std::vector<int>& cpus);
+	int currentCpu();
+	std::vector<int> parseCpuList(const std::string& list);
+
+	// Bump allocator owned by one thread. Chunks are allocated on the node
+	// the thread is pinned to (VirtualAllocExNuma on Windows, first touch
+	// from the pinned thread on Linux). Memory is released only by reset().
+	class ThreadArena
+	{
+	public:
+		static ThreadArena& local();
+
+		~ThreadArena();
+
+		void reserve(size_t bytes);
+		void* alloc(size_t bytes, size_t alignment = 16);
+		template<class T>
+		T* allocArray(size_t count)
+		{
+			return static_cast<T*>(alloc(sizeof(T) * count, alignof(T)));
+		}
+		void reset();
+
+		size_t used() const { return mUsed; }
+		size_t capacity() const { return mCapacity; }
+		int node() const { return mNode; }
+	private:
+		ThreadArena() = default;
+		ThreadArena(const ThreadArena&) = delete;
+
+		struct Chunk
+		{
+			char* data;
+			size_t size;
+			size_t offset;
+		};
+		void addChunk(size_t bytes);
+
+		std::vector<Chunk> mChunks;
+		size_t mCurrent = 0;
+		size_t mUsed = 0;
+		size_t mCapacity = 0;
+		int mNode = 0;
+	};
+}
@@ -0,0 +1,128 @@
+#include "trace.hpp"
+#include "log.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+TraceRecorder& TraceRecorder::get()
+{
+	static TraceRecorder recorder;
+	return recorder;
+}
+
+TraceRecorder::TraceRecorder() :
+	mEpoch(nowNs())
+{
+}
+
+int64_t TraceRecorder::nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TraceRecorder::ThreadBuffer& TraceRecorder::localBuffer()
+{
+	thread_local ThreadBuffer* buffer = nullptr;
+	if (buffer)
+		return *buffer;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mThreads.emplace_back(new ThreadBuffer());
+	buffer = mThreads.back().get();
+	buffer->tid = static_cast<uint32_t>(mThreads.size());
+	buffer->name = "thread " + std::to_string(buffer->tid);
+	buffer->events.resize(THREAD_EVENTS);
+	return *buffer;
+}
+
+void TraceRecorder::setThreadName(const std::string& name)
+{
+	ThreadBuffer& buffer = localBuffer();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		buffer.name = name;
+	}
+	Logger::get().setThreadName(name);
+}
+
+void TraceRecorder::addZone(const char* name, uint64_t startTicks, uint64_t endTicks)
+{
+	ThreadBuffer& buffer = localBuffer();
+	uint64_t index = buffer.written.load(std::memory_order_relaxed);
+	buffer.events[index & (THREAD_EVENTS - 1)] = { name, startTicks, endTicks };
+	buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void TraceRecorder::addTrackZone(const char* track, const char* name, int64_t startNs, int64_t endNs)
+{
+	if (!enabled())
+		return;
+	std::lock_guard<std::mutex> lock(mMutex);
+	mTrackEvents.push_back({ track, { name, startNs, endNs } });
+}
+
+static void writeEvent(FILE* file, bool& first, const char* name, int pid, uint32_t tid, int64_t startNs, int64_t endNs)
+{
+	fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+		first ? "" : ",", name, pid, tid, startNs / 1000.0, std::max<int64_t>(endNs - startNs, 0) / 1000.0);
+	first = false;
+}
+
+static void writeName(FILE* file, bool& first, const char* kind, int pid, uint32_t tid, const std::string& name)
+{
+	fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+		first ? "" : ",", kind, pid, tid, name.c_str());
+	first = false;
+}
+
+bool TraceRecorder::write(const std::string& filename)
+{
+	setEnabled(false);
+
+	FILE* file = fopen(filename.c_str(), "w");
+	if (!file)
+	{
+		LOG_ERROR("trace", "could not write %s", filename.c_str());
+		return false;
+	}
+
+	const int cpuPid = 1;
+	const int trackPid = 2;
+	bool first = true;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	writeName(file, first, "process_name", cpuPid, 0, "CPU");
+	writeName(file, first, "process_name", trackPid, 0, "GPU / async");
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& buffer : mThreads)
+	{
+		writeName(file, first, "thread_name", cpuPid, buffer->tid, buffer->name);
+		uint64_t written = buffer->written.load(std::memory_order_acquire);
+		uint64_t begin = written > THREAD_EVENTS ? written - THREAD_EVENTS : 0;
+		for (uint64_t i = begin; i < written; i++)
+		{
+			const TickEvent& e = buffer->events[i & (THREAD_EVENTS - 1)];
+			writeEvent(file, first, e.name, cpuPid, buffer->tid,
+				tsc::toSteadyNs(e.start) - mEpoch, tsc::toSteadyNs(e.end) - mEpoch);
+		}
+	}
+
+	std::vector<const char*> tracks;
+	for (const TrackEvent& t : mTrackEvents)
+	{
+		auto it = std::find_if(tracks.begin(), tracks.end(), [&t](const char* name) { return std::string(name) == t.track; });
+		uint32_t tid = static_cast<uint32_t>(it - tracks.begin()) + 1;
+		if (it == tracks.end())
+		{
+			tracks.push_back(t.track);
+			writeName(file, first, "thread_name", trackPid, tid, t.track);
+		}
+		writeEvent(file, first, t.event.name, trackPid, tid, t.event.start - mEpoch, t.event.end - mEpoch);
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	LOG_INFO("trace", "wrote %s", filename.c_str());
+	return true;
+}
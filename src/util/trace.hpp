@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "tsc.hpp"
+
+// Records timeline zones and writes them in the Chrome trace event format,
+// loadable in chrome://tracing or ui.perfetto.dev.
+//
+// CPU zones go into a ring buffer owned by the recording thread as raw
+// tsc ticks, so a zone costs two tick reads and a store; ticks are
+// converted when the trace is written. When a ring is full the oldest events
+// are overwritten. Zones that do not belong to a thread (GPU work, path
+// batches spanning several threads) go to named tracks; those are rare and
+// take a lock.
+//
+// Zone and track names are not copied, pass string literals.
+class TraceRecorder
+{
+public:
+	static const uint32_t THREAD_EVENTS = 1 << 15;
+
+	static TraceRecorder& get();
+
+	void setEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+	bool enabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+	// steady clock, nanoseconds
+	static int64_t nowNs();
+
+	void setThreadName(const std::string& name);
+	// tsc::now() ticks
+	void addZone(const char* name, uint64_t startTicks, uint64_t endTicks);
+	// steady clock ns
+	void addTrackZone(const char* track, const char* name, int64_t startNs, int64_t endNs);
+
+	// Stops recording and writes every buffered event. Threads still inside
+	// a zone may lose that zone.
+	bool write(const std::string& filename);
+private:
+	TraceRecorder();
+
+	struct Event
+	{
+		const char* name;
+		int64_t start;
+		int64_t end;
+	};
+	struct TickEvent
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+	struct ThreadBuffer
+	{
+		uint32_t tid;
+		std::string name;
+		std::vector<TickEvent> events;
+		std::atomic<uint64_t> written{ 0 };
+	};
+	struct TrackEvent
+	{
+		const char* track;
+		Event event;
+	};
+
+	ThreadBuffer& localBuffer();
+
+	std::atomic<bool> mEnabled{ false };
+	int64_t mEpoch;
+
+	std::mutex mMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> mThreads;
+	std::vector<TrackEvent> mTrackEvents;
+};
+
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name) :
+		mName(name),
+		mActive(TraceRecorder::get().enabled()),
+		mStart(mActive ? tsc::now() : 0)
+	{}
+	~TraceScope()
+	{
+		if (mActive)
+			TraceRecorder::get().addZone(mName, mStart, tsc::now());
+	}
+private:
+	const char* mName;
+	bool mActive;
+	uint64_t mStart;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,114 @@
+#include "tsc.hpp"
+
+#include <chrono>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#if TSC_X86 && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+namespace tsc
+{
+	static bool detectInvariantTsc()
+	{
+#if TSC_X86
+		unsigned int regs[4] = {};
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0x80000000);
+		if (unsigned(info[0]) < 0x80000007)
+			return false;
+		__cpuid(info, 0x80000007);
+		regs[3] = unsigned(info[3]);
+#else
+		if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+			return false;
+		__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+		// EDX bit 8: constant rate in all P/C states
+		return (regs[3] & (1u << 8)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	const bool useTsc = detectInvariantTsc();
+
+	uint64_t fallbackNow()
+	{
+#if defined(_WIN32)
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return static_cast<uint64_t>(counter.QuadPart);
+#elif defined(CLOCK_MONOTONIC_RAW)
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	struct Calibration
+	{
+		double nsPerTick = 1.0;
+		uint64_t baseTicks = 0;
+		int64_t baseNs = 0;
+	};
+
+	static int64_t steadyNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static Calibration calibrate()
+	{
+		Calibration c;
+		int64_t ns0 = steadyNs();
+		uint64_t t0 = now();
+		int64_t ns1 = ns0;
+		while (ns1 - ns0 < 20000000)
+			ns1 = steadyNs();
+		uint64_t t1 = now();
+
+		if (t1 > t0)
+			c.nsPerTick = double(ns1 - ns0) / double(t1 - t0);
+		c.baseTicks = t1;
+		c.baseNs = ns1;
+		return c;
+	}
+
+	static const Calibration& calibration()
+	{
+		static const Calibration c = calibrate();
+		return c;
+	}
+
+	double nsPerTick()
+	{
+		return calibration().nsPerTick;
+	}
+
+	int64_t toSteadyNs(uint64_t ticks)
+	{
+		const Calibration& c = calibration();
+		return c.baseNs + static_cast<int64_t>((static_cast<int64_t>(ticks - c.baseTicks)) * c.nsPerTick);
+	}
+
+	const char* sourceName()
+	{
+		if (useTsc)
+			return "invariant tsc";
+#if defined(_WIN32)
+		return "QueryPerformanceCounter";
+#else
+		return "CLOCK_MONOTONIC_RAW";
+#endif
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define TSC_X86 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define TSC_X86 1
+#else
+#define TSC_X86 0
+#endif
+
+// Cheap timestamps for dense instrumentation.
+//
+// now() returns raw ticks: the invariant TSC when the CPU has one, else
+// CLOCK_MONOTONIC_RAW (Linux) or QueryPerformanceCounter (Windows). Keep
+// ticks around and convert when reporting; the first conversion calibrates
+// against steady_clock, which takes about 20 ms.
+namespace tsc
+{
+	// decided once at start-up
+	extern const bool useTsc;
+	uint64_t fallbackNow();
+
+	inline uint64_t now()
+	{
+#if TSC_X86
+		if (useTsc)
+			return __rdtsc();
+#endif
+		return fallbackNow();
+	}
+
+	double nsPerTick();
+	inline uint64_t toNs(uint64_t ticks)
+	{
+		return static_cast<uint64_t>(ticks * nsPerTick());
+	}
+	inline double toSeconds(uint64_t ticks)
+	{
+		return ticks * nsPerTick() * 1e-9;
+	}
+	// absolute steady_clock time in ns, to line up with other clocks
+	int64_t toSteadyNs(uint64_t ticks);
+
+	const char* sourceName();
+}
+
+// Adds the ticks spent in the scope to sink.
+class TickScope
+{
+public:
+	explicit TickScope(uint64_t& sink) : mSink(sink), mStart(tsc::now()) {}
+	~TickScope() { mSink += tsc::now() - mStart; }
+private:
+	uint64_t& mSink;
+	uint64_t mStart;
+};
@@ -1,8 +1,10 @@
 #include "world.h" 
 #include <math.h>
-#include "lodepng/lodepng.h"
+#include "mapimage.hpp"
+#include "util/trace.hpp"
+#include "replay.hpp"
+#include "util/log.hpp"
 #include <time.h>
-#include <iostream>
 
 World::World() {
 
@@ -14,16 +16,27 @@ World::~World() {
 }
 
 void World::setNewGoal() {
-	goal = uvec2(rand() % dims.x, rand() % dims.y);
+	if (replay && replay->playing() && updating) {
+		goal = replay->nextReachedGoal();
+		numComputes = 0;
+		return;
+	}
+
+	goal = uvec2(rng.below(dims.x), rng.below(dims.y));
 	//goal = uvec2(3, 4);
 	while (origMap[mapIdx(goal.x, goal.y)] == 1) {
-		goal = uvec2(rand() % dims.x, rand() % dims.y);
+		goal = uvec2(rng.below(dims.x), rng.below(dims.y));
 	}
 	numComputes = 0;
+	if (replay && replay->recording()) {
+		replay->recordGoal(tick, goal, updating);
+	}
 	//goal = uvec2(5, 1);
 }
 
 void World::updateEntities() {
+	TRACE_SCOPE("entity update");
+	updating = true;
 
 	bool didSomething = false;
 	if (stepsCount > 0) {
@@ -38,7 +51,7 @@ void World::updateEntities() {
 				
 				if (entities[e].x == goal.x && entities[e].y == goal.y) {
 					goalReached = true;
-					printf("Goal reached!\n");
+					LOG_LIMITED(LEVEL_INFO, 5, "world", "goal reached at tick %llu", (unsigned long long)tick);
 					setNewGoal();
 				}
 			}
@@ -49,60 +62,64 @@ void World::updateEntities() {
 	if (finished && !goalReached) {
 		numComputes++;
 	}
+	updating = false;
+	tick++;
 }
 
 void World::init(std::string filename, unsigned int entityCount) {
-	std::vector<unsigned char> image; //the raw pixels
-	unsigned width, height;
-
-	steps = new ivec2[20* entityCount];
-
-	srand(time(NULL));
-
-	//decode
-	unsigned error = lodepng::decode(image, width, height, filename, LCT_RGBA);
-	Pixel* pixels = reinterpret_cast<Pixel*>(image.data());
-
-	
-
-
-	if (error) {
-		printf("[lodepng] Failed to load map.\n");
+	// the renderer builds its texture from the same decode
+	std::shared_ptr<const MapImage> image;
+	try {
+		image = MapImageCache::get().load(filename);
+	}
+	catch (const std::exception& e) {
+		LOG_ERROR("world", "failed to load map %s: %s", filename.c_str(), e.what());
 		return;
 	}
+	init(image->occupancy(), entityCount);
+}
+
+void World::init(const GeneratedMap& map, unsigned int entityCount) {
+	unsigned width = map.dims.x, height = map.dims.y;
+
+	steps = new ivec2[20* entityCount];
 
-	printf("[World] Loaded map with dimensions: %d x %d \n", width, height);
+	LOG_INFO("world", "loaded map with dimensions %u x %u, seed %llu", width, height, (unsigned long long)seed);
 
 	dims.x = width; dims.y = height;
 	origMap = new unsigned int[width*height];
 	mapSize = width * height * sizeof(unsigned int);
 	entitiesSize = entityCount * sizeof(uvec2);
 
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
+	for (unsigned y = 0; y < height; y++) {
+		for (unsigned x = 0; x < width; x++) {
 			int idx = mapIdx(x, y);
-			if (pixels[idx].r == 255) {
-				origMap[idx] = 1;
-			}
-			else {
-				origMap[idx] = 0;
-			}
-			printf("%d", origMap[idx]);
+			origMap[idx] = map.cells[idx];
+		}
+	}
+
+	// only dump maps that fit on a screen
+	if (Logger::get().enabled(LEVEL_DEBUG) && width <= 128 && height <= 128) {
+		std::string row;
+		for (unsigned y = 0; y < height; y++) {
+			row.clear();
+			for (unsigned x = 0; x < width; x++)
+				row += origMap[mapIdx(x, y)] ? '1' : '0';
+			LOG_DEBUG("world", "%s", row.c_str());
 		}
-		printf("\n");
 	}
 
-	for (int i = 0; i < entityCount; i++) {
-		uvec2 pos(rand() % width, rand() % height);
-		while (origMap[mapIdx(goal.x, goal.y)] == 1) {
-			pos = uvec2(rand() % width, rand() % height);
+	for (unsigned i = 0; i < entityCount; i++) {
+		uvec2 pos(rng.below(width), rng.below(height));
+		while (origMap[mapIdx(pos.x, pos.y)] == 1) {
+			pos = uvec2(rng.below(width), rng.below(height));
 		}
 		entities.push_back(uvec2(pos.x, pos.y));
 		//entities.push_back(uvec2(5, 2));
 	}
-	std::cout << entities.size() << "\n";
+	LOG_INFO("world", "%zu entities", entities.size());
 	emptySteps = new unsigned int[entities.size()];
 	
 	setNewGoal();
-	printf("Goal at: %d %d\n", goal.x, goal.y);
+	LOG_INFO("world", "goal at %u %u", goal.x, goal.y);
 }
\ No newline at end of file
@@ -1,10 +1,12 @@
 #pragma once
 #include <vector>
 #include "entity.h"
+#include "path/pathtypes.hpp"
+#include "mapgen/mapgen.hpp"
+#include "util/random.hpp"
+#include "util/log.hpp"
 
-struct Pixel {
-	unsigned char r, g, b, a;
-};
+class ReplayLog;
 
 class World {
 private:
@@ -15,14 +17,45 @@ private:
 	unsigned int* emptySteps;
 	bool goalReached = false;
 
+	// all randomness goes through rng so a seed reproduces a run
+	Xoshiro256 rng;
+	uint64_t seed = 1;
+	// number of updateEntities calls so far
+	uint64_t tick = 0;
+	bool updating = false;
+	ReplayLog* replay = nullptr;
+
 	
 public:
 	World();
 	~World();
 	
 	void setNewGoal();
+	// goal from a replay, same bookkeeping as setNewGoal
+	void setGoal(uvec2 g) {
+		goal = g;
+		numComputes = 0;
+	}
+
+	// before init
+	void setSeed(uint64_t s) {
+		seed = s;
+		rng.reseed(s);
+	}
+	uint64_t getSeed() const {
+		return seed;
+	}
+	uint64_t getTick() const {
+		return tick;
+	}
+	// records goal changes, or takes them from the log when it is playing
+	void setReplay(ReplayLog* log) {
+		replay = log;
+	}
 
 	void init(std::string filename, unsigned int entityCount);
+	// generated maps skip the PNG round trip
+	void init(const GeneratedMap& map, unsigned int entityCount);
 	
 	void addEntity(uvec2 pos) {
 		Entity ent(pos.x, pos.y);
@@ -31,7 +64,7 @@ public:
 
 	void printEntities() {
 		for (uvec2 ent : entities) {
-			printf("entity at: %d %d\n", ent.x, ent.y);
+			LOG_DEBUG("world", "entity at %u %u", ent.x, ent.y);
 		}
 	}
 
@@ -66,6 +99,18 @@ public:
 		}
 	}
 	
+	// one query per entity towards the current goal
+	PathBatch makePathBatch() const {
+		PathBatch batch;
+		batch.map = origMap;
+		batch.dims = dims;
+		batch.queries.reserve(entities.size());
+		for (const uvec2& e : entities) {
+			batch.queries.push_back({ e, goal });
+		}
+		return batch;
+	}
+
 	std::vector<uvec2> getEntities() {
 		return entities;
 	}